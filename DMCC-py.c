@@ -5,6 +5,35 @@
 #include "Python.h"
 #include "DMCC.h"
 
+// dmccError - raises the Python exception for a DMCC_E* status
+static PyObject *
+dmccError(int result)
+{
+    if (result == DMCC_EINVAL) {
+        PyErr_SetString(PyExc_ValueError, "DMCC invalid argument");
+    } else if (result == DMCC_ENOTSUP) {
+        PyErr_SetString(PyExc_NotImplementedError,
+                        "DMCC cape firmware does not support this");
+    } else if (result == DMCC_ERANGE) {
+        PyErr_SetString(PyExc_OverflowError,
+                        "DMCC result does not fit its register");
+    } else if (result == DMCC_ETIMEDOUT) {
+        PyErr_SetString(PyExc_IOError, "DMCC time limit passed");
+    } else {
+        PyErr_SetString(PyExc_IOError, "DMCC bus transfer failed");
+    }
+    return NULL;
+}
+
+// connectError - raises IOError for a board that cannot be connected to
+//                (DMCCstart would exit the Python interpreter instead)
+static PyObject *
+connectError(int nBoard)
+{
+    PyErr_Format(PyExc_IOError, "cannot connect to DMCC board %d", nBoard);
+    return NULL;
+}
+
 static PyObject *
 dmcc_setMotor(PyObject *self, PyObject *args)
 {
@@ -45,9 +74,15 @@ dmcc_setMotor(PyObject *self, PyObject *args)
     }
 
     int session;
-    session = DMCCstart(nBoard);
-    setMotorPower(session, nMotor, nPower);
+    session = DMCCopen(nBoard);
+    if (session < 0) {
+        return connectError(nBoard);
+    }
+    int result = setMotorPower(session, nMotor, nPower);
     DMCCend(session);
+    if (result != DMCC_OK) {
+        return dmccError(result);
+    }
 
     return Py_BuildValue("i", 0);
 }
@@ -80,9 +115,16 @@ dmcc_getMotorVoltageInt(PyObject *self, PyObject *args)
 
     int session;
     unsigned int voltage;
-    session = DMCCstart(nBoard);
+    session = DMCCopen(nBoard);
+    if (session < 0) {
+        return connectError(nBoard);
+    }
     voltage = getMotorVoltage(session);
+    int error = DMCCgetError(session);
     DMCCend(session);
+    if (error != DMCC_OK) {
+        return dmccError(error);
+    }
 
     return Py_BuildValue("i", voltage);
 }
@@ -115,9 +157,16 @@ dmcc_getMotorVoltage(PyObject *self, PyObject *args)
     unsigned int voltage;
     double fVoltage;
     
-    session = DMCCstart(nBoard);
+    session = DMCCopen(nBoard);
+    if (session < 0) {
+        return connectError(nBoard);
+    }
     voltage = getMotorVoltage(session);
+    int error = DMCCgetError(session);
     DMCCend(session);
+    if (error != DMCC_OK) {
+        return dmccError(error);
+    }
     
     fVoltage = voltage * 1.0 / 1000.0;
 
@@ -157,9 +206,16 @@ dmcc_getMotorCurrent(PyObject *self, PyObject *args)
 
     int session;
     unsigned int current;
-    session = DMCCstart(nBoard);
+    session = DMCCopen(nBoard);
+    if (session < 0) {
+        return connectError(nBoard);
+    }
     current = getMotorCurrent(session,nMotor);
+    int error = DMCCgetError(session);
     DMCCend(session);
+    if (error != DMCC_OK) {
+        return dmccError(error);
+    }
 
     return Py_BuildValue("i", current);
 }
@@ -200,9 +256,16 @@ dmcc_getQEI(PyObject *self, PyObject *args)
     int session;
     unsigned int nQEI;
     
-    session = DMCCstart(nBoard);
+    session = DMCCopen(nBoard);
+    if (session < 0) {
+        return connectError(nBoard);
+    }
     nQEI = getQEI(session, nMotor);
+    int error = DMCCgetError(session);
     DMCCend(session);
+    if (error != DMCC_OK) {
+        return dmccError(error);
+    }
     
     return Py_BuildValue("i", nQEI);
 }
@@ -244,9 +307,16 @@ dmcc_getQEIVel(PyObject *self, PyObject *args)
     int session;
     int vel;
     
-    session = DMCCstart(nBoard);
+    session = DMCCopen(nBoard);
+    if (session < 0) {
+        return connectError(nBoard);
+    }
     vel = getQEIVel(session, nMotor);
+    int error = DMCCgetError(session);
     DMCCend(session);
+    if (error != DMCC_OK) {
+        return dmccError(error);
+    }
     
     return Py_BuildValue("i", vel);
 }
@@ -284,9 +354,15 @@ dmcc_setTargetPos(PyObject *self, PyObject *args)
     }
 
     int session;
-    session = DMCCstart(nBoard);
-    setTargetPos(session, nMotor, nPosition);
+    session = DMCCopen(nBoard);
+    if (session < 0) {
+        return connectError(nBoard);
+    }
+    int result = setTargetPos(session, nMotor, nPosition);
     DMCCend(session);
+    if (result != DMCC_OK) {
+        return dmccError(result);
+    }
 
     return Py_BuildValue("i", 0);
 }
@@ -358,9 +434,15 @@ dmcc_setPIDConstants(PyObject *self, PyObject *args)
     
     int session;
     
-    session = DMCCstart(nBoard);
-    setPIDConstants(session, nMotor, posOrVel, P, I, D);
+    session = DMCCopen(nBoard);
+    if (session < 0) {
+        return connectError(nBoard);
+    }
+    int result = setPIDConstants(session, nMotor, posOrVel, P, I, D);
     DMCCend(session);
+    if (result != DMCC_OK) {
+        return dmccError(result);
+    }
 
     return Py_BuildValue("i", 0);
 }
@@ -402,9 +484,15 @@ dmcc_setTargetVel(PyObject *self, PyObject *args)
     
     int session;
     
-    session = DMCCstart(nBoard);
-    setTargetVel(session, nMotor, nVel);
+    session = DMCCopen(nBoard);
+    if (session < 0) {
+        return connectError(nBoard);
+    }
+    int result = setTargetVel(session, nMotor, nVel);
     DMCCend(session);
+    if (result != DMCC_OK) {
+        return dmccError(result);
+    }
 
     return Py_BuildValue("i", 0);
 }
@@ -28,9 +28,17 @@
 #include <fcntl.h>
 #include <string.h>
 #include <time.h>
+#include <math.h>
+#include <limits.h>
+#include <errno.h>
+#include <signal.h>
 #include <linux/i2c-dev.h>
 
 #include "DMCC.h"
+#include "DMCCclient.h"
+#include "DMCCprobe.h"
+#include "DMCCtrace.h"
+#include "DMCClog.h"
 
 char *Compatible_Versions[] = {"05", "06", "07", NULL};
 
@@ -42,108 +50,792 @@ int QEI_Vel_Threshold_1 = 5;
 int QEI_Threshold_2 = 30;
 int QEI_Vel_Threshold_2 = 5;
 
+// ------------------------
+// Autotune Settings
+// ------------------------
+// Firmware PID loop period (the I and D constants are per loop)
+#define PID_TICK_US 1000
+// Relay cycles ignored while the oscillation builds up, then measured
+#define TUNE_SETTLE_CYCLES 2
+#define TUNE_CYCLES 4
+// Time limit for the whole experiment in seconds
+#define TUNE_TIME_LIMIT 30
+
+// ------------------------
+// Transports attached to sessions (indexed by file descriptor)
+// ------------------------
+#define DMCC_MAX_SESSIONS 256
+static DMCCtransport DMCC_Transports[DMCC_MAX_SESSIONS];
+
+// ------------------------
+// Firmware capabilities of sessions (indexed by file descriptor)
+// ------------------------
+// What each firmware version supports (newer versions get the last entry)
+static const DMCCcaps Firmware_Caps[] = {
+    // version, autoIncrement, maxBurst, powerLimits
+    {5, 0, 1, 0},
+    {6, 1, 16, 0},
+    {7, 1, 32, 1},
+};
+#define NUM_FIRMWARE_CAPS (sizeof(Firmware_Caps) / sizeof(Firmware_Caps[0]))
+
+// Capabilities when the ID cannot be read: one register per transfer and
+// every command is sent, as the library has always done
+static const DMCCcaps Unknown_Caps = {0, 0, 1, 1};
+
+static DMCCcaps DMCC_Caps[DMCC_MAX_SESSIONS];
+static unsigned char DMCC_Caps_Known[DMCC_MAX_SESSIONS];
+static char DMCC_IDs[DMCC_MAX_SESSIONS][DMCC_ID_LEN + 1];
+
+// ------------------------
+// Buses
+// ------------------------
+// Bus of each session opened with DMCCstartBus (plus one, 0 if unknown)
+// and the cape address on it, to reopen the adapter after failures
+static int DMCC_Session_Bus[DMCC_MAX_SESSIONS];
+static unsigned char DMCC_Session_Addr[DMCC_MAX_SESSIONS];
+
+// Replacement for opening /dev/i2c-<bus> (DMCCsetBusOpener)
+static DMCCbusOpener DMCC_Bus_Opener;
+
+// ------------------------
+// Emergency stop (DMCCemergencyStopAll)
+// ------------------------
+// All stop of every open session, encoded when the session starts so the
+// stop itself only writes
+static DMCCprepared DMCC_Estop[DMCC_MAX_SESSIONS];
+static volatile sig_atomic_t DMCC_Estop_Ready[DMCC_MAX_SESSIONS];
+static volatile sig_atomic_t DMCC_Estop_Limit;  // highest session + 1
+
+// ------------------------
+// Retries and errors (indexed by file descriptor)
+// ------------------------
+static const DMCCretry Default_Retry = {
+    DMCC_RETRY_BUDGET_US, DMCC_RETRY_BACKOFF_US, DMCC_RETRY_REOPEN
+};
+static DMCCretry DMCC_Retry[DMCC_MAX_SESSIONS];
+static unsigned char DMCC_Retry_Set[DMCC_MAX_SESSIONS];
+static DMCCretryStats DMCC_Retry_Stats[DMCC_MAX_SESSIONS];
+static int DMCC_Error[DMCC_MAX_SESSIONS];       // first error (DMCCgetError)
+static unsigned int DMCC_Failures[DMCC_MAX_SESSIONS];  // failures in a row
+
+// ------------------------
+// Motor commands sent (DMCCgetCommandState)
+// ------------------------
+static volatile unsigned int DMCC_Command_Count[DMCC_MAX_SESSIONS];
+static volatile unsigned char DMCC_Motor_Mode[DMCC_MAX_SESSIONS][2];
+
+// noteCommand - records a motor command written to register 0xff
+static void noteCommand(int fd, const unsigned char *buf, int len)
+{
+    unsigned char mode;
+
+    if ((fd < 0) || (fd >= DMCC_MAX_SESSIONS) || (len < 2) ||
+            (buf[0] != 0xff)) {
+        return;
+    }
+    unsigned char command = buf[1];
+    unsigned char motors = command & 0x0f;
+    if ((command & 0xf0) == 0x00) {
+        mode = DMCC_MODE_POWER;
+    } else if ((command & 0xf0) == 0x10) {
+        mode = DMCC_MODE_POS;
+    } else if ((command & 0xf0) == 0x20) {
+        mode = DMCC_MODE_VEL;
+    } else {
+        return;
+    }
+    // 1 - motor 1, 2 - motor 2, 3 - both (0x00 is the status snapshot)
+    if ((motors < 1) || (motors > 3)) {
+        return;
+    }
+    if (motors & 1) {
+        DMCC_Motor_Mode[fd][0] = mode;
+    }
+    if (motors & 2) {
+        DMCC_Motor_Mode[fd][1] = mode;
+    }
+    DMCC_Command_Count[fd]++;
+}
+
+#ifdef DMCC_STATS
+// ------------------------
+// Statistics kept for sessions (indexed by file descriptor)
+// ------------------------
+static DMCCstats DMCC_Stats[DMCC_MAX_SESSIONS];
+
+// statTime - time stamp for latency measurement in nanoseconds
+static unsigned long long statTime(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((unsigned long long)ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+}
+
+// statTransaction - counts one write()/read() on the bus
+static void statTransaction(int fd, int len, int result)
+{
+    if ((fd < 0) || (fd >= DMCC_MAX_SESSIONS)) {
+        return;
+    }
+    DMCC_Stats[fd].transactions++;
+    if (result > 0) {
+        DMCC_Stats[fd].bytes += result;
+    }
+    if (result != len) {
+        DMCC_Stats[fd].errors++;
+    }
+}
+
+// statLatency - adds the time since start to the histogram of an operation
+static void statLatency(int fd, int op, unsigned long long start)
+{
+    if ((fd < 0) || (fd >= DMCC_MAX_SESSIONS)) {
+        return;
+    }
+    unsigned long long ns = statTime() - start;
+    int bucket = (ns == 0) ? 0 : (63 - __builtin_clzll(ns));
+    if (bucket >= DMCC_LATENCY_BUCKETS) {
+        bucket = DMCC_LATENCY_BUCKETS - 1;
+    }
+    DMCC_Stats[fd].latency[op][bucket]++;
+}
+
+#define STAT_START(t) unsigned long long t = statTime()
+#define STAT_LATENCY(fd, op, t) statLatency(fd, op, t)
+#define STAT_TRANSACTION(fd, len, result) statTransaction(fd, len, result)
+#define STAT_RETRY(fd) (DMCC_Stats[fd].retries++)
+#else
+#define STAT_START(t)
+#define STAT_LATENCY(fd, op, t)
+#define STAT_TRANSACTION(fd, len, result)
+#define STAT_RETRY(fd)
+#endif
+
+// busWrite - write() on the session, or on its attached transport
+static int busWrite(int fd, const unsigned char *buf, int len)
+{
+    int result;
+    TRACE_START(start);
+
+    if ((fd >= 0) && (fd < DMCC_MAX_SESSIONS) &&
+            (DMCC_Transports[fd].write != NULL)) {
+        result = DMCC_Transports[fd].write(DMCC_Transports[fd].ctx, buf, len);
+    } else {
+        result = write(fd, buf, len);
+    }
+    if (result == len) {
+        noteCommand(fd, buf, len);
+    }
+    STAT_TRANSACTION(fd, len, result);
+    TRACE_TRANSACTION(fd, DMCC_TRACE_WRITE, buf, len, start);
+    return result;
+}
+
+// busRead - read() on the session, or on its attached transport
+static int busRead(int fd, unsigned char *buf, int len)
+{
+    int result;
+    TRACE_START(start);
+
+    if ((fd >= 0) && (fd < DMCC_MAX_SESSIONS) &&
+            (DMCC_Transports[fd].read != NULL)) {
+        result = DMCC_Transports[fd].read(DMCC_Transports[fd].ctx, buf, len);
+    } else {
+        result = read(fd, buf, len);
+    }
+    STAT_TRANSACTION(fd, len, result);
+    TRACE_TRANSACTION(fd, DMCC_TRACE_READ, buf, len, start);
+    return result;
+}
+
+// setError - keeps the first error of a session for DMCCgetError
+// Returns: code
+static int setError(int fd, int code)
+{
+    if ((fd >= 0) && (fd < DMCC_MAX_SESSIONS) && (DMCC_Error[fd] == DMCC_OK)) {
+        DMCC_Error[fd] = code;
+    }
+    return code;
+}
+
+// flushSession - sends the writes the transport of a session has queued
+//                Logs an error if a queued write failed
+// Returns: DMCC_EIO - if a write sent since the last flush failed
+//          DMCC_OK - otherwise
+static int flushSession(int fd)
+{
+    if ((fd < 0) || (fd >= DMCC_MAX_SESSIONS) ||
+            (DMCC_Transports[fd].flush == NULL)) {
+        return DMCC_OK;
+    }
+    if (DMCC_Transports[fd].flush(DMCC_Transports[fd].ctx) != 0) {
+        LOG_ERROR("queued bus write failed");
+        return setError(fd, DMCC_EIO);
+    }
+    return DMCC_OK;
+}
+
+// reopenSession - resets the link of a session without changing its number
+//                 (the transport's reopen, or a new /dev/i2c-<bus> put in
+//                 place of the old one)
+// Returns: -1 - if the session cannot be reopened
+//           0 - otherwise
+static int reopenSession(int fd)
+{
+    char filename[64];
+
+    if (DMCC_Transports[fd].write != NULL) {
+        if (DMCC_Transports[fd].reopen == NULL) {
+            return -1;
+        }
+        return DMCC_Transports[fd].reopen(DMCC_Transports[fd].ctx);
+    }
+    if (DMCC_Session_Bus[fd] == 0) {
+        return -1;
+    }
+
+    snprintf(filename, sizeof(filename), "/dev/i2c-%d",
+                DMCC_Session_Bus[fd] - 1);
+    DMCCsystemPath(filename, sizeof(filename), filename);
+    int newFd = open(filename, O_RDWR);
+    if (newFd < 0) {
+        return -1;
+    }
+    if ((ioctl(newFd, I2C_SLAVE, DMCC_Session_Addr[fd] + 0x2c) < 0) ||
+            (dup2(newFd, fd) < 0)) {
+        close(newFd);
+        return -1;
+    }
+    close(newFd);
+    return 0;
+}
+
+// transfer - one bus transaction: a write, then a read if rlen > 0.
+//            A transaction that fails is tried again after backoffUs until
+//            it works or budgetUs has passed since the first failure, and
+//            the adapter is reopened every reopenAfter failures in a row
+//            (counted across transactions, a hung adapter can take the
+//            whole budget of each one)
+//            A read also fails if a write the transport queued before it
+//            failed (see flushSession)
+//            Prints an error if the transaction is given up
+// Returns: DMCC_EIO - if the transaction is given up
+//          DMCC_OK - otherwise
+static int transfer(int fd, const unsigned char *wbuf, int wlen,
+                        unsigned char *rbuf, int rlen)
+{
+    if ((busWrite(fd, wbuf, wlen) == wlen) &&
+            ((rlen == 0) || (busRead(fd, rbuf, rlen) == rlen))) {
+        if ((fd >= 0) && (fd < DMCC_MAX_SESSIONS)) {
+            DMCC_Failures[fd] = 0;
+        }
+        return (rlen > 0) ? flushSession(fd) : DMCC_OK;
+    }
+    if ((fd < 0) || (fd >= DMCC_MAX_SESSIONS)) {
+        LOG_ERROR("bus transfer at address 0x%02x failed", wbuf[0]);
+        return DMCC_EIO;
+    }
+
+    const DMCCretry *retry = DMCC_Retry_Set[fd] ? &DMCC_Retry[fd] :
+                                                    &Default_Retry;
+    DMCCretryStats *stats = &DMCC_Retry_Stats[fd];
+    unsigned long long start = DMCCclock(fd);
+    unsigned long long end = start + retry->budgetUs;
+    unsigned long long now;
+    unsigned int failures = 1;
+    int result = DMCC_EIO;
+
+    for (;;) {
+        stats->failures++;
+        DMCC_Failures[fd]++;
+        if ((retry->reopenAfter > 0) &&
+                (DMCC_Failures[fd] >= retry->reopenAfter)) {
+            DMCC_Failures[fd] = 0;
+            if (reopenSession(fd) == 0) {
+                stats->reopens++;
+            }
+        }
+        now = DMCCclock(fd);
+        if (now >= end) {
+            break;
+        }
+        DMCCwaitUntil(fd, ((end - now) > retry->backoffUs) ?
+                            (now + retry->backoffUs) : end);
+
+        stats->retries++;
+        STAT_RETRY(fd);
+        if ((busWrite(fd, wbuf, wlen) == wlen) &&
+                ((rlen == 0) || (busRead(fd, rbuf, rlen) == rlen))) {
+            stats->recovered++;
+            DMCC_Failures[fd] = 0;
+            result = DMCC_OK;
+            break;
+        }
+        failures++;
+    }
+
+    now = DMCCclock(fd);
+    if (now - start > stats->maxRetryUs) {
+        stats->maxRetryUs = now - start;
+    }
+    if (result != DMCC_OK) {
+        stats->errors++;
+        LOG_ERROR("bus transfer at address 0x%02x failed %u times",
+                wbuf[0], failures);
+        setError(fd, DMCC_EIO);
+    } else if (rlen > 0) {
+        result = flushSession(fd);
+    }
+    return result;
+}
+
+// readID - reads the ID of the cape with one burst read (one register at
+//          a time if the firmware does not auto-increment)
+// Parameters: fd - session from DMCC start
+//             ID - where to put the DMCC_ID_LEN bytes (NUL terminated)
+// Returns: -1 - if the ID cannot be read
+//           0 - if the burst read worked
+//           1 - if the ID had to be read one register at a time
+static int readID(int fd, char *ID)
+{
+    unsigned char addr = 0xe0;
+    int i;
+
+    memset(ID, 0, DMCC_ID_LEN + 1);
+    if ((busWrite(fd, &addr, 1) != 1) ||
+            (busRead(fd, (unsigned char *)ID, DMCC_ID_LEN) != DMCC_ID_LEN)) {
+        return -1;
+    }
+    if (DMCCidVersion(ID) >= 0) {
+        return 0;
+    }
+
+    for (i = 0; i < DMCC_ID_LEN; i++) {
+        addr = 0xe0 + i;
+        if ((busWrite(fd, &addr, 1) != 1) ||
+                (busRead(fd, (unsigned char *)&ID[i], 1) != 1)) {
+            return -1;
+        }
+    }
+    return 1;
+}
+
+// detectCaps - builds the capabilities of a session from the cape ID
+static void detectCaps(int fd)
+{
+    char ID[DMCC_ID_LEN + 1];
+    DMCCcaps caps = Unknown_Caps;
+    unsigned int i;
+
+    if ((fd < 0) || (fd >= DMCC_MAX_SESSIONS)) {
+        return;
+    }
+    int burst = readID(fd, ID);
+    if (burst < 0) {
+        ID[0] = '\0';
+    }
+    memcpy(DMCC_IDs[fd], ID, sizeof(ID));
+    int version = (burst >= 0) ? DMCCidVersion(ID) : -1;
+    if (version > 0) {
+        for (i = 0; i < NUM_FIRMWARE_CAPS; i++) {
+            if (Firmware_Caps[i].version <= version) {
+                caps = Firmware_Caps[i];
+            }
+        }
+        caps.version = version;
+        // Whatever the table says, a burst that failed on the ID means
+        // the firmware does not auto-increment
+        if (burst == 1) {
+            caps.autoIncrement = 0;
+            caps.maxBurst = 1;
+        }
+    }
+    DMCC_Caps[fd] = caps;
+    DMCC_Caps_Known[fd] = 1;
+}
+
+// prepareEstop - encodes the all stop of a session (setAllMotorPower with
+//                zero power: registers 0x02 - 0x05, then command 0x03)
+static void prepareEstop(int fd)
+{
+    if ((fd < 0) || (fd >= DMCC_MAX_SESSIONS)) {
+        return;
+    }
+    DMCC_Estop_Ready[fd] = 0;
+    if (DMCCpreparePower(fd, &DMCC_Estop[fd], 0, 0) == 0) {
+        DMCC_Estop_Ready[fd] = 1;
+        if (fd >= DMCC_Estop_Limit) {
+            DMCC_Estop_Limit = fd + 1;
+        }
+    }
+}
+
+// sessionCaps - capabilities of a session (found on first use)
+static const DMCCcaps *sessionCaps(int fd)
+{
+    if ((fd < 0) || (fd >= DMCC_MAX_SESSIONS)) {
+        return &Unknown_Caps;
+    }
+    if (!DMCC_Caps_Known[fd]) {
+        detectCaps(fd);
+    }
+    return &DMCC_Caps[fd];
+}
+
+int DMCCgetCaps(int session, DMCCcaps *caps)
+{
+    if ((session < 0) || (session >= DMCC_MAX_SESSIONS)) {
+        return -1;
+    }
+    *caps = *sessionCaps(session);
+    return 0;
+}
+
+int DMCCgetID(int session, char *id, int len)
+{
+    if ((session < 0) || (session >= DMCC_MAX_SESSIONS) || (len < 1)) {
+        return -1;
+    }
+    sessionCaps(session);
+    snprintf(id, len, "%s", DMCC_IDs[session]);
+    return 0;
+}
+
+int DMCCsetRetry(int session, const DMCCretry *retry)
+{
+    if ((session < 0) || (session >= DMCC_MAX_SESSIONS)) {
+        return DMCC_EINVAL;
+    }
+    DMCC_Retry[session] = (retry != NULL) ? *retry : Default_Retry;
+    DMCC_Retry_Set[session] = 1;
+    return DMCC_OK;
+}
+
+int DMCCgetRetryStats(int session, DMCCretryStats *stats)
+{
+    if ((session < 0) || (session >= DMCC_MAX_SESSIONS)) {
+        return DMCC_EINVAL;
+    }
+    *stats = DMCC_Retry_Stats[session];
+    return DMCC_OK;
+}
+
+int DMCCgetError(int session)
+{
+    if ((session < 0) || (session >= DMCC_MAX_SESSIONS)) {
+        return DMCC_EINVAL;
+    }
+    int error = DMCC_Error[session];
+    DMCC_Error[session] = DMCC_OK;
+    return error;
+}
+
+int DMCCattachTransport(int session, const DMCCtransport *transport)
+{
+    if ((session < 0) || (session >= DMCC_MAX_SESSIONS)) {
+        if (transport == NULL) {
+            // Nothing can be attached there, so nothing to detach
+            return 0;
+        }
+        LOG_ERROR("session %d cannot take a transport", session);
+        return -1;
+    }
+    // Out of the emergency stop while the transport changes
+    DMCC_Estop_Ready[session] = 0;
+    if (transport == NULL) {
+        memset(&DMCC_Transports[session], 0, sizeof(DMCCtransport));
+        DMCC_Caps_Known[session] = 0;
+    } else {
+        DMCCtraceFromEnv();
+        DMCClogFromEnv();
+        DMCC_Transports[session] = *transport;
+        detectCaps(session);
+        prepareEstop(session);
+    }
+    return 0;
+}
+
+int DMCCemergencyStopAll(void)
+{
+    int saved = errno;
+    int stopped = 0;
+    int fd, i, n;
+
+    for (fd = 0; fd < DMCC_Estop_Limit; fd++) {
+        if (!DMCC_Estop_Ready[fd]) {
+            continue;
+        }
+        const DMCCtransport *transport = &DMCC_Transports[fd];
+        const DMCCprepared *cmd = &DMCC_Estop[fd];
+        const unsigned char *buf = cmd->bytes;
+        for (i = 0; i < cmd->numTransfers; i++) {
+            if (transport->stop != NULL) {
+                n = transport->stop(transport->ctx, buf, cmd->length[i]);
+            } else if (transport->write != NULL) {
+                n = transport->write(transport->ctx, buf, cmd->length[i]);
+            } else {
+                n = write(fd, buf, cmd->length[i]);
+            }
+            // Never send the command after a failed write of the zeros
+            if (n != cmd->length[i]) {
+                break;
+            }
+            buf += cmd->length[i];
+        }
+        if (i == cmd->numTransfers) {
+            stopped++;
+        }
+    }
+    errno = saved;
+    return stopped;
+}
+
+unsigned long long DMCCclock(int session)
+{
+    if ((session >= 0) && (session < DMCC_MAX_SESSIONS) &&
+            (DMCC_Transports[session].now != NULL)) {
+        return DMCC_Transports[session].now(DMCC_Transports[session].ctx);
+    }
+
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((unsigned long long)ts.tv_sec * 1000000ULL) + (ts.tv_nsec / 1000);
+}
+
+int DMCCflush(int session)
+{
+    if ((session < 0) || (session >= DMCC_MAX_SESSIONS)) {
+        return DMCC_EINVAL;
+    }
+    return flushSession(session);
+}
+
+void DMCCwaitUntil(int session, unsigned long long deadline)
+{
+    // Writes waiting in the transport would otherwise wait too
+    flushSession(session);
+
+    unsigned long long now = DMCCclock(session);
+    if (now >= deadline) {
+        return;
+    }
+
+    if ((session >= 0) && (session < DMCC_MAX_SESSIONS) &&
+            (DMCC_Transports[session].sleep != NULL)) {
+        DMCC_Transports[session].sleep(DMCC_Transports[session].ctx,
+                                        (unsigned int)(deadline - now));
+        return;
+    }
+
+    // Absolute deadline so time spent on the bus is not added to the wait
+    struct timespec ts;
+    ts.tv_sec = deadline / 1000000ULL;
+    ts.tv_nsec = (deadline % 1000000ULL) * 1000;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0) {
+        // Interrupted by a signal, keep waiting
+    }
+}
+
+int DMCCgetStats(int session, DMCCstats *stats)
+{
+#ifdef DMCC_STATS
+    if ((session < 0) || (session >= DMCC_MAX_SESSIONS)) {
+        return -1;
+    }
+    *stats = DMCC_Stats[session];
+    return 0;
+#else
+    memset(stats, 0, sizeof(DMCCstats));
+    return -1;
+#endif
+}
+
+void DMCCresetStats(int session)
+{
+    if ((session < 0) || (session >= DMCC_MAX_SESSIONS)) {
+        return;
+    }
+    memset(&DMCC_Retry_Stats[session], 0, sizeof(DMCCretryStats));
+#ifdef DMCC_STATS
+    memset(&DMCC_Stats[session], 0, sizeof(DMCCstats));
+#endif
+}
+
 // -----------------------
 // DMCC Session Functions
 // -----------------------
 
 // putByte - Writes the data byte at the given address
-//           Prints an error when data is read incorrectly or invalid address
+//           Prints an error if the write fails
 // Parameters: fd - file descriptor
 //             addr - address of the desired write
-void putByte(int fd, unsigned char addr, unsigned char data)
+int putByte(int fd, unsigned char addr, unsigned char data)
 {
     unsigned char buf[2];
     buf[0] = addr;
     buf[1] = data;
+    STAT_START(start);
 
-    if (write(fd, buf, 2) != 2) {
-        printf("Error in write address 0x02\n");
-        close(fd);
-        exit(1);
-    }
+    int result = transfer(fd, buf, 2, NULL, 0);
+    STAT_LATENCY(fd, DMCC_OP_PUT, start);
+    return result;
 }
 
 // getByte - Reads the data byte at the given address
-//           Prints an error when data is read incorrectly or invalid address
+//           Prints an error if the read fails
 // Parameters: fd - file descriptor
 //             addr - address of the desired read
 unsigned char getByte(int fd, unsigned char addr)
 {
-    unsigned char buf[2];
-
-    buf[0] = addr;
-    if (write(fd, buf, 1) != 1) {
-        printf("Error in write address 0x02\n");
-        close(fd);
-        exit(1);
-    }
+    unsigned char b;
 
-    if (read(fd, buf, 1) != 1) {
-        printf("Error in read\n");
-        close(fd);
-        exit(1);
-    }
-    return buf[0];
+    getBytes(fd, addr, &b, 1);
+    return b;
 }
 
 // getWord - Reads the data word (2 bytes) at the given address
-//           Prints an error when data is read incorrectly or invalid address
+//           Prints an error if the read fails
 // Parameters: fd - file descriptor
 //             addr - address of the desired read
 unsigned int getWord(int fd, unsigned char addr)
 {
-    unsigned int result;
-
-    result = ((unsigned int) getByte(fd, addr)) +
-                ((unsigned int) (getByte(fd, addr+1) << 8));
+    unsigned char b[2];
 
-    return result;
+    getBytes(fd, addr, b, 2);
+    return ((unsigned int) b[0]) + ((unsigned int) b[1] << 8);
 }
 
 // getDWord - Reads the data word (4 bytes) at the given address
-//           Prints an error when data is read incorrectly or invalid address
+//           Prints an error if the read fails
 // Parameters: fd - file descriptor
 //             addr - address of the desired read
 // Returns: int from the 4 bytes read in
 unsigned int getDWord(int fd, unsigned char addr)
 {
-    unsigned int result;
-    result = ((unsigned int) getByte(fd, addr)) +
-                ((unsigned int) getByte(fd, addr+1) << 8) +
-                ((unsigned int) getByte(fd, addr+2) << 16) +
-                ((unsigned int) getByte(fd, addr+3) << 24);
-    return result;
+    unsigned char b[4];
+
+    getBytes(fd, addr, b, 4);
+    return ((unsigned int) b[0]) +
+                ((unsigned int) b[1] << 8) +
+                ((unsigned int) b[2] << 16) +
+                ((unsigned int) b[3] << 24);
 }
 
-// getNumberOfBytes - Reads a given number of bytes at the given address
-//           Prints an error when data is read incorrectly or invalid address
+// putBytes - Writes consecutive registers, in as few transactions as the
+//            firmware allows (one per byte without auto-increment)
 // Parameters: fd - file descriptor
-//             num - number of bytes to be read
-//             addr - address of the desired read
-// Returns: pointer to an array of strings for bytes read in
-//          (Note: pointer must be freed when function called to
-//                 prevent memory leaks)
-char *getNumberOfBytes(int fd, int num, unsigned char addr) 
+//             addr - address of the first byte
+//             data - bytes to write
+//             num - number of bytes
+int putBytes(int fd, unsigned char addr, const unsigned char *data, int num)
 {
-    if (num <= 0) {
-        printf("Error: Too few bytes specified\n");
-        return NULL;
-    } 
+    const DMCCcaps *caps = sessionCaps(fd);
+    int chunk = caps->autoIncrement ? caps->maxBurst : 1;
+    unsigned char buf[256];
+    int i, n;
+
+    STAT_START(start);
+    for (i = 0; i < num; i += n) {
+        n = ((num - i) < chunk) ? (num - i) : chunk;
+        buf[0] = addr + i;
+        memcpy(&buf[1], &data[i], n);
+        if (transfer(fd, buf, n + 1, NULL, 0) != DMCC_OK) {
+            return DMCC_EIO;
+        }
+    }
+    STAT_LATENCY(fd, DMCC_OP_PUT, start);
+    return DMCC_OK;
+}
 
-    char *result = (char *)malloc(sizeof(char)*num);
-    // Check that the memory has been allocated
-    if (result == NULL) {
-        printf("Error: memory allocation failure\n");
+// getBytes - Reads consecutive registers, in as few transactions as the
+//            firmware allows (one per byte without auto-increment)
+// Parameters: fd - file descriptor
+//             addr - address of the first byte
+//             data - where to put the bytes
+//             num - number of bytes
+int getBytes(int fd, unsigned char addr, unsigned char *data, int num)
+{
+    const DMCCcaps *caps = sessionCaps(fd);
+    int chunk = caps->autoIncrement ? caps->maxBurst : 1;
+    int i, n;
+
+    STAT_START(start);
+    for (i = 0; i < num; i += n) {
+        unsigned char reg = addr + i;
+        n = ((num - i) < chunk) ? (num - i) : chunk;
+        if (transfer(fd, &reg, 1, &data[i], n) != DMCC_OK) {
+            memset(data, 0, num);
+            return DMCC_EIO;
+        }
     }
+    STAT_LATENCY(fd, DMCC_OP_GET, start);
+    return DMCC_OK;
+}
+
+int DMCCreadRegs(int fd, unsigned char first, int num, DMCCregs *regs)
+{
+    unsigned char b[256];
+
+    if ((num < 1) || (first + num > 256)) {
+        LOG_ERROR("invalid register span 0x%02x + %d", first, num);
+        return DMCC_EINVAL;
+    }
+
+    // getBytes leaves zeros when it fails
+    int result = getBytes(fd, first, b, num);
+    DMCCdecodeRegs(b, first, num, regs);
+    return result;
+}
 
-    // Get bytes at the given address
+int DMCCwriteRegs(int fd, unsigned char first, int num, const DMCCregs *regs)
+{
+    unsigned char b[256];
+    int start = -1;
     int i = 0;
-    while(i < num) {
-        result[i] = (char)(getByte(fd, addr+i));
+
+    if ((num < 1) || (first + num > 256)) {
+        LOG_ERROR("invalid register span 0x%02x + %d", first, num);
+        return DMCC_EINVAL;
+    }
+    DMCCencodeRegs(regs, first, num, b);
+
+    // One putBytes per run of registers (the bytes between them are not
+    // written)
+    while (i <= num) {
+        int width = (i < num) ? DMCCregWidth(first + i) : 0;
+        if ((width > 0) && (i + width <= num)) {
+            if (start < 0) {
+                start = i;
+            }
+            i += width;
+            continue;
+        }
+        if ((start >= 0) &&
+                (putBytes(fd, first + start, &b[start], i - start) !=
+                    DMCC_OK)) {
+            return DMCC_EIO;
+        }
+        start = -1;
         i++;
     }
-    //printf("Bytes are %s\n", result);
-    return result;
+    return DMCC_OK;
+}
+
+int DMCCreadStatus(int fd, unsigned char first, int num, DMCCregs *regs)
+{
+    TRACE_API("DMCCreadStatus");
+    // Send status update command (required call before reading)
+    int result = putByte(fd, DMCC_REG_COMMAND, 0x00);
+    if (result != DMCC_OK) {
+        unsigned char b[256];
+        if ((num >= 1) && (first + num <= 256)) {
+            memset(b, 0, num);
+            DMCCdecodeRegs(b, first, num, regs);
+        }
+        return result;
+    }
+    return DMCCreadRegs(fd, first, num, regs);
 }
 
 // validCapeAddress - checks if the given address has a DMCC cape connected
@@ -167,76 +859,43 @@ char *validCapeAddress(unsigned char addr)
     }
 }
 
-int getVersionNumber(unsigned char capeAddr)
+// boardVersion - reads the version number of a cape on a bus
+// Returns: version number
+//          -1 - if an error occurs
+static int boardVersion(int bus, unsigned char capeAddr)
 {
-    capeAddr += 0x2c;
-    // Check if the given address is valid and get the directory
-    char *addr = validCapeAddress(capeAddr);
-    if (addr == NULL) {
-        printf("Error: invalid cape address specified\n");
+    // Check if the given address is valid
+    if (validCapeAddress(capeAddr + 0x2c) == NULL) {
+        LOG_ERROR("invalid cape address specified");
         return -1;
     }
 
-    // Find the desired file and store the path in file
-    char file[40];
-    strcpy(file, "/sys/bus/i2c/devices/");
-    strcat(file, addr);
-    strcat(file, "/eeprom");
-
-    FILE *p = NULL;
-    int pos = 1;
-    int c;
-   
-    p = fopen(file, "rb");
-    if (p == NULL) {
-        printf("Error in opening file\n");
-        return -1;
+    // Version number is located at the 40 byte of the EEPROM
+    int version = DMCCreadBoardVersion(bus, capeAddr);
+    if (version < 0) {
+        LOG_ERROR("No version number found");
     }
+    return version;
+}
 
-    // Version number is located at the 40 byte 
-    for (c = fgetc(p); c != EOF; c = fgetc(p)) {
-        pos++;
-        if (pos == 42) {
-            int temp = fgetc(p);
-            if (temp == EOF) {
-                break;
-            }
-            temp = temp & 0x0f;
-            c = c & 0x0f;
-            if ((c > 0x09) || (temp > 0x09)) {
-                printf("Error: Invalid version number\n");
-                break;
-            }
-            fclose(p);
-            return ((c * 10) + temp);
-        }
-    }
-    fclose(p);
-    printf("Error: No version number found\n");
-    return -1;
+int getVersionNumber(unsigned char capeAddr)
+{
+    TRACE_API("getVersionNumber");
+    return boardVersion(1, capeAddr);
 }
 
-// checkID - checks the ID of the cape to ensure connection to DMCC
-// Parameters: fd - session from DMCC start
+// checkIDString - checks an ID read from the cape
+// Parameters: ID - ID string of the cape
 //             version - version number
 // Returns: 0 - if the ID has a compatible version number
 //          -1 - if an error occurs
 //          Software version number - otherwise
-int checkID(int fd, int version) 
+static int checkIDString(const char *ID, int version)
 {
-    // Get ID from cape
-    char *ID = getNumberOfBytes(fd, 16, 0xe0);
-    if (ID == NULL) {
-        printf("Error: No ID found for DMCC cape\n");
-        free(ID);
-        return -1;
-    } 
-
     // Check ID is DMCC cape
     if (strncmp(ID, "DMCC Mk.", 7) != 0) {
-        free(ID);
-        printf("Error: Cape specified is not a DMCC cape\n");
-        printf("ID: %s\n", ID);
+        LOG_ERROR("Cape specified is not a DMCC cape (ID: %.*s)",
+                    DMCC_ID_LEN, ID);
         return -1;
     }
 
@@ -244,262 +903,408 @@ int checkID(int fd, int version)
     //      check if board version is the same
     int v = ((int)(ID[8] - 0x30) * 10) + (int)(ID[9] - 0x30);
     if (v != version) {
-        printf("Error: Board and board base software are not the same\n");
-        free(ID);
+        LOG_ERROR("Board and board base software are not the same");
         return v;
     }
 
-    // Check that the version number is compatible
-    char pV[2];
-    pV[0] = ID[8];
-    pV[1] = ID[9];
     // Software is compatible with versions listed in Compatible_Versions array
     int i = 0;
     while(Compatible_Versions[i] != NULL) {
-        if (strncmp(pV, Compatible_Versions[i], 2) == 0) {
-            free(ID);
+        if (strncmp(&ID[8], Compatible_Versions[i], 2) == 0) {
             return 0;
         }
         i++;
     }
-    
-    // Get the software version number as an integer
-    free(ID);
     return v;
 }
 
+// checkID - checks the ID of the cape to ensure connection to DMCC
+// Parameters: fd - session from DMCC start
+//             version - version number
+// Returns: 0 - if the ID has a compatible version number
+//          -1 - if an error occurs
+//          Software version number - otherwise
+int checkID(int fd, int version) 
+{
+    char ID[DMCC_ID_LEN + 1];
+
+    // Get ID from cape
+    if (readID(fd, ID) != 0) {
+        LOG_ERROR("No ID found for DMCC cape");
+        return -1;
+    }
+    return checkIDString(ID, version);
+}
+
+int DMCCopen(unsigned char capeAddr)
+{
+    TRACE_API("DMCCopen");
+    DMCCtraceFromEnv();
+    DMCClogFromEnv();
+
+    // Go through the bus daemon when there is one
+    char *daemon = getenv(DMCCD_SOCKET_ENV);
+    if ((daemon != NULL) && (daemon[0] != '\0')) {
+        return DMCCclientStart(daemon, capeAddr);
+    }
+    return DMCCstartBus(1, capeAddr);
+}
+
 int DMCCstart(unsigned char capeAddr)
 {
-    capeAddr+=0x2c;
-    char filename[20];
-    strcpy(filename,"/dev/i2c-1");
+    int session = DMCCopen(capeAddr);
+    if (session < 0) {
+        // Said even with logging off: the program is about to disappear
+        fprintf(stderr, "DMCC error: cannot connect to board %u, exiting\n",
+                capeAddr);
+        exit(1);
+    }
+    return session;
+}
+
+int DMCCgetCommandState(int session, DMCCcommandState *state)
+{
+    if ((session < 0) || (session >= DMCC_MAX_SESSIONS)) {
+        return -1;
+    }
+    state->count = DMCC_Command_Count[session];
+    state->mode[0] = DMCC_Motor_Mode[session][0];
+    state->mode[1] = DMCC_Motor_Mode[session][1];
+    return 0;
+}
+
+void DMCCsetBusOpener(DMCCbusOpener opener)
+{
+    DMCC_Bus_Opener = opener;
+}
 
+int DMCCstartBus(int bus, unsigned char capeAddr)
+{
+    char filename[64];
     int fd;
 
-    //Opens a file descriptor to the board
-    fd = open(filename, O_RDWR);
-    if (fd <0) {
-        printf("Error: cannot open %s\n",filename);
-        exit(1);
+    DMCClogFromEnv();
+    if (capeAddr > 3) {
+        LOG_ERROR("invalid cape address specified");
+        return -1;
     }
-    if (ioctl(fd, I2C_SLAVE, capeAddr) < 0) {
-        printf("Error: cannot ioctl to addr 0x%x\n", capeAddr);
-        close(fd);
-        exit(1);
+
+    if (DMCC_Bus_Opener != NULL) {
+        fd = DMCC_Bus_Opener(bus, capeAddr);
+    } else {
+        //Opens a file descriptor to the board
+        snprintf(filename, sizeof(filename), "/dev/i2c-%d", bus);
+        DMCCsystemPath(filename, sizeof(filename), filename);
+        fd = open(filename, O_RDWR);
+        if (fd <0) {
+            LOG_ERROR("cannot open %s",filename);
+            return -1;
+        }
+        if (ioctl(fd, I2C_SLAVE, capeAddr + 0x2c) < 0) {
+            LOG_ERROR("cannot ioctl to addr 0x%x", capeAddr + 0x2c);
+            close(fd);
+            return -1;
+        }
+        TRACE_CAPE(fd, capeAddr + 0x2c);
+        detectCaps(fd);
+        prepareEstop(fd);
+    }
+
+    if ((fd >= 0) && (fd < DMCC_MAX_SESSIONS)) {
+        DMCC_Session_Bus[fd] = bus + 1;
+        DMCC_Session_Addr[fd] = capeAddr;
     }
-	
     return fd;
 }
 
 int checkVersion(int fd, unsigned char capeAddr)
 {
-	int boardVer = getVersionNumber(capeAddr - 0x2c);
-    int softVer = checkID(fd, boardVer);
+    TRACE_API("checkVersion");
+    int boardVer, softVer;
+
+    // Also accept the bus address of the cape (0x2c - 0x2f)
+    if (capeAddr >= 0x2c) {
+        capeAddr -= 0x2c;
+    }
+
+    // Bus the session was started on (DMCCstartBus), 1 if not known
+    int bus = 1;
+    if ((fd >= 0) && (fd < DMCC_MAX_SESSIONS) && (DMCC_Session_Bus[fd] > 0)) {
+        bus = DMCC_Session_Bus[fd] - 1;
+    }
+
+    if ((fd >= 0) && (fd < DMCC_MAX_SESSIONS) &&
+            (DMCC_Transports[fd].write == NULL)) {
+        // Cape on an i2c bus: probed once per boot (see DMCCprobe.h)
+        DMCCcapeInfo info;
+        if (DMCCprobeCape(bus, capeAddr, &info, 1) != 0) {
+            return -1;
+        }
+        boardVer = info.boardVersion;
+        if (info.id[0] == '\0') {
+            LOG_ERROR("No ID found for DMCC cape");
+            softVer = -1;
+        } else {
+            softVer = checkIDString(info.id, boardVer);
+        }
+    } else {
+        boardVer = boardVersion(bus, capeAddr);
+        softVer = checkID(fd, boardVer);
+    }
+
     if (softVer != 0) { 
-        printf("Error: software version and board version are incompatible\n");
-        printf("       Board version = %d, Software version = %d\n",
-                boardVer, softVer);
-        printf("NOTE: if any version number is -1, the version is not found\n");
+        // A version of -1 was not found
+        LOG_ERROR("software version and board version are incompatible "
+                    "(board version = %d, software version = %d)",
+                    boardVer, softVer);
 		return -1;
     }
 	return 0;
 }
 
-void setDefaultPIDConstants(int fd)
+int setDefaultPIDConstants(int fd)
 {
-    //Default PID constants
-    setPIDConstants(fd, 1, 1, -19200, -8000, -150);
-    setPIDConstants(fd, 2, 1, -19200, -8000, -150);
-    setPIDConstants(fd, 1, 0, -5248, -75, -500);
-    setPIDConstants(fd, 2, 0, -10000, -75, -500);
+    TRACE_API("setDefaultPIDConstants");
+    DMCCregs regs;
+
+    // Default PID constants
+    regs.posP1 = -5248;
+    regs.posI1 = -75;
+    regs.posD1 = -500;
+    regs.velP1 = -19200;
+    regs.velI1 = -8000;
+    regs.velD1 = -150;
+    regs.posP2 = -10000;
+    regs.posI2 = -75;
+    regs.posD2 = -500;
+    regs.velP2 = -19200;
+    regs.velI2 = -8000;
+    regs.velD2 = -150;
+
+    // One write per motor (0x30 - 0x3b, 0x40 - 0x4b)
+    return DMCCwriteRegs(fd, DMCC_REG_POS_P1,
+                            DMCC_REG_VEL_D2 + 2 - DMCC_REG_POS_P1, &regs);
 }
 
-void DMCCend(int session)
+int DMCCend(int session)
 {
-    close(session);
+    int flushed = flushSession(session);
+    DMCCattachTransport(session, NULL);
+    DMCCresetStats(session);
+    if ((session >= 0) && (session < DMCC_MAX_SESSIONS)) {
+        DMCC_Session_Bus[session] = 0;
+        DMCC_Command_Count[session] = 0;
+        DMCC_Motor_Mode[session][0] = DMCC_MODE_POWER;
+        DMCC_Motor_Mode[session][1] = DMCC_MODE_POWER;
+        DMCC_Retry_Set[session] = 0;
+        DMCC_Error[session] = DMCC_OK;
+        DMCC_Failures[session] = 0;
+    }
+    if (close(session) != 0) {
+        return DMCC_EINVAL;
+    }
+    return flushed;
 }
 
-unsigned int getQEI(int fd, unsigned int motor)
-{
+// getStatusReg - sends the status update command, then reads one register
+// Parameters: fd - connection to the board
+//             motor - motor number (1 or 2)
+//             reg1 - register of motor 1
+//             reg2 - register of motor 2
+// Returns: value of the register (decoded as the register table says)
+//          0 - if an error occurs (see DMCCgetError)
+static int getStatusReg(int fd, unsigned int motor, unsigned char reg1,
+                            unsigned char reg2)
+{
+    unsigned char b[4];
+
+    if ((motor != 1) && (motor != 2)) {
+        LOG_ERROR("invalid motor number");
+        setError(fd, DMCC_EINVAL);
+        return 0;
+    }
+    unsigned char reg = (motor == 1) ? reg1 : reg2;
+
     // Send status update command (required call before reading)
-    putByte(fd, 0xff, 0x00);
-
-    if (motor == 1) {
-        return getDWord(fd, 0x10);
-    } else if (motor == 2) {
-        return getDWord(fd, 0x14);
-    } else {
-        printf("Error: invalid motor number\n");
+    if ((putByte(fd, DMCC_REG_COMMAND, 0x00) != DMCC_OK) ||
+            (getBytes(fd, reg, b, DMCCregWidth(reg)) != DMCC_OK)) {
         return 0;
     }
+    return DMCCdecodeReg(b, reg);
 }
 
-int getQEIVel(int fd, unsigned int motor)
+// pidReg - first register (P) of a set of PID constants
+// Parameters: motor - motor number (1 or 2)
+//             posOrVel - 0 for position, 1 for velocity
+// Returns: register offset
+//          0 - if motor or posOrVel is invalid (logs an error)
+static unsigned char pidReg(unsigned int motor, unsigned int posOrVel)
 {
-    // Send status update command (required call before reading)
-    putByte(fd, 0xff, 0x00);
-    
-    int result;
+    static const unsigned char reg[2][2] = {
+        {DMCC_REG_POS_P1, DMCC_REG_VEL_P1},
+        {DMCC_REG_POS_P2, DMCC_REG_VEL_P2}
+    };
 
-    if (motor == 1) {
-        result = (int)getWord(fd, 0x18);
-        if (result > 32767) {
-            return (-1 * (0xffff-result));
-        }    
-        return result;
-    } else if (motor == 2) {
-        result = getWord(fd, 0x1A);
-        if (result > 32767) {
-            return (-1 * (0xffff-result));
-        }
-            return result;
-    } else {
-        printf("Error: invalid motor number\n");
+    if ((motor != 1) && (motor != 2)) {
+        LOG_ERROR("invalid motor number specified");
         return 0;
     }
+    if (posOrVel > 1) {
+        LOG_ERROR("posOrVel is not given as 0 or 1");
+        return 0;
+    }
+    return reg[motor - 1][posOrVel];
+}
+
+unsigned int getQEI(int fd, unsigned int motor)
+{
+    TRACE_API("getQEI");
+    return (unsigned int)getStatusReg(fd, motor, DMCC_REG_QEI1,
+                                        DMCC_REG_QEI2);
+}
 
+int getQEIVel(int fd, unsigned int motor)
+{
+    TRACE_API("getQEIVel");
+    return getStatusReg(fd, motor, DMCC_REG_QEI_VEL1, DMCC_REG_QEI_VEL2);
 }
 
 int getQEIDir(int fd, unsigned int motor)
 {
+    TRACE_API("getQEIDir");
+    unsigned char byte1;
+
+    if ((motor != 1) && (motor != 2)) {
+        LOG_ERROR("invalid motor number");
+        return DMCC_EINVAL;
+    }
+
     // Send status update command
-    putByte(fd, 0xff, 0x00);
-    
-    if (motor == 1) {
-        return ((getByte(fd, 0x01) >> 2) & 1);
-    } else if (motor == 2) {
-        return ((getByte(fd, 0x01) >> 3) & 1);
-    } else {
-        printf("Error: invalid motor number\n");
-        return -1;
+    if ((putByte(fd, DMCC_REG_COMMAND, 0x00) != DMCC_OK) ||
+            (getBytes(fd, DMCC_REG_CONFIG, &byte1, 1) != DMCC_OK)) {
+        return DMCC_EIO;
     }
+    return (byte1 >> (motor + 1)) & 1;
 }
 
-void configQEIDir(int fd, unsigned int motor, int dir)
+int configQEIDir(int fd, unsigned int motor, int dir)
 {
-    unsigned char byte1 = getByte(fd, 0x01);
+    TRACE_API("configQEIDir");
+    unsigned char byte1;
+
+    if ((motor != 1) && (motor != 2)) {
+        LOG_ERROR("invalid motor number");
+        return DMCC_EINVAL;
+    }
+    if (getBytes(fd, DMCC_REG_CONFIG, &byte1, 1) != DMCC_OK) {
+        return DMCC_EIO;
+    }
     if (motor == 1) {
         byte1 = ((byte1 & 0x0b) | (unsigned char)((dir & 0x1) << 2));
-        putByte(fd, 0x01, byte1);
-    } else if (motor == 2) {
-        byte1 = ((byte1 & 0x07) | (unsigned char)((dir & 0x1) << 3));
-        putByte(fd, 0x01, byte1);
     } else {
-        printf("Error: invalid motor number\n");
+        byte1 = ((byte1 & 0x07) | (unsigned char)((dir & 0x1) << 3));
     }
+    return putByte(fd, DMCC_REG_CONFIG, byte1);
 }
 
-void resetQEI(int fd, unsigned int motor)
+int resetQEI(int fd, unsigned int motor)
 {
+    TRACE_API("resetQEI");
     if (motor == 1) {
-        putByte(fd, 0xff, 0x30);
+        return putByte(fd, DMCC_REG_COMMAND, 0x30);
     } else if (motor == 2) {
-        putByte(fd, 0xff, 0x31);
+        return putByte(fd, DMCC_REG_COMMAND, 0x31);
     } else {
-        printf("Error: invalid motor number\n");
+        LOG_ERROR("invalid motor number");
+        return DMCC_EINVAL;
     }
 }
 
-void resetAllQEI(int fd)
+int resetAllQEI(int fd)
 {
-    putByte(fd, 0xff, 0x32);
+    TRACE_API("resetAllQEI");
+    return putByte(fd, DMCC_REG_COMMAND, 0x32);
 }
 
-void setMotorPower(int fd, unsigned int motor, int pwm)
+int setMotorPower(int fd, unsigned int motor, int pwm)
 {
-    short int pwm16 = (short int) pwm;
+    TRACE_API("setMotorPower");
 
     // Check for a valid motor selection
     if ((motor != 1) && (motor != 2)) {
-        printf("Error: motor number must be 1 or 2\n");
-        exit(1);
+        LOG_ERROR("motor number must be 1 or 2");
+        return DMCC_EINVAL;
     }
 
     // Check for a valid power input (boundaries for motor control)
     if (pwm < -10000) {
-        printf("min is -10000, %d is invalid\n",pwm);
-        exit(1);
+        LOG_ERROR("min is -10000, %d is invalid", pwm);
+        return DMCC_EINVAL;
     }
     if (pwm > 10000) {
-        printf("max is 10000, %d is invalid\n",pwm);
-        exit(1);
+        LOG_ERROR("max is 10000, %d is invalid", pwm);
+        return DMCC_EINVAL;
     }
 
     // Set power to given motor
-    putByte(fd, (motor * 2), ((unsigned char)(pwm16 & 0xff)));
-    putByte(fd, ((motor * 2) + 1), (unsigned char) ((pwm16 & 0xff00) >> 8));
-//    printf("Setting pwm to %d\n",pwm);
+    unsigned char data[2];
+    DMCC_REG_PUT(data, 2, pwm);
+    if (putBytes(fd, (motor == 1) ? DMCC_REG_PWM1 : DMCC_REG_PWM2, data,
+                    2) != DMCC_OK) {
+        return DMCC_EIO;
+    }
+    LOG_DEBUG("Setting pwm to %d", pwm);
 
     // Send the set motor power command
-    putByte(fd, 0xff, ((unsigned char) motor));
+    return putByte(fd, DMCC_REG_COMMAND, ((unsigned char) motor));
 }
 
-void setAllMotorPower(int fd, int pwm1, int pwm2)
+int setAllMotorPower(int fd, int pwm1, int pwm2)
 {
-    short int pwm1_16 = (short int) pwm1;
-    short int pwm2_16 = (short int) pwm2;
-	
+    TRACE_API("setAllMotorPower");
+    DMCCregs regs;
+
     // Check for a valid power input (boundaries for motor control)
     if ((pwm1 < -10000) || (pwm2 < -10000)) {
-        printf("Error: min power input is -10000\n");
-        exit(1);
+        LOG_ERROR("min power input is -10000");
+        return DMCC_EINVAL;
     }
     if ((pwm1 > 10000) || (pwm2 > 10000)) {
-        printf("Error: max power input is 10000\n");
-        exit(1);
+        LOG_ERROR("max power input is 10000");
+        return DMCC_EINVAL;
     }
 
-    // Set power to motor 1
-    putByte(fd, 0x02, ((unsigned char)(pwm1_16 & 0xff)));
-    putByte(fd, 0x03, ((unsigned char)((pwm1_16 >> 8) & 0xff)));
-
-    // Set power to motor 2
-    putByte(fd, 0x04, ((unsigned char)(pwm2_16 & 0xff)));
-    putByte(fd, 0x05, ((unsigned char)((pwm2_16 >> 8) & 0xff)));
+    // Set power to motor 1 and motor 2
+    regs.pwm1 = pwm1;
+    regs.pwm2 = pwm2;
+    if (DMCCwriteRegs(fd, DMCC_REG_PWM1, 4, &regs) != DMCC_OK) {
+        return DMCC_EIO;
+    }
    
-    printf("Setting pwm1 to %d and pwm2 to %d\n", pwm1, pwm2); 
+    LOG_DEBUG("Setting pwm1 to %d and pwm2 to %d", pwm1, pwm2);
     // Send the set motor power 1 and 2 command
-    putByte(fd, 0xff, 0x03);
+    return putByte(fd, DMCC_REG_COMMAND, 0x03);
 }
 
 unsigned int getMotorCurrent(int fd, unsigned int motor)
 {
-    // Grab the data at the current point
-    putByte(fd, 0xff, 0x00);
-
-    // Get the current for the given motor number
-    if (motor == 1) {
-        return getWord(fd, 0x1C);
-    } else if (motor == 2) {
-        return getWord(fd, 0x1E);
-    } else {
-        printf("Error: invalid motor number\n");
-    }
-    return 0;
+    TRACE_API("getMotorCurrent");
+    return (unsigned int)getStatusReg(fd, motor, DMCC_REG_CURRENT1,
+                                        DMCC_REG_CURRENT2);
 }
 
 unsigned int getMotorVoltage(int fd)
 {
-    //Grab data at current point
-    putByte(fd, 0xff, 0x00);
-    
-    //Get motor supply voltage
-    return getWord(fd, 0x06);
+    TRACE_API("getMotorVoltage");
+    return (unsigned int)getStatusReg(fd, 1, DMCC_REG_VOLTAGE,
+                                        DMCC_REG_VOLTAGE);
 }
 
 unsigned int getTargetPos(int fd, unsigned int motor)
 {
-    // Grab data
-    putByte(fd, 0xff, 0x00);
-
-    if (motor == 1) {
-        return getDWord(fd, 0x20);
-    } else if (motor == 2) {
-        return getDWord(fd, 0x24);
-    } else {
-        printf("Error: invalid motor number\n");
-        return 0;
-    } 
+    TRACE_API("getTargetPos");
+    return (unsigned int)getStatusReg(fd, motor, DMCC_REG_TARGET_POS1,
+                                        DMCC_REG_TARGET_POS2);
 }
 
 // setTargetPos - Sets the target position for the desired motor
@@ -508,69 +1313,60 @@ unsigned int getTargetPos(int fd, unsigned int motor)
 // Parameters: fd - connection to the board (value returned from DMCCstart)
 //             motor - motor number desired
 //             position - motor position
-void setTargetPos(int fd, unsigned int motor, int pos)
+int setTargetPos(int fd, unsigned int motor, int pos)
 {
+    TRACE_API("setTargetPos");
     unsigned char start;
 
     // Perform check on motor number
     if (motor == 1) {
-        start = 0x20;
+        start = DMCC_REG_TARGET_POS1;
         motor = 0x11;
     } else if (motor == 2){
-        start = 0x24;
+        start = DMCC_REG_TARGET_POS2;
         motor = 0x12;
     } else {
         // neither motor 1 or 2 is called so exit the function
-        printf("In set target pos\n");
-        printf("Error: invalid motor number\n");
-        return;
+        LOG_ERROR("invalid motor number in setTargetPos");
+        return DMCC_EINVAL;
     }
 
     // Write the new position into the array
-    putByte(fd, start, ((unsigned char)(pos & 0xff)));
-    putByte(fd, (start + 1), ((unsigned char)((pos >> 8) & 0xff)));
-    putByte(fd, (start + 2), ((unsigned char)((pos >> 16) & 0xff)));
-    putByte(fd, (start + 3), ((unsigned char)((pos >> 24) & 0xff)));
+    unsigned char data[4];
+    DMCC_REG_PUT(data, 4, pos);
+    if (putBytes(fd, start, data, 4) != DMCC_OK) {
+        return DMCC_EIO;
+    }
 
     // Send the command to start the PID mode
-    putByte(fd, 0xff, ((unsigned char) motor)); 
+    return putByte(fd, DMCC_REG_COMMAND, ((unsigned char) motor));
 }
 
 // setAllTargetPos - Sets the target position for both motors
 // Parameters: fd - connection to the board (value returned from DMCCstart)
 //             pos1 - motor 1 position
 //             pos2 - motor 2 position
-void setAllTargetPos(int fd, int pos1, int pos2)
+int setAllTargetPos(int fd, int pos1, int pos2)
 {
-    // Write the new target position to the first motor
-    putByte(fd, 0x20, ((unsigned char)(pos1 & 0xff)));
-    putByte(fd, 0x21, ((unsigned char)((pos1 >> 8) & 0xff)));
-    putByte(fd, 0x22, ((unsigned char)((pos1 >> 16) & 0xff)));
-    putByte(fd, 0x23, ((unsigned char)((pos1 >> 24) & 0xff))); 
-
-    // Write the new target position to the second motor
-    putByte(fd, 0x24, ((unsigned char)(pos2 & 0xff)));
-    putByte(fd, 0x25, ((unsigned char)((pos2 >> 8) & 0xff)));
-    putByte(fd, 0x26, ((unsigned char)((pos2 >> 16) & 0xff)));
-    putByte(fd, 0x27, ((unsigned char)((pos2 >> 24) & 0xff)));
+    TRACE_API("setAllTargetPos");
+    DMCCregs regs;
+
+    // Write the new target positions of both motors (0x20 - 0x27)
+    regs.targetPos1 = pos1;
+    regs.targetPos2 = pos2;
+    if (DMCCwriteRegs(fd, DMCC_REG_TARGET_POS1, 8, &regs) != DMCC_OK) {
+        return DMCC_EIO;
+    }
 
     // Send the command to start the PID mode
-    putByte(fd, 0xff, 0x13);
+    return putByte(fd, DMCC_REG_COMMAND, 0x13);
 }
 
 int getTargetVel(int fd, unsigned int motor)
 {
-    // Grab data
-    putByte(fd, 0xff, 0x00);
-
-    if (motor == 1) {
-        return ((int) getDWord(fd, 0x20));
-    } else if (motor == 2) {
-        return ((int) getDWord(fd, 0x24));
-    } else {
-        printf("Error: invalid motor number\n");
-        return 0;
-    }
+    TRACE_API("getTargetVel");
+    return getStatusReg(fd, motor, DMCC_REG_TARGET_VEL1,
+                            DMCC_REG_TARGET_VEL2);
 }
 
 // setTargetVel - Sets the target velocity for the desired motor
@@ -579,83 +1375,255 @@ int getTargetVel(int fd, unsigned int motor)
 // Parameters: fd - connection to the board (value returned from DMCCstart)
 //             motor - motor number desired
 //             velocity - motor velocity
-void setTargetVel(int fd, unsigned int motor, int vel)
+int setTargetVel(int fd, unsigned int motor, int vel)
 {
-
-    short int vel16 = (short int) vel;
+    TRACE_API("setTargetVel");
     unsigned char start;
 
     // Perform check on motors
     if (motor == 1) {
-        start = 0x28;
+        start = DMCC_REG_TARGET_VEL1;
         motor = 0x21;
     } else if (motor == 2) {
-        start = 0x2A;
+        start = DMCC_REG_TARGET_VEL2;
         motor = 0x22;
     } else {
         // Neither motor 1 or 2 is called so exit the function
-        printf("Error: invalid motor number\n");
-        return;
+        LOG_ERROR("invalid motor number");
+        return DMCC_EINVAL;
     }
 
     // Write the new target velocity to the array
-    putByte(fd, start, ((unsigned char)(vel16 & 0xff)));
-    putByte(fd, (start+1), ((unsigned char)((vel16 >> 8) & 0xff)));
+    unsigned char data[2];
+    DMCC_REG_PUT(data, 2, vel);
+    if (putBytes(fd, start, data, 2) != DMCC_OK) {
+        return DMCC_EIO;
+    }
 
     // Send the command to start the PID mode
-    putByte(fd, 0xff, ((unsigned char) motor));
-        
+    return putByte(fd, DMCC_REG_COMMAND, ((unsigned char) motor));
 }
 
 // setAllTargetVel - Sets the target velocity for all motors
 // Parameters: fd - connection to the board (value returned from DMCCstart)
 //             vel1 - motor 1 velocity
 //             vel2 - motor 2 velocity
-void setAllTargetVel(int fd, int vel1, int vel2)
+int setAllTargetVel(int fd, int vel1, int vel2)
 {
-    short int vel1_16 = (short int) vel1;
-    short int vel2_16 = (short int) vel2;
-
-    // Write the new target velocity for the first motor
-    putByte(fd, 0x28, ((unsigned char)(vel1_16 & 0xff)));
-    putByte(fd, 0x29, ((unsigned char)((vel1_16 >> 8) & 0xff)));
-
-    // Write the new target velocity for the second motor
-    putByte(fd, 0x2A, ((unsigned char)(vel2_16 & 0xff)));
-    putByte(fd, 0x2B, ((unsigned char)((vel2_16 >> 8) & 0xff)));
+    TRACE_API("setAllTargetVel");
+    DMCCregs regs;
+
+    // Write the new target velocities of both motors (0x28 - 0x2B)
+    regs.targetVel1 = vel1;
+    regs.targetVel2 = vel2;
+    if (DMCCwriteRegs(fd, DMCC_REG_TARGET_VEL1, 4, &regs) != DMCC_OK) {
+        return DMCC_EIO;
+    }
 
 	// Send the command to start the PID mode
-    putByte(fd, 0xff, 0x23);
-
+    return putByte(fd, DMCC_REG_COMMAND, 0x23);
 }
 
 int getMotorDir(int fd, unsigned int motor)
 {
+    TRACE_API("getMotorDir");
+    unsigned char byte1;
+
+    if ((motor != 1) && (motor != 2)) {
+        LOG_ERROR("invalid motor number");
+        return DMCC_EINVAL;
+    }
+
     // Send read command
-    putByte(fd, 0xff, 0x00);
+    if ((putByte(fd, DMCC_REG_COMMAND, 0x00) != DMCC_OK) ||
+            (getBytes(fd, DMCC_REG_CONFIG, &byte1, 1) != DMCC_OK)) {
+        return DMCC_EIO;
+    }
+    return (byte1 >> (motor - 1)) & 1;
+}
+
+int configMotorDir(int fd, unsigned int motor, int dir)
+{
+    TRACE_API("configMotorDir");
+    unsigned char byte1;
 
+    if ((motor != 1) && (motor != 2)) {
+        LOG_ERROR("invalid motor number");
+        return DMCC_EINVAL;
+    }
+    if (getBytes(fd, DMCC_REG_CONFIG, &byte1, 1) != DMCC_OK) {
+        return DMCC_EIO;
+    }
     if (motor == 1) {
-        return (getByte(fd, 0x01) & 1);
-    } else if (motor == 2) {
-        return ((getByte(fd, 0x01) >> 1) & 1);
-    } else {
-        printf("Error: invalid motor number\n");
+        return putByte(fd, DMCC_REG_CONFIG,
+                ((byte1 & 0xe) | (unsigned char)(dir & 0x1)));
+    }
+    return putByte(fd, DMCC_REG_CONFIG,
+            ((byte1 & 0xd) | (unsigned char)((dir & 0x1) << 1)));
+}
+
+// prepareStart - empties a prepared command
+static void prepareStart(DMCCprepared *cmd)
+{
+    memset(cmd, 0, sizeof(DMCCprepared));
+}
+
+// prepareWrite - adds the transfers that write consecutive registers (as
+//                putBytes would send them) and records where each data
+//                byte ends up
+// Parameters: pos - where to put the offset of each data byte (or NULL)
+static void prepareWrite(int fd, DMCCprepared *cmd, unsigned char addr,
+                            const unsigned char *data, int num,
+                            unsigned char *pos)
+{
+    const DMCCcaps *caps = sessionCaps(fd);
+    int chunk = caps->autoIncrement ? caps->maxBurst : 1;
+    int used = 0;
+    int i, j, n;
+
+    for (i = 0; i < cmd->numTransfers; i++) {
+        used += cmd->length[i];
+    }
+    for (i = 0; i < num; i += n) {
+        n = ((num - i) < chunk) ? (num - i) : chunk;
+        cmd->bytes[used] = addr + i;
+        for (j = 0; j < n; j++) {
+            cmd->bytes[used + 1 + j] = data[i + j];
+            if (pos != NULL) {
+                pos[i + j] = used + 1 + j;
+            }
+        }
+        cmd->length[cmd->numTransfers++] = n + 1;
+        used += n + 1;
+    }
+}
+
+// prepareField - makes data bytes [first, first+size) a field
+static void prepareField(DMCCprepared *cmd, const unsigned char *pos,
+                            int first, int size, int min, int max)
+{
+    int f = cmd->numFields++;
+    int i;
+
+    cmd->fieldSize[f] = size;
+    for (i = 0; i < size; i++) {
+        cmd->fieldByte[f][i] = pos[first + i];
+    }
+    cmd->fieldMin[f] = min;
+    cmd->fieldMax[f] = max;
+}
+
+// prepareTwo - prepares two values written from addr, then a command
+static void prepareTwo(int fd, DMCCprepared *cmd, unsigned char addr,
+                        int size, int value1, int value2, int min, int max,
+                        unsigned char command)
+{
+    unsigned char data[8];
+    unsigned char pos[8];
+
+    memset(data, 0, sizeof(data));
+    prepareStart(cmd);
+    prepareWrite(fd, cmd, addr, data, 2 * size, pos);
+    prepareField(cmd, pos, 0, size, min, max);
+    prepareField(cmd, pos, size, size, min, max);
+    DMCCpatchPrepared(cmd, 0, value1);
+    DMCCpatchPrepared(cmd, 1, value2);
+    prepareWrite(fd, cmd, DMCC_REG_COMMAND, &command, 1, NULL);
+}
+
+int DMCCpreparePower(int fd, DMCCprepared *cmd, int pwm1, int pwm2)
+{
+    TRACE_API("DMCCpreparePower");
+    // Check for a valid power input (boundaries for motor control)
+    if ((pwm1 < -10000) || (pwm2 < -10000) ||
+            (pwm1 > 10000) || (pwm2 > 10000)) {
+        LOG_ERROR("power input must be -10000 - 10000");
         return -1;
     }
+    prepareTwo(fd, cmd, DMCC_REG_PWM1, 2, pwm1, pwm2, -10000, 10000, 0x03);
+    return 0;
 }
 
-void configMotorDir(int fd, unsigned int motor, int dir)
+int DMCCprepareTargetPos(int fd, DMCCprepared *cmd, int pos1, int pos2)
 {
-    unsigned char byte1 = getByte(fd, 0x01);
-    if (motor == 1) {
-        putByte(fd, 0x01, 
-                ((byte1 & 0xe) | (unsigned char)(dir & 0x1)));
-    } else if (motor == 2) {
-        putByte(fd, 0x01, 
-                ((byte1 & 0xd) | (unsigned char)((dir & 0x1) << 1)));
-    } else {
-        printf("Error: invalid motor number\n");
+    TRACE_API("DMCCprepareTargetPos");
+    prepareTwo(fd, cmd, DMCC_REG_TARGET_POS1, 4, pos1, pos2, INT_MIN, INT_MAX, 0x13);
+    return 0;
+}
+
+int DMCCprepareTargetVel(int fd, DMCCprepared *cmd, int vel1, int vel2)
+{
+    TRACE_API("DMCCprepareTargetVel");
+    if ((vel1 < SHRT_MIN) || (vel2 < SHRT_MIN) ||
+            (vel1 > SHRT_MAX) || (vel2 > SHRT_MAX)) {
+        LOG_ERROR("velocity must be %d - %d", SHRT_MIN, SHRT_MAX);
+        return -1;
+    }
+    prepareTwo(fd, cmd, DMCC_REG_TARGET_VEL1, 2, vel1, vel2, SHRT_MIN, SHRT_MAX, 0x23);
+    return 0;
+}
+
+int DMCCpreparePIDConstants(int fd, DMCCprepared *cmd, unsigned int motor,
+                            unsigned int posOrVel, int P, int I, int D)
+{
+    TRACE_API("DMCCpreparePIDConstants");
+    unsigned char data[6];
+    unsigned char pos[6];
+
+    if (pidReg(motor, posOrVel) == 0) {
+        return -1;
+    }
+
+    // Same registers as setPIDConstants
+    memset(data, 0, sizeof(data));
+    prepareStart(cmd);
+    prepareWrite(fd, cmd, pidReg(motor, posOrVel), data, 6, pos);
+    prepareField(cmd, pos, 0, 2, SHRT_MIN, USHRT_MAX);
+    prepareField(cmd, pos, 2, 2, SHRT_MIN, USHRT_MAX);
+    prepareField(cmd, pos, 4, 2, SHRT_MIN, USHRT_MAX);
+    if ((DMCCpatchPrepared(cmd, 0, P) != 0) ||
+            (DMCCpatchPrepared(cmd, 1, I) != 0) ||
+            (DMCCpatchPrepared(cmd, 2, D) != 0)) {
+        return -1;
+    }
+    return 0;
+}
+
+int DMCCpatchPrepared(DMCCprepared *cmd, int field, int value)
+{
+    int i;
+
+    if ((field < 0) || (field >= cmd->numFields)) {
+        LOG_ERROR("prepared command has no field %d", field);
+        return -1;
+    }
+    if ((value < cmd->fieldMin[field]) || (value > cmd->fieldMax[field])) {
+        LOG_ERROR("%d is out of range for field %d", value, field);
+        return -1;
+    }
+    // Little endian, like the registers
+    for (i = 0; i < cmd->fieldSize[field]; i++) {
+        cmd->bytes[cmd->fieldByte[field][i]] =
+            (unsigned char)(((unsigned int)value >> (8 * i)) & 0xff);
+    }
+    return 0;
+}
+
+int DMCCsendPrepared(int fd, const DMCCprepared *cmd)
+{
+    TRACE_API("DMCCsendPrepared");
+    const unsigned char *buf = cmd->bytes;
+    int i;
+
+    STAT_START(start);
+    for (i = 0; i < cmd->numTransfers; i++) {
+        if (transfer(fd, buf, cmd->length[i], NULL, 0) != DMCC_OK) {
+            return DMCC_EIO;
+        }
+        buf += cmd->length[i];
     }
+    STAT_LATENCY(fd, DMCC_OP_PUT, start);
+    return DMCC_OK;
 }
 
 void DMCCwait(unsigned int microseconds)
@@ -663,32 +1631,37 @@ void DMCCwait(unsigned int microseconds)
     usleep(microseconds);
 }
 
-void DMCCwaitSec(unsigned int seconds)
+int DMCCwaitSec(unsigned int seconds)
 {
     if (seconds > 2147) {
-        printf("Error: too long a wait time");
-        printf(" (must be less than 2147 seconds)\n");
+        LOG_ERROR("too long a wait time (must be less than 2147 seconds)");
+        return DMCC_EINVAL;
     }
     usleep(seconds*1000000);
+    return DMCC_OK;
 }
 
-void moveUntilTime(int fd, unsigned int motor, int pwm, unsigned int time)
+int moveUntilTime(int fd, unsigned int motor, int pwm, unsigned int time)
 {
+    TRACE_API("moveUntilTime");
     if ((motor != 1) && (motor != 2)) {
-        printf("Error: invalid motor number\n");
-        return;
+        LOG_ERROR("invalid motor number");
+        return DMCC_EINVAL;
+    }
+    int result = setMotorPower(fd, motor, pwm);
+    if (result != DMCC_OK) {
+        return result;
     }
-    setMotorPower(fd, motor, pwm);
     usleep(time);
-    setMotorPower(fd, motor, 0);
+    return setMotorPower(fd, motor, 0);
 }
 
 int moveUntilPos(int fd, unsigned int motor, int pos, unsigned int tLimit)
 {
+    TRACE_API("moveUntilPos");
 	if (tLimit > 2147) {
-        printf("Error: too long a time limit");
-        printf(" (must be less than 2147 seconds)\n");
-		return -1;
+        LOG_ERROR("too long a time limit (must be less than 2147 seconds)");
+		return DMCC_EINVAL;
     }
 	
     // Threshold value for QEI
@@ -699,8 +1672,8 @@ int moveUntilPos(int fd, unsigned int motor, int pos, unsigned int tLimit)
     } else if (motor == 2) {
         threshold = QEI_Threshold_2;
     } else {
-        printf("Error: invalid motor number\n");
-        return -1;
+        LOG_ERROR("invalid motor number");
+        return DMCC_EINVAL;
     }
 
     // Motor timeout (if the motor does not reach the desired position)
@@ -708,50 +1681,54 @@ int moveUntilPos(int fd, unsigned int motor, int pos, unsigned int tLimit)
     time(&startTime);
     time(&currentTime);
 
-    // Error value
+    // Error value (bus errors before the move are not the move's)
+    DMCCgetError(fd);
     int error = abs(pos - (int)(getQEI(fd, motor)));
 
-    // Current value for motor
-    int current = getMotorCurrent(fd, motor); 
-
-    // Count for print statement
+    // Count for the log statement (the current is only read to log it)
     int count = 0;
-    printf("Error = %d, Current = %u\n", error, current);
+    LOG_DEBUG("Error = %d, Current = %u", error, getMotorCurrent(fd, motor));
 
     // Set the target position desired
-    setTargetPos(fd, motor, pos); 
+    if ((DMCCgetError(fd) != DMCC_OK) ||
+            (setTargetPos(fd, motor, pos) != DMCC_OK)) {
+        return DMCC_EIO;
+    }
 
     // Wait until the motor has reached the desired position or timeout
     while (error > threshold) {
         // Check if have waited longer than maximum time limit
         if ((currentTime - startTime) > tLimit) {
-			printf("Could not reach desired target within time alloted\n");
-            return -1;
+            LOG_WARN("Could not reach desired target within time alloted");
+            return DMCC_ETIMEDOUT;
         }
         time(&currentTime);
 
         // Get error between QEI target position and current position
         error = abs(pos - (int)(getQEI(fd, motor)));
+        if (DMCCgetError(fd) != DMCC_OK) {
+            return DMCC_EIO;
+        }
 
-        // Print out the error and current readings for the user
-        if (count == 100){
+        // Log the error and current readings
+        if (count == 100) {
             count = 0;
-            current = getMotorCurrent(fd, motor);
-            printf("Error = %d, Current = %u\n", error, current);
+            LOG_DEBUG("Error = %d, Current = %u", error,
+                        getMotorCurrent(fd, motor));
         }
         count++;
 	}
-    printf("Position at %d reached\n", pos);
-	return 0;
+    LOG_INFO("Position at %d reached", pos);
+	return DMCC_OK;
 }
 
 int moveUntilVel(int fd, unsigned int motor, int vel, unsigned int tLimit)
 {
+    TRACE_API("moveUntilVel");
 	// Check time limit allowed values
 	if (tLimit > 2147) {
-        printf("Error: too long a time limit");
-        printf(" (must be less than 2147 seconds)\n");
-		return -1;
+        LOG_ERROR("too long a time limit (must be less than 2147 seconds)");
+		return DMCC_EINVAL;
     }
 	
     // Set threshold values
@@ -762,8 +1739,8 @@ int moveUntilVel(int fd, unsigned int motor, int vel, unsigned int tLimit)
     } else if (motor == 2) {
         threshold = QEI_Vel_Threshold_2;
     } else {
-        printf("Error: invalid motor number\n");
-        return -1;
+        LOG_ERROR("invalid motor number");
+        return DMCC_EINVAL;
     }
 
     // Motor timeout (if the motor does not reach the desired velocity)
@@ -771,48 +1748,52 @@ int moveUntilVel(int fd, unsigned int motor, int vel, unsigned int tLimit)
     time(&startTime);
     time(&currentTime);
 
-    // Error value
+    // Error value (bus errors before the move are not the move's)
+    DMCCgetError(fd);
     int error = abs(vel - (int)(getQEIVel(fd, motor)));
 
-    // Current value for motor
-    int current = getMotorCurrent(fd, motor);
-
-    // Count for the print statement
+    // Count for the log statement (the current is only read to log it)
     int count = 0;
-    printf("Error = %d, Current = %u\n", error, current);
+    LOG_DEBUG("Error = %d, Current = %u", error, getMotorCurrent(fd, motor));
 
     // Set the target speed desired
-    setTargetVel(fd, motor, vel);
+    if ((DMCCgetError(fd) != DMCC_OK) ||
+            (setTargetVel(fd, motor, vel) != DMCC_OK)) {
+        return DMCC_EIO;
+    }
 
     // Wait until the motor has reached the desired position or timeout
     while (error > threshold) {
         if ((currentTime - startTime) > tLimit) {
-            printf("Could not reach desired target within time alloted\n");
-            return -1;
+            LOG_WARN("Could not reach desired target within time alloted");
+            return DMCC_ETIMEDOUT;
         }
         time(&currentTime);
 
         error = abs(vel - (int)(getQEIVel(fd, motor)));
+        if (DMCCgetError(fd) != DMCC_OK) {
+            return DMCC_EIO;
+        }
         
-        // Print out the error and current readings for the user
-        if (count == 100){
+        // Log the error and current readings
+        if (count == 100) {
             count = 0;
-            current = getMotorCurrent(fd, motor);
-            printf("Error = %d, Current = %u\n", error, current);
+            LOG_DEBUG("Error = %d, Current = %u", error,
+                        getMotorCurrent(fd, motor));
         }
         count++;
     }
-    printf("Velocity at %d reached\n", vel);
-	return 0;
+    LOG_INFO("Velocity at %d reached", vel);
+	return DMCC_OK;
 }
 
 int moveAllUntilPos(int fd, int pos1, int pos2, unsigned int tLimit)
 {
+    TRACE_API("moveAllUntilPos");
 	// Check time limit allowed values
 	if (tLimit > 2147) {
-        printf("Error: too long a time limit");
-        printf(" (must be less than 2147 seconds)\n");
-		return -1;
+        LOG_ERROR("too long a time limit (must be less than 2147 seconds)");
+		return DMCC_EINVAL;
     }
 	
     // Motor timeout (if the motor does not reach the desired velocity)
@@ -820,55 +1801,57 @@ int moveAllUntilPos(int fd, int pos1, int pos2, unsigned int tLimit)
     time(&startTime);
     time(&currentTime);
 
-    // Error value
+    // Error value (bus errors before the move are not the move's)
+    DMCCgetError(fd);
     int error1 = abs(pos1 - (int)(getQEI(fd, 1)));
     int error2 = abs(pos2 - (int)(getQEI(fd, 2)));
 
-    // Current given to motors
-    int curr1 = getMotorCurrent(fd, 1);
-    int curr2 = getMotorCurrent(fd, 2);
-
-    // Count for the print statements
+    // Count for the log statements (the currents are only read to log them)
     int count = 0;
-    printf("Error1 = %d, Error2 = %d, Current1 = %u, Current2 = %u\n",
-                        error1, error2, curr1, curr2);
+    LOG_DEBUG("Error1 = %d, Error2 = %d, Current1 = %u, Current2 = %u",
+                error1, error2, getMotorCurrent(fd, 1), getMotorCurrent(fd, 2));
 
     // Set the new target position for both motors
-    setAllTargetPos(fd, pos1, pos2);
+    if ((DMCCgetError(fd) != DMCC_OK) ||
+            (setAllTargetPos(fd, pos1, pos2) != DMCC_OK)) {
+        return DMCC_EIO;
+    }
 
     // Wait until both motors are within the desired threshold or timeout
     while ((error1 > QEI_Threshold_1) || (error2 > QEI_Threshold_2)) {
         // Check if the time limit for the motors has been passed
         if ((currentTime - startTime) > tLimit) {
-            printf("Could not reach desired target within time alloted\n");
-            return -1;
+            LOG_WARN("Could not reach desired target within time alloted");
+            return DMCC_ETIMEDOUT;
         }
         time(&currentTime);
 
         error1 = abs(pos1 - (int)(getQEI(fd, 1)));
         error2 = abs(pos2 - (int)(getQEI(fd, 2)));
+        if (DMCCgetError(fd) != DMCC_OK) {
+            return DMCC_EIO;
+        }
 
-        // Print out the error and current readings for the user
-        if (count == 100){
+        // Log the error and current readings
+        if (count == 100) {
             count = 0;
-            curr1 = getMotorCurrent(fd, 1);
-            curr2 = getMotorCurrent(fd, 2);
-            printf("Error1 = %d, Error2 = %d, Current1 = %u, Current2 = %u\n", 
-                        error1, error2, curr1, curr2);
+            LOG_DEBUG("Error1 = %d, Error2 = %d, Current1 = %u, Current2 = %u",
+                        error1, error2, getMotorCurrent(fd, 1),
+                        getMotorCurrent(fd, 2));
         }
         count++;
     }
-    printf("Position 1 at %d and position 2 at %d reached\n", pos1, pos2);
-	return 0;
+    LOG_INFO("Position 1 at %d and position 2 at %d reached", pos1, pos2);
+	return DMCC_OK;
 }
 
 int moveAllUntilVel(int fd, int vel1, int vel2, unsigned int tLimit)
 {
+    TRACE_API("moveAllUntilVel");
 	// Check time limit allowed values
 	if (tLimit > 2147) {
-        printf("Error: too long a time limit");
-        printf(" (must be less than 2147 seconds)\n");
-		return -1;
+        LOG_ERROR("too long a time limit (must be less than 2147 seconds)");
+		return DMCC_EINVAL;
     }
 	
     // Motor timeout (if the motor does not reach the desired velocity)
@@ -876,53 +1859,59 @@ int moveAllUntilVel(int fd, int vel1, int vel2, unsigned int tLimit)
     time(&startTime);
     time(&currentTime);
 
-    // Error value
+    // Error value (bus errors before the move are not the move's)
+    DMCCgetError(fd);
     int error1 = abs(vel1 - (int)(getQEIVel(fd, 1)));
     int error2 = abs(vel2 - (int)(getQEIVel(fd, 2)));
 
-    // Current given to motors
-    int curr1 = getMotorCurrent(fd, 1);
-    int curr2 = getMotorCurrent(fd, 2);
-
-    // Count for print statements
+    // Count for the log statements (the currents are only read to log them)
     int count = 0;
-    printf("Error1 = %d, Error2 = %d, Current1 = %u, Current2 = %u\n",
-                error1, error2, curr1, curr2);
+    LOG_DEBUG("Error1 = %d, Error2 = %d, Current1 = %u, Current2 = %u",
+                error1, error2, getMotorCurrent(fd, 1), getMotorCurrent(fd, 2));
 
     // Set the new target velocity for both motors
-    setAllTargetVel(fd, vel1, vel2);
+    if ((DMCCgetError(fd) != DMCC_OK) ||
+            (setAllTargetVel(fd, vel1, vel2) != DMCC_OK)) {
+        return DMCC_EIO;
+    }
 
     // Wait until both motors are within the desired threshold or timeout
     while ((error1 > QEI_Vel_Threshold_1) || (error2 > QEI_Vel_Threshold_2)) {
         // Check if the time limit for the motors has been passed
         if ((currentTime - startTime) > tLimit) {
-            printf("Could not reach desired target within time alloted\n");
-            return -1;
+            LOG_WARN("Could not reach desired target within time alloted");
+            return DMCC_ETIMEDOUT;
         }
         time(&currentTime);
 
         error1 = abs(vel1 - (int)(getQEIVel(fd, 1)));
         error2 = abs(vel2 - (int)(getQEIVel(fd, 2)));
+        if (DMCCgetError(fd) != DMCC_OK) {
+            return DMCC_EIO;
+        }
         
-        // Print out the error and current readings for the user
-        if (count == 100){
+        // Log the error and current readings
+        if (count == 100) {
             count = 0;
-            curr1 = getMotorCurrent(fd, 1);
-            curr2 = getMotorCurrent(fd, 2);
-            printf("Error1 = %d, Error2 = %d, Current1 = %u, Current2 = %u\n", 
-                error1, error2, curr1, curr2);
+            LOG_DEBUG("Error1 = %d, Error2 = %d, Current1 = %u, Current2 = %u",
+                        error1, error2, getMotorCurrent(fd, 1),
+                        getMotorCurrent(fd, 2));
         }
         count++;
     }
-    printf("Velocity 1 at %d and velocity 2 at %d reached\n", vel1, vel2);
-	return 0;
+    LOG_INFO("Velocity 1 at %d and velocity 2 at %d reached", vel1, vel2);
+	return DMCC_OK;
 }
 
-void moveAllUntilTime(int fd, int pwm1, int pwm2, unsigned int time)
+int moveAllUntilTime(int fd, int pwm1, int pwm2, unsigned int time)
 {
-    setAllMotorPower(fd, pwm1, pwm2);
+    TRACE_API("moveAllUntilTime");
+    int result = setAllMotorPower(fd, pwm1, pwm2);
+    if (result != DMCC_OK) {
+        return result;
+    }
     usleep(time);
-    setAllMotorPower(fd, 0, 0);
+    return setAllMotorPower(fd, 0, 0);
 }
 
 // returnPIDConstants - gets the PID constants starting at the addr (helper)
@@ -931,55 +1920,30 @@ void moveAllUntilTime(int fd, int pwm1, int pwm2, unsigned int time)
 //             P - constant P
 //             I - constant I
 //             D - constant D
-void returnPIDConstants(int fd, unsigned char addr, int *P, int *I, int *D)
+int returnPIDConstants(int fd, unsigned char addr, int *P, int *I, int *D)
 {
-    // Temporary variable to change from unsigned 16bit int to signed
-    int result;
+    unsigned char data[6];
 
-    // Get constant P
-    result = (int)getWord(fd, addr);
-    if (result > 32767) {
-            result = (-1 * (0xffff-result));
-    }
-    *P = result;
-
-    // Put constant I
-    result = (int)getWord(fd, (addr + 0x02));
-    if (result > 32767) {
-            result = (-1 * (0xffff-result));
-    }
-    *I = result;
-    
-    // Put constant D
-    result = (int)getWord(fd, (addr + 0x04));
-    if (result > 32767) {
-            result = (-1 * (0xffff-result));
+    // Constants P, I and D are consecutive signed words
+    if (getBytes(fd, addr, data, 6) != DMCC_OK) {
+        return DMCC_EIO;
     }
-    *D = result;
+    *P = DMCCdecodeReg(&data[0], addr);
+    *I = DMCCdecodeReg(&data[2], addr + 2);
+    *D = DMCCdecodeReg(&data[4], addr + 4);
+    return DMCC_OK;
 }
 
-void getPIDConstants(int fd, unsigned int motor, unsigned int posOrVel, 
+int getPIDConstants(int fd, unsigned int motor, unsigned int posOrVel, 
                         int *P, int *I, int *D ) 
 {
-    if (motor == 1) {
-        if (posOrVel == 0) {
-            returnPIDConstants(fd, 0x30, P, I, D);
-        } else if (posOrVel == 1) {
-            returnPIDConstants(fd, 0x36, P, I, D);
-        } else {
-            printf("Error: posOrVel is not given as 0 or 1\n");
-        }
-    } else if (motor == 2) {
-        if (posOrVel == 0) {
-            returnPIDConstants(fd, 0x40, P, I, D);
-        } else if (posOrVel == 1) {
-            returnPIDConstants(fd, 0x46, P, I, D);
-        } else {
-            printf("Error: posOrVel is not given as 0 or 1\n");
-        }
-    } else {
-        printf("Error: invalid motor number specified\n");
+    TRACE_API("getPIDConstants");
+    unsigned char reg = pidReg(motor, posOrVel);
+
+    if (reg == 0) {
+        return DMCC_EINVAL;
     }
+    return returnPIDConstants(fd, reg, P, I, D);
 }
 
 // putPIDConstants - puts the PID constants starting at the given addr (helper)
@@ -988,57 +1952,209 @@ void getPIDConstants(int fd, unsigned int motor, unsigned int posOrVel,
 //             P - constant P
 //             I - constant I
 //             D - constant D
-void putPIDConstants(int fd, unsigned char addr, int P, int I, int D)
+int putPIDConstants(int fd, unsigned char addr, int P, int I, int D)
 {
-    // Put constant P 
-    putByte(fd, addr, (unsigned char)(P & 0xff));
-    putByte(fd, (addr +0x01), (unsigned char)((P & 0xff00)>>8));
+    unsigned char data[6];
 
-    // Put constant I 
-    putByte(fd, (addr+0x02), (unsigned char)(I & 0xff));
-    putByte(fd, (addr+0x03), (unsigned char)((I & 0xff00)>>8));
-
-    // Put constant D 
-    putByte(fd, (addr+0x04), (unsigned char)(D & 0xff));
-    putByte(fd, (addr+0x05), (unsigned char)((D & 0xff00)>>8));    
+    // Constants P, I and D
+    DMCC_REG_PUT(&data[0], 2, P);
+    DMCC_REG_PUT(&data[2], 2, I);
+    DMCC_REG_PUT(&data[4], 2, D);
+    return putBytes(fd, addr, data, 6);
 }
 
-void setPIDConstants(int fd, unsigned int motor, unsigned int posOrVel, 
+int setPIDConstants(int fd, unsigned int motor, unsigned int posOrVel, 
                         int P, int I, int D) 
 {
-    if (motor == 1) {
-        if (posOrVel == 0) {
-            putPIDConstants(fd, 0x30, P, I, D);
-        } else if (posOrVel == 1) {
-            putPIDConstants(fd, 0x36, P, I, D);
-        } else {
-            printf("Error: posOrVel is not given as 0 or 1\n");
-        }
-    } else if (motor == 2) {
-        if (posOrVel == 0) {
-            putPIDConstants(fd, 0x40, P, I, D);
-        } else if (posOrVel == 1) {
-            putPIDConstants(fd, 0x46, P, I, D);
-        } else {
-            printf("Error: posOrVel is not given as 0 or 1\n");
-        }
-    } else {
-        printf("Error: invalid motor number specified\n");
+    TRACE_API("setPIDConstants");
+    unsigned char reg = pidReg(motor, posOrVel);
+
+    if (reg == 0) {
+        return DMCC_EINVAL;
     }
+    return putPIDConstants(fd, reg, P, I, D);
 }
 
-void setPIDPowerLimits(int fd, unsigned int pidLimit1, unsigned int pidLimit2)
+int setPIDPowerLimits(int fd, unsigned int pidLimit1, unsigned int pidLimit2)
 {
+    TRACE_API("setPIDPowerLimits");
     if (pidLimit1 > 10000) {
         pidLimit1 = 10000;
     }
     if (pidLimit2 > 10000) {
         pidLimit2 = 10000;
     }
-    putByte(fd, (0x08), (unsigned char) (pidLimit1 & 0xff));
-    putByte(fd, (0x09), (unsigned char) ((pidLimit1 & 0xff00) >> 8));
-    
-    putByte(fd, (0x0a), (unsigned char) (pidLimit2 & 0xff));
-    putByte(fd, (0x0b), (unsigned char) ((pidLimit2 & 0xff00) >> 8));
 
+    // Older firmware has no power limit registers
+    const DMCCcaps *caps = sessionCaps(fd);
+    if (!caps->powerLimits) {
+        LOG_ERROR("PID power limits need firmware Mk.07 (cape has Mk.%02d)",
+                    caps->version);
+        return DMCC_ENOTSUP;
+    }
+
+    DMCCregs regs;
+    regs.pidLimit1 = pidLimit1;
+    regs.pidLimit2 = pidLimit2;
+    return DMCCwriteRegs(fd, DMCC_REG_PID_LIMIT1, 4, &regs);
+}
+
+// fitsConstant - checks that a PID constant fits the 16 bit signed register
+static int fitsConstant(double k)
+{
+    return (k >= -32768.5) && (k < 32767.5);
+}
+
+int autotunePID(int fd, unsigned int motor, unsigned int posOrVel,
+                    int relayPower, unsigned int samplePeriod,
+                    int *P, int *I, int *D)
+{
+    TRACE_API("autotunePID");
+    if ((motor != 1) && (motor != 2)) {
+        LOG_ERROR("invalid motor number");
+        return DMCC_EINVAL;
+    }
+    if (posOrVel > 1) {
+        LOG_ERROR("posOrVel is not given as 0 or 1");
+        return DMCC_EINVAL;
+    }
+    if ((relayPower < 1) || (relayPower > 10000)) {
+        LOG_ERROR("relay power must be between 1 and 10000");
+        return DMCC_EINVAL;
+    }
+    if (samplePeriod == 0) {
+        LOG_ERROR("sample period must be at least 1 microsecond");
+        return DMCC_EINVAL;
+    }
+
+    // Relay switches when the motor is this far past the reference
+    // (bus errors before the experiment are not the experiment's)
+    DMCCgetError(fd);
+    int hysteresis = (posOrVel == 0) ? 2 : 1;
+    int ref = (posOrVel == 0) ? (int)getQEI(fd, motor) : 0;
+
+    int up = 1;
+    int rises = 0;
+    int measured = 0;
+    int samples = 0;
+    int late = 0;
+    int maxV = ref;
+    int minV = ref;
+    double periodSum = 0.0;
+    double ampSum = 0.0;
+    unsigned long long lastRise = 0;
+
+    if ((DMCCgetError(fd) != DMCC_OK) ||
+            (setMotorPower(fd, motor, relayPower) != DMCC_OK)) {
+        return DMCC_EIO;
+    }
+
+    unsigned long long start = DMCCclock(fd);
+    unsigned long long deadline = start;
+    unsigned long long limit = start + (TUNE_TIME_LIMIT * 1000000ULL);
+
+    while (measured < TUNE_CYCLES) {
+        deadline += samplePeriod;
+        DMCCwaitUntil(fd, deadline);
+
+        int value;
+        if (posOrVel == 0) {
+            value = (int)getQEI(fd, motor);
+        } else {
+            value = getQEIVel(fd, motor);
+        }
+        unsigned long long t = DMCCclock(fd);
+        samples++;
+
+        if (DMCCgetError(fd) != DMCC_OK) {
+            setMotorPower(fd, motor, 0);
+            LOG_ERROR("bus failed during the relay experiment");
+            return DMCC_EIO;
+        }
+
+        if (t > limit) {
+            setMotorPower(fd, motor, 0);
+            LOG_ERROR("no steady oscillation within %d seconds (check "
+                        "configMotorDir/configQEIDir and relay power)",
+                        TUNE_TIME_LIMIT);
+            return DMCC_ETIMEDOUT;
+        }
+
+        // Bounded latency: a sample finishing more than half a period late
+        // has an unknown time, so drop it and restart the schedule from now
+        if (t > deadline + (samplePeriod / 2)) {
+            late++;
+            deadline = t;
+            if ((samples >= 20) && ((late * 4) > samples)) {
+                setMotorPower(fd, motor, 0);
+                LOG_ERROR("samples are late, sample period %u is too short "
+                            "for the bus", samplePeriod);
+                return DMCC_EINVAL;
+            }
+            continue;
+        }
+
+        if (value > maxV) {
+            maxV = value;
+        }
+        if (value < minV) {
+            minV = value;
+        }
+
+        if (up && (value > ref + hysteresis)) {
+            setMotorPower(fd, motor, -relayPower);
+            up = 0;
+        } else if (!up && (value < ref - hysteresis)) {
+            setMotorPower(fd, motor, relayPower);
+            up = 1;
+
+            // One full relay cycle ends at every upward switch
+            rises++;
+            if (rises > TUNE_SETTLE_CYCLES) {
+                periodSum += (double)(t - lastRise);
+                ampSum += (maxV - minV) / 2.0;
+                measured++;
+            }
+            lastRise = t;
+            maxV = value;
+            minV = value;
+        }
+    }
+    setMotorPower(fd, motor, 0);
+
+    double Tu = (periodSum / measured) / 1000000.0;
+    double a = ampSum / measured;
+    if ((Tu <= 0.0) || (a <= 0.0)) {
+        LOG_ERROR("relay oscillation could not be measured");
+        return DMCC_ERANGE;
+    }
+
+    // Ultimate gain in power per count (or per velocity unit)
+    double Ku = (4.0 * relayPower) / (M_PI * a);
+
+    // Classic Ziegler-Nichols PID
+    double Kp = 0.6 * Ku;
+    double Ki = 1.2 * Ku / Tu;
+    double Kd = 0.075 * Ku * Tu;
+
+    // Firmware form: power = -(P*e + I*sum(e) + D*de) / 256 every loop
+    // A constant clamped to the register would not be the tuning that was
+    // measured, so nothing is set if one does not fit
+    double tick = PID_TICK_US / 1000000.0;
+    double kP = -256.0 * Kp;
+    double kI = -256.0 * Ki * tick;
+    double kD = -256.0 * Kd / tick;
+    if (!fitsConstant(kP) || !fitsConstant(kI) || !fitsConstant(kD)) {
+        LOG_ERROR("PID constants P = %.0f, I = %.0f, D = %.0f do not fit "
+                    "the registers (-32768 to 32767)", kP, kI, kD);
+        return DMCC_ERANGE;
+    }
+    *P = (int)lround(kP);
+    *I = (int)lround(kI);
+    *D = (int)lround(kD);
+
+    if (setPIDConstants(fd, motor, posOrVel, *P, *I, *D) != DMCC_OK) {
+        return DMCC_EIO;
+    }
+    return DMCC_OK;
 }
@@ -25,19 +25,451 @@
 #ifndef DMCC
 #define DMCC
 
+#include "DMCCregs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// --------------------------
+// Status codes - returned by the functions below that do not return a
+// register value (those return 0 on an error, see DMCCgetError)
+// --------------------------
+// (DMCC_ETIMEDOUT is -1 because the move functions have always returned
+//  -1 when the target is not reached in time)
+#define DMCC_OK 0               // success
+#define DMCC_ETIMEDOUT -1       // the time limit passed before the target
+#define DMCC_EIO -2             // bus transfer failed (retries used up)
+#define DMCC_ENOTSUP -3         // the firmware of the cape cannot do it
+#define DMCC_ERANGE -4          // a result does not fit its register
+#define DMCC_EINVAL -5          // invalid argument (motor number, range, ...)
+
 // --------------------------
 // Session functions - to start and end the user program
 // --------------------------
 
 // DMCCstart - Begins the session by connecting to the given board
-//             Prints an error if connection fails
+//             (through dmccd when DMCC_SOCKET is set, see DMCCclient.h)
+//             If the connection fails it prints an error on stderr (at
+//             any log level) and EXITS the program with status 1; use
+//             DMCCopen to handle the failure instead (libraries, bindings)
 // Parameters: capeAddr - address of motor controller board specified [0-3]
 // Returns: connection to the board (session number)
 int DMCCstart(unsigned char capeAddr);
 
-// DMCCend - Ends the given session/connection to the board
+// DMCCopen - Same as DMCCstart, but returns an error instead of exiting
+//            Logs an error if connection fails
+// Parameters: capeAddr - address of motor controller board specified [0-3]
+// Returns: connection to the board (session number)
+//          -1 - if an error occurs
+int DMCCopen(unsigned char capeAddr);
+
+// DMCCstartBus - Begins a session on a cape on any i2c bus (DMCCenumerate
+//                in DMCCprobe.h finds the capes on all buses)
+//                Logs an error if connection fails
+// Parameters: bus - i2c adapter number (/dev/i2c-<bus>)
+//             capeAddr - address of motor controller board specified [0-3]
+// Returns: connection to the board (session number)
+//          -1 - if an error occurs
+int DMCCstartBus(int bus, unsigned char capeAddr);
+
+// DMCCend - Ends the given session/connection to the board (queued writes
+//           are sent first, see DMCCflush)
 // Parameters: session - connection to board (value returned from DMCC start)
-void DMCCend(int session);
+// Returns: DMCC_EINVAL - if the session is not open
+//          DMCC_EIO - if a queued write failed (the session is ended)
+//          DMCC_OK - otherwise
+int DMCCend(int session);
+
+// DMCCemergencyStopAll - Sets the power of both motors of every open session
+//                        to zero (same as setAllMotorPower(fd, 0, 0)).
+//                        Safe to call from a signal handler: the stops are
+//                        encoded when the sessions start, and sessions on
+//                        i2c-dev only use write() (a session with a
+//                        transport is as safe as its stop, or write,
+//                        callback; sessions through dmccd send the stop
+//                        without waiting for an answer).
+//                        Logs nothing and never exits.
+// Returns: number of sessions stopped (a session whose write fails is
+//          skipped, its command is not sent)
+int DMCCemergencyStopAll(void);
+
+// --------------------------
+// Transport functions - to run a session over something other than i2c-dev
+// --------------------------
+
+// DMCCtransport - replacement for the write()/read() calls on a session.
+//                 Both callbacks follow i2c-dev semantics: the first byte
+//                 of a write is the register address (remaining bytes are
+//                 written from there with auto-increment), a read returns
+//                 bytes starting at the last register address written.
+//                 Both return the number of bytes transferred.
+//                 now/sleep give the session its own clock (in
+//                 microseconds), leave them NULL to use the system clock.
+//                 reopen is called after repeated failures to reset the
+//                 link (like reopening the adapter) and returns 0 if it
+//                 worked; leave it NULL if there is nothing to reset.
+//                 A transport may queue writes and send them later: flush
+//                 sends what is queued and returns -1 if a write sent
+//                 since the last flush failed, 0 otherwise (it is called
+//                 after every read, by DMCCflush, DMCCwaitUntil and
+//                 DMCCend); leave it NULL if writes are not queued.
+//                 stop is used instead of write by DMCCemergencyStopAll,
+//                 from a signal handler: it must only make
+//                 async-signal-safe calls and must not wait for an
+//                 answer; leave it NULL to use write.
+typedef struct DMCCtransport {
+    int (*write)(void *ctx, const unsigned char *buf, int len);
+    int (*read)(void *ctx, unsigned char *buf, int len);
+    unsigned long long (*now)(void *ctx);
+    void (*sleep)(void *ctx, unsigned int microseconds);
+    int (*reopen)(void *ctx);
+    int (*flush)(void *ctx);
+    int (*stop)(void *ctx, const unsigned char *buf, int len);
+    void *ctx;
+} DMCCtransport;
+
+// DMCCattachTransport - Routes all bus traffic of a session through the
+//                       given transport instead of the file descriptor
+//                       (the transport is copied, DMCCend detaches it)
+// Parameters: session - connection to the board (any open file descriptor)
+//             transport - callbacks to use, NULL to detach
+// Returns: -1 - if the session cannot take a transport
+//           0 - otherwise
+int DMCCattachTransport(int session, const DMCCtransport *transport);
+
+// DMCCbusOpener - opens a session on a cape (bus, board number [0-3]) and
+//                 returns it, or -1 if there is nothing to open
+typedef int (*DMCCbusOpener)(int bus, unsigned char capeAddr);
+
+// DMCCsetBusOpener - Replaces how DMCCstart and DMCCstartBus open capes,
+//                    e.g. with simulated capes that have a transport
+//                    attached (NULL goes back to /dev/i2c-<bus>)
+// Parameters: opener - function that opens a session
+void DMCCsetBusOpener(DMCCbusOpener opener);
+
+// DMCCflush - Sends the writes the transport of a session has queued
+//             (sessions through dmccd queue writes until the next read)
+//             Logs an error if a queued write failed
+// Parameters: session - connection to the board (value returned from DMCCstart)
+// Returns: DMCC_EINVAL - if the session is invalid
+//          DMCC_EIO - if a write sent since the last flush failed
+//          DMCC_OK - otherwise (always, if the transport does not queue)
+int DMCCflush(int session);
+
+// DMCCclock - Gets the time on the clock of the session
+// Parameters: session - connection to the board (value returned from DMCCstart)
+// Returns: time in microseconds (only differences are meaningful)
+unsigned long long DMCCclock(int session);
+
+// DMCCwaitUntil - Waits until the clock of the session reaches a given time
+//                 (queued writes are sent first, see DMCCflush)
+//                 Returns at once if that time has already passed
+// Parameters: session - connection to the board (value returned from DMCCstart)
+//             deadline - time in microseconds (from DMCCclock)
+void DMCCwaitUntil(int session, unsigned long long deadline);
+
+// --------------------------
+// Retry functions - a bus transaction that fails (NAK, timeout) is repeated
+// until it works or the retry budget of the session is used up; then the
+// function returns DMCC_EIO and the program carries on
+// --------------------------
+
+#define DMCC_RETRY_BUDGET_US 20000  // default time to keep retrying
+#define DMCC_RETRY_BACKOFF_US 200   // default wait before each retry
+#define DMCC_RETRY_REOPEN 2         // default failures in a row before the
+                                    // adapter is reopened
+
+// DMCCretry - how a session retries.  A transaction gives up budgetUs
+//             after its first failure (plus the time of its last try, so
+//             keep the adapter timeout short: the I2C_TIMEOUT ioctl, in
+//             10ms units).  Failures in a row are counted across
+//             transactions, so a hung adapter is reopened even when each
+//             try takes the whole budget.
+typedef struct DMCCretry {
+    unsigned int budgetUs;      // time to keep retrying (0 - never retry)
+    unsigned int backoffUs;     // wait before each retry
+    unsigned int reopenAfter;   // failures in a row before the adapter is
+                                // reopened (0 - never reopen)
+} DMCCretry;
+
+// DMCCretryStats - retry counters of a session (always kept)
+typedef struct DMCCretryStats {
+    unsigned long long failures;    // tries that failed
+    unsigned long long retries;     // tries after a failure
+    unsigned long long recovered;   // transactions that worked on a retry
+    unsigned long long reopens;     // times the adapter was reopened
+    unsigned long long errors;      // transactions given up (DMCC_EIO)
+    unsigned long long maxRetryUs;  // longest time one transaction retried
+} DMCCretryStats;
+
+// DMCCsetRetry - Sets how a session retries failed transactions
+// Parameters: session - connection to the board (value returned from DMCCstart)
+//             retry - settings to use, NULL for the defaults
+// Returns: DMCC_EINVAL - if the session is invalid
+//          DMCC_OK - otherwise
+int DMCCsetRetry(int session, const DMCCretry *retry);
+
+// DMCCgetRetryStats - Gets the retry counters of a session
+//                     (DMCCresetStats and DMCCend clear them)
+// Parameters: session - connection to the board (value returned from DMCCstart)
+//             stats - where to put the counters
+// Returns: DMCC_EINVAL - if the session is invalid
+//          DMCC_OK - otherwise
+int DMCCgetRetryStats(int session, DMCCretryStats *stats);
+
+// DMCCgetError - Gets and clears the first error of a session since the
+//                last call: failed transfers of any function, and invalid
+//                arguments of the functions that return a register value
+// Parameters: session - connection to the board (value returned from DMCCstart)
+// Returns: DMCC_OK if there was no error, otherwise a DMCC_E* code
+int DMCCgetError(int session);
+
+// Motor modes (DMCCcommandState.mode)
+#define DMCC_MODE_POWER 0       // power set directly (commands 0x01 - 0x03)
+#define DMCC_MODE_POS 1         // position PID (commands 0x11 - 0x13)
+#define DMCC_MODE_VEL 2         // velocity PID (commands 0x21 - 0x23)
+
+// DMCCcommandState - motor commands a session has sent to register 0xff
+typedef struct DMCCcommandState {
+    unsigned int count;         // motor commands sent since DMCCstart
+    unsigned char mode[2];      // DMCC_MODE_* of motor 1 and 2
+} DMCCcommandState;
+
+// DMCCgetCommandState - Gets the motor commands a session has sent, e.g.
+//                       to sample faster as soon as a motor is commanded
+//                       (cheap, no bus traffic)
+// Parameters: session - connection to the board (value returned from DMCCstart)
+//             state - where to put the state
+// Returns: -1 - if the session is invalid
+//           0 - otherwise
+int DMCCgetCommandState(int session, DMCCcommandState *state);
+
+// --------------------------
+// Capability functions - what the firmware of the cape supports
+// (found from the ID at register 0xe0 when the session starts; every
+//  function below uses the fastest transfers the firmware supports)
+// --------------------------
+
+// DMCCcaps - what the firmware of a cape can do
+typedef struct DMCCcaps {
+    int version;                    // firmware version ("DMCC Mk.07" is 7),
+                                    // 0 if the ID could not be read
+    unsigned char autoIncrement;    // several registers per transfer
+    unsigned char maxBurst;         // most data bytes in one transfer
+    unsigned char powerLimits;      // PID power limits (setPIDPowerLimits)
+} DMCCcaps;
+
+// DMCCgetCaps - Gets the capabilities of the cape behind a session
+// Parameters: session - connection to the board (value returned from DMCCstart)
+//             caps - where to put the capabilities
+// Returns: -1 - if the session is invalid
+//           0 - otherwise
+int DMCCgetCaps(int session, DMCCcaps *caps);
+
+// DMCCgetID - Gets the ID string the cape gave at register 0xe0 (as read,
+//             even if it is not a firmware version the library knows)
+// Parameters: session - connection to the board (value returned from DMCCstart)
+//             id - where to put the ID (NUL terminated, empty if the ID
+//                  could not be read)
+//             len - size of id (DMCC_ID_LEN + 1 holds all of it)
+// Returns: -1 - if the session is invalid
+//           0 - otherwise
+int DMCCgetID(int session, char *id, int len);
+
+// --------------------------
+// Statistics functions - bus counters and latency histograms per session
+// (only collected when the library is compiled with -DDMCC_STATS, otherwise
+//  they cost nothing and DMCCgetStats returns -1)
+// --------------------------
+
+// Operation types with a latency histogram
+#define DMCC_OP_PUT 0           // register write (putByte)
+#define DMCC_OP_GET 1           // register read (getByte)
+#define DMCC_OP_COUNT 2
+
+// Latency histogram bucket n counts operations that took
+// 2^n to 2^(n+1)-1 nanoseconds (bucket 0 also counts 0 ns)
+#define DMCC_LATENCY_BUCKETS 32
+
+// DMCCstats - what a session has done on the bus
+typedef struct DMCCstats {
+    unsigned long long transactions;    // write()/read() calls on the bus
+    unsigned long long bytes;           // bytes moved (including addresses)
+    unsigned long long errors;          // transactions that came up short
+    unsigned long long retries;         // transactions that were repeated
+    unsigned long long latency[DMCC_OP_COUNT][DMCC_LATENCY_BUCKETS];
+} DMCCstats;
+
+// DMCCgetStats - Takes a snapshot of the statistics of a session
+// Parameters: session - connection to the board (value returned from DMCCstart)
+//             stats - where to put the snapshot
+// Returns: -1 - if statistics are not compiled in or the session is invalid
+//           0 - otherwise
+int DMCCgetStats(int session, DMCCstats *stats);
+
+// DMCCresetStats - Clears the statistics and retry counters of a session
+//                  (DMCCend does too)
+// Parameters: session - connection to the board (value returned from DMCCstart)
+void DMCCresetStats(int session);
+
+// --------------------------
+// Trace functions - records every bus transaction with the function that
+// made it, and writes a Chrome trace (chrome://tracing, Perfetto)
+// (only available when the library is compiled with -DDMCC_TRACE; setting
+//  the DMCC_TRACE_FILE environment variable traces the whole program)
+// --------------------------
+
+#define DMCC_TRACE_THREADS 8     // threads that can be traced at once
+
+// DMCCtraceStart - Starts (or restarts) recording
+//                  Up to DMCC_TRACE_THREADS live threads that call the
+//                  library each keep their most recent events (the buffers
+//                  are allocated here, so recording never allocates; the
+//                  buffer of a thread that exits goes to the next new one)
+// Parameters: eventsPerThread - events each thread keeps
+// Returns: -1 - if tracing is not compiled in or the buffers cannot be
+//               allocated
+//           0 - otherwise
+int DMCCtraceStart(unsigned int eventsPerThread);
+
+// DMCCtraceStop - Stops recording (the events are kept)
+void DMCCtraceStop(void);
+
+// DMCCtraceWrite - Writes the recorded events as a Chrome trace JSON file
+// Parameters: path - file to write
+// Returns: -1 - if tracing is not compiled in or the file cannot be written
+//           0 - otherwise
+int DMCCtraceWrite(const char *path);
+
+// --------------------------
+// Log functions - what the library has to say (errors, progress of the
+// moves) goes to a sink on a thread of its own, so logging never blocks
+// on a terminal or a file.  Nothing is logged unless a level is set here
+// or in the DMCC_LOG_LEVEL environment variable (error, warn, info, debug).
+// Build with -DDMCC_LOG_MAX=<level> to compile out the more detailed ones.
+// --------------------------
+
+// Log levels
+#define DMCC_LOG_OFF 0
+#define DMCC_LOG_ERROR 1
+#define DMCC_LOG_WARN 2
+#define DMCC_LOG_INFO 3
+#define DMCC_LOG_DEBUG 4
+
+// DMCClogSink - called on the log thread with each message, in order
+//               (must not call the library)
+// Parameters: level - DMCC_LOG_*
+//             message - text of the message (no newline)
+//             ctx - ctx given to DMCCsetLogSink
+typedef void (*DMCClogSink)(int level, const char *message, void *ctx);
+
+// DMCCsetLogLevel - Sets the most detailed level logged
+//                   (starts the log thread the first time)
+// Parameters: level - DMCC_LOG_* (DMCC_LOG_OFF for nothing)
+// Returns: DMCC_EINVAL - if the level is not a DMCC_LOG_* level
+//          DMCC_EIO - if the log thread cannot be started
+//          DMCC_OK - otherwise
+int DMCCsetLogLevel(int level);
+
+// DMCCsetLogSink - Sets where messages go (after the ones already logged)
+// Parameters: sink - function to call, NULL to write them to stderr
+//             ctx - passed to sink
+void DMCCsetLogSink(DMCClogSink sink, void *ctx);
+
+// DMCClogFlush - Waits until every message logged so far has been passed
+//                to the sink (done at exit too)
+void DMCClogFlush(void);
+
+// DMCClogDropped - Number of messages lost because the sink fell behind
+//                  (the ring holds 256 messages of up to 119 characters)
+unsigned long long DMCClogDropped(void);
+
+// --------------------------
+// Register functions - raw access to the cape registers
+// (the functions below are built on these; use them for registers that
+//  have no function of their own, or to read several values after one
+//  status update command)
+// --------------------------
+
+// putByte - Writes the data byte at the given address
+// Parameters: fd - connection to the board (value returned from DMCCstart)
+//             addr - register address
+//             data - value to write
+// Returns: DMCC_EIO - if the write fails
+//          DMCC_OK - otherwise
+int putByte(int fd, unsigned char addr, unsigned char data);
+
+// getByte - Reads the data byte at the given address
+// Parameters: fd - connection to the board (value returned from DMCCstart)
+//             addr - register address
+// Returns: register value
+//          0 - if the read fails (DMCCgetError tells)
+unsigned char getByte(int fd, unsigned char addr);
+
+// getWord - Reads the little endian word (2 bytes) at the given address
+// Parameters: fd - connection to the board (value returned from DMCCstart)
+//             addr - register address of the low byte
+// Returns: register value (unsigned)
+//          0 - if the read fails (DMCCgetError tells)
+unsigned int getWord(int fd, unsigned char addr);
+
+// getDWord - Reads the little endian double word (4 bytes) at the given
+//            address
+// Parameters: fd - connection to the board (value returned from DMCCstart)
+//             addr - register address of the low byte
+// Returns: register value (unsigned)
+//          0 - if the read fails (DMCCgetError tells)
+unsigned int getDWord(int fd, unsigned char addr);
+
+// putBytes - Writes consecutive registers
+// Parameters: fd - connection to the board (value returned from DMCCstart)
+//             addr - register address of the first byte
+//             data - values to write
+//             num - number of bytes
+// Returns: DMCC_EIO - if a write fails (the bytes after it are not written)
+//          DMCC_OK - otherwise
+int putBytes(int fd, unsigned char addr, const unsigned char *data, int num);
+
+// getBytes - Reads consecutive registers
+// Parameters: fd - connection to the board (value returned from DMCCstart)
+//             addr - register address of the first byte
+//             data - where to put the values
+//             num - number of bytes
+// Returns: DMCC_EIO - if a read fails (data is all zero)
+//          DMCC_OK - otherwise
+int getBytes(int fd, unsigned char addr, unsigned char *data, int num);
+
+// DMCCreadRegs - Reads a span of registers (as getBytes does) and decodes
+//                every register of DMCCregs.h that lies wholly inside it
+// Parameters: fd - connection to the board (value returned from DMCCstart)
+//             first - register address of the first byte
+//             num - number of bytes
+//             regs - fields to set (fields of other registers are left
+//                    alone; they are 0 if the read fails)
+// Returns: DMCC_EINVAL - if the span runs past register 0xff
+//          DMCC_EIO - if a read fails
+//          DMCC_OK - otherwise
+int DMCCreadRegs(int fd, unsigned char first, int num, DMCCregs *regs);
+
+// DMCCwriteRegs - Encodes and writes the registers of DMCCregs.h that lie
+//                 wholly inside a span, one putBytes per run of registers
+//                 (bytes between registers are not written)
+// Parameters: fd - connection to the board (value returned from DMCCstart)
+//             first - register address of the first byte
+//             num - number of bytes
+//             regs - values to write
+// Returns: DMCC_EINVAL - if the span runs past register 0xff
+//          DMCC_EIO - if a write fails
+//          DMCC_OK - otherwise
+int DMCCwriteRegs(int fd, unsigned char first, int num, const DMCCregs *regs);
+
+// DMCCreadStatus - Sends the status update command, then DMCCreadRegs
+//                  (e.g. DMCC_REG_QEI1, 16 for the encoders, velocities
+//                  and currents of both motors in one read)
+// Parameters: same as DMCCreadRegs
+// Returns: same as DMCCreadRegs
+int DMCCreadStatus(int fd, unsigned char first, int num, DMCCregs *regs);
 
 // ---------------------------
 // Cape Functions - to determine software updates and connected boards
@@ -51,7 +483,8 @@ void DMCCend(int session);
 int getVersionNumber(unsigned char capeAddr);
 
 // checkVersion - checks that the version of the cape matches the software
-//                version
+//                version (capes on the bus are probed once per boot and
+//                the result is cached, see DMCCprobe.h)
 // Parameter: fd - connection to the board (value returned from DMCCstart)
 //            capeAddr - address of desired cape to check version number [0-3]
 // Returns: -1 - if the software and hardware versions do not match
@@ -63,147 +496,254 @@ int checkVersion(int fd, unsigned char capeAddr);
 // --------------------------
 
 // getQEI - Gets the QEI for the desired motor
-//          Prints an error if QEI for motor is not received
+//          Logs an error if QEI for motor is not received
 // Parameters: fd - connection to the board (value returned from DMCCstart)
 //             motor - motor number desired
 // Returns: QEI for given motor
-//          always returns 0 if an error occurs
+//          always returns 0 if an error occurs (see DMCCgetError)
 unsigned int getQEI(int fd, unsigned int motor);
 
 // getQEIVel - Gets the QEI velocity for the desired motor
-//             Prints an error if QEI velocity for motor is not received
+//             Logs an error if QEI velocity for motor is not received
 // Parameters: fd - connection to the board (value returned from DMCC start)
 //             motor - motor number desired
 // Returns: QEI velocity for given motor
-//          always returns 0 if an error occurs
+//          always returns 0 if an error occurs (see DMCCgetError)
 int getQEIVel(int fd, unsigned int motor);
 
 // getQEIDir - Gets the QEI direction for the desired motor
-//             Prints an error if the QEI dir is not received
+//             Logs an error if the QEI dir is not received
 // Parameters: fd - connection to the board (value returned from DMCC start)
 //             motor - motor number desired
 // Returns: 1 if the QEI is in reverse
 //          0 if the QEI is in forward
-//          always returns -1 if an error occurs
+//          a negative DMCC_E* code if an error occurs
 int getQEIDir(int fd, unsigned int motor);
 
 // reverseQEIDir - Sets the QEI direction for the desired motor
-//             Prints an error if the QEI dir is not received
+//             Logs an error if the QEI dir is not received
 // Parameters: fd - connection to the board (value returned from DMCC start)
 //             motor - motor number desired
 //             dir -  1 if the QEI is in reverse
 //                    0 if the QEI is in forward
-void configQEIDir(int fd, unsigned int motor, int dir);
+// Returns: DMCC_EINVAL - if an argument is invalid
+//          DMCC_EIO - if the bus transfer fails
+//          DMCC_OK - otherwise
+int configQEIDir(int fd, unsigned int motor, int dir);
 
 // resetQEI - Resets the QEI for the desired motor to 0
-//            Prints an error if QEI was not reset
+//            Logs an error if QEI was not reset
 // Parameters: fd - connection to the board (value returned from DMCCstart)
 //             motor - motor number desired
-void resetQEI(int fd, unsigned int motor);
+// Returns: DMCC_EINVAL - if an argument is invalid
+//          DMCC_EIO - if the bus transfer fails
+//          DMCC_OK - otherwise
+int resetQEI(int fd, unsigned int motor);
 
 // resetAllQEI - Resets the QEI for all motors
 // Parameters: fd - connection to the board (value returned from DMCCstart)
-void resetAllQEI(int fd);
+// Returns: DMCC_EIO - if the bus transfer fails
+//          DMCC_OK - otherwise
+int resetAllQEI(int fd);
 
 // --------------------------
 // Motor functions
 // --------------------------
 
 // getMotorCurrent - Gets the current for the desired motor
-//                   Prints an error if the current for the 
+//                   Logs an error if the current for the 
 //                      motor is not received
 // Parameters: fd - connection to the board (value returned from DMCCstart)
 //             motor - motor number desired
 // Returns: Current for given motor
-//          always returns 0 if an error occurs
+//          always returns 0 if an error occurs (see DMCCgetError)
 unsigned int getMotorCurrent(int fd, unsigned int motor);
 
 // getMotorVoltage - Gets the motor supply voltage for all motors
 // Parameters: fd - connection to the board (value returned from DMCCstart)
 //             motor - motor number desired
 // Returns: Motor supply voltage
+//          0 if an error occurs (see DMCCgetError)
 unsigned int getMotorVoltage(int fd);
 
 // getTargetPos - Gets the target position for the desired motor
-//                Prints an error if the target position for the
+//                Logs an error if the target position for the
 //                      motor is not received
 // Parameters: fd - connection to the board (value returned from DMCCstart)
 //             motor - motor number desired
 // Returns: Target position for given motor
-//          always returns 0 if an error occurs
+//          always returns 0 if an error occurs (see DMCCgetError)
 unsigned int getTargetPos(int fd, unsigned int motor);
 
 // setTargetPos - Sets the target position for the desired motor
-//                Prints an error if there is a problem
+//                Logs an error if there is a problem
 //                  communicating to motor
 // Parameters: fd - connection to the board (value returned from DMCCstart)
 //             motor - motor number desired
 //             pos - motor position
-void setTargetPos(int fd, unsigned int motor, int pos);
+// Returns: DMCC_EINVAL - if an argument is invalid
+//          DMCC_EIO - if the bus transfer fails
+//          DMCC_OK - otherwise
+int setTargetPos(int fd, unsigned int motor, int pos);
 
 // setAllTargetPos - Sets the target position for both motors
-//                Prints an error if there is a problem
+//                Logs an error if there is a problem
 //                  communicating to motor
 // Parameters: fd - connection to the board (value returned from DMCCstart)
 //             pos1 - motor 1 position
 //             pos2 - motor 2 position
-void setAllTargetPos(int fd, int pos1, int pos2);
+// Returns: DMCC_EIO - if the bus transfer fails
+//          DMCC_OK - otherwise
+int setAllTargetPos(int fd, int pos1, int pos2);
 
 // getTargetVel - Gets the target velocity for the desired motor
-//                Prints an error if the target velocity for the
+//                Logs an error if the target velocity for the
 //                      motor is not received
 // Parameters: fd - connection to the board (value returned from DMCCstart)
 //             motor - motor number desired
 // Returns: Target velocity for given motor
-//          always returns 0 if an error occurs
+//          always returns 0 if an error occurs (see DMCCgetError)
 int getTargetVel(int fd, unsigned int motor);
 
 // setTargetVel - Sets the target velocity for the desired motor
-//                Prints an error if there is a problem
+//                Logs an error if there is a problem
 //                  communicating to motor
 // Parameters: fd - connection to the board (value returned from DMCCstart)
 //             motor - motor number desired
 //             velocity - motor velocity
-void setTargetVel(int fd, unsigned int motor, int vel);
+// Returns: DMCC_EINVAL - if an argument is invalid
+//          DMCC_EIO - if the bus transfer fails
+//          DMCC_OK - otherwise
+int setTargetVel(int fd, unsigned int motor, int vel);
 
 // setAllTargetVel - Sets the target velocity for both motors
-//                Prints an error if there is a problem
+//                Logs an error if there is a problem
 //                  communicating to motor
 // Parameters: fd - connection to the board (value returned from DMCCstart)
 //             vel1 - motor 1 velocity
 //             vel2 - motor 2 velocity
-void setAllTargetVel(int fd, int vel1, int vel2);
+// Returns: DMCC_EIO - if the bus transfer fails
+//          DMCC_OK - otherwise
+int setAllTargetVel(int fd, int vel1, int vel2);
 
 // getMotorDir - Gets the direction for the desired motor
-//               Prints an error if the motor dir is not received
+//               Logs an error if the motor dir is not received
 // Parameters: fd - connection to the board (value returned from DMCCstart)
 //             motor - motor number desired
 // Returns: 1 if the motor is in reverse
 //          0 if the motor is in forward
-//          always returns -1 if an error occurs
+//          a negative DMCC_E* code if an error occurs
 int getMotorDir(int fd, unsigned int motor);
 
 // setMotorPower - Sets power for the desired motor 
-//                 Prints an error if there is a problem 
+//                 Logs an error if there is a problem 
 //                      communicating to the motor
 // Parameters: fd - connection to the board (value returned from DMCCstart)
 //             motor - motor number desired
 //             pwm - power level (ranges from -10000 to 10000)
-void setMotorPower(int fd, unsigned int motor, int pwm);
+// Returns: DMCC_EINVAL - if an argument is invalid
+//          DMCC_EIO - if the bus transfer fails
+//          DMCC_OK - otherwise
+int setMotorPower(int fd, unsigned int motor, int pwm);
 
 // setAllMotorPower - Sets the power for all motors
 // Parameters: fd - connection to the board (value returned from DMCCstart)
 //             pwm1 - power level for motor 1 (ranges from -10000 to 10000)
 //             pwm2 - power level for motor 2 (ranges from -10000 to 10000)
-void setAllMotorPower(int fd, int pwm1, int pwm2);
+// Returns: DMCC_EINVAL - if an argument is invalid
+//          DMCC_EIO - if the bus transfer fails
+//          DMCC_OK - otherwise
+int setAllMotorPower(int fd, int pwm1, int pwm2);
 
 // setMotorDir - Sets the direction for the desired motor
-//               Prints an error if there is a problem
+//               Logs an error if there is a problem
 //                  communicating to the motor
 // Parameters: fd - connection to the board (value returned from DMCCstart)
 //             motor - motor number desired
 //             dir - direction (1 is reverse the dir, 0 is keep the dir)
-void configMotorDir(int fd, unsigned int motor, int dir);
+// Returns: DMCC_EINVAL - if an argument is invalid
+//          DMCC_EIO - if the bus transfer fails
+//          DMCC_OK - otherwise
+int configMotorDir(int fd, unsigned int motor, int dir);
+
+// --------------------------
+// Prepared command functions - commands encoded once, then sent with one
+// call (e.g. an all stop, or PID constants to switch gains)
+// --------------------------
+
+#define DMCC_PREPARED_TRANSFERS 10  // enough for 8 bytes without auto-increment
+#define DMCC_PREPARED_BYTES 48
+#define DMCC_PREPARED_FIELDS 3
+
+// DMCCprepared - bus transfers of a command, ready to be written.  The
+//                transfers follow the firmware of the session the command
+//                was prepared on, so send it on that session (or one with
+//                the same DMCCcaps).
+typedef struct DMCCprepared {
+    unsigned char bytes[DMCC_PREPARED_BYTES];       // transfers back to back
+    unsigned char length[DMCC_PREPARED_TRANSFERS];  // bytes in each transfer
+    int numTransfers;
+    int numFields;                                  // values that can change
+    unsigned char fieldSize[DMCC_PREPARED_FIELDS];  // 2 or 4 bytes
+    unsigned char fieldByte[DMCC_PREPARED_FIELDS][4];   // where in bytes
+    int fieldMin[DMCC_PREPARED_FIELDS];
+    int fieldMax[DMCC_PREPARED_FIELDS];
+} DMCCprepared;
+
+// DMCCpreparePower - Prepares setAllMotorPower
+//                    Logs an error if the power is out of range
+// Parameters: fd - connection to the board (value returned from DMCCstart)
+//             cmd - where to put the command (fields: 0 - pwm1, 1 - pwm2)
+//             pwm1, pwm2 - power of motor 1 and 2 [-10000 - 10000]
+// Returns: -1 - if an error occurs
+//           0 - otherwise
+int DMCCpreparePower(int fd, DMCCprepared *cmd, int pwm1, int pwm2);
+
+// DMCCprepareTargetPos - Prepares setAllTargetPos
+// Parameters: fd - connection to the board (value returned from DMCCstart)
+//             cmd - where to put the command (fields: 0 - pos1, 1 - pos2)
+//             pos1, pos2 - target position of motor 1 and 2
+// Returns: -1 - if an error occurs
+//           0 - otherwise
+int DMCCprepareTargetPos(int fd, DMCCprepared *cmd, int pos1, int pos2);
+
+// DMCCprepareTargetVel - Prepares setAllTargetVel
+//                        Logs an error if the velocity is out of range
+// Parameters: fd - connection to the board (value returned from DMCCstart)
+//             cmd - where to put the command (fields: 0 - vel1, 1 - vel2)
+//             vel1, vel2 - target velocity of motor 1 and 2 (16 bit)
+// Returns: -1 - if an error occurs
+//           0 - otherwise
+int DMCCprepareTargetVel(int fd, DMCCprepared *cmd, int vel1, int vel2);
+
+// DMCCpreparePIDConstants - Prepares setPIDConstants
+//                           Logs an error if an argument is invalid
+// Parameters: fd - connection to the board (value returned from DMCCstart)
+//             cmd - where to put the command (fields: 0 - P, 1 - I, 2 - D)
+//             motor - motor number desired
+//             posOrVel - 0 for position, 1 for velocity
+//             P, I, D - constants (16 bit)
+// Returns: -1 - if an error occurs
+//           0 - otherwise
+int DMCCpreparePIDConstants(int fd, DMCCprepared *cmd, unsigned int motor,
+                            unsigned int posOrVel, int P, int I, int D);
+
+// DMCCpatchPrepared - Changes one value of a prepared command
+//                     Logs an error if the field or value is invalid
+// Parameters: cmd - command from a DMCCprepare function
+//             field - which value (see the DMCCprepare function)
+//             value - new value
+// Returns: -1 - if an error occurs (the command is unchanged)
+//           0 - otherwise
+int DMCCpatchPrepared(DMCCprepared *cmd, int field, int value);
+
+// DMCCsendPrepared - Writes a prepared command to the cape
+//                    Logs an error if a transfer fails
+// Parameters: fd - connection to the board (value returned from DMCCstart)
+//             cmd - command from a DMCCprepare function
+// Returns: DMCC_EIO - if a transfer fails
+//          DMCC_OK - otherwise
+int DMCCsendPrepared(int fd, const DMCCprepared *cmd);
 
 // --------------------------
 // Wait functions
@@ -214,76 +754,96 @@ void configMotorDir(int fd, unsigned int motor, int dir);
 void DMCCwait(unsigned int microseconds);
 
 // waitSec - Creates a delay in the program for a given number of seconds
-//           Prints an error if the user asks for more than 2147 seconds
+//           Logs an error if the user asks for more than 2147 seconds
 // Parameters: seconds - number of seconds to wait for
-void DMCCwaitSec(unsigned int seconds);
+// Returns: DMCC_EINVAL - if the wait is too long (nothing is waited)
+//          DMCC_OK - otherwise
+int DMCCwaitSec(unsigned int seconds);
 
 // --------------------------
 // Move functions
 // --------------------------
 
 // moveUntilPos - Powers on a motor until it has reached the desired position
-//                Prints an error if there is a problem 
+//                Logs an error if there is a problem 
 //                      communicating with the motor
 // Parameters: fd - connection to the board (value returned from DMCCstart)
 //             motor - motor number desired
 //             pos - desired position for motor
 //             tLimit - time limit in seconds (maximum of 2147 seconds)
-// Return: -1 - if the position is not reached within the time limit allowed
-//          0 - otherwise
+// Return: DMCC_EINVAL - if an argument is invalid
+//          DMCC_ETIMEDOUT - if the target is not reached within the time
+//                           limit allowed
+//          DMCC_EIO - if the bus transfer fails
+//          DMCC_OK - otherwise
 int moveUntilPos(int fd, unsigned int motor, int pos, unsigned int tLimit);
 
 // moveUntilTime - Powers on a motor for a given time period
-//                Prints an error if there is a problem
+//                Logs an error if there is a problem
 //                      communicating with the motor
 // Parameters: fd - connection to the board (value returned from DMCCstart)
 //             time - desired wait time in microseconds
 //             motor - motor number desired
 //             pwm - power level for motor (ranges from -10000 to 10000)
-void moveUntilTime(int fd, unsigned int motor, int pwm, unsigned int time);
+// Returns: DMCC_EINVAL - if an argument is invalid
+//          DMCC_EIO - if the bus transfer fails
+//          DMCC_OK - otherwise
+int moveUntilTime(int fd, unsigned int motor, int pwm, unsigned int time);
 
 // moveUntilVel - Powers on a motor until it has reached the desired velocity
-//                Prints an error if there is a problem
+//                Logs an error if there is a problem
 //                      communicating with the motor
 // Parameters: fd - connection to the board (value returned from DMCCstart)
 //             motor - motor number desired
 //             vel - desired velocity for motor
 //             tLimit - time limit in seconds (maximum of 2147 seconds)
-// Return: -1 - if the position is not reached within the time limit allowed
-//          0 - otherwise
+// Return: DMCC_EINVAL - if an argument is invalid
+//          DMCC_ETIMEDOUT - if the target is not reached within the time
+//                           limit allowed
+//          DMCC_EIO - if the bus transfer fails
+//          DMCC_OK - otherwise
 int moveUntilVel(int fd, unsigned int motor, int vel, unsigned tLimit);
 
 // moveAllUntilPos - Power on both motors until they have both reached
 //                      the desired position
-//                   Prints an error if there is a problem
+//                   Logs an error if there is a problem
 //                      communicating with the motor
 // Parameters: fd - connection to the board (value returned from DMCCstart)
 //             pos1 - desired position for motor1
 //             pos2 - desired position for motor2
 //             tLimit - time limit in seconds (maximum of 2147 seconds)
-// Return: -1 - if the position is not reached within the time limit allowed
-//          0 - otherwise
+// Return: DMCC_EINVAL - if an argument is invalid
+//          DMCC_ETIMEDOUT - if the target is not reached within the time
+//                           limit allowed
+//          DMCC_EIO - if the bus transfer fails
+//          DMCC_OK - otherwise
 int moveAllUntilPos(int fd, int pos1, int pos2, unsigned int tLimit);
 
 // moveAllUntilTime - Power on both motors for a given time period
-//                   Prints an error if there is a problem
+//                   Logs an error if there is a problem
 //                      communicating with the motor
 // Parameters: fd - connection to the board (value returned from DMCCstart)
 //             time - desired wait time in microseconds
 //             pwm1 - power level for motor1
 //             pwm2 - power level for motor2
-void moveAllUntilTime(int fd, int pwm1, int pwm2, unsigned int time);
+// Returns: DMCC_EINVAL - if an argument is invalid
+//          DMCC_EIO - if the bus transfer fails
+//          DMCC_OK - otherwise
+int moveAllUntilTime(int fd, int pwm1, int pwm2, unsigned int time);
 
 // moveAllUntilPos - Power on both motors until they have both reached
 //                      the desired velocity
-//                   Prints an error if there is a problem
+//                   Logs an error if there is a problem
 //                      communicating with the motor
 // Parameters: fd - connection to the board (value returned from DMCCstart)
 //             vel1 - desired velocity for motor 1
 //             vel2 - desired velocity for motor 2
 //             tLimit - time limit in seconds (maximum of 2147 seconds)
-// Return: -1 - if the position is not reached within the time limit allowed
-//          0 - otherwise
+// Return: DMCC_EINVAL - if an argument is invalid
+//          DMCC_ETIMEDOUT - if the target is not reached within the time
+//                           limit allowed
+//          DMCC_EIO - if the bus transfer fails
+//          DMCC_OK - otherwise
 int moveAllUntilVel(int fd, int vel1, int vel2, unsigned int tLimit);
 
 // ---------------------------
@@ -293,7 +853,7 @@ int moveAllUntilVel(int fd, int vel1, int vel2, unsigned int tLimit);
 // ---------------------------
 
 // getPIDConstants - Gets the PID constants and returns them through pointers
-//                   Prints an error if there is a problem communicating
+//                   Logs an error if there is a problem communicating
 //                      with the motor
 // Paramters: fd - connection to the board (value returned from DMCCstart)
 //            posOrVel - 0 for getting the position PID
@@ -302,11 +862,14 @@ int moveAllUntilVel(int fd, int vel1, int vel2, unsigned int tLimit);
 //            I - constant for I in PID algorithm
 //            D - constant for D in PID algorithm
 //            motor - motor number desired
-void getPIDConstants(int fd, unsigned int motor, unsigned int posOrVel, 
+// Returns: DMCC_EINVAL - if an argument is invalid
+//          DMCC_EIO - if the bus transfer fails
+//          DMCC_OK - otherwise
+int getPIDConstants(int fd, unsigned int motor, unsigned int posOrVel, 
                             int *P, int *I, int *D);
 
 // setPIDConstants - Set the PID constants for the motors
-//                   Prints an error if there is a problem 
+//                   Logs an error if there is a problem 
 //                      communicating with the motor
 // Parameters: fd - connection to the board (value returned from DMCCstart)
 //             posOrVel - 0 for changing the position PID
@@ -315,12 +878,17 @@ void getPIDConstants(int fd, unsigned int motor, unsigned int posOrVel,
 //             I - constant for I in the PID algorithm
 //             D - constant for D in the PID algorithm
 //             motor - motor number desired
-void setPIDConstants(int fd, unsigned int motor, unsigned int posOrVel, 
+// Returns: DMCC_EINVAL - if an argument is invalid
+//          DMCC_EIO - if the bus transfer fails
+//          DMCC_OK - otherwise
+int setPIDConstants(int fd, unsigned int motor, unsigned int posOrVel, 
                             int P, int I, int D);
 
 // setDefaultPIDCOnstants - Set the PID constants to a default
 //
-void setDefaultPIDConstants(int fd);
+// Returns: DMCC_EIO - if the bus transfer fails
+//          DMCC_OK - otherwise
+int setDefaultPIDConstants(int fd);
 
 // setPIDPowerLimits -  Set a limit on the max power that will be set on the 
 //			motors when the DMCC is operating in PID mode
@@ -329,8 +897,43 @@ void setDefaultPIDConstants(int fd);
 //			   limit.
 //             pidLimit2 - power limit for motor 2.  1-10000.  Set to 0 for no
 //			   limit.
-//
-//
-void setPIDPowerLimits(int fd, unsigned int pidLimit1, unsigned int pidLimit2);
+// Returns: DMCC_ENOTSUP - if the firmware has no power limits (before Mk.07)
+//          DMCC_EIO - if the bus transfer fails
+//          DMCC_OK - otherwise
+int setPIDPowerLimits(int fd, unsigned int pidLimit1, unsigned int pidLimit2);
+
+// autotunePID - Finds and sets PID constants with a relay experiment.
+//               The motor is driven with +/-relayPower around its current
+//               position (or around zero velocity) until it oscillates
+//               steadily, the ultimate gain and period are measured from
+//               the QEI samples, and Ziegler-Nichols PID constants are
+//               converted to the firmware's scaled form and set with
+//               setPIDConstants.  The motor is stopped afterwards.
+//               Logs an error if no steady oscillation is found
+// Parameters: fd - connection to the board (value returned from DMCCstart)
+//             motor - motor number desired
+//             posOrVel - 0 for tuning the position PID
+//                      - 1 for tuning the velocity PID
+//             relayPower - power used for the relay (1 to 10000)
+//             samplePeriod - time between QEI samples in microseconds
+//                            (must be longer than one getQEI on the bus)
+//             P, I, D - the constants that were set
+// Return: DMCC_EINVAL - if an argument is invalid, or samplePeriod is too
+//                        short for the bus (nothing is set)
+//          DMCC_ETIMEDOUT - if no steady oscillation is found in time
+//                           (nothing is set)
+//          DMCC_ERANGE - if the oscillation could not be measured or a
+//                        constant found is past the register limits
+//                        (nothing is set)
+//          DMCC_EIO - if the bus transfer fails (the motor is stopped if
+//                     the bus lets it)
+//          DMCC_OK - otherwise
+int autotunePID(int fd, unsigned int motor, unsigned int posOrVel,
+                    int relayPower, unsigned int samplePeriod,
+                    int *P, int *I, int *D);
+
+#ifdef __cplusplus
+}
+#endif
 
 #endif
@@ -0,0 +1,395 @@
+//
+// Copyright (C) 2013-2016 - Exadler Technologies Inc., Sarah Tan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+
+// DMCC.hpp - C++ layer over DMCC.h (header only)
+//
+// dmcc::Session owns a session and ends it when it goes out of scope; it
+// can be moved but not copied.  dmcc::Motor<1> and dmcc::Motor<2> pick the
+// registers and command codes of their motor at compile time, so a call
+// has no motor number to check (Motor<3> does not compile).  Errors are
+// reported the same way as in DMCC.h: status codes from the functions that
+// set something, 0 and DMCCgetError from the ones that read a value.
+//
+//     dmcc::Session cape(0);
+//     dmcc::Motor<1> left(cape);
+//     left.setTargetVel(200);
+//     unsigned int qei = left.qei();
+
+#ifndef DMCC_HPP
+#define DMCC_HPP
+
+#include "DMCC.h"
+
+namespace dmcc {
+
+// Register map of one motor
+template <unsigned int N> struct MotorRegs;
+
+template <> struct MotorRegs<1> {
+    enum {
+        power = DMCC_REG_PWM1,            // pwm (2 bytes)
+        qei = DMCC_REG_QEI1,              // position (4 bytes)
+        qeiVel = DMCC_REG_QEI_VEL1,       // velocity (2 bytes)
+        current = DMCC_REG_CURRENT1,      // current (2 bytes)
+        targetPos = DMCC_REG_TARGET_POS1, // target position (4)
+        targetVel = DMCC_REG_TARGET_VEL1, // target velocity (2)
+        pidPos = DMCC_REG_POS_P1,         // P, I, D (3 x 2 bytes)
+        pidVel = DMCC_REG_VEL_P1,
+        dirBit = 0x01,                    // in DMCC_REG_CONFIG
+        qeiDirBit = 0x04,
+        cmdPower = 0x01,                  // commands (DMCC_REG_COMMAND)
+        cmdPos = 0x11,
+        cmdVel = 0x21,
+        cmdResetQEI = 0x30
+    };
+};
+
+template <> struct MotorRegs<2> {
+    enum {
+        power = DMCC_REG_PWM2,
+        qei = DMCC_REG_QEI2,
+        qeiVel = DMCC_REG_QEI_VEL2,
+        current = DMCC_REG_CURRENT2,
+        targetPos = DMCC_REG_TARGET_POS2,
+        targetVel = DMCC_REG_TARGET_VEL2,
+        pidPos = DMCC_REG_POS_P2,
+        pidVel = DMCC_REG_VEL_P2,
+        dirBit = 0x02,
+        qeiDirBit = 0x08,
+        cmdPower = 0x02,
+        cmdPos = 0x12,
+        cmdVel = 0x22,
+        cmdResetQEI = 0x31
+    };
+};
+
+namespace detail {
+
+// Reg - width and signedness of the register at an offset (from
+//       DMCC_REGISTERS, so offsets that are not registers do not compile)
+template <unsigned int Offset> struct Reg;
+
+#define DMCC_HPP_REG(name, field, offset, width, sgn) \
+    template <> struct Reg<offset> { enum { size = width, isSigned = sgn }; };
+DMCC_REGISTERS(DMCC_HPP_REG)
+#undef DMCC_HPP_REG
+
+// Register values to and from their bytes
+template <unsigned int Offset> inline int get(const unsigned char *b)
+{
+    return DMCC_REG_GET(b, Reg<Offset>::size, Reg<Offset>::isSigned);
+}
+
+template <unsigned int Offset> inline void put(unsigned char *b, int v)
+{
+    DMCC_REG_PUT(b, Reg<Offset>::size, v);
+}
+
+// status - status update command, then a read of num bytes at addr
+//          (the bytes are 0 if either fails)
+inline int status(int fd, unsigned char addr, unsigned char *b, int num)
+{
+    int result = putByte(fd, DMCC_REG_COMMAND, 0x00);
+    if (result != DMCC_OK) {
+        for (int i = 0; i < num; i++) {
+            b[i] = 0;
+        }
+        return result;
+    }
+    return getBytes(fd, addr, b, num);
+}
+
+} // namespace detail
+
+template <unsigned int N> class Motor;
+
+// Session - owns a connection to a cape (DMCCend when destroyed)
+class Session {
+public:
+    // Opens board capeAddr [0-3] on i2c bus (DMCCstartBus); check valid()
+    explicit Session(unsigned char capeAddr, int bus = 1)
+        : fd_(DMCCstartBus(bus, capeAddr)) {}
+
+    // Takes over a session opened some other way (DMCCstart, DMCCsimStart)
+    static Session adopt(int fd)
+    {
+        return Session(fd, Adopt());
+    }
+
+    Session(Session &&other) : fd_(other.fd_)
+    {
+        other.fd_ = -1;
+    }
+
+    Session &operator=(Session &&other)
+    {
+        if (this != &other) {
+            close();
+            fd_ = other.fd_;
+            other.fd_ = -1;
+        }
+        return *this;
+    }
+
+    Session(const Session &) = delete;
+    Session &operator=(const Session &) = delete;
+
+    ~Session()
+    {
+        close();
+    }
+
+    bool valid() const
+    {
+        return fd_ >= 0;
+    }
+
+    // Session number to pass to the DMCC.h functions
+    int fd() const
+    {
+        return fd_;
+    }
+
+    // Gives up the session without ending it
+    int release()
+    {
+        int fd = fd_;
+        fd_ = -1;
+        return fd;
+    }
+
+    // Ends the session now (DMCCend)
+    int close()
+    {
+        int result = DMCC_OK;
+        if (fd_ >= 0) {
+            result = DMCCend(fd_);
+            fd_ = -1;
+        }
+        return result;
+    }
+
+    // First error since the last call (DMCCgetError)
+    int error()
+    {
+        return DMCCgetError(fd_);
+    }
+
+    template <unsigned int N> Motor<N> motor()
+    {
+        return Motor<N>(*this);
+    }
+
+    // Both motors at once (one burst and one command)
+    int setPower(int pwm1, int pwm2)
+    {
+        return setAllMotorPower(fd_, pwm1, pwm2);
+    }
+
+    int setTargetPos(int pos1, int pos2)
+    {
+        return setAllTargetPos(fd_, pos1, pos2);
+    }
+
+    int setTargetVel(int vel1, int vel2)
+    {
+        return setAllTargetVel(fd_, vel1, vel2);
+    }
+
+    int resetQEI()
+    {
+        return resetAllQEI(fd_);
+    }
+
+    unsigned int voltage()
+    {
+        unsigned char b[detail::Reg<DMCC_REG_VOLTAGE>::size];
+        detail::status(fd_, DMCC_REG_VOLTAGE, b, sizeof(b));
+        return detail::get<DMCC_REG_VOLTAGE>(b);
+    }
+
+private:
+    struct Adopt {};
+    Session(int fd, Adopt) : fd_(fd) {}
+
+    int fd_;
+};
+
+// Motor - one motor of a cape (must not outlive its session)
+template <unsigned int N> class Motor {
+    static_assert((N == 1) || (N == 2), "a DMCC cape has motors 1 and 2");
+    typedef MotorRegs<N> Regs;
+
+public:
+    explicit Motor(const Session &session) : fd_(session.fd()) {}
+
+    // Encoder position (counts)
+    unsigned int qei() const
+    {
+        unsigned char b[detail::Reg<Regs::qei>::size];
+        detail::status(fd_, Regs::qei, b, sizeof(b));
+        return (unsigned int)detail::get<Regs::qei>(b);
+    }
+
+    // Encoder velocity
+    int qeiVel() const
+    {
+        unsigned char b[detail::Reg<Regs::qeiVel>::size];
+        detail::status(fd_, Regs::qeiVel, b, sizeof(b));
+        return detail::get<Regs::qeiVel>(b);
+    }
+
+    unsigned int current() const
+    {
+        unsigned char b[detail::Reg<Regs::current>::size];
+        detail::status(fd_, Regs::current, b, sizeof(b));
+        return detail::get<Regs::current>(b);
+    }
+
+    unsigned int targetPos() const
+    {
+        unsigned char b[detail::Reg<Regs::targetPos>::size];
+        detail::status(fd_, Regs::targetPos, b, sizeof(b));
+        return (unsigned int)detail::get<Regs::targetPos>(b);
+    }
+
+    int targetVel() const
+    {
+        unsigned char b[detail::Reg<Regs::targetVel>::size];
+        detail::status(fd_, Regs::targetVel, b, sizeof(b));
+        return detail::get<Regs::targetVel>(b);
+    }
+
+    // Power [-10000, 10000], no PID
+    int setPower(int pwm) const
+    {
+        if ((pwm < -10000) || (pwm > 10000)) {
+            return DMCC_EINVAL;
+        }
+        unsigned char b[detail::Reg<Regs::power>::size];
+        detail::put<Regs::power>(b, pwm);
+        return send(Regs::power, b, sizeof(b), Regs::cmdPower);
+    }
+
+    // Position PID to pos
+    int setTargetPos(int pos) const
+    {
+        unsigned char b[detail::Reg<Regs::targetPos>::size];
+        detail::put<Regs::targetPos>(b, pos);
+        return send(Regs::targetPos, b, sizeof(b), Regs::cmdPos);
+    }
+
+    // Velocity PID to vel (16 bit signed)
+    int setTargetVel(int vel) const
+    {
+        unsigned char b[detail::Reg<Regs::targetVel>::size];
+        detail::put<Regs::targetVel>(b, vel);
+        return send(Regs::targetVel, b, sizeof(b), Regs::cmdVel);
+    }
+
+    int resetQEI() const
+    {
+        return putByte(fd_, DMCC_REG_COMMAND, Regs::cmdResetQEI);
+    }
+
+    // PID constants of the position (posOrVel 0) or velocity (1) loop
+    template <unsigned int posOrVel> int setPID(int P, int I, int D) const
+    {
+        static_assert(posOrVel <= 1, "posOrVel is 0 or 1");
+        enum { reg = posOrVel ? Regs::pidVel : Regs::pidPos };
+        unsigned char b[6];
+        detail::put<reg>(b, P);
+        detail::put<reg + 2>(b + 2, I);
+        detail::put<reg + 4>(b + 4, D);
+        return putBytes(fd_, reg, b, 6);
+    }
+
+    template <unsigned int posOrVel> int getPID(int &P, int &I, int &D) const
+    {
+        static_assert(posOrVel <= 1, "posOrVel is 0 or 1");
+        enum { reg = posOrVel ? Regs::pidVel : Regs::pidPos };
+        unsigned char b[6];
+        int result = getBytes(fd_, reg, b, 6);
+        P = detail::get<reg>(b);
+        I = detail::get<reg + 2>(b + 2);
+        D = detail::get<reg + 4>(b + 4);
+        return result;
+    }
+
+    // Motor and encoder directions (0 or 1, DMCC_EIO if the bus fails)
+    int dir() const
+    {
+        return configBit(Regs::dirBit);
+    }
+
+    int qeiDir() const
+    {
+        return configBit(Regs::qeiDirBit);
+    }
+
+    int setDir(int dir) const
+    {
+        return setConfigBit(Regs::dirBit, dir);
+    }
+
+    int setQEIDir(int dir) const
+    {
+        return setConfigBit(Regs::qeiDirBit, dir);
+    }
+
+private:
+    // send - writes the registers, then the command that uses them
+    int send(unsigned char addr, const unsigned char *b, int num,
+                unsigned char cmd) const
+    {
+        if (putBytes(fd_, addr, b, num) != DMCC_OK) {
+            return DMCC_EIO;
+        }
+        return putByte(fd_, DMCC_REG_COMMAND, cmd);
+    }
+
+    int configBit(unsigned char bit) const
+    {
+        unsigned char b;
+        if (detail::status(fd_, DMCC_REG_CONFIG, &b, 1) != DMCC_OK) {
+            return DMCC_EIO;
+        }
+        return (b & bit) ? 1 : 0;
+    }
+
+    int setConfigBit(unsigned char bit, int value) const
+    {
+        unsigned char b;
+        if (getBytes(fd_, DMCC_REG_CONFIG, &b, 1) != DMCC_OK) {
+            return DMCC_EIO;
+        }
+        b = (b & 0x0f & ~bit) | ((value & 1) ? bit : 0);
+        return putByte(fd_, DMCC_REG_CONFIG, b);
+    }
+
+    int fd_;
+};
+
+} // namespace dmcc
+
+#endif
@@ -0,0 +1,488 @@
+//
+// Copyright (C) 2013-2016 - Exadler Technologies Inc., Sarah Tan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "DMCC.h"
+#include "DMCCclient.h"
+#include "DMCClog.h"
+
+// ------------------------
+// Sessions through the daemon (indexed by connection)
+// ------------------------
+#define CLIENT_MAX_SESSIONS 256
+
+typedef struct ClientSession {
+    int conn;
+    unsigned int board;
+    unsigned char addr;         // register pointer, as on i2c-dev
+    int failed;                 // a queued write failed since the last flush
+    DMCCbatch queue;            // writes not sent yet
+} ClientSession;
+
+static ClientSession Client_Sessions[CLIENT_MAX_SESSIONS];
+
+// ------------------------
+// Status pushed while a connection waited for a reply (indexed by
+// connection), for DMCCclientNextStatus
+// ------------------------
+typedef struct ClientPush {
+    unsigned int board;
+    int ok;                     // 0 if the daemon could not read the board
+    DMCCtelemetryRecord status;
+} ClientPush;
+
+typedef struct ClientPushQueue {
+    unsigned int head;          // pushes taken
+    unsigned int tail;          // pushes kept
+    unsigned long dropped;      // pushes lost because the queue was full
+    ClientPush push[DMCCD_PUSH_QUEUE];
+} ClientPushQueue;
+
+static ClientPushQueue Client_Pushes[CLIENT_MAX_SESSIONS];
+
+int DMCCclientConnect(const char *path)
+{
+    struct sockaddr_un sa;
+
+    if (strlen(path) >= sizeof(sa.sun_path)) {
+        LOG_ERROR("socket path %s is too long", path);
+        return -1;
+    }
+
+    int conn = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+    if (conn < 0) {
+        LOG_ERROR("cannot create socket");
+        return -1;
+    }
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sun_family = AF_UNIX;
+    strcpy(sa.sun_path, path);
+    if (connect(conn, (struct sockaddr *)&sa, sizeof(sa)) != 0) {
+        LOG_ERROR("cannot connect to dmccd at %s", path);
+        close(conn);
+        return -1;
+    }
+    // Nothing kept from an earlier connection with the same number
+    if (conn < CLIENT_MAX_SESSIONS) {
+        memset(&Client_Pushes[conn], 0, sizeof(ClientPushQueue));
+    }
+    return conn;
+}
+
+void DMCCbatchInit(DMCCbatch *batch)
+{
+    batch->header.magic = DMCCD_MAGIC;
+    batch->header.type = DMCCD_REQUEST;
+    batch->header.count = 0;
+    batch->header.length = 0;
+}
+
+int DMCCbatchAdd(DMCCbatch *batch, unsigned int code, unsigned int board,
+                    unsigned char addr, const void *data, unsigned int len)
+{
+    unsigned int dataLen = 0;
+    if ((code == DMCCD_OP_WRITE) || (code == DMCCD_OP_SUBSCRIBE)) {
+        dataLen = len;
+    }
+
+    if ((batch->header.count == 255) || (len > 255) ||
+            (batch->header.length + sizeof(DMCCdOp) + dataLen >
+                DMCCD_MAX_BODY)) {
+        return -1;
+    }
+
+    DMCCdOp *op = (DMCCdOp *)&batch->body[batch->header.length];
+    op->code = code;
+    op->board = board;
+    op->addr = addr;
+    op->len = len;
+    if (dataLen > 0) {
+        memcpy(op + 1, data, dataLen);
+    }
+    batch->header.length += sizeof(DMCCdOp) + dataLen;
+    batch->header.count++;
+    return 0;
+}
+
+// parsePush - takes the status out of a pushed message
+// Returns: -1 - if the message is not a status push
+//           0 - otherwise
+static int parsePush(const DMCCbatch *batch, ClientPush *push)
+{
+    const unsigned char *data;
+    const DMCCdResult *result = DMCCbatchResult(batch, 0, &data);
+
+    if (result == NULL) {
+        return -1;
+    }
+    push->board = result->board;
+    push->ok = (result->status == DMCCD_OK);
+    if (!push->ok) {
+        return 0;
+    }
+    if (result->len != sizeof(DMCCtelemetryRecord)) {
+        return -1;
+    }
+    memcpy(&push->status, data, sizeof(DMCCtelemetryRecord));
+    return 0;
+}
+
+// keepPush - queues a status pushed while waiting for a reply
+static void keepPush(int conn, const DMCCbatch *batch)
+{
+    if ((conn < 0) || (conn >= CLIENT_MAX_SESSIONS)) {
+        return;
+    }
+    ClientPushQueue *q = &Client_Pushes[conn];
+    if (q->tail - q->head == DMCCD_PUSH_QUEUE) {
+        q->dropped++;
+        return;
+    }
+    if (parsePush(batch, &q->push[q->tail % DMCCD_PUSH_QUEUE]) == 0) {
+        q->tail++;
+    }
+}
+
+// receive - waits for the next message of the given type
+static int receive(int conn, DMCCbatch *batch, int type)
+{
+    while (1) {
+        ssize_t n = recv(conn, batch, sizeof(DMCCbatch), 0);
+        if (n < (ssize_t)sizeof(DMCCdHeader)) {
+            return -1;
+        }
+        if ((batch->header.magic != DMCCD_MAGIC) ||
+                (batch->header.length != n - sizeof(DMCCdHeader))) {
+            return -1;
+        }
+        if (batch->header.type == type) {
+            return 0;
+        }
+        // Status pushed while waiting for a reply is kept for
+        // DMCCclientNextStatus
+        if (batch->header.type == DMCCD_PUSH) {
+            keepPush(conn, batch);
+        }
+    }
+}
+
+int DMCCbatchSend(int conn, DMCCbatch *batch)
+{
+    size_t len = sizeof(DMCCdHeader) + batch->header.length;
+
+    if (send(conn, batch, len, 0) != (ssize_t)len) {
+        return -1;
+    }
+    return receive(conn, batch, DMCCD_REPLY);
+}
+
+const DMCCdResult *DMCCbatchResult(const DMCCbatch *batch, unsigned int n,
+                                    const unsigned char **data)
+{
+    unsigned int pos = 0;
+    unsigned int i;
+
+    for (i = 0; i < batch->header.count; i++) {
+        if (pos + sizeof(DMCCdResult) > batch->header.length) {
+            return NULL;
+        }
+        const DMCCdResult *r = (const DMCCdResult *)&batch->body[pos];
+        if (pos + sizeof(DMCCdResult) + r->len > batch->header.length) {
+            return NULL;
+        }
+        if (i == n) {
+            if (data != NULL) {
+                *data = (const unsigned char *)(r + 1);
+            }
+            return r;
+        }
+        pos += sizeof(DMCCdResult) + r->len;
+    }
+    return NULL;
+}
+
+int DMCCclientSubscribe(int conn, unsigned int board, unsigned int rate)
+{
+    DMCCbatch batch;
+    uint32_t r = rate;
+
+    DMCCbatchInit(&batch);
+    DMCCbatchAdd(&batch, DMCCD_OP_SUBSCRIBE, board, 0, &r, sizeof(r));
+    if (DMCCbatchSend(conn, &batch) != 0) {
+        return -1;
+    }
+    const DMCCdResult *result = DMCCbatchResult(&batch, 0, NULL);
+    if ((result == NULL) || (result->status != DMCCD_OK)) {
+        return -1;
+    }
+    return 0;
+}
+
+int DMCCclientNextStatus(int conn, unsigned int *board,
+                            DMCCtelemetryRecord *status)
+{
+    DMCCbatch batch;
+    ClientPush next;
+    ClientPush *push = &next;
+
+    // Pushes kept while waiting for replies come first, oldest first
+    ClientPushQueue *q = NULL;
+    if ((conn >= 0) && (conn < CLIENT_MAX_SESSIONS)) {
+        q = &Client_Pushes[conn];
+    }
+    if ((q != NULL) && (q->head != q->tail)) {
+        push = &q->push[q->head % DMCCD_PUSH_QUEUE];
+        q->head++;
+    } else if ((receive(conn, &batch, DMCCD_PUSH) != 0) ||
+                (parsePush(&batch, &next) != 0)) {
+        return -1;
+    }
+
+    *board = push->board;
+    if (!push->ok) {
+        return 1;
+    }
+    memcpy(status, &push->status, sizeof(DMCCtelemetryRecord));
+    return 0;
+}
+
+unsigned long DMCCclientDropped(int conn)
+{
+    if ((conn < 0) || (conn >= CLIENT_MAX_SESSIONS)) {
+        return 0;
+    }
+    return Client_Pushes[conn].dropped;
+}
+
+// -----------------------
+// Transport for sessions through the daemon
+// -----------------------
+
+// sendQueue - sends the queued writes, and the read queued after them if
+//             len > 0, in one round trip
+// Parameters: s - session
+//             buf - where to put the bytes read
+//             len - number of bytes read (0 if no read is queued)
+// Returns: -1 - if the daemon did not answer or the read failed
+//           0 - otherwise (a write that failed sets s->failed)
+static int sendQueue(ClientSession *s, unsigned char *buf, int len)
+{
+    DMCCbatch *batch = &s->queue;
+    const DMCCdResult *result;
+    const unsigned char *data;
+    unsigned int writes = batch->header.count - ((len > 0) ? 1 : 0);
+    unsigned int i;
+
+    if (batch->header.count == 0) {
+        return 0;
+    }
+    // The queue is replaced with the reply
+    if (DMCCbatchSend(s->conn, batch) != 0) {
+        if (writes > 0) {
+            s->failed = 1;
+        }
+        DMCCbatchInit(batch);
+        return -1;
+    }
+    for (i = 0; i < writes; i++) {
+        result = DMCCbatchResult(batch, i, NULL);
+        if ((result == NULL) || (result->status != DMCCD_OK)) {
+            s->failed = 1;
+        }
+    }
+
+    int status = 0;
+    if (len > 0) {
+        result = DMCCbatchResult(batch, writes, &data);
+        if ((result == NULL) || (result->status != DMCCD_OK) ||
+                (result->len != len)) {
+            status = -1;
+        } else {
+            memcpy(buf, data, len);
+        }
+    }
+    DMCCbatchInit(batch);
+    return status;
+}
+
+// clientWrite - register write through the daemon (DMCCtransport
+//               callback), queued until the next read or flush.  A motor
+//               command is sent at once with the writes queued before it,
+//               so a program that commands a motor and then sleeps moves
+//               it, and the command fails if any of them failed
+static int clientWrite(void *ctx, const unsigned char *buf, int len)
+{
+    ClientSession *s = (ClientSession *)ctx;
+
+    if (len <= 0) {
+        return 0;
+    }
+    // Setting the register pointer for a read needs no round trip
+    if (len == 1) {
+        s->addr = buf[0];
+        return 1;
+    }
+
+    if (DMCCbatchAdd(&s->queue, DMCCD_OP_WRITE, s->board, buf[0], buf + 1,
+                        len - 1) != 0) {
+        // Queue is full, send it and start again
+        sendQueue(s, NULL, 0);
+        if (DMCCbatchAdd(&s->queue, DMCCD_OP_WRITE, s->board, buf[0],
+                            buf + 1, len - 1) != 0) {
+            return -1;
+        }
+    }
+    s->addr = buf[0] + (len - 1);
+
+    // Everything but the status snapshot (which a read always follows)
+    if ((buf[0] == DMCC_REG_COMMAND) && (buf[1] != 0x00)) {
+        sendQueue(s, NULL, 0);
+        if (s->failed) {
+            s->failed = 0;
+            return -1;
+        }
+    }
+    return len;
+}
+
+// clientRead - register read through the daemon (DMCCtransport callback),
+//              sent with the queued writes
+static int clientRead(void *ctx, unsigned char *buf, int len)
+{
+    ClientSession *s = (ClientSession *)ctx;
+
+    if (len <= 0) {
+        return 0;
+    }
+
+    if (DMCCbatchAdd(&s->queue, DMCCD_OP_READ, s->board, s->addr, NULL,
+                        len) != 0) {
+        sendQueue(s, NULL, 0);
+        if (DMCCbatchAdd(&s->queue, DMCCD_OP_READ, s->board, s->addr, NULL,
+                            len) != 0) {
+            return -1;
+        }
+    }
+    if (sendQueue(s, buf, len) != 0) {
+        return -1;
+    }
+    s->addr += len;
+    return len;
+}
+
+// clientFlush - sends the queued writes (DMCCtransport callback)
+static int clientFlush(void *ctx)
+{
+    ClientSession *s = (ClientSession *)ctx;
+
+    sendQueue(s, NULL, 0);
+    int failed = s->failed;
+    s->failed = 0;
+    return failed ? -1 : 0;
+}
+
+// clientStop - emergency stop write (DMCCtransport callback).  Called from
+//              a signal handler: the queue is left alone, the write goes
+//              out as a request with no reply (so a reply the interrupted
+//              code is waiting for cannot be taken), and send is the only
+//              system call
+static int clientStop(void *ctx, const unsigned char *buf, int len)
+{
+    ClientSession *s = (ClientSession *)ctx;
+    DMCCbatch stop;
+
+    if (len <= 1) {
+        return len;
+    }
+    DMCCbatchInit(&stop);
+    stop.header.type = DMCCD_ONEWAY;
+    if (DMCCbatchAdd(&stop, DMCCD_OP_WRITE, s->board, buf[0], buf + 1,
+                        len - 1) != 0) {
+        return -1;
+    }
+    size_t size = sizeof(DMCCdHeader) + stop.header.length;
+    if (send(s->conn, &stop, size, MSG_DONTWAIT | MSG_NOSIGNAL) !=
+            (ssize_t)size) {
+        return -1;
+    }
+    return len;
+}
+
+int DMCCclientStart(const char *path, unsigned char capeAddr)
+{
+    DMCCtransport transport;
+    DMCCbatch batch;
+
+    if (capeAddr > 3) {
+        LOG_ERROR("invalid cape address specified");
+        return -1;
+    }
+
+    int conn = DMCCclientConnect(path);
+    if (conn < 0) {
+        return -1;
+    }
+    if (conn >= CLIENT_MAX_SESSIONS) {
+        LOG_ERROR("too many sessions open");
+        close(conn);
+        return -1;
+    }
+
+    // Zero length read checks that the daemon has the board
+    DMCCbatchInit(&batch);
+    DMCCbatchAdd(&batch, DMCCD_OP_READ, capeAddr, 0, NULL, 0);
+    const DMCCdResult *result = NULL;
+    if (DMCCbatchSend(conn, &batch) == 0) {
+        result = DMCCbatchResult(&batch, 0, NULL);
+    }
+    if ((result == NULL) || (result->status != DMCCD_OK)) {
+        LOG_ERROR("dmccd has no board %d", capeAddr);
+        close(conn);
+        return -1;
+    }
+
+    ClientSession *s = &Client_Sessions[conn];
+    s->conn = conn;
+    s->board = capeAddr;
+    s->addr = 0;
+    s->failed = 0;
+    DMCCbatchInit(&s->queue);
+
+    memset(&transport, 0, sizeof(transport));
+    transport.write = clientWrite;
+    transport.read = clientRead;
+    transport.flush = clientFlush;
+    transport.stop = clientStop;
+    transport.ctx = s;
+    if (DMCCattachTransport(conn, &transport) != 0) {
+        close(conn);
+        return -1;
+    }
+    return conn;
+}
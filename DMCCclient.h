@@ -0,0 +1,185 @@
+//
+// Copyright (C) 2013-2016 - Exadler Technologies Inc., Sarah Tan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+// DMCCclient.h - talking to the capes through dmccd (the bus daemon)
+//
+// dmccd owns every cape on the bus and serves clients on a Unix domain
+// socket (SOCK_SEQPACKET, one message per request/reply, host byte order).
+// A message is a DMCCdHeader followed by <count> operations.  Each request
+// operation gets one result in the reply, in the same order.
+//
+// Existing programs do not need to change: when the DMCC_SOCKET environment
+// variable names the daemon socket, DMCCstart connects to the daemon and
+// every function in DMCC.h goes through it.  Register writes are queued
+// and sent with the next read or motor command (a write to register 0xff),
+// so setting a target and commanding the motor is one round trip (and the
+// daemon joins writes to consecutive registers).  Motor commands are never
+// held back: set, sleep, set works as it does on the bus, and a command
+// fails if it or a write queued before it failed.  A write that fails
+// otherwise makes the read it went with fail.  Queued writes are also sent
+// by DMCCflush, DMCCwaitUntil and DMCCend: a program that writes plain
+// registers (PID constants, limits) and then sleeps on its own must call
+// DMCCflush first to see their result.  The batch functions below let new
+// programs put any operations into one round trip.
+
+#ifndef DMCCCLIENT
+#define DMCCCLIENT
+
+#include <stdint.h>
+
+#include "DMCCtelemetry.h"
+
+// Environment variable holding the daemon socket path
+#define DMCCD_SOCKET_ENV "DMCC_SOCKET"
+
+#define DMCCD_MAGIC 0xDCC1
+#define DMCCD_MAX_BODY 4096
+
+// Message types
+#define DMCCD_REQUEST 0
+#define DMCCD_REPLY 1
+#define DMCCD_PUSH 2            // status from a subscription
+#define DMCCD_ONEWAY 3          // request that gets no reply (emergency
+                                // stop from a signal handler)
+
+// Operation codes
+#define DMCCD_OP_WRITE 1        // write <len> bytes from <addr>
+#define DMCCD_OP_READ 2         // read <len> bytes from <addr>
+#define DMCCD_OP_STATUS 3       // status snapshot (DMCCtelemetryRecord)
+#define DMCCD_OP_SUBSCRIBE 4    // push status at uint32 rate (0 stops)
+
+// Status pushes a connection keeps while it waits for a reply
+#define DMCCD_PUSH_QUEUE 16
+
+// Result status
+#define DMCCD_OK 0
+#define DMCCD_ERROR 1           // no such board, bad operation or the bus
+                                // transfer failed
+
+// DMCCdHeader - start of every message
+typedef struct DMCCdHeader {
+    uint16_t magic;             // DMCCD_MAGIC
+    uint8_t type;               // DMCCD_REQUEST, DMCCD_REPLY or DMCCD_PUSH
+    uint8_t count;              // number of operations/results
+    uint32_t length;            // bytes after the header
+} DMCCdHeader;
+
+// DMCCdOp - one operation in a request (followed by <len> data bytes for
+//           DMCCD_OP_WRITE and DMCCD_OP_SUBSCRIBE)
+typedef struct DMCCdOp {
+    uint8_t code;
+    uint8_t board;              // board number [0-3]
+    uint8_t addr;
+    uint8_t len;
+} DMCCdOp;
+
+// DMCCdResult - one result in a reply (followed by <len> data bytes for
+//               DMCCD_OP_READ and DMCCD_OP_STATUS)
+typedef struct DMCCdResult {
+    uint8_t code;
+    uint8_t board;
+    uint8_t status;             // DMCCD_OK or DMCCD_ERROR
+    uint8_t len;
+} DMCCdResult;
+
+// DMCCbatch - a request being built, then its reply
+typedef struct DMCCbatch {
+    DMCCdHeader header;
+    unsigned char body[DMCCD_MAX_BODY];
+} DMCCbatch;
+
+// DMCCclientConnect - Opens a connection to the daemon
+//                     Logs an error if the daemon cannot be reached
+// Parameters: path - socket path of the daemon
+// Returns: connection to the daemon
+//          -1 - if an error occurs
+int DMCCclientConnect(const char *path);
+
+// DMCCclientStart - Begins a session on a cape through the daemon; the
+//                   session works with every function in DMCC.h
+// Parameters: path - socket path of the daemon
+//             capeAddr - address of motor controller board specified [0-3]
+// Returns: session (end with DMCCend)
+//          -1 - if an error occurs
+int DMCCclientStart(const char *path, unsigned char capeAddr);
+
+// DMCCbatchInit - Empties a batch
+// Parameters: batch - batch to empty
+void DMCCbatchInit(DMCCbatch *batch);
+
+// DMCCbatchAdd - Adds an operation to a batch
+// Parameters: batch - batch being built
+//             code - DMCCD_OP_*
+//             board - board number [0-3]
+//             addr - register address (DMCCD_OP_WRITE, DMCCD_OP_READ)
+//             data - bytes to send with the operation (or NULL)
+//             len - number of data bytes for DMCCD_OP_WRITE and
+//                   DMCCD_OP_SUBSCRIBE, bytes to read for DMCCD_OP_READ
+// Returns: -1 - if the batch is full
+//           0 - otherwise
+int DMCCbatchAdd(DMCCbatch *batch, unsigned int code, unsigned int board,
+                    unsigned char addr, const void *data, unsigned int len);
+
+// DMCCbatchSend - Sends a batch and replaces it with the reply
+// Parameters: conn - connection from DMCCclientConnect
+//             batch - request, reply on return
+// Returns: -1 - if the daemon did not answer
+//           0 - otherwise
+int DMCCbatchSend(int conn, DMCCbatch *batch);
+
+// DMCCbatchResult - Finds a result in a reply
+// Parameters: batch - reply from DMCCbatchSend
+//             n - result number (same order as the operations)
+//             data - set to the data bytes of the result (may be NULL)
+// Returns: the result
+//          NULL - if there is no such result
+const DMCCdResult *DMCCbatchResult(const DMCCbatch *batch, unsigned int n,
+                                    const unsigned char **data);
+
+// DMCCclientSubscribe - Asks the daemon to push status for a cape
+// Parameters: conn - connection from DMCCclientConnect
+//             board - board number [0-3]
+//             rate - snapshots per second (0 stops the subscription)
+// Returns: -1 - if the daemon refused
+//           0 - otherwise
+int DMCCclientSubscribe(int conn, unsigned int board, unsigned int rate);
+
+// DMCCclientNextStatus - Waits for the next pushed status (status pushed
+//                        while a request on the connection waited for its
+//                        reply is kept, up to DMCCD_PUSH_QUEUE, and given
+//                        first)
+// Parameters: conn - connection from DMCCclientConnect
+//             board - set to the board number of the status
+//             status - where to put the snapshot
+// Returns: -1 - if the connection closed
+//           1 - if the daemon could not read the board (status is not set)
+//           0 - otherwise
+int DMCCclientNextStatus(int conn, unsigned int *board,
+                            DMCCtelemetryRecord *status);
+
+// DMCCclientDropped - Counts the pushed status lost because too many
+//                     arrived while the connection waited for replies
+// Parameters: conn - connection from DMCCclientConnect
+// Returns: number of pushes lost since the connection opened
+unsigned long DMCCclientDropped(int conn);
+
+#endif
@@ -0,0 +1,220 @@
+//
+// Copyright (C) 2013-2016 - Exadler Technologies Inc., Sarah Tan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <pthread.h>
+#include <semaphore.h>
+
+#include "DMCC.h"
+#include "DMCClog.h"
+
+// ------------------------
+// Message ring
+// ------------------------
+// Any thread may log (claiming a slot with compare and swap); one thread
+// drains the ring into the sink.  A slot's seq says whose turn it is:
+// seq == pos - it is free for the message at pos
+// seq == pos + 1 - the message at pos is ready for the sink
+#define LOG_RING_SIZE 256       // power of two
+#define LOG_MESSAGE_LEN 120
+
+typedef struct LogSlot {
+    unsigned long seq;
+    int level;
+    char message[LOG_MESSAGE_LEN];
+} LogSlot;
+
+int DMCClogLevel = DMCC_LOG_OFF;
+
+static LogSlot logRing[LOG_RING_SIZE];
+static unsigned long logHead;           // next slot to claim
+static unsigned long logTail;           // next slot to drain
+static unsigned long long logDropped;
+static sem_t logReady;
+static pthread_once_t logOnce = PTHREAD_ONCE_INIT;
+static int logRunning;
+
+static DMCClogSink logSink;
+static void *logCtx;
+
+static const char *levelName(int level)
+{
+    switch (level) {
+    case DMCC_LOG_ERROR: return "error";
+    case DMCC_LOG_WARN: return "warning";
+    case DMCC_LOG_INFO: return "info";
+    default: return "debug";
+    }
+}
+
+// stderrSink - where messages go when no sink is set
+static void stderrSink(int level, const char *message, void *ctx)
+{
+    (void)ctx;
+    fprintf(stderr, "DMCC %s: %s\n", levelName(level), message);
+}
+
+// drainMain - passes the messages in the ring to the sink, in order
+static void *drainMain(void *arg)
+{
+    (void)arg;
+    for (;;) {
+        LogSlot *slot = &logRing[logTail & (LOG_RING_SIZE - 1)];
+        if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != logTail + 1) {
+            // Empty, or the next message is still being written
+            sem_wait(&logReady);
+            continue;
+        }
+        DMCClogSink sink = __atomic_load_n(&logSink, __ATOMIC_ACQUIRE);
+        if (sink == NULL) {
+            stderrSink(slot->level, slot->message, NULL);
+        } else {
+            sink(slot->level, slot->message, logCtx);
+        }
+        __atomic_store_n(&slot->seq, logTail + LOG_RING_SIZE,
+                            __ATOMIC_RELEASE);
+        __atomic_store_n(&logTail, logTail + 1, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
+
+// logStart - starts the sink thread (once)
+static void logStart(void)
+{
+    pthread_t thread;
+    pthread_attr_t attr;
+    unsigned long i;
+
+    for (i = 0; i < LOG_RING_SIZE; i++) {
+        logRing[i].seq = i;
+    }
+    sem_init(&logReady, 0, 0);
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (pthread_create(&thread, &attr, drainMain, NULL) == 0) {
+        logRunning = 1;
+        // Messages logged just before the program exits still get out
+        atexit(DMCClogFlush);
+    }
+    pthread_attr_destroy(&attr);
+}
+
+void DMCClogWrite(int level, const char *format, ...)
+{
+    unsigned long pos = __atomic_load_n(&logHead, __ATOMIC_RELAXED);
+    LogSlot *slot;
+    va_list args;
+
+    for (;;) {
+        slot = &logRing[pos & (LOG_RING_SIZE - 1)];
+        long diff = (long)(__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) -
+                            pos);
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&logHead, &pos, pos + 1, 1,
+                                __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // Full: never wait for the sink
+            __atomic_fetch_add(&logDropped, 1, __ATOMIC_RELAXED);
+            return;
+        } else {
+            pos = __atomic_load_n(&logHead, __ATOMIC_RELAXED);
+        }
+    }
+
+    slot->level = level;
+    va_start(args, format);
+    vsnprintf(slot->message, LOG_MESSAGE_LEN, format, args);
+    va_end(args);
+    __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+    sem_post(&logReady);
+}
+
+int DMCCsetLogLevel(int level)
+{
+    if ((level < DMCC_LOG_OFF) || (level > DMCC_LOG_DEBUG)) {
+        return DMCC_EINVAL;
+    }
+    if (level > DMCC_LOG_OFF) {
+        pthread_once(&logOnce, logStart);
+        if (!logRunning) {
+            return DMCC_EIO;
+        }
+    }
+    __atomic_store_n(&DMCClogLevel, level, __ATOMIC_RELEASE);
+    return DMCC_OK;
+}
+
+void DMCCsetLogSink(DMCClogSink sink, void *ctx)
+{
+    DMCClogFlush();
+    logCtx = ctx;
+    __atomic_store_n(&logSink, sink, __ATOMIC_RELEASE);
+}
+
+void DMCClogFlush(void)
+{
+    struct timespec wait = {0, 100000};
+    unsigned long head = __atomic_load_n(&logHead, __ATOMIC_ACQUIRE);
+
+    if (!logRunning) {
+        return;
+    }
+    while ((long)(__atomic_load_n(&logTail, __ATOMIC_ACQUIRE) - head) < 0) {
+        nanosleep(&wait, NULL);
+    }
+}
+
+unsigned long long DMCClogDropped(void)
+{
+    return __atomic_load_n(&logDropped, __ATOMIC_RELAXED);
+}
+
+void DMCClogFromEnv(void)
+{
+    static const char *names[] = {"off", "error", "warn", "info", "debug"};
+    static int started = 0;
+    char *value = getenv("DMCC_LOG_LEVEL");
+    int level;
+
+    if (started || (value == NULL) || (value[0] == '\0')) {
+        return;
+    }
+    started = 1;
+    for (level = DMCC_LOG_DEBUG; level > DMCC_LOG_OFF; level--) {
+        if (strcasecmp(value, names[level]) == 0) {
+            break;
+        }
+    }
+    if ((level == DMCC_LOG_OFF) && (strcasecmp(value, "off") != 0)) {
+        level = atoi(value);
+    }
+    DMCCsetLogLevel(level);
+}
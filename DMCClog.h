@@ -0,0 +1,83 @@
+//
+// Copyright (C) 2013-2016 - Exadler Technologies Inc., Sarah Tan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+
+// DMCClog.h - hooks the library uses to log what it is doing
+//
+// Only used inside the library.  The functions to pick the level and the
+// sink are in DMCC.h.  Levels above DMCC_LOG_MAX (-DDMCC_LOG_MAX=<level>,
+// DMCC_LOG_INFO by default) compile to nothing; the others cost one test
+// of the run time level while logging is off (the default).
+
+#ifndef DMCCLOG
+#define DMCCLOG
+
+#include "DMCC.h"
+
+#ifndef DMCC_LOG_MAX
+#define DMCC_LOG_MAX DMCC_LOG_INFO
+#endif
+
+// Most detailed level passed on at run time (DMCCsetLogLevel)
+extern int DMCClogLevel;
+
+// DMCClogWrite - formats a message into the ring for the sink thread
+//                (drops it if the ring is full)
+void DMCClogWrite(int level, const char *format, ...)
+        __attribute__((format(printf, 2, 3)));
+
+// DMCClogFromEnv - sets the level from the DMCC_LOG_LEVEL environment
+//                  variable (error, warn, info, debug or a number)
+void DMCClogFromEnv(void);
+
+#define LOG_AT(level, ...) \
+    do { \
+        if (__builtin_expect(DMCClogLevel >= (level), 0)) { \
+            DMCClogWrite(level, __VA_ARGS__); \
+        } \
+    } while (0)
+
+#if DMCC_LOG_MAX >= DMCC_LOG_ERROR
+#define LOG_ERROR(...) LOG_AT(DMCC_LOG_ERROR, __VA_ARGS__)
+#else
+#define LOG_ERROR(...)
+#endif
+
+#if DMCC_LOG_MAX >= DMCC_LOG_WARN
+#define LOG_WARN(...) LOG_AT(DMCC_LOG_WARN, __VA_ARGS__)
+#else
+#define LOG_WARN(...)
+#endif
+
+#if DMCC_LOG_MAX >= DMCC_LOG_INFO
+#define LOG_INFO(...) LOG_AT(DMCC_LOG_INFO, __VA_ARGS__)
+#else
+#define LOG_INFO(...)
+#endif
+
+#if DMCC_LOG_MAX >= DMCC_LOG_DEBUG
+#define LOG_DEBUG(...) LOG_AT(DMCC_LOG_DEBUG, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...)
+#endif
+
+#endif
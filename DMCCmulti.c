@@ -0,0 +1,334 @@
+//
+// Copyright (C) 2013-2016 - Exadler Technologies Inc., Sarah Tan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "DMCC.h"
+#include "DMCCmulti.h"
+#include "DMCClog.h"
+
+// nowNs - monotonic time in nanoseconds
+static unsigned long long nowNs(void)
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (unsigned long long)t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+// ------------------------
+// Work done on a bus
+// ------------------------
+
+// readStatus - reads the status of one cape (one status update command,
+//              then the QEI, velocity and current registers in one read)
+static void readStatus(DMCCmulti *multi, int cape, DMCCcapeStatus *status)
+{
+    int fd = multi->session[cape];
+    DMCCregs regs;
+
+    status->bus = multi->bus[cape];
+    status->capeAddr = multi->capeAddr[cape];
+    status->timeUs = DMCCclock(fd);
+
+    // Status update command, then 0x10 - 0x1f: QEI (4 bytes each),
+    // velocity, current (2 bytes each); the fields are 0 if a read fails
+    status->error = DMCCreadStatus(fd, DMCC_REG_QEI1,
+                                    DMCC_REG_CURRENT2 + 2 - DMCC_REG_QEI1, &regs);
+    if (status->error == DMCC_OK) {
+        status->error = DMCCreadRegs(fd, DMCC_REG_VOLTAGE, 2, &regs);
+    } else {
+        regs.voltage = 0;
+    }
+    status->qei[0] = regs.qei1;
+    status->qei[1] = regs.qei2;
+    status->vel[0] = regs.qeiVel1;
+    status->vel[1] = regs.qeiVel2;
+    status->current[0] = regs.current1;
+    status->current[1] = regs.current2;
+    status->voltage = regs.voltage;
+}
+
+// runCommand - sends one command to its cape
+// Returns: DMCC_OK, or why the command failed
+static int runCommand(DMCCmulti *multi, const DMCCmotorCommand *command)
+{
+    int fd = multi->session[command->cape];
+
+    if (command->type == DMCC_CMD_POWER) {
+        return setMotorPower(fd, command->motor, command->value);
+    } else if (command->type == DMCC_CMD_POS) {
+        return setTargetPos(fd, command->motor, command->value);
+    } else if (command->type == DMCC_CMD_VEL) {
+        return setTargetVel(fd, command->motor, command->value);
+    }
+    return DMCC_EINVAL;
+}
+
+// workerMain - runs every job on the capes of one bus
+static void *workerMain(void *arg)
+{
+    DMCCmultiWorker *worker = (DMCCmultiWorker *)arg;
+    DMCCmulti *multi = worker->multi;
+    int i;
+
+    for (;;) {
+        pthread_mutex_lock(&multi->lock);
+        while (!multi->quit && (worker->seen == multi->generation)) {
+            pthread_cond_wait(&multi->wake, &multi->lock);
+        }
+        if (multi->quit) {
+            pthread_mutex_unlock(&multi->lock);
+            return NULL;
+        }
+        worker->seen = multi->generation;
+        DMCCcapeStatus *status = multi->status;
+        DMCCmotorCommand *commands = multi->commands;
+        int numCommands = multi->numCommands;
+        pthread_mutex_unlock(&multi->lock);
+
+        unsigned long long start = nowNs();
+        if (status != NULL) {
+            for (i = 0; i < worker->numCapes; i++) {
+                readStatus(multi, worker->capes[i],
+                            &status[worker->capes[i]]);
+            }
+        } else {
+            for (i = 0; i < numCommands; i++) {
+                int cape = commands[i].cape;
+                // Each command is only written by the worker of its bus
+                if ((cape >= 0) && (cape < multi->numCapes) &&
+                        (multi->bus[cape] == worker->bus)) {
+                    commands[i].result = runCommand(multi, &commands[i]);
+                }
+            }
+        }
+        unsigned long long busy = nowNs() - start;
+
+        pthread_mutex_lock(&multi->lock);
+        worker->jobs++;
+        worker->busyNs += busy;
+        multi->running--;
+        if (multi->running == 0) {
+            pthread_cond_signal(&multi->done);
+        }
+        pthread_mutex_unlock(&multi->lock);
+    }
+}
+
+// runJob - hands the job in multi to every worker and waits for all
+static void runJob(DMCCmulti *multi)
+{
+    pthread_mutex_lock(&multi->lock);
+    multi->generation++;
+    multi->running = multi->numWorkers;
+    pthread_cond_broadcast(&multi->wake);
+    while (multi->running > 0) {
+        pthread_cond_wait(&multi->done, &multi->lock);
+    }
+    multi->status = NULL;
+    multi->commands = NULL;
+    multi->numCommands = 0;
+    pthread_mutex_unlock(&multi->lock);
+}
+
+// ------------------------
+// Executor
+// ------------------------
+
+// stopWorkers - stops the first count workers
+static void stopWorkers(DMCCmulti *multi, int count)
+{
+    int i;
+
+    pthread_mutex_lock(&multi->lock);
+    multi->quit = 1;
+    pthread_cond_broadcast(&multi->wake);
+    pthread_mutex_unlock(&multi->lock);
+    for (i = 0; i < count; i++) {
+        pthread_join(multi->worker[i].thread, NULL);
+    }
+}
+
+// endSessions - ends the first count sessions
+static void endSessions(DMCCmulti *multi, int count)
+{
+    int i;
+
+    for (i = 0; i < count; i++) {
+        DMCCend(multi->session[i]);
+    }
+}
+
+int DMCCmultiOpen(DMCCmulti *multi, const DMCCcapeInfo *capes, int count)
+{
+    DMCCmultiWorker tmp;
+    int i, j;
+
+    memset(multi, 0, sizeof(DMCCmulti));
+    if ((count <= 0) || (count > DMCC_MULTI_MAX_CAPES)) {
+        LOG_ERROR("number of capes must be 1 - %d", DMCC_MULTI_MAX_CAPES);
+        return -1;
+    }
+
+    // One worker for every bus with a cape on it
+    for (i = 0; i < count; i++) {
+        for (j = 0; j < multi->numWorkers; j++) {
+            if (multi->worker[j].bus == capes[i].bus) {
+                break;
+            }
+        }
+        if (j == multi->numWorkers) {
+            if (j == DMCC_MULTI_MAX_BUSES) {
+                LOG_ERROR("more than %d buses", DMCC_MULTI_MAX_BUSES);
+                return -1;
+            }
+            multi->worker[j].bus = capes[i].bus;
+            multi->numWorkers++;
+        }
+        multi->worker[j].capes[multi->worker[j].numCapes++] = i;
+    }
+    // Workers in bus order
+    for (i = 1; i < multi->numWorkers; i++) {
+        for (j = i; (j > 0) &&
+                (multi->worker[j - 1].bus > multi->worker[j].bus); j--) {
+            tmp = multi->worker[j];
+            multi->worker[j] = multi->worker[j - 1];
+            multi->worker[j - 1] = tmp;
+        }
+    }
+
+    for (i = 0; i < count; i++) {
+        multi->session[i] = DMCCstartBus(capes[i].bus, capes[i].capeAddr);
+        if (multi->session[i] < 0) {
+            endSessions(multi, i);
+            return -1;
+        }
+        multi->bus[i] = capes[i].bus;
+        multi->capeAddr[i] = capes[i].capeAddr;
+        multi->numCapes++;
+    }
+
+    pthread_mutex_init(&multi->lock, NULL);
+    pthread_cond_init(&multi->wake, NULL);
+    pthread_cond_init(&multi->done, NULL);
+    multi->statsStartNs = nowNs();
+    for (i = 0; i < multi->numWorkers; i++) {
+        multi->worker[i].multi = multi;
+        if (pthread_create(&multi->worker[i].thread, NULL, workerMain,
+                            &multi->worker[i]) != 0) {
+            LOG_ERROR("cannot start the worker of bus %d",
+                        multi->worker[i].bus);
+            stopWorkers(multi, i);
+            endSessions(multi, count);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void DMCCmultiClose(DMCCmulti *multi)
+{
+    stopWorkers(multi, multi->numWorkers);
+    endSessions(multi, multi->numCapes);
+    pthread_mutex_destroy(&multi->lock);
+    pthread_cond_destroy(&multi->wake);
+    pthread_cond_destroy(&multi->done);
+    multi->numWorkers = 0;
+    multi->numCapes = 0;
+}
+
+void DMCCmultiReadStatus(DMCCmulti *multi, DMCCcapeStatus *status)
+{
+    multi->status = status;
+    runJob(multi);
+}
+
+int DMCCmultiSend(DMCCmulti *multi, DMCCmotorCommand *commands, int count)
+{
+    int failed = 0;
+    int i;
+
+    // The workers skip commands for no cape, and fail invalid types
+    for (i = 0; i < count; i++) {
+        commands[i].result = DMCC_OK;
+        if ((commands[i].cape < 0) || (commands[i].cape >= multi->numCapes)) {
+            LOG_ERROR("invalid cape %d in command %d", commands[i].cape, i);
+            commands[i].result = DMCC_EINVAL;
+        } else if ((commands[i].type < DMCC_CMD_POWER) ||
+                (commands[i].type > DMCC_CMD_VEL)) {
+            LOG_ERROR("invalid type %d in command %d", commands[i].type, i);
+        }
+    }
+    multi->commands = commands;
+    multi->numCommands = count;
+    runJob(multi);
+
+    for (i = 0; i < count; i++) {
+        failed += (commands[i].result != DMCC_OK);
+    }
+    return failed;
+}
+
+int DMCCmultiSession(DMCCmulti *multi, int cape)
+{
+    if ((cape < 0) || (cape >= multi->numCapes)) {
+        return -1;
+    }
+    return multi->session[cape];
+}
+
+int DMCCmultiGetBusStats(DMCCmulti *multi, int index, DMCCbusStats *stats)
+{
+    if ((index < 0) || (index >= multi->numWorkers)) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&multi->lock);
+    DMCCmultiWorker *worker = &multi->worker[index];
+    stats->bus = worker->bus;
+    stats->capes = worker->numCapes;
+    stats->jobs = worker->jobs;
+    stats->busyUs = worker->busyNs / 1000;
+    stats->elapsedUs = (nowNs() - multi->statsStartNs) / 1000;
+    pthread_mutex_unlock(&multi->lock);
+
+    stats->utilization = (stats->elapsedUs > 0) ?
+        (double)stats->busyUs / stats->elapsedUs : 0.0;
+    return 0;
+}
+
+void DMCCmultiResetStats(DMCCmulti *multi)
+{
+    int i;
+
+    pthread_mutex_lock(&multi->lock);
+    for (i = 0; i < multi->numWorkers; i++) {
+        multi->worker[i].jobs = 0;
+        multi->worker[i].busyNs = 0;
+    }
+    multi->statsStartNs = nowNs();
+    pthread_mutex_unlock(&multi->lock);
+}
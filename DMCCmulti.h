@@ -0,0 +1,162 @@
+//
+// Copyright (C) 2013-2016 - Exadler Technologies Inc., Sarah Tan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+
+// DMCCmulti.h - driving capes on several i2c buses at the same time
+//
+// Every bus gets its own worker thread, which owns the sessions of the
+// capes on that bus.  A status read or a batch of commands is handed to all
+// workers at once and returns when every bus is done, so capes on
+// different adapters transfer in parallel while capes sharing an adapter
+// still take turns.  Open the capes found by DMCCenumerate (DMCCprobe.h).
+
+#ifndef DMCCMULTI
+#define DMCCMULTI
+
+#include <pthread.h>
+
+#include "DMCCprobe.h"
+
+#define DMCC_MULTI_MAX_BUSES 16
+#define DMCC_MULTI_MAX_CAPES 64
+
+// Command types (DMCCmotorCommand.type)
+#define DMCC_CMD_POWER 0        // setMotorPower
+#define DMCC_CMD_POS   1        // setTargetPos
+#define DMCC_CMD_VEL   2        // setTargetVel
+
+// DMCCmotorCommand - one motor command of a batch
+typedef struct DMCCmotorCommand {
+    int cape;               // index of the cape (order given to DMCCmultiOpen)
+    int type;               // DMCC_CMD_*
+    unsigned int motor;     // motor number [1-2]
+    int value;              // power, position or velocity
+    int result;             // DMCC_OK, or why the command failed (set by
+                            // DMCCmultiSend)
+} DMCCmotorCommand;
+
+// DMCCcapeStatus - status of one cape (from one status update command)
+typedef struct DMCCcapeStatus {
+    int bus;                    // i2c adapter number
+    unsigned char capeAddr;     // board number [0-3]
+    unsigned long long timeUs;  // DMCCclock of the session when read
+    int qei[2];                 // QEI position of motor 1 and 2
+    int vel[2];                 // QEI velocity of motor 1 and 2
+    unsigned int current[2];    // current of motor 1 and 2
+    unsigned int voltage;       // motor supply voltage
+    int error;                  // DMCC_OK, or why the status is not read
+} DMCCcapeStatus;
+
+// DMCCbusStats - how busy the worker of a bus has been
+typedef struct DMCCbusStats {
+    int bus;                    // i2c adapter number
+    int capes;                  // capes on the bus
+    unsigned long long jobs;    // status reads and batches run
+    unsigned long long busyUs;  // time spent on the bus
+    unsigned long long elapsedUs;   // time since open or DMCCmultiResetStats
+    double utilization;         // busyUs / elapsedUs
+} DMCCbusStats;
+
+// DMCCmultiWorker - the thread that owns one bus
+typedef struct DMCCmultiWorker {
+    struct DMCCmulti *multi;
+    pthread_t thread;
+    int bus;
+    int numCapes;
+    int capes[DMCC_MULTI_MAX_CAPES];    // indices of its capes
+    unsigned long long seen;            // last job generation run
+    unsigned long long jobs;
+    unsigned long long busyNs;
+} DMCCmultiWorker;
+
+// DMCCmulti - capes on several buses and their workers
+typedef struct DMCCmulti {
+    int numCapes;
+    int session[DMCC_MULTI_MAX_CAPES];
+    int bus[DMCC_MULTI_MAX_CAPES];
+    unsigned char capeAddr[DMCC_MULTI_MAX_CAPES];
+    int numWorkers;
+    DMCCmultiWorker worker[DMCC_MULTI_MAX_BUSES];
+
+    // Job handed to the workers (guarded by lock)
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_cond_t done;
+    unsigned long long generation;
+    int running;
+    int quit;
+    DMCCcapeStatus *status;
+    DMCCmotorCommand *commands;
+    int numCommands;
+    unsigned long long statsStartNs;
+} DMCCmulti;
+
+// DMCCmultiOpen - Starts a session on every cape (DMCCstartBus) and one
+//                 worker thread per bus
+//                 Logs an error if a cape or a worker cannot be started
+// Parameters: multi - executor to open
+//             capes - capes to drive (e.g. from DMCCenumerate)
+//             count - number of capes
+// Returns: -1 - if an error occurs (nothing is left open)
+//           0 - otherwise
+int DMCCmultiOpen(DMCCmulti *multi, const DMCCcapeInfo *capes, int count);
+
+// DMCCmultiClose - Stops the workers and ends every session
+// Parameters: multi - executor from DMCCmultiOpen
+void DMCCmultiClose(DMCCmulti *multi);
+
+// DMCCmultiReadStatus - Reads the status of every cape, all buses at once
+// Parameters: multi - executor from DMCCmultiOpen
+//             status - where to put the status of each cape (same order
+//                      as given to DMCCmultiOpen)
+void DMCCmultiReadStatus(DMCCmulti *multi, DMCCcapeStatus *status);
+
+// DMCCmultiSend - Sends a batch of commands, all buses at once (commands
+//                 for the same cape are sent in the order given)
+//                 Logs an error for commands with an invalid cape or type
+// Parameters: multi - executor from DMCCmultiOpen
+//             commands - commands to send (the result of each is set)
+//             count - number of commands
+// Returns: number of commands that failed (result is not DMCC_OK)
+int DMCCmultiSend(DMCCmulti *multi, DMCCmotorCommand *commands, int count);
+
+// DMCCmultiSession - Gets the session of a cape, e.g. for DMCCgetStats
+//                    (only use it while no job is running)
+// Parameters: multi - executor from DMCCmultiOpen
+//             cape - index of the cape
+// Returns: session
+//          -1 - if the index is invalid
+int DMCCmultiSession(DMCCmulti *multi, int cape);
+
+// DMCCmultiGetBusStats - Gets how busy the worker of a bus has been
+// Parameters: multi - executor from DMCCmultiOpen
+//             index - worker number [0 - numWorkers-1], in bus order
+//             stats - where to put the statistics
+// Returns: -1 - if the index is invalid
+//           0 - otherwise
+int DMCCmultiGetBusStats(DMCCmulti *multi, int index, DMCCbusStats *stats);
+
+// DMCCmultiResetStats - Clears the statistics of every bus
+// Parameters: multi - executor from DMCCmultiOpen
+void DMCCmultiResetStats(DMCCmulti *multi);
+
+#endif
@@ -0,0 +1,423 @@
+//
+// Copyright (C) 2013-2016 - Exadler Technologies Inc., Sarah Tan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "DMCC.h"
+#include "DMCCprobe.h"
+#include "DMCClog.h"
+
+// Version number bytes in the cape EEPROM
+#define EEPROM_VERSION_OFFSET 40
+
+// Address of the cape EEPROM (board 0 - 3)
+#define EEPROM_ADDR 0x54
+
+#define BOOT_ID_FILE "/proc/sys/kernel/random/boot_id"
+#define BOOT_ID_LEN 36
+#define MAX_LINE 128
+#define MAX_ENTRIES 64          // buses x addresses kept in the cache
+#define MAX_BUSES 32            // adapters looked at by DMCCenumerate
+
+void DMCCsystemPath(char *path, size_t size, const char *name)
+{
+    char full[256];
+    char *root = getenv(DMCC_ROOT_ENV);
+
+    if ((root == NULL) || (root[0] == '\0')) {
+        root = "";
+    }
+    snprintf(full, sizeof(full), "%s%s", root, name);
+    snprintf(path, size, "%s", full);
+}
+
+// ------------------------
+// Probing
+// ------------------------
+
+int DMCCreadBoardVersion(int bus, unsigned char capeAddr)
+{
+    char file[64];
+    unsigned char v[2];
+
+    if (capeAddr >= DMCC_MAX_CAPES) {
+        return -1;
+    }
+    snprintf(file, sizeof(file), "/sys/bus/i2c/devices/%d-%04x/eeprom", bus,
+                EEPROM_ADDR + capeAddr);
+    DMCCsystemPath(file, sizeof(file), file);
+    int fd = open(file, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    ssize_t n = pread(fd, v, 2, EEPROM_VERSION_OFFSET);
+    close(fd);
+    if (n != 2) {
+        return -1;
+    }
+
+    int high = v[0] & 0x0f;
+    int low = v[1] & 0x0f;
+    if ((high > 0x09) || (low > 0x09)) {
+        return -1;
+    }
+    return (high * 10) + low;
+}
+
+int DMCCidVersion(const char *id)
+{
+    if ((strncmp(id, "DMCC Mk.", 8) != 0) ||
+            (id[8] < '0') || (id[8] > '9') || (id[9] < '0') || (id[9] > '9')) {
+        return -1;
+    }
+    return ((id[8] - '0') * 10) + (id[9] - '0');
+}
+
+// probeOne - probes one address of a bus through a session on it
+// Returns: -1 - if no session can be opened at the address (info says
+//               there is no cape)
+static int probeOne(int bus, unsigned char capeAddr, DMCCcapeInfo *info)
+{
+    int i;
+
+    memset(info, 0, sizeof(DMCCcapeInfo));
+    info->bus = bus;
+    info->capeAddr = capeAddr;
+    info->boardVersion = -1;
+    info->softwareVersion = -1;
+
+    // The session reads the ID (one burst) to find the firmware version
+    int session = DMCCstartBus(bus, capeAddr);
+    if (session < 0) {
+        return -1;
+    }
+    if (DMCCgetID(session, info->id, sizeof(info->id)) != 0) {
+        info->id[0] = '\0';
+    }
+    // The ID is kept as the cape gave it, up to its padding (the cache
+    // holds one cape per line, so it stops at any unprintable byte)
+    for (i = 0; info->id[i] != '\0'; i++) {
+        if ((info->id[i] < ' ') || (info->id[i] > '~')) {
+            info->id[i] = '\0';
+            break;
+        }
+    }
+    // Firmware whose version cannot be read from the ID (a variant or a
+    // newer format) is still listed, with software version -1
+    info->softwareVersion = DMCCidVersion(info->id);
+    if ((info->softwareVersion > 0) || (strncmp(info->id, "DMCC", 4) == 0)) {
+        info->present = 1;
+        info->boardVersion = DMCCreadBoardVersion(bus, capeAddr);
+    }
+    DMCCend(session);
+    return 0;
+}
+
+// ------------------------
+// Cache (one line per bus and address, valid for one boot)
+// ------------------------
+
+// cachePath - file name of the cache
+static const char *cachePath(void)
+{
+    char *path = getenv(DMCC_PROBE_CACHE_ENV);
+    if ((path != NULL) && (path[0] != '\0')) {
+        return path;
+    }
+    return DMCC_PROBE_CACHE;
+}
+
+// bootID - identifies this boot of the system
+// Returns: -1 - if it cannot be found (nothing is cached then)
+static int bootID(char *id)
+{
+    int fd = open(BOOT_ID_FILE, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    ssize_t n = read(fd, id, BOOT_ID_LEN);
+    close(fd);
+    if (n != BOOT_ID_LEN) {
+        return -1;
+    }
+    id[BOOT_ID_LEN] = '\0';
+    return 0;
+}
+
+// parseEntry - reads a cache line
+// Returns: -1 - if the line is not an entry
+static int parseEntry(const char *line, DMCCcapeInfo *info)
+{
+    int bus, addr, present, boardVer, softVer, n = 0;
+
+    memset(info, 0, sizeof(DMCCcapeInfo));
+    if ((sscanf(line, "%d %d %d %d %d %n", &bus, &addr, &present, &boardVer,
+                    &softVer, &n) < 5) || (n == 0) ||
+            (addr < 0) || (addr >= DMCC_MAX_CAPES)) {
+        return -1;
+    }
+    info->bus = bus;
+    info->capeAddr = addr;
+    info->present = (present != 0);
+    info->boardVersion = boardVer;
+    info->softwareVersion = softVer;
+    strncpy(info->id, line + n, DMCC_ID_LEN);
+    info->id[strcspn(info->id, "\n")] = '\0';
+    return 0;
+}
+
+// cacheLoad - reads the entries of this boot (with read() into the stack,
+//             not stdio, so checkVersion never allocates)
+// Returns: number of entries
+static int cacheLoad(DMCCcapeInfo *entries, int max)
+{
+    char boot[BOOT_ID_LEN + 1];
+    char text[MAX_LINE * (MAX_ENTRIES + 1)];
+    ssize_t len = 0;
+    ssize_t got;
+    int n = 0;
+
+    if (bootID(boot) != 0) {
+        return 0;
+    }
+    // A cache someone else could have written is not trusted
+    struct stat st;
+    int fd = open(cachePath(), O_RDONLY | O_NOFOLLOW);
+    if (fd < 0) {
+        return 0;
+    }
+    if ((fstat(fd, &st) != 0) || !S_ISREG(st.st_mode) ||
+            ((st.st_uid != geteuid()) && (st.st_uid != 0)) ||
+            ((st.st_mode & (S_IWGRP | S_IWOTH)) != 0)) {
+        close(fd);
+        return 0;
+    }
+    while ((len < (ssize_t)sizeof(text) - 1) &&
+            ((got = read(fd, text + len, sizeof(text) - 1 - len)) > 0)) {
+        len += got;
+    }
+    close(fd);
+    text[len] = '\0';
+
+    // First line is the boot the entries belong to
+    if (strncmp(text, boot, BOOT_ID_LEN) != 0) {
+        return 0;
+    }
+    char *line = strchr(text, '\n');
+    while ((line != NULL) && (n < max)) {
+        line++;
+        char *end = strchr(line, '\n');
+        if (end != NULL) {
+            *end = '\0';
+        }
+        if (parseEntry(line, &entries[n]) == 0) {
+            n++;
+        }
+        line = end;
+    }
+    return n;
+}
+
+// cacheFind - looks up a bus and address in the cache
+// Returns: -1 - if it is not cached
+static int cacheFind(int bus, unsigned char capeAddr, DMCCcapeInfo *info)
+{
+    DMCCcapeInfo entries[MAX_ENTRIES];
+    int i;
+
+    int n = cacheLoad(entries, MAX_ENTRIES);
+    for (i = 0; i < n; i++) {
+        if ((entries[i].bus == bus) && (entries[i].capeAddr == capeAddr)) {
+            *info = entries[i];
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// cacheStore - adds (or replaces) entries in the cache
+static void cacheStore(const DMCCcapeInfo *info, int count)
+{
+    DMCCcapeInfo entries[MAX_ENTRIES];
+    char boot[BOOT_ID_LEN + 1];
+    char tmp[256];
+    int i, j;
+
+    if (bootID(boot) != 0) {
+        return;
+    }
+    int n = cacheLoad(entries, MAX_ENTRIES);
+    for (i = 0; i < count; i++) {
+        for (j = 0; j < n; j++) {
+            if ((entries[j].bus == info[i].bus) &&
+                    (entries[j].capeAddr == info[i].capeAddr)) {
+                break;
+            }
+        }
+        if (j < MAX_ENTRIES) {
+            entries[j] = info[i];
+            n = (j == n) ? n + 1 : n;
+        }
+    }
+
+    // Written next to the cache and renamed, so readers never see half
+    char text[MAX_LINE * (MAX_ENTRIES + 1)];
+    int len = snprintf(text, sizeof(text), "%s\n", boot);
+    for (j = 0; (j < n) && (len < (int)sizeof(text)); j++) {
+        len += snprintf(text + len, sizeof(text) - len, "%d %d %d %d %d %s\n",
+                        entries[j].bus, entries[j].capeAddr,
+                        entries[j].present, entries[j].boardVersion,
+                        entries[j].softwareVersion, entries[j].id);
+    }
+    if (len >= (int)sizeof(text)) {
+        return;
+    }
+    // mkstemp makes a new file (O_EXCL), so a link planted under the
+    // temporary name cannot redirect the write
+    if (strcmp(cachePath(), DMCC_PROBE_CACHE) == 0) {
+        mkdir(DMCC_PROBE_DIR, 0755);
+    }
+    if (snprintf(tmp, sizeof(tmp), "%s.XXXXXX", cachePath()) >=
+            (int)sizeof(tmp)) {
+        return;
+    }
+    int fd = mkstemp(tmp);
+    if (fd < 0) {
+        return;
+    }
+    int written = (fchmod(fd, 0644) == 0) && (write(fd, text, len) == len);
+    if ((close(fd) != 0) || !written || (rename(tmp, cachePath()) != 0)) {
+        unlink(tmp);
+    }
+}
+
+int DMCCprobeCapes(int bus, DMCCcapeInfo info[DMCC_MAX_CAPES], int useCache)
+{
+    DMCCcapeInfo entries[MAX_ENTRIES];
+    int found = 0;
+    int cached = 0;
+    int i, j;
+
+    if (useCache) {
+        int n = cacheLoad(entries, MAX_ENTRIES);
+        for (i = 0; i < DMCC_MAX_CAPES; i++) {
+            for (j = 0; j < n; j++) {
+                if ((entries[j].bus == bus) && (entries[j].capeAddr == i)) {
+                    info[i] = entries[j];
+                    cached++;
+                    break;
+                }
+            }
+        }
+    }
+
+    if (cached < DMCC_MAX_CAPES) {
+        // An address that cannot be opened (e.g. a kernel driver owns it,
+        // EBUSY) has no cape to drive; the bus is only given up if no
+        // address can be opened
+        int opened = 0;
+        for (i = 0; i < DMCC_MAX_CAPES; i++) {
+            if (probeOne(bus, i, &info[i]) == 0) {
+                opened++;
+            }
+        }
+        if (opened == 0) {
+            return -1;
+        }
+        cacheStore(info, DMCC_MAX_CAPES);
+    }
+
+    for (i = 0; i < DMCC_MAX_CAPES; i++) {
+        found += info[i].present;
+    }
+    return found;
+}
+
+int DMCCprobeCape(int bus, unsigned char capeAddr, DMCCcapeInfo *info,
+                    int useCache)
+{
+    if (capeAddr >= DMCC_MAX_CAPES) {
+        LOG_ERROR("invalid cape address specified");
+        return -1;
+    }
+    if (useCache && (cacheFind(bus, capeAddr, info) == 0)) {
+        return 0;
+    }
+
+    if (probeOne(bus, capeAddr, info) != 0) {
+        return -1;
+    }
+    cacheStore(info, 1);
+    return 0;
+}
+
+// compareBus - qsort order of bus numbers
+static int compareBus(const void *a, const void *b)
+{
+    return *(const int *)a - *(const int *)b;
+}
+
+int DMCCenumerate(DMCCcapeInfo *capes, int max, int useCache)
+{
+    DMCCcapeInfo info[DMCC_MAX_CAPES];
+    int buses[MAX_BUSES];
+    char dir[256];
+    struct dirent *entry;
+    int numBuses = 0;
+    int found = 0;
+    int i, j, bus, n;
+
+    DMCCsystemPath(dir, sizeof(dir), "/dev");
+    DIR *d = opendir(dir);
+    if (d == NULL) {
+        LOG_ERROR("cannot open %s", dir);
+        return -1;
+    }
+    while (((entry = readdir(d)) != NULL) && (numBuses < MAX_BUSES)) {
+        n = 0;
+        if ((sscanf(entry->d_name, "i2c-%d%n", &bus, &n) == 1) &&
+                (entry->d_name[n] == '\0') && (bus >= 0)) {
+            buses[numBuses++] = bus;
+        }
+    }
+    closedir(d);
+    qsort(buses, numBuses, sizeof(int), compareBus);
+
+    for (i = 0; i < numBuses; i++) {
+        // A bus that cannot be opened has no capes to drive
+        if (DMCCprobeCapes(buses[i], info, useCache) <= 0) {
+            continue;
+        }
+        for (j = 0; j < DMCC_MAX_CAPES; j++) {
+            if (info[j].present && (found < max)) {
+                capes[found++] = info[j];
+            }
+        }
+    }
+    return found;
+}
@@ -0,0 +1,112 @@
+//
+// Copyright (C) 2013-2016 - Exadler Technologies Inc., Sarah Tan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+// DMCCprobe.h - finding the capes on a bus and their versions
+//
+// Probing a cape reads the board version from its EEPROM (one pread) and
+// the ID string at register 0xe0 (one burst read).  Results are kept in a
+// cache file until the next boot, so programs started later do not touch
+// the bus or the EEPROMs again.  checkVersion uses the cache too.
+//
+// DMCCenumerate looks at every /dev/i2c-* adapter.  Each cape it finds is
+// opened with DMCCstartBus(info.bus, info.capeAddr); capes on different
+// buses do not share a bus, so they can be driven in parallel.
+
+#ifndef DMCCPROBE
+#define DMCCPROBE
+
+#include <stddef.h>
+
+// Cache file (the DMCC_PROBE_CACHE environment variable overrides it).  It
+// is kept out of /tmp: a cache is only read if it belongs to root or to
+// the user running the program and nobody else can write it
+#define DMCC_PROBE_DIR "/run/dmcc"
+#define DMCC_PROBE_CACHE DMCC_PROBE_DIR "/probe.cache"
+#define DMCC_PROBE_CACHE_ENV "DMCC_PROBE_CACHE"
+
+// Directory that /dev and /sys are found in (for a fake tree when testing)
+#define DMCC_ROOT_ENV "DMCC_ROOT"
+
+#define DMCC_MAX_CAPES 4        // cape addresses 0x2c - 0x2f
+#define DMCC_ID_LEN 16          // bytes of ID at register 0xe0
+
+// DMCCcapeInfo - what was found at one cape address
+typedef struct DMCCcapeInfo {
+    int bus;                    // i2c adapter number (/dev/i2c-<bus>)
+    unsigned char capeAddr;     // board number [0-3]
+    unsigned char present;      // 1 if a DMCC cape answered (its ID starts
+                                // with "DMCC")
+    int boardVersion;           // version in the EEPROM (-1 if not found)
+    int softwareVersion;        // version in the ID string (-1 if not found
+                                // or the ID is not in the "DMCC Mk.07" form)
+    char id[DMCC_ID_LEN + 1];   // ID string as read, up to the first
+                                // unprintable byte (NUL terminated)
+} DMCCcapeInfo;
+
+// DMCCprobeCapes - Finds the DMCC capes at all four addresses of a bus
+// Parameters: bus - i2c adapter number (1 on the BeagleBone headers)
+//             info - where to put what was found at each address
+//             useCache - 0 to ignore (and then refresh) the cache
+// Returns: number of capes found (an address that cannot be opened, e.g.
+//          one a kernel driver owns, has no cape)
+//          -1 - if the bus cannot be opened at any address
+int DMCCprobeCapes(int bus, DMCCcapeInfo info[DMCC_MAX_CAPES], int useCache);
+
+// DMCCenumerate - Finds the DMCC capes on all i2c buses (/dev/i2c-*)
+// Parameters: capes - where to put the capes found (by bus, then address)
+//             max - size of capes
+//             useCache - 0 to ignore (and then refresh) the cache
+// Returns: number of capes found (at most max)
+//          -1 - if the list of buses cannot be read
+int DMCCenumerate(DMCCcapeInfo *capes, int max, int useCache);
+
+// DMCCprobeCape - Same as DMCCprobeCapes for one address
+// Parameters: bus - i2c adapter number
+//             capeAddr - board number [0-3]
+//             info - what was found
+//             useCache - 0 to ignore (and then refresh) the cache
+// Returns: -1 - if the bus cannot be opened or the address is invalid
+//           0 - otherwise (info->present tells if there is a cape)
+int DMCCprobeCape(int bus, unsigned char capeAddr, DMCCcapeInfo *info,
+                    int useCache);
+
+// DMCCreadBoardVersion - Reads the board version from the cape EEPROM
+// Parameters: bus - i2c adapter number
+//             capeAddr - board number [0-3]
+// Returns: board version
+//          -1 - if the EEPROM cannot be read or holds no version
+int DMCCreadBoardVersion(int bus, unsigned char capeAddr);
+
+// DMCCidVersion - Software version in an ID string ("DMCC Mk.07" is 7)
+// Parameters: id - ID string read from register 0xe0
+// Returns: software version
+//          -1 - if the ID is not the ID of a DMCC cape
+int DMCCidVersion(const char *id);
+
+// DMCCsystemPath - Puts the DMCC_ROOT directory (if set) in front of a
+//                  path under /dev or /sys
+// Parameters: path - where to put the path (may be the same as name)
+//             size - size of path
+//             name - path on the system, e.g. "/dev/i2c-1"
+void DMCCsystemPath(char *path, size_t size, const char *name);
+
+#endif
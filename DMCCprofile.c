@@ -0,0 +1,387 @@
+//
+// Copyright (C) 2013-2016 - Exadler Technologies Inc., Sarah Tan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "DMCC.h"
+#include "DMCCprofile.h"
+#include "DMCCtrace.h"
+#include "DMCClog.h"
+
+#define MAX_LINE 64
+#define MAX_FILE 2048
+
+// Thresholds of the move functions (DMCC.c)
+extern int QEI_Threshold_1;
+extern int QEI_Vel_Threshold_1;
+extern int QEI_Threshold_2;
+extern int QEI_Vel_Threshold_2;
+
+// Registers a profile sets, in address order
+static const unsigned char Profile_Regs[] = {
+    DMCC_REG_CONFIG, DMCC_REG_PID_LIMIT1, DMCC_REG_PID_LIMIT2,
+    DMCC_REG_POS_P1, DMCC_REG_POS_I1, DMCC_REG_POS_D1,
+    DMCC_REG_VEL_P1, DMCC_REG_VEL_I1, DMCC_REG_VEL_D1,
+    DMCC_REG_POS_P2, DMCC_REG_POS_I2, DMCC_REG_POS_D2,
+    DMCC_REG_VEL_P2, DMCC_REG_VEL_I2, DMCC_REG_VEL_D2
+};
+
+#define NUM_PROFILE_REGS (int)(sizeof(Profile_Regs) / sizeof(Profile_Regs[0]))
+
+// ProfileItem - one line of a profile file
+typedef struct ProfileItem {
+    const char *name;
+    size_t offset;              // of the int in DMCCprofile
+    int bit;                    // bit of that int, 0 for the whole value
+} ProfileItem;
+
+#define PROFILE_FIELD(field) offsetof(DMCCprofile, field)
+
+static const ProfileItem Profile_Items[] = {
+    {"motorDir1", PROFILE_FIELD(regs.config), DMCC_PROFILE_MOTOR_DIR1},
+    {"motorDir2", PROFILE_FIELD(regs.config), DMCC_PROFILE_MOTOR_DIR2},
+    {"qeiDir1", PROFILE_FIELD(regs.config), DMCC_PROFILE_QEI_DIR1},
+    {"qeiDir2", PROFILE_FIELD(regs.config), DMCC_PROFILE_QEI_DIR2},
+    {"pidLimit1", PROFILE_FIELD(regs.pidLimit1), 0},
+    {"pidLimit2", PROFILE_FIELD(regs.pidLimit2), 0},
+    {"posP1", PROFILE_FIELD(regs.posP1), 0},
+    {"posI1", PROFILE_FIELD(regs.posI1), 0},
+    {"posD1", PROFILE_FIELD(regs.posD1), 0},
+    {"velP1", PROFILE_FIELD(regs.velP1), 0},
+    {"velI1", PROFILE_FIELD(regs.velI1), 0},
+    {"velD1", PROFILE_FIELD(regs.velD1), 0},
+    {"posP2", PROFILE_FIELD(regs.posP2), 0},
+    {"posI2", PROFILE_FIELD(regs.posI2), 0},
+    {"posD2", PROFILE_FIELD(regs.posD2), 0},
+    {"velP2", PROFILE_FIELD(regs.velP2), 0},
+    {"velI2", PROFILE_FIELD(regs.velI2), 0},
+    {"velD2", PROFILE_FIELD(regs.velD2), 0},
+    {"qeiThreshold1", PROFILE_FIELD(qeiThreshold[0]), 0},
+    {"qeiThreshold2", PROFILE_FIELD(qeiThreshold[1]), 0},
+    {"qeiVelThreshold1", PROFILE_FIELD(qeiVelThreshold[0]), 0},
+    {"qeiVelThreshold2", PROFILE_FIELD(qeiVelThreshold[1]), 0}
+};
+
+#define NUM_PROFILE_ITEMS \
+    (int)(sizeof(Profile_Items) / sizeof(Profile_Items[0]))
+
+// itemValue - the int a profile file line sets
+static int *itemValue(DMCCprofile *profile, const ProfileItem *item)
+{
+    return (int *)((char *)profile + item->offset);
+}
+
+void DMCCprofileDefaults(DMCCprofile *profile)
+{
+    memset(profile, 0, sizeof(DMCCprofile));
+
+    // Same constants as setDefaultPIDConstants
+    profile->regs.posP1 = -5248;
+    profile->regs.posI1 = -75;
+    profile->regs.posD1 = -500;
+    profile->regs.velP1 = -19200;
+    profile->regs.velI1 = -8000;
+    profile->regs.velD1 = -150;
+    profile->regs.posP2 = -10000;
+    profile->regs.posI2 = -75;
+    profile->regs.posD2 = -500;
+    profile->regs.velP2 = -19200;
+    profile->regs.velI2 = -8000;
+    profile->regs.velD2 = -150;
+
+    profile->qeiThreshold[0] = 30;
+    profile->qeiThreshold[1] = 30;
+    profile->qeiVelThreshold[0] = 5;
+    profile->qeiVelThreshold[1] = 5;
+}
+
+// ------------------------
+// Cape
+// ------------------------
+
+// readProfileRegs - reads the registers a profile sets: with auto-increment
+//                   as two bursts (0x01 - 0x0b and 0x30 - 0x4b), without
+//                   it only the register bytes, since every byte is a
+//                   transfer of its own
+//                   (fields of other registers are 0)
+static int readProfileRegs(int fd, const DMCCcaps *caps, DMCCregs *regs)
+{
+    unsigned char b[4];
+    DMCCregs all;
+    int result;
+    int i;
+
+    memset(&all, 0, sizeof(DMCCregs));
+    memset(regs, 0, sizeof(DMCCregs));
+    if (caps->autoIncrement) {
+        result = DMCCreadRegs(fd, DMCC_REG_CONFIG,
+                    (caps->powerLimits ? DMCC_REG_PID_LIMIT2 + 2 :
+                                            DMCC_REG_CONFIG + 1) -
+                        DMCC_REG_CONFIG, &all);
+        if (result == DMCC_OK) {
+            result = DMCCreadRegs(fd, DMCC_REG_POS_P1,
+                        DMCC_REG_VEL_D2 + 2 - DMCC_REG_POS_P1, &all);
+        }
+    } else {
+        result = DMCCreadRegs(fd, DMCC_REG_CONFIG, 1, &all);
+        if ((result == DMCC_OK) && caps->powerLimits) {
+            result = DMCCreadRegs(fd, DMCC_REG_PID_LIMIT1, 4, &all);
+        }
+        if (result == DMCC_OK) {
+            result = DMCCreadRegs(fd, DMCC_REG_POS_P1,
+                        DMCC_REG_VEL_D1 + 2 - DMCC_REG_POS_P1, &all);
+        }
+        if (result == DMCC_OK) {
+            result = DMCCreadRegs(fd, DMCC_REG_POS_P2,
+                        DMCC_REG_VEL_D2 + 2 - DMCC_REG_POS_P2, &all);
+        }
+    }
+    if (!caps->powerLimits) {
+        all.pidLimit1 = 0;
+        all.pidLimit2 = 0;
+    }
+
+    // Keep only the registers of the profile (the bursts cover others)
+    for (i = 0; i < NUM_PROFILE_REGS; i++) {
+        int width = DMCCregWidth(Profile_Regs[i]);
+        DMCCencodeRegs(&all, Profile_Regs[i], width, b);
+        DMCCdecodeRegs(b, Profile_Regs[i], width, regs);
+    }
+    return result;
+}
+
+// regDiffers - true if a register has other bytes in the two sets
+static int regDiffers(const DMCCregs *a, const DMCCregs *b, int offset)
+{
+    unsigned char x[4];
+    unsigned char y[4];
+    int width = DMCCregWidth(offset);
+
+    DMCCencodeRegs(a, offset, width, x);
+    DMCCencodeRegs(b, offset, width, y);
+    return memcmp(x, y, width) != 0;
+}
+
+int DMCCprofileRead(int fd, DMCCprofile *profile)
+{
+    TRACE_API("DMCCprofileRead");
+    DMCCcaps caps;
+
+    DMCCprofileDefaults(profile);
+    if (DMCCgetCaps(fd, &caps) != 0) {
+        return DMCC_EINVAL;
+    }
+    if (readProfileRegs(fd, &caps, &profile->regs) != DMCC_OK) {
+        return DMCC_EIO;
+    }
+    profile->regs.config &= 0x0f;
+    profile->qeiThreshold[0] = QEI_Threshold_1;
+    profile->qeiThreshold[1] = QEI_Threshold_2;
+    profile->qeiVelThreshold[0] = QEI_Vel_Threshold_1;
+    profile->qeiVelThreshold[1] = QEI_Vel_Threshold_2;
+    return DMCC_OK;
+}
+
+int DMCCprofileApply(int fd, const DMCCprofile *profile)
+{
+    TRACE_API("DMCCprofileApply");
+    DMCCcaps caps;
+    DMCCregs have;
+    DMCCregs want;
+    int runs = 0;
+    int i = 0;
+
+    if (DMCCgetCaps(fd, &caps) != 0) {
+        return DMCC_EINVAL;
+    }
+    if (readProfileRegs(fd, &caps, &have) != DMCC_OK) {
+        return DMCC_EIO;
+    }
+
+    // Only the direction bits of register 0x01 belong to the profile
+    want = profile->regs;
+    want.config = (have.config & ~0x0f) | (profile->regs.config & 0x0f);
+
+    // One write per run of neighbouring registers that differ
+    while (i < NUM_PROFILE_REGS) {
+        int first = Profile_Regs[i];
+        int limit = (first == DMCC_REG_PID_LIMIT1) ||
+                    (first == DMCC_REG_PID_LIMIT2);
+        if ((limit && !caps.powerLimits) || !regDiffers(&have, &want, first)) {
+            i++;
+            continue;
+        }
+        int end = first + DMCCregWidth(first);
+        for (i++; (i < NUM_PROFILE_REGS) && (Profile_Regs[i] == end) &&
+                    regDiffers(&have, &want, end); i++) {
+            end += DMCCregWidth(end);
+        }
+        if (DMCCwriteRegs(fd, first, end - first, &want) != DMCC_OK) {
+            return DMCC_EIO;
+        }
+        LOG_DEBUG("profile wrote registers 0x%02x - 0x%02x", first, end - 1);
+        runs++;
+    }
+
+    QEI_Threshold_1 = profile->qeiThreshold[0];
+    QEI_Threshold_2 = profile->qeiThreshold[1];
+    QEI_Vel_Threshold_1 = profile->qeiVelThreshold[0];
+    QEI_Vel_Threshold_2 = profile->qeiVelThreshold[1];
+    return runs;
+}
+
+// ------------------------
+// File (read() and write() on the stack, so no step allocates)
+// ------------------------
+
+// parseLine - sets the value a profile line names
+// Returns: -1 - if the line is not a setting
+static int parseLine(char *line, DMCCprofile *profile)
+{
+    char name[MAX_LINE];
+    char value[MAX_LINE];
+    char extra;
+    char *end;
+    int i;
+
+    if (sscanf(line, "%63s %63s %c", name, value, &extra) != 2) {
+        return -1;
+    }
+    long v = strtol(value, &end, 0);
+    if (*end != '\0') {
+        return -1;
+    }
+    for (i = 0; i < NUM_PROFILE_ITEMS; i++) {
+        const ProfileItem *item = &Profile_Items[i];
+        if (strcmp(item->name, name) != 0) {
+            continue;
+        }
+        int *field = itemValue(profile, item);
+        if (item->bit == 0) {
+            *field = (int)v;
+        } else if (v != 0) {
+            *field |= item->bit;
+        } else {
+            *field &= ~item->bit;
+        }
+        return 0;
+    }
+    return -1;
+}
+
+int DMCCprofileLoad(const char *path, DMCCprofile *profile)
+{
+    char text[MAX_FILE];
+    ssize_t len = 0;
+    ssize_t got;
+    int lineNum = 1;
+
+    DMCCprofileDefaults(profile);
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        LOG_ERROR("cannot open profile %s", path);
+        return -1;
+    }
+    while ((len < (ssize_t)sizeof(text) - 1) &&
+            ((got = read(fd, text + len, sizeof(text) - 1 - len)) > 0)) {
+        len += got;
+    }
+    close(fd);
+    text[len] = '\0';
+
+    char *line = text;
+    while ((line != NULL) && (*line != '\0')) {
+        char *next = strchr(line, '\n');
+        if (next != NULL) {
+            *next++ = '\0';
+        }
+        line[strcspn(line, "\r#")] = '\0';
+        if ((line[strspn(line, " \t")] != '\0') &&
+                (parseLine(line, profile) != 0)) {
+            LOG_ERROR("%s:%d: not a profile setting: %s", path, lineNum,
+                        line);
+            return -1;
+        }
+        line = next;
+        lineNum++;
+    }
+    return 0;
+}
+
+int DMCCprofileFormat(const DMCCprofile *profile, char *text, size_t size)
+{
+    int len;
+    int i;
+
+    len = snprintf(text, size, "# DMCC motor profile (DMCCprofile.h)\n");
+    for (i = 0; (i < NUM_PROFILE_ITEMS) && (len < (int)size); i++) {
+        const ProfileItem *item = &Profile_Items[i];
+        int value = *(const int *)((const char *)profile + item->offset);
+        if (item->bit != 0) {
+            value = (value & item->bit) ? 1 : 0;
+        }
+        len += snprintf(text + len, size - len, "%s %d\n", item->name,
+                        value);
+    }
+    return (len < (int)size) ? len : -1;
+}
+
+int DMCCprofileSave(const char *path, const DMCCprofile *profile)
+{
+    char text[MAX_FILE];
+    char tmp[256];
+
+    int len = DMCCprofileFormat(profile, text, sizeof(text));
+    if (len < 0) {
+        LOG_ERROR("profile does not fit in %d bytes", MAX_FILE);
+        return -1;
+    }
+
+    // Written next to the file and renamed, so readers never see half
+    snprintf(tmp, sizeof(tmp), "%s.%d", path, (int)getpid());
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        LOG_ERROR("cannot write profile %s", path);
+        return -1;
+    }
+    int written = (write(fd, text, len) == len);
+    if ((close(fd) != 0) || !written || (rename(tmp, path) != 0)) {
+        LOG_ERROR("cannot write profile %s", path);
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+void DMCCprofilePath(char *path, size_t size, int bus, unsigned char capeAddr)
+{
+    char *dir = getenv(DMCC_PROFILE_DIR_ENV);
+
+    if ((dir == NULL) || (dir[0] == '\0')) {
+        dir = DMCC_PROFILE_DIR;
+    }
+    snprintf(path, size, "%s/i2c-%d-%d.profile", dir, bus, capeAddr);
+}
@@ -0,0 +1,122 @@
+//
+// Copyright (C) 2013-2016 - Exadler Technologies Inc., Sarah Tan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+// DMCCprofile.h - motor configuration of a cape, kept in a file
+//
+// A profile holds what a program sets up on a cape before it moves the
+// motors: the position and velocity PID constants of both motors, the PID
+// power limits, the motor and QEI direction bits, and the thresholds the
+// move functions stop within.  DMCCprofileApply reads the registers back,
+// then writes only the runs of registers that differ, so a program that
+// restarts on a cape that is already set up sends no writes at all.
+//
+// The file has one "name value" line per setting (names as in
+// DMCCprofileSave, lines starting with # are ignored); settings it leaves
+// out keep their defaults (DMCCprofileDefaults).
+
+#ifndef DMCCPROFILE
+#define DMCCPROFILE
+
+#include <stddef.h>
+
+#include "DMCC.h"
+
+// Directory of the profiles (the DMCC_PROFILE_DIR environment variable
+// overrides it)
+#define DMCC_PROFILE_DIR "/etc/dmcc"
+#define DMCC_PROFILE_DIR_ENV "DMCC_PROFILE_DIR"
+
+// Direction bits of DMCCprofile.regs.config (register 0x01)
+#define DMCC_PROFILE_MOTOR_DIR1 0x01
+#define DMCC_PROFILE_MOTOR_DIR2 0x02
+#define DMCC_PROFILE_QEI_DIR1 0x04
+#define DMCC_PROFILE_QEI_DIR2 0x08
+
+// DMCCprofile - configuration of one cape
+typedef struct DMCCprofile {
+    DMCCregs regs;              // config (direction bits), pidLimit1/2 and
+                                // the PID constants; other fields unused
+    int qeiThreshold[2];        // moveUntilPos stops within (counts)
+    int qeiVelThreshold[2];     // moveUntilVel stops within
+} DMCCprofile;
+
+// DMCCprofileDefaults - The configuration of a cape nobody has set up: the
+//                       constants of setDefaultPIDConstants, no power
+//                       limits, every direction bit 0, and the default
+//                       thresholds
+// Parameters: profile - where to put it
+void DMCCprofileDefaults(DMCCprofile *profile);
+
+// DMCCprofileRead - Reads the configuration of a cape (in as few bursts as
+//                   its firmware allows) and the thresholds in use
+// Parameters: fd - connection to the board (value returned from DMCCstart)
+//             profile - where to put it
+// Returns: DMCC_EIO - if a read fails
+//          DMCC_OK - otherwise
+int DMCCprofileRead(int fd, DMCCprofile *profile);
+
+// DMCCprofileApply - Sets up a cape from a profile: reads its registers
+//                    back, writes each run of registers that differs, and
+//                    sets the thresholds (power limits are left alone on
+//                    firmware without them)
+// Parameters: fd - connection to the board (value returned from DMCCstart)
+//             profile - configuration to apply
+// Returns: number of register runs written (0 if the cape was set up)
+//          DMCC_EINVAL - if the session is invalid
+//          DMCC_EIO - if a read or write fails
+int DMCCprofileApply(int fd, const DMCCprofile *profile);
+
+// DMCCprofileLoad - Reads a profile file
+//                   Logs an error if the file cannot be read
+// Parameters: path - file to read
+//             profile - where to put it
+// Returns: -1 - if the file cannot be read or has a line that is not a
+//               setting
+//           0 - otherwise
+int DMCCprofileLoad(const char *path, DMCCprofile *profile);
+
+// DMCCprofileSave - Writes a profile file (replacing it at once, so a
+//                   program starting meanwhile never reads half a file)
+//                   Logs an error if the file cannot be written
+// Parameters: path - file to write
+//             profile - configuration to save
+// Returns: -1 - if the file cannot be written
+//           0 - otherwise
+int DMCCprofileSave(const char *path, const DMCCprofile *profile);
+
+// DMCCprofileFormat - Puts a profile in the text of a profile file
+// Parameters: profile - configuration to format
+//             text - where to put the text (NUL terminated)
+//             size - size of text
+// Returns: length of the text
+//          -1 - if it does not fit
+int DMCCprofileFormat(const DMCCprofile *profile, char *text, size_t size);
+
+// DMCCprofilePath - File name of the profile of a cape
+//                   (<DMCC_PROFILE_DIR>/i2c-<bus>-<capeAddr>.profile)
+// Parameters: path - where to put the file name
+//             size - size of path
+//             bus - i2c adapter number
+//             capeAddr - board number [0-3]
+void DMCCprofilePath(char *path, size_t size, int bus, unsigned char capeAddr);
+
+#endif
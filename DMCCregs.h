@@ -0,0 +1,172 @@
+//
+// Copyright (C) 2013-2016 - Exadler Technologies Inc., Sarah Tan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+
+// DMCCregs.h - register map of the DMCC cape
+//
+// DMCC_REGISTERS lists every value register once: name, field in DMCCregs,
+// offset, width in bytes and whether it is signed.  Everything else (the
+// DMCC_REG_* offsets, the DMCCregs fields, the burst encoders and decoders)
+// is generated from it.  Registers are little endian.  The bytes between
+// them (0x0c - 0x0f, 0x3c - 0x3f) are not registers.
+
+#ifndef DMCCREGS
+#define DMCCREGS
+
+//  X(name,        field,      offset, width, signed)
+#define DMCC_REGISTERS(X) \
+    X(CONFIG,      config,      0x01, 1, 0) /* motor and QEI directions */ \
+    X(PWM1,        pwm1,        0x02, 2, 1) \
+    X(PWM2,        pwm2,        0x04, 2, 1) \
+    X(VOLTAGE,     voltage,     0x06, 2, 0) \
+    X(PID_LIMIT1,  pidLimit1,   0x08, 2, 0) \
+    X(PID_LIMIT2,  pidLimit2,   0x0a, 2, 0) \
+    X(QEI1,        qei1,        0x10, 4, 0) \
+    X(QEI2,        qei2,        0x14, 4, 0) \
+    X(QEI_VEL1,    qeiVel1,     0x18, 2, 1) \
+    X(QEI_VEL2,    qeiVel2,     0x1a, 2, 1) \
+    X(CURRENT1,    current1,    0x1c, 2, 0) \
+    X(CURRENT2,    current2,    0x1e, 2, 0) \
+    X(TARGET_POS1, targetPos1,  0x20, 4, 1) \
+    X(TARGET_POS2, targetPos2,  0x24, 4, 1) \
+    X(TARGET_VEL1, targetVel1,  0x28, 2, 1) \
+    X(TARGET_VEL2, targetVel2,  0x2a, 2, 1) \
+    X(POS_P1,      posP1,       0x30, 2, 1) /* position PID, motor 1 */ \
+    X(POS_I1,      posI1,       0x32, 2, 1) \
+    X(POS_D1,      posD1,       0x34, 2, 1) \
+    X(VEL_P1,      velP1,       0x36, 2, 1) /* velocity PID, motor 1 */ \
+    X(VEL_I1,      velI1,       0x38, 2, 1) \
+    X(VEL_D1,      velD1,       0x3a, 2, 1) \
+    X(POS_P2,      posP2,       0x40, 2, 1) /* position PID, motor 2 */ \
+    X(POS_I2,      posI2,       0x42, 2, 1) \
+    X(POS_D2,      posD2,       0x44, 2, 1) \
+    X(VEL_P2,      velP2,       0x46, 2, 1) /* velocity PID, motor 2 */ \
+    X(VEL_I2,      velI2,       0x48, 2, 1) \
+    X(VEL_D2,      velD2,       0x4a, 2, 1)
+
+// Register offsets (DMCC_REG_QEI1 is 0x10, ...)
+enum {
+#define DMCC_REG_OFFSET(name, field, offset, width, sgn) \
+    DMCC_REG_##name = (offset),
+    DMCC_REGISTERS(DMCC_REG_OFFSET)
+#undef DMCC_REG_OFFSET
+    DMCC_REG_ID = 0xe0,         // ID string (DMCC_ID_LEN bytes)
+    DMCC_REG_COMMAND = 0xff     // commands (0x00 is the status update)
+};
+
+// DMCCregs - one field per register (a burst fills the ones it covers)
+typedef struct DMCCregs {
+#define DMCC_REG_FIELD(name, field, offset, width, sgn) int field;
+    DMCC_REGISTERS(DMCC_REG_FIELD)
+#undef DMCC_REG_FIELD
+} DMCCregs;
+
+// DMCC_REG_GET - value of a register from its bytes (width and sgn are
+//                constants, so this is a few shifts)
+#define DMCC_REG_GET(b, width, sgn) \
+    (((width) == 1) ? (int)(b)[0] : \
+     ((width) == 2) ? ((sgn) ? (int)(short int)((b)[0] | ((b)[1] << 8)) : \
+                                (int)((b)[0] | ((b)[1] << 8))) : \
+     (int)((unsigned int)(b)[0] | ((unsigned int)(b)[1] << 8) | \
+            ((unsigned int)(b)[2] << 16) | ((unsigned int)(b)[3] << 24)))
+
+// DMCC_REG_PUT - bytes of a register value
+#define DMCC_REG_PUT(b, width, value) \
+    do { \
+        (b)[0] = (unsigned char)((value) & 0xff); \
+        if ((width) > 1) { \
+            (b)[1] = (unsigned char)(((value) >> 8) & 0xff); \
+        } \
+        if ((width) > 2) { \
+            (b)[2] = (unsigned char)(((value) >> 16) & 0xff); \
+            (b)[3] = (unsigned char)(((value) >> 24) & 0xff); \
+        } \
+    } while (0)
+
+// DMCC_REG_IN - true if a register lies wholly in [first, first + num)
+#define DMCC_REG_IN(offset, width, first, num) \
+    (((offset) >= (first)) && ((offset) + (width) <= (first) + (num)))
+
+// DMCCdecodeRegs - Sets the fields of the registers in a span of bytes
+// Parameters: bytes - register bytes, starting at register first
+//             first - offset of bytes[0]
+//             num - number of bytes
+//             regs - fields to set (the others are left alone)
+static inline void DMCCdecodeRegs(const unsigned char *bytes, int first,
+                                    int num, DMCCregs *regs)
+{
+#define DMCC_REG_DECODE(name, field, offset, width, sgn) \
+    if (DMCC_REG_IN(offset, width, first, num)) { \
+        regs->field = DMCC_REG_GET(&bytes[(offset) - first], width, sgn); \
+    }
+    DMCC_REGISTERS(DMCC_REG_DECODE)
+#undef DMCC_REG_DECODE
+}
+
+// DMCCencodeRegs - Puts the fields of the registers in a span into bytes
+//                  (bytes that are not registers are left alone)
+// Parameters: regs - values to encode
+//             first - offset of bytes[0]
+//             num - number of bytes
+//             bytes - where to put them
+static inline void DMCCencodeRegs(const DMCCregs *regs, int first, int num,
+                                    unsigned char *bytes)
+{
+#define DMCC_REG_ENCODE(name, field, offset, width, sgn) \
+    if (DMCC_REG_IN(offset, width, first, num)) { \
+        DMCC_REG_PUT(&bytes[(offset) - first], width, regs->field); \
+    }
+    DMCC_REGISTERS(DMCC_REG_ENCODE)
+#undef DMCC_REG_ENCODE
+}
+
+// DMCCdecodeReg - Value of one register from its bytes
+// Parameters: bytes - register bytes
+//             offset - register offset
+// Returns: value of the register (0 if no register starts at offset)
+static inline int DMCCdecodeReg(const unsigned char *bytes, int offset)
+{
+    switch (offset) {
+#define DMCC_REG_CASE(name, field, offset, width, sgn) \
+    case (offset): return DMCC_REG_GET(bytes, width, sgn);
+    DMCC_REGISTERS(DMCC_REG_CASE)
+#undef DMCC_REG_CASE
+    default: return 0;
+    }
+}
+
+// DMCCregWidth - Width of the register at an offset
+// Parameters: offset - register offset
+// Returns: width in bytes
+//          0 - if no register starts there
+static inline int DMCCregWidth(int offset)
+{
+    switch (offset) {
+#define DMCC_REG_WIDTH(name, field, offset, width, sgn) \
+    case (offset): return (width);
+    DMCC_REGISTERS(DMCC_REG_WIDTH)
+#undef DMCC_REG_WIDTH
+    default: return 0;
+    }
+}
+
+#endif
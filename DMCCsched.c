@@ -0,0 +1,169 @@
+//
+// Copyright (C) 2013-2016 - Exadler Technologies Inc., Sarah Tan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+
+#include <string.h>
+#include <time.h>
+
+#include "DMCCsched.h"
+
+// nowNs - monotonic time in nanoseconds
+static unsigned long long nowNs(void)
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (unsigned long long)t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+// waitBucket - histogram bucket of a wait (2^n to 2^(n+1)-1 ns)
+static int waitBucket(unsigned long long ns)
+{
+    int bucket = (ns == 0) ? 0 : (63 - __builtin_clzll(ns));
+    if (bucket >= DMCC_LATENCY_BUCKETS) {
+        bucket = DMCC_LATENCY_BUCKETS - 1;
+    }
+    return bucket;
+}
+
+// dispatch - gives a free bus to the next waiting thread (lock held)
+static void dispatch(DMCCsched *sched)
+{
+    unsigned long long now = nowNs();
+    int c, cls = -1, aged = 0;
+
+    if (sched->busy) {
+        return;
+    }
+    // Highest class with a waiting thread...
+    for (c = 0; c < DMCC_CLASSES; c++) {
+        if (sched->serving[c] != sched->next[c]) {
+            cls = c;
+            break;
+        }
+    }
+    if (cls < 0) {
+        return;
+    }
+    // ...unless a lower class has waited too long (not over an e-stop)
+    if (cls != DMCC_CLASS_ESTOP) {
+        for (c = DMCC_CLASSES - 1; c > cls; c--) {
+            if ((sched->serving[c] != sched->next[c]) &&
+                    (sched->maxWaitNs[c] > 0) &&
+                    (now - sched->arrival[c][sched->serving[c] %
+                        DMCC_SCHED_MAX_WAITING] >= sched->maxWaitNs[c])) {
+                cls = c;
+                aged = 1;
+                break;
+            }
+        }
+    }
+
+    sched->busy = 1;
+    sched->grantClass = cls;
+    sched->grantTicket = sched->serving[cls]++;
+    sched->stats[cls].aged += aged;
+    pthread_cond_broadcast(&sched->granted);
+}
+
+void DMCCschedInit(DMCCsched *sched)
+{
+    memset(sched, 0, sizeof(DMCCsched));
+    pthread_mutex_init(&sched->lock, NULL);
+    pthread_cond_init(&sched->granted, NULL);
+    sched->grantClass = -1;
+    sched->maxWaitNs[DMCC_CLASS_STATUS] = DMCC_SCHED_STATUS_WAIT_US * 1000ULL;
+    sched->maxWaitNs[DMCC_CLASS_BULK] = DMCC_SCHED_BULK_WAIT_US * 1000ULL;
+}
+
+void DMCCschedDestroy(DMCCsched *sched)
+{
+    pthread_mutex_destroy(&sched->lock);
+    pthread_cond_destroy(&sched->granted);
+}
+
+int DMCCschedSetMaxWait(DMCCsched *sched, int cls, unsigned int microseconds)
+{
+    if ((cls <= DMCC_CLASS_ESTOP) || (cls >= DMCC_CLASSES)) {
+        return -1;
+    }
+    pthread_mutex_lock(&sched->lock);
+    sched->maxWaitNs[cls] = microseconds * 1000ULL;
+    pthread_mutex_unlock(&sched->lock);
+    return 0;
+}
+
+void DMCCschedAcquire(DMCCsched *sched, int cls)
+{
+    if ((cls < 0) || (cls >= DMCC_CLASSES)) {
+        cls = DMCC_CLASS_BULK;
+    }
+
+    pthread_mutex_lock(&sched->lock);
+    unsigned long long start = nowNs();
+    unsigned long long ticket = sched->next[cls]++;
+    sched->arrival[cls][ticket % DMCC_SCHED_MAX_WAITING] = start;
+    dispatch(sched);
+    while ((sched->grantClass != cls) || (sched->grantTicket != ticket)) {
+        pthread_cond_wait(&sched->granted, &sched->lock);
+    }
+
+    DMCCschedStats *stats = &sched->stats[cls];
+    sched->holdStart = nowNs();
+    sched->holdClass = cls;
+    unsigned long long wait = sched->holdStart - start;
+    stats->grants++;
+    stats->totalWaitNs += wait;
+    if (wait > stats->maxWaitNs) {
+        stats->maxWaitNs = wait;
+    }
+    stats->wait[waitBucket(wait)]++;
+    pthread_mutex_unlock(&sched->lock);
+}
+
+void DMCCschedRelease(DMCCsched *sched)
+{
+    pthread_mutex_lock(&sched->lock);
+    sched->stats[sched->holdClass].totalHoldNs += nowNs() - sched->holdStart;
+    sched->busy = 0;
+    sched->grantClass = -1;
+    dispatch(sched);
+    pthread_mutex_unlock(&sched->lock);
+}
+
+int DMCCschedGetStats(DMCCsched *sched, int cls, DMCCschedStats *stats)
+{
+    if ((cls < 0) || (cls >= DMCC_CLASSES)) {
+        return -1;
+    }
+    pthread_mutex_lock(&sched->lock);
+    *stats = sched->stats[cls];
+    pthread_mutex_unlock(&sched->lock);
+    return 0;
+}
+
+void DMCCschedResetStats(DMCCsched *sched)
+{
+    pthread_mutex_lock(&sched->lock);
+    memset(sched->stats, 0, sizeof(sched->stats));
+    pthread_mutex_unlock(&sched->lock);
+}
@@ -0,0 +1,124 @@
+//
+// Copyright (C) 2013-2016 - Exadler Technologies Inc., Sarah Tan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+
+// DMCCsched.h - sharing one bus between threads by priority
+//
+// Threads that use the same bus (a control loop and a logger, say) take
+// turns through a scheduler instead of a plain lock.  Every use of the bus
+// is wrapped in DMCCschedAcquire / DMCCschedRelease with a priority class;
+// when the bus is released it goes to the waiting thread of the highest
+// class, first come first served within a class.  High priority work thus
+// waits for at most the one operation that is on the bus.
+//
+// Starvation protection: a class with a maximum wait is served before the
+// higher classes (all but DMCC_CLASS_ESTOP) once its oldest waiter has
+// waited that long.
+
+#ifndef DMCCSCHED
+#define DMCCSCHED
+
+#include <pthread.h>
+
+#include "DMCC.h"
+
+// Priority classes, highest first
+#define DMCC_CLASS_ESTOP 0      // emergency stop
+#define DMCC_CLASS_SETPOINT 1   // control setpoints (power, targets)
+#define DMCC_CLASS_STATUS 2     // status reads (QEI, current)
+#define DMCC_CLASS_BULK 3       // bulk telemetry and configuration
+#define DMCC_CLASSES 4
+
+// Threads that can wait in one class at the same time
+#define DMCC_SCHED_MAX_WAITING 64
+
+// Default maximum waits in microseconds (0 is no limit)
+#define DMCC_SCHED_STATUS_WAIT_US 20000
+#define DMCC_SCHED_BULK_WAIT_US 100000
+
+// DMCCschedStats - time spent waiting for the bus in one class
+typedef struct DMCCschedStats {
+    unsigned long long grants;          // times the bus was given
+    unsigned long long aged;            // given early for waiting too long
+    unsigned long long totalWaitNs;
+    unsigned long long maxWaitNs;
+    unsigned long long totalHoldNs;     // time the bus was kept
+    unsigned long long wait[DMCC_LATENCY_BUCKETS];  // as in DMCCstats
+} DMCCschedStats;
+
+// DMCCsched - one bus shared by priority
+typedef struct DMCCsched {
+    pthread_mutex_t lock;
+    pthread_cond_t granted;
+    int busy;                           // the bus is given to a thread
+    int grantClass;                     // class and ticket last given
+    unsigned long long grantTicket;
+    unsigned long long holdStart;
+    int holdClass;
+    unsigned long long next[DMCC_CLASSES];      // next ticket of a class
+    unsigned long long serving[DMCC_CLASSES];   // next ticket to be given
+    unsigned long long arrival[DMCC_CLASSES][DMCC_SCHED_MAX_WAITING];
+    unsigned long long maxWaitNs[DMCC_CLASSES];
+    DMCCschedStats stats[DMCC_CLASSES];
+} DMCCsched;
+
+// DMCCschedInit - Sets up a scheduler with the default maximum waits
+// Parameters: sched - scheduler to set up
+void DMCCschedInit(DMCCsched *sched);
+
+// DMCCschedDestroy - Frees what DMCCschedInit set up (no thread may be
+//                    waiting)
+// Parameters: sched - scheduler from DMCCschedInit
+void DMCCschedDestroy(DMCCsched *sched);
+
+// DMCCschedSetMaxWait - Sets how long a class may wait before it is served
+//                       ahead of higher classes
+// Parameters: sched - scheduler from DMCCschedInit
+//             cls - DMCC_CLASS_SETPOINT, DMCC_CLASS_STATUS or
+//                   DMCC_CLASS_BULK
+//             microseconds - maximum wait (0 is no limit)
+// Returns: -1 - if the class is invalid
+//           0 - otherwise
+int DMCCschedSetMaxWait(DMCCsched *sched, int cls, unsigned int microseconds);
+
+// DMCCschedAcquire - Waits until the bus is given to the calling thread
+// Parameters: sched - scheduler from DMCCschedInit
+//             cls - priority class of the work (DMCC_CLASS_*)
+void DMCCschedAcquire(DMCCsched *sched, int cls);
+
+// DMCCschedRelease - Gives the bus to the next waiting thread
+// Parameters: sched - scheduler from DMCCschedInit
+void DMCCschedRelease(DMCCsched *sched);
+
+// DMCCschedGetStats - Takes a snapshot of the waits of a class
+// Parameters: sched - scheduler from DMCCschedInit
+//             cls - priority class
+//             stats - where to put the snapshot
+// Returns: -1 - if the class is invalid
+//           0 - otherwise
+int DMCCschedGetStats(DMCCsched *sched, int cls, DMCCschedStats *stats);
+
+// DMCCschedResetStats - Clears the statistics of every class
+// Parameters: sched - scheduler from DMCCschedInit
+void DMCCschedResetStats(DMCCsched *sched);
+
+#endif
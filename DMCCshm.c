@@ -0,0 +1,208 @@
+//
+// Copyright (C) 2013-2016 - Exadler Technologies Inc., Sarah Tan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sched.h>
+#include <time.h>
+
+#include "DMCCshm.h"
+#include "DMCClog.h"
+
+// nowUs - monotonic time in microseconds
+static unsigned long long nowUs(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (unsigned long long)t.tv_sec * 1000000ULL + t.tv_nsec / 1000;
+}
+
+int DMCCshmPublish(DMCCshm *shm, const char *name)
+{
+    int fd = shm_open(name, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        LOG_ERROR("cannot create shared memory %s", name);
+        return -1;
+    }
+    if (ftruncate(fd, sizeof(DMCCshmSegment)) != 0) {
+        LOG_ERROR("cannot size shared memory %s", name);
+        close(fd);
+        return -1;
+    }
+
+    void *map = mmap(NULL, sizeof(DMCCshmSegment), PROT_READ | PROT_WRITE,
+                        MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        LOG_ERROR("cannot map shared memory %s", name);
+        return -1;
+    }
+
+    shm->segment = (DMCCshmSegment *)map;
+    shm->writable = 1;
+
+    // Start with nothing published (readers see sequence 0 as empty)
+    memset(map, 0, sizeof(DMCCshmSegment));
+    shm->segment->recordSize = sizeof(DMCCtelemetryRecord);
+    shm->segment->capes = DMCC_SHM_CAPES;
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(shm->segment->magic, DMCC_SHM_MAGIC, 8);
+    return 0;
+}
+
+int DMCCshmSubscribe(DMCCshm *shm, const char *name)
+{
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) {
+        LOG_ERROR("no status publisher at %s", name);
+        return -1;
+    }
+
+    struct stat st;
+    if ((fstat(fd, &st) != 0) ||
+            ((size_t)st.st_size < sizeof(DMCCshmSegment))) {
+        LOG_ERROR("%s is not a DMCC status segment", name);
+        close(fd);
+        return -1;
+    }
+
+    void *map = mmap(NULL, sizeof(DMCCshmSegment), PROT_READ, MAP_SHARED,
+                        fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        LOG_ERROR("cannot map shared memory %s", name);
+        return -1;
+    }
+
+    shm->segment = (DMCCshmSegment *)map;
+    shm->writable = 0;
+    if ((memcmp(shm->segment->magic, DMCC_SHM_MAGIC, 8) != 0) ||
+            (shm->segment->recordSize != sizeof(DMCCtelemetryRecord)) ||
+            (shm->segment->capes != DMCC_SHM_CAPES)) {
+        LOG_ERROR("%s is not a DMCC status segment", name);
+        DMCCshmClose(shm);
+        return -1;
+    }
+    return 0;
+}
+
+void DMCCshmWrite(DMCCshm *shm, unsigned int board,
+                    const DMCCtelemetryRecord *status)
+{
+    if ((!shm->writable) || (board >= DMCC_SHM_CAPES)) {
+        return;
+    }
+    DMCCshmSlot *slot = &shm->segment->slot[board];
+    uint32_t seq = slot->seq;
+    uint32_t next = seq + 2;
+
+    // Sequence 0 means never published, skip it when the counter wraps
+    if (next == 0) {
+        next = 2;
+    }
+
+    // Odd sequence marks the update as in progress
+    __atomic_store_n(&slot->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    slot->status = *status;
+    __atomic_store_n(&slot->seq, next, __ATOMIC_RELEASE);
+}
+
+void DMCCshmSetCommands(DMCCshm *shm, unsigned int board,
+                        const DMCCcommandState *state)
+{
+    if ((!shm->writable) || (board >= DMCC_SHM_CAPES)) {
+        return;
+    }
+    DMCCshmSlot *slot = &shm->segment->slot[board];
+
+    // Modes first: a reader that sees the new count also sees its modes
+    __atomic_store_n(&slot->mode[0], state->mode[0], __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->mode[1], state->mode[1], __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->commands, state->count, __ATOMIC_RELEASE);
+}
+
+int DMCCshmGetCommands(DMCCshm *shm, unsigned int board,
+                        DMCCcommandState *state)
+{
+    if (board >= DMCC_SHM_CAPES) {
+        return -1;
+    }
+    DMCCshmSlot *slot = &shm->segment->slot[board];
+
+    state->count = __atomic_load_n(&slot->commands, __ATOMIC_ACQUIRE);
+    state->mode[0] = __atomic_load_n(&slot->mode[0], __ATOMIC_RELAXED);
+    state->mode[1] = __atomic_load_n(&slot->mode[1], __ATOMIC_RELAXED);
+    return 0;
+}
+
+int DMCCshmRead(DMCCshm *shm, unsigned int board, DMCCtelemetryRecord *status)
+{
+    if (board >= DMCC_SHM_CAPES) {
+        return -1;
+    }
+    DMCCshmSlot *slot = &shm->segment->slot[board];
+    unsigned long long deadline = 0;
+    uint32_t before, after;
+
+    while (1) {
+        before = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        if (before == 0) {
+            return -1;
+        }
+        *status = slot->status;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        after = __atomic_load_n(&slot->seq, __ATOMIC_RELAXED);
+        if (!(before & 1) && (before == after)) {
+            return 0;
+        }
+
+        // A publisher that died between the two sequence stores leaves the
+        // slot odd for good, but one that was only preempted needs the
+        // processor back to finish, so yield and go by the clock
+        unsigned long long t = nowUs();
+        if (deadline == 0) {
+            deadline = t + DMCC_SHM_STALL_US;
+        } else if (t >= deadline) {
+            return -2;
+        }
+        sched_yield();
+    }
+}
+
+void DMCCshmClose(DMCCshm *shm)
+{
+    if (shm->segment != NULL) {
+        munmap(shm->segment, sizeof(DMCCshmSegment));
+        shm->segment = NULL;
+    }
+}
+
+void DMCCshmRemove(const char *name)
+{
+    shm_unlink(name);
+}
@@ -0,0 +1,136 @@
+//
+// Copyright (C) 2013-2016 - Exadler Technologies Inc., Sarah Tan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+// DMCCshm.h - cape status shared between processes
+//
+// One process (the publisher) owns the capes, samples them and puts every
+// snapshot into a POSIX shared memory segment.  Any number of other
+// processes read the latest snapshot from the segment without opening the
+// bus.  Each cape has a sequence lock: readers never block the publisher,
+// and a reader that overlaps an update simply copies the snapshot again.
+// The publisher also publishes the motor commands it has sent, as soon as
+// it sends them, so that samplers in other processes (DMCCadaptive) can
+// speed up before the next snapshot shows the motor moving.
+
+#ifndef DMCCSHM
+#define DMCCSHM
+
+#include <stdint.h>
+
+#include "DMCCtelemetry.h"
+
+#define DMCC_SHM_MAGIC "DMCCSHM2"
+
+// Number of cape addresses (board numbers 0-3)
+#define DMCC_SHM_CAPES 4
+
+// Time in microseconds a reader waits for an update in progress before it
+// calls the publisher stalled.  An update is a copy of one record, but on
+// one core a reader can preempt the publisher in the middle of it, so the
+// reader yields while it waits and this covers a few scheduler slices.
+#define DMCC_SHM_STALL_US 100000
+
+// DMCCshmSlot - latest status of one cape
+typedef struct DMCCshmSlot {
+    uint32_t seq;                   // odd while an update is in progress
+    uint32_t commands;              // motor commands sent to the cape
+    uint8_t mode[2];                // DMCC_MODE_* of motor 1 and 2
+    uint8_t reserved[6];
+    DMCCtelemetryRecord status;
+} DMCCshmSlot;
+
+// DMCCshmSegment - layout of the shared memory segment
+typedef struct DMCCshmSegment {
+    char magic[8];                  // DMCC_SHM_MAGIC
+    uint32_t recordSize;            // sizeof(DMCCtelemetryRecord)
+    uint32_t capes;                 // DMCC_SHM_CAPES
+    DMCCshmSlot slot[DMCC_SHM_CAPES];
+} DMCCshmSegment;
+
+// DMCCshm - an open segment
+typedef struct DMCCshm {
+    DMCCshmSegment *segment;
+    int writable;
+} DMCCshm;
+
+// DMCCshmPublish - Creates (or takes over) the segment as its publisher
+//                  Logs an error if the segment cannot be created
+// Parameters: shm - segment to open
+//             name - shared memory name (for example "/dmcc")
+// Returns: -1 - if an error occurs
+//           0 - otherwise
+int DMCCshmPublish(DMCCshm *shm, const char *name);
+
+// DMCCshmSubscribe - Opens an existing segment for reading
+//                    Logs an error if there is no publisher
+// Parameters: shm - segment to open
+//             name - shared memory name used by the publisher
+// Returns: -1 - if an error occurs
+//           0 - otherwise
+int DMCCshmSubscribe(DMCCshm *shm, const char *name);
+
+// DMCCshmWrite - Publishes a new status for a cape (publisher only)
+// Parameters: shm - segment from DMCCshmPublish
+//             board - board number [0-3]
+//             status - snapshot to publish
+void DMCCshmWrite(DMCCshm *shm, unsigned int board,
+                    const DMCCtelemetryRecord *status);
+
+// DMCCshmSetCommands - Publishes the motor commands sent to a cape
+//                      (publisher only, cheap: call it after every command)
+// Parameters: shm - segment from DMCCshmPublish
+//             board - board number [0-3]
+//             state - commands sent (from DMCCgetCommandState)
+void DMCCshmSetCommands(DMCCshm *shm, unsigned int board,
+                        const DMCCcommandState *state);
+
+// DMCCshmGetCommands - Gets the motor commands the publisher has sent to a
+//                      cape (cheap, for DMCCadaptiveDueState)
+// Parameters: shm - segment from DMCCshmPublish or DMCCshmSubscribe
+//             board - board number [0-3]
+//             state - where to put the commands
+// Returns: -1 - if the board number is invalid
+//           0 - otherwise
+int DMCCshmGetCommands(DMCCshm *shm, unsigned int board,
+                        DMCCcommandState *state);
+
+// DMCCshmRead - Copies the latest status of a cape (only waits, yielding
+//               the processor, while an update is in progress: at most
+//               DMCC_SHM_STALL_US)
+// Parameters: shm - segment from DMCCshmPublish or DMCCshmSubscribe
+//             board - board number [0-3]
+//             status - where to put the snapshot
+// Returns: -1 - if nothing has been published for the cape
+//          -2 - if the publisher stalled (or died) in an update for
+//               DMCC_SHM_STALL_US; status is not a snapshot
+//           0 - otherwise
+int DMCCshmRead(DMCCshm *shm, unsigned int board, DMCCtelemetryRecord *status);
+
+// DMCCshmClose - Unmaps the segment (it stays for other processes)
+// Parameters: shm - segment to close
+void DMCCshmClose(DMCCshm *shm);
+
+// DMCCshmRemove - Removes the segment name (publisher, on shutdown)
+// Parameters: name - shared memory name
+void DMCCshmRemove(const char *name);
+
+#endif
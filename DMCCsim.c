@@ -0,0 +1,697 @@
+//
+// Copyright (C) 2013-2016 - Exadler Technologies Inc., Sarah Tan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <errno.h>
+#include <ctype.h>
+
+#include "DMCC.h"
+#include "DMCCsim.h"
+
+// -----------------------
+// Register helpers
+// -----------------------
+
+// regWord - little endian 16 bit register value
+static int regWord(DMCCsim *sim, unsigned char addr)
+{
+    return (short int)(sim->reg[addr] | (sim->reg[addr + 1] << 8));
+}
+
+// regDWord - little endian 32 bit register value
+static int regDWord(DMCCsim *sim, unsigned char addr)
+{
+    return (int)((unsigned int)sim->reg[addr] |
+                    ((unsigned int)sim->reg[addr + 1] << 8) |
+                    ((unsigned int)sim->reg[addr + 2] << 16) |
+                    ((unsigned int)sim->reg[addr + 3] << 24));
+}
+
+// putRegWord - stores a little endian 16 bit register value
+static void putRegWord(DMCCsim *sim, unsigned char addr, int value)
+{
+    sim->reg[addr] = (unsigned char)(value & 0xff);
+    sim->reg[addr + 1] = (unsigned char)((value >> 8) & 0xff);
+}
+
+// putRegDWord - stores a little endian 32 bit register value
+static void putRegDWord(DMCCsim *sim, unsigned char addr, int value)
+{
+    sim->reg[addr] = (unsigned char)(value & 0xff);
+    sim->reg[addr + 1] = (unsigned char)((value >> 8) & 0xff);
+    sim->reg[addr + 2] = (unsigned char)((value >> 16) & 0xff);
+    sim->reg[addr + 3] = (unsigned char)((value >> 24) & 0xff);
+}
+
+// -----------------------
+// Motor and firmware model
+// -----------------------
+
+// motorVelReg - QEI velocity of the motor in register units
+static int motorVelReg(DMCCsim *sim, int m)
+{
+    double v = sim->motor[m].vel * DMCC_SIM_VEL_PERIOD_US / 1000000.0;
+    // QEI direction bit reverses what the encoder reports
+    if ((sim->reg[0x01] >> (2 + m)) & 1) {
+        v = -v;
+    }
+    return (int)lround(v);
+}
+
+// motorPosReg - QEI count of the motor in register units
+static int motorPosReg(DMCCsim *sim, int m)
+{
+    long long p = llround(sim->motor[m].pos);
+    if ((sim->reg[0x01] >> (2 + m)) & 1) {
+        p = -p;
+    }
+    return (int)p;
+}
+
+// motorCurrent - current drawn by the motor in register units
+static int motorCurrent(DMCCsim *sim, int m)
+{
+    DMCCsimMotor *mo = &sim->motor[m];
+    double drive = mo->pwm / 10000.0 * sim->supplyVolts / sim->nominalVolts;
+    double i = fabs(drive - mo->vel / mo->maxVel) * mo->stallCurrent;
+    return (int)lround(i);
+}
+
+// firmwarePID - one tick of the firmware PID loop for a motor
+static void firmwarePID(DMCCsim *sim, int m)
+{
+    DMCCsimMotor *mo = &sim->motor[m];
+    unsigned char pid;
+    int error;
+
+    if (mo->mode == DMCC_SIM_MODE_POS) {
+        pid = (m == 0) ? 0x30 : 0x40;
+        error = regDWord(sim, (m == 0) ? 0x20 : 0x24) - motorPosReg(sim, m);
+    } else if (mo->mode == DMCC_SIM_MODE_VEL) {
+        pid = (m == 0) ? 0x36 : 0x46;
+        error = regWord(sim, (m == 0) ? 0x28 : 0x2A) - motorVelReg(sim, m);
+    } else {
+        return;
+    }
+
+    long long P = regWord(sim, pid);
+    long long I = regWord(sim, pid + 2);
+    long long D = regWord(sim, pid + 4);
+
+    // Integral is clamped so the I term alone cannot exceed full power
+    mo->integral += error;
+    if (I != 0) {
+        long long maxIntegral = (10000LL * 256) / llabs(I);
+        if (mo->integral > maxIntegral) {
+            mo->integral = maxIntegral;
+        } else if (mo->integral < -maxIntegral) {
+            mo->integral = -maxIntegral;
+        }
+    }
+
+    long long out = -(P * error + I * mo->integral +
+                        D * (error - mo->prevError)) / 256;
+    mo->prevError = error;
+
+    // Power limit in PID mode (setPIDPowerLimits, 0 is no limit)
+    int limit = 0;
+    if (sim->powerLimits) {
+        limit = regWord(sim, (m == 0) ? 0x08 : 0x0a) & 0xffff;
+    }
+    if ((limit == 0) || (limit > 10000)) {
+        limit = 10000;
+    }
+    if (out > limit) {
+        out = limit;
+    } else if (out < -limit) {
+        out = -limit;
+    }
+    mo->pwm = (int)out;
+}
+
+// motorStep - moves the motor forward by dt seconds
+static void motorStep(DMCCsim *sim, int m, double dt)
+{
+    DMCCsimMotor *mo = &sim->motor[m];
+    double drive = mo->pwm / 10000.0 * sim->supplyVolts / sim->nominalVolts;
+
+    // Motor direction bit reverses the output
+    if ((sim->reg[0x01] >> m) & 1) {
+        drive = -drive;
+    }
+
+    // Static friction keeps a stopped motor from turning at low power
+    if ((fabs(drive) < mo->deadband) && (fabs(mo->vel) < 1.0)) {
+        mo->vel = 0.0;
+        return;
+    }
+
+    double target = drive * mo->maxVel;
+    mo->vel += (target - mo->vel) * (dt / (mo->tau + dt));
+    mo->pos += mo->vel * dt;
+}
+
+// statusSnapshot - latches the live values into the status registers
+//                  (command 0x00)
+static void statusSnapshot(DMCCsim *sim)
+{
+    putRegWord(sim, 0x06, (int)lround(sim->supplyVolts * 1000.0));
+    putRegDWord(sim, 0x10, motorPosReg(sim, 0));
+    putRegDWord(sim, 0x14, motorPosReg(sim, 1));
+    putRegWord(sim, 0x18, motorVelReg(sim, 0));
+    putRegWord(sim, 0x1A, motorVelReg(sim, 1));
+    putRegWord(sim, 0x1C, motorCurrent(sim, 0));
+    putRegWord(sim, 0x1E, motorCurrent(sim, 1));
+}
+
+// startMode - puts a motor into a new mode with fresh PID state
+static void startMode(DMCCsim *sim, int m, int mode)
+{
+    sim->motor[m].mode = mode;
+    sim->motor[m].integral = 0;
+    sim->motor[m].prevError = 0;
+    if (mode == DMCC_SIM_MODE_POWER) {
+        sim->motor[m].pwm = regWord(sim, (m == 0) ? 0x02 : 0x04);
+    }
+}
+
+// runCommand - executes a command written to register 0xff
+static void runCommand(DMCCsim *sim, unsigned char cmd)
+{
+    switch (cmd) {
+    case 0x00:
+        statusSnapshot(sim);
+        break;
+    case 0x01:
+    case 0x02:
+    case 0x03:
+        if (cmd & 0x01) {
+            startMode(sim, 0, DMCC_SIM_MODE_POWER);
+        }
+        if (cmd & 0x02) {
+            startMode(sim, 1, DMCC_SIM_MODE_POWER);
+        }
+        break;
+    case 0x11:
+    case 0x12:
+    case 0x13:
+        if (cmd & 0x01) {
+            startMode(sim, 0, DMCC_SIM_MODE_POS);
+        }
+        if (cmd & 0x02) {
+            startMode(sim, 1, DMCC_SIM_MODE_POS);
+        }
+        break;
+    case 0x21:
+    case 0x22:
+    case 0x23:
+        if (cmd & 0x01) {
+            startMode(sim, 0, DMCC_SIM_MODE_VEL);
+        }
+        if (cmd & 0x02) {
+            startMode(sim, 1, DMCC_SIM_MODE_VEL);
+        }
+        break;
+    case 0x30:
+        sim->motor[0].pos = 0.0;
+        break;
+    case 0x31:
+        sim->motor[1].pos = 0.0;
+        break;
+    case 0x32:
+        sim->motor[0].pos = 0.0;
+        sim->motor[1].pos = 0.0;
+        break;
+    default:
+        // Unknown commands are ignored, like on the real firmware
+        break;
+    }
+}
+
+// queueCommand - holds a motor command back for the firmware delay
+static void queueCommand(DMCCsim *sim, unsigned char cmd)
+{
+    if ((cmd == 0x00) || (sim->commandDelayUs == 0) ||
+            (sim->numPending == DMCC_SIM_MAX_PENDING)) {
+        runCommand(sim, cmd);
+        return;
+    }
+    sim->pendingCmd[sim->numPending] = cmd;
+    sim->pendingDue[sim->numPending] = sim->timeUs + sim->commandDelayUs;
+    sim->numPending++;
+}
+
+// runPending - executes the queued commands that are due at the given time
+static void runPending(DMCCsim *sim, unsigned long long now)
+{
+    unsigned int done = 0;
+    unsigned int i;
+
+    while ((done < sim->numPending) && (sim->pendingDue[done] <= now)) {
+        runCommand(sim, sim->pendingCmd[done]);
+        done++;
+    }
+    if (done == 0) {
+        return;
+    }
+    for (i = done; i < sim->numPending; i++) {
+        sim->pendingCmd[i - done] = sim->pendingCmd[i];
+        sim->pendingDue[i - done] = sim->pendingDue[i];
+    }
+    sim->numPending -= done;
+}
+
+// -----------------------
+// Public functions
+// -----------------------
+
+void DMCCsimInit(DMCCsim *sim)
+{
+    int m;
+
+    memset(sim, 0, sizeof(DMCCsim));
+    for (m = 0; m < 2; m++) {
+        sim->motor[m].maxVel = 20000.0;
+        sim->motor[m].tau = 0.05;
+        sim->motor[m].deadband = 0.05;
+        sim->motor[m].stallCurrent = 3000.0;
+    }
+    sim->supplyVolts = 12.0;
+    sim->nominalVolts = 12.0;
+    // 100kHz bus, 9 clocks per byte
+    sim->usPerByte = 90;
+    sim->timeoutUs = 10000;
+    sim->seed = 1;
+    DMCCsimSetFirmware(sim, DMCC_SIM_FIRMWARE);
+    statusSnapshot(sim);
+}
+
+int DMCCsimSetFirmware(DMCCsim *sim, int version)
+{
+    char id[11];
+
+    if ((version < 5) || (version > 7)) {
+        printf("Error: firmware Mk.%02d is not simulated\n", version);
+        return -1;
+    }
+    sim->firmware = version;
+    sim->autoIncrement = (version >= 6);
+    sim->maxBurst = (version >= 7) ? 32 : ((version == 6) ? 16 : 1);
+    sim->powerLimits = (version >= 7);
+
+    snprintf(id, sizeof(id), "DMCC Mk.%02d", version);
+    memset(&sim->reg[0xe0], 0, 16);
+    memcpy(&sim->reg[0xe0], id, 10);
+    return 0;
+}
+
+// simNow - clock of a simulated session (DMCCtransport callback)
+static unsigned long long simNow(void *ctx)
+{
+    return ((DMCCsim *)ctx)->timeUs;
+}
+
+// simSleep - waiting on a simulated session runs the cape instead
+static void simSleep(void *ctx, unsigned int microseconds)
+{
+    DMCCsimAdvance((DMCCsim *)ctx, microseconds);
+}
+
+int DMCCsimStart(DMCCsim *sim)
+{
+    DMCCtransport transport;
+
+    // A real descriptor keeps session numbers unique and DMCCend working
+    int fd = open("/dev/null", O_RDWR);
+    if (fd < 0) {
+        printf("Error: cannot open a simulated session\n");
+        return -1;
+    }
+
+    transport.write = DMCCsimWrite;
+    transport.read = DMCCsimRead;
+    transport.now = simNow;
+    transport.sleep = simSleep;
+    transport.reopen = DMCCsimReopen;
+    transport.flush = NULL;
+    transport.stop = NULL;
+    transport.ctx = sim;
+    if (DMCCattachTransport(fd, &transport) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+void DMCCsimAdvance(DMCCsim *sim, unsigned int microseconds)
+{
+    sim->timeUs += microseconds;
+    sim->tickUs += microseconds;
+    while (sim->tickUs >= DMCC_SIM_TICK_US) {
+        sim->tickUs -= DMCC_SIM_TICK_US;
+        runPending(sim, sim->timeUs - sim->tickUs);
+        firmwarePID(sim, 0);
+        firmwarePID(sim, 1);
+        motorStep(sim, 0, DMCC_SIM_TICK_US / 1000000.0);
+        motorStep(sim, 1, DMCC_SIM_TICK_US / 1000000.0);
+    }
+}
+
+// blockTransfer - holds the caller for the real time of a transfer
+static void blockTransfer(DMCCsim *sim)
+{
+    struct timespec t;
+
+    if (sim->latencyUs > 0) {
+        t.tv_sec = sim->latencyUs / 1000000;
+        t.tv_nsec = (sim->latencyUs % 1000000) * 1000L;
+        nanosleep(&t, NULL);
+    }
+}
+
+// injectFault - decides if a transfer fails, and takes its bus time if so
+// Returns: 1 - if the transfer fails (errno is set)
+//          0 - otherwise
+static int injectFault(DMCCsim *sim)
+{
+    if (!sim->hung && (sim->nakPerMille + sim->timeoutPerMille +
+                            sim->hangPerMille == 0)) {
+        return 0;
+    }
+    unsigned int r = (unsigned int)rand_r(&sim->seed) % 1000;
+    if (!sim->hung && (r < sim->hangPerMille)) {
+        sim->hung = 1;
+        sim->hangs++;
+    }
+    if (sim->hung || (r < sim->hangPerMille + sim->timeoutPerMille)) {
+        sim->timeouts++;
+        DMCCsimAdvance(sim, sim->timeoutUs);
+        errno = ETIMEDOUT;
+        return 1;
+    }
+    if (r < sim->hangPerMille + sim->timeoutPerMille + sim->nakPerMille) {
+        // Address byte sent, not acknowledged
+        sim->naks++;
+        DMCCsimAdvance(sim, sim->usPerByte);
+        errno = EREMOTEIO;
+        return 1;
+    }
+    return 0;
+}
+
+// chance - true with the given chance per 1000
+static int chance(DMCCsim *sim, unsigned int perMille)
+{
+    return (perMille > 0) &&
+            (((unsigned int)rand_r(&sim->seed) % 1000) < perMille);
+}
+
+// exponentialUs - random time, exponential with the given mean
+static unsigned int exponentialUs(DMCCsim *sim, unsigned int meanUs)
+{
+    double u = (rand_r(&sim->seed) + 1.0) / (RAND_MAX + 2.0);
+    return (unsigned int)(-log(u) * meanUs);
+}
+
+// applyFaults - runs the fault rules on a transfer before it moves data,
+//               taking the delays they add
+// Parameters: first - first register the transfer touches
+//             num - number of registers it touches
+//             read - 1 for a read, 0 for a write
+//             len - bytes to read, made smaller by a short read
+// Returns: 1 - if the transfer fails (errno is set)
+//          0 - otherwise
+static int applyFaults(DMCCsim *sim, unsigned char first, int num, int read,
+                        int *len)
+{
+    unsigned int last = first + num - 1;
+    int i;
+
+    if (sim->timeUs < sim->busyUntil) {
+        sim->naks++;
+        DMCCsimAdvance(sim, sim->usPerByte);
+        errno = EREMOTEIO;
+        return 1;
+    }
+    for (i = 0; i < sim->numFaults; i++) {
+        const DMCCsimFault *f = &sim->fault[i];
+        if ((read ? !f->reads : !f->writes) || (last < f->first) ||
+                (first > f->last)) {
+            continue;
+        }
+
+        unsigned int delay = f->latencyUs;
+        if (f->jitterUs > 0) {
+            delay += exponentialUs(sim, f->jitterUs);
+        }
+        if (chance(sim, f->tailPerMille)) {
+            delay += f->tailUs;
+        }
+        if (chance(sim, f->stretchPerMille)) {
+            unsigned int stretch = (f->stretchUs > 0) ?
+                        (unsigned int)rand_r(&sim->seed) % f->stretchUs : 0;
+            sim->stretches++;
+            if (stretch >= sim->timeoutUs) {
+                // The adapter gives up while the clock is held
+                sim->timeouts++;
+                DMCCsimAdvance(sim, delay + sim->timeoutUs);
+                errno = ETIMEDOUT;
+                return 1;
+            }
+            delay += stretch;
+        }
+        DMCCsimAdvance(sim, delay);
+
+        if (chance(sim, f->nakPerMille)) {
+            sim->naks++;
+            DMCCsimAdvance(sim, sim->usPerByte);
+            errno = EREMOTEIO;
+            return 1;
+        }
+        if (read && (*len > 1) && chance(sim, f->shortPerMille)) {
+            sim->shortReads++;
+            *len = (unsigned int)rand_r(&sim->seed) % *len;
+        }
+        if (chance(sim, f->busyPerMille)) {
+            sim->busyPeriods++;
+            sim->busyUntil = sim->timeUs + f->busyUs;
+        }
+    }
+    return 0;
+}
+
+int DMCCsimAddFault(DMCCsim *sim, const DMCCsimFault *fault)
+{
+    if (sim->numFaults >= DMCC_SIM_MAX_FAULTS) {
+        printf("Error: a simulated cape takes %d fault rules\n",
+                DMCC_SIM_MAX_FAULTS);
+        return -1;
+    }
+    sim->fault[sim->numFaults++] = *fault;
+    return 0;
+}
+
+int DMCCsimParseFault(DMCCsim *sim, const char *line)
+{
+    DMCCsimFault fault;
+    char copy[256];
+    char *save = NULL;
+    unsigned int first, last, a, b;
+    int n;
+
+    while (isspace((unsigned char)*line)) {
+        line++;
+    }
+    if ((*line == '\0') || (*line == '#')) {
+        return 0;
+    }
+    memset(&fault, 0, sizeof(DMCCsimFault));
+    snprintf(copy, sizeof(copy), "%s", line);
+
+    // Which transfers
+    char *word = strtok_r(copy, " \t\r\n", &save);
+    if (strcmp(word, "read") == 0) {
+        fault.reads = 1;
+    } else if (strcmp(word, "write") == 0) {
+        fault.writes = 1;
+    } else if (strcmp(word, "any") == 0) {
+        fault.reads = 1;
+        fault.writes = 1;
+    } else {
+        goto bad;
+    }
+
+    // Registers
+    word = strtok_r(NULL, " \t\r\n", &save);
+    if (word == NULL) {
+        goto bad;
+    }
+    n = sscanf(word, "%i-%i", (int *)&first, (int *)&last);
+    if (n == 1) {
+        last = first;
+    }
+    if ((n < 1) || (first > last) || (last > 0xff)) {
+        goto bad;
+    }
+    fault.first = first;
+    fault.last = last;
+
+    // What happens to them
+    while ((word = strtok_r(NULL, " \t\r\n", &save)) != NULL) {
+        char *value = strchr(word, '=');
+        if (value == NULL) {
+            goto bad;
+        }
+        *value++ = '\0';
+        b = 0;
+        n = sscanf(value, "%u:%u", &a, &b);
+        if (n < 1) {
+            goto bad;
+        }
+        if (strcmp(word, "latency") == 0) {
+            fault.latencyUs = a;
+        } else if (strcmp(word, "jitter") == 0) {
+            fault.jitterUs = a;
+        } else if ((strcmp(word, "tail") == 0) && (n == 2) && (a <= 1000)) {
+            fault.tailPerMille = a;
+            fault.tailUs = b;
+        } else if ((strcmp(word, "stretch") == 0) && (n == 2) &&
+                    (a <= 1000)) {
+            fault.stretchPerMille = a;
+            fault.stretchUs = b;
+        } else if ((strcmp(word, "nak") == 0) && (a <= 1000)) {
+            fault.nakPerMille = a;
+        } else if ((strcmp(word, "short") == 0) && (a <= 1000)) {
+            fault.shortPerMille = a;
+        } else if ((strcmp(word, "busy") == 0) && (n == 2) && (a <= 1000)) {
+            fault.busyPerMille = a;
+            fault.busyUs = b;
+        } else {
+            goto bad;
+        }
+    }
+    return DMCCsimAddFault(sim, &fault);
+
+bad:
+    printf("Error: cannot read fault rule: %s\n", line);
+    return -1;
+}
+
+int DMCCsimLoadFaults(DMCCsim *sim, const char *path)
+{
+    char line[256];
+
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        printf("Error: cannot open %s\n", path);
+        return -1;
+    }
+    while (fgets(line, sizeof(line), f) != NULL) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (DMCCsimParseFault(sim, line) != 0) {
+            fclose(f);
+            return -1;
+        }
+    }
+    fclose(f);
+    return 0;
+}
+
+int DMCCsimReopen(void *ctx)
+{
+    DMCCsim *sim = (DMCCsim *)ctx;
+
+    sim->hung = 0;
+    sim->reopens++;
+    return 0;
+}
+
+int DMCCsimWrite(void *ctx, const unsigned char *buf, int len)
+{
+    DMCCsim *sim = (DMCCsim *)ctx;
+    int i;
+
+    if (len <= 0) {
+        return 0;
+    }
+    if (injectFault(sim) ||
+            applyFaults(sim, buf[0], (len > 1) ? len - 1 : 1, 0, &len)) {
+        return -1;
+    }
+    // Address byte plus data bytes
+    DMCCsimAdvance(sim, sim->usPerByte * (len + 1));
+    blockTransfer(sim);
+
+    // Bytes past what the firmware takes in one transfer are lost; without
+    // auto-increment every byte goes to the same register
+    sim->addr = buf[0];
+    for (i = 1; i < len; i++) {
+        if (sim->autoIncrement && (i > (int)sim->maxBurst)) {
+            break;
+        }
+        if (sim->addr == 0xff) {
+            queueCommand(sim, buf[i]);
+        } else {
+            sim->reg[sim->addr] = buf[i];
+        }
+        if (sim->autoIncrement) {
+            sim->addr++;
+        }
+    }
+    return len;
+}
+
+int DMCCsimRead(void *ctx, unsigned char *buf, int len)
+{
+    DMCCsim *sim = (DMCCsim *)ctx;
+    int i;
+
+    if (len <= 0) {
+        return 0;
+    }
+    if (injectFault(sim) || applyFaults(sim, sim->addr, len, 1, &len)) {
+        return -1;
+    }
+    // Address byte plus data bytes
+    DMCCsimAdvance(sim, sim->usPerByte * (len + 1));
+    blockTransfer(sim);
+
+    // Past what the firmware sends in one transfer the bus reads 0xff;
+    // without auto-increment every byte repeats the same register
+    for (i = 0; i < len; i++) {
+        if (sim->autoIncrement && (i >= (int)sim->maxBurst)) {
+            buf[i] = 0xff;
+            continue;
+        }
+        buf[i] = sim->reg[sim->addr];
+        if (sim->autoIncrement) {
+            sim->addr++;
+        }
+    }
+    return len;
+}
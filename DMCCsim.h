@@ -0,0 +1,243 @@
+//
+// Copyright (C) 2013-2016 - Exadler Technologies Inc., Sarah Tan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+// DMCCsim.h - simulated DMCC cape (register file, firmware PID and motors)
+//
+// The simulated cape answers the same register reads/writes and commands
+// as the real board, so a session opened with DMCCsimStart can be passed to
+// every function in DMCC.h.  Time on the cape only moves forward when bus
+// traffic happens (usPerByte) or when DMCCsimAdvance is called, so results
+// are repeatable and independent of the speed of the host.  Set latencyUs
+// to also make every transfer take real time, like an adapter would (for
+// running several buses in parallel).  Transfers can also be made to fail
+// (NAKs, timeouts, a hung adapter) to test how programs ride out a bad bus,
+// and fault rules (DMCCsimFault) add delays and failures to the transfers
+// of chosen registers only, to measure tail latency.
+//
+// NOTE: the firmware PID is an approximation of the Mk.07 fixed point loop
+//       (1 kHz, output = -(P*e + I*sum(e) + D*de) / 256), good enough to
+//       compare sets of constants but not to predict the exact response of
+//       a given robot.
+
+#ifndef DMCCSIM
+#define DMCCSIM
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Firmware control loop period in microseconds
+#define DMCC_SIM_TICK_US 1000
+
+// QEI velocity is reported in counts per this many microseconds
+#define DMCC_SIM_VEL_PERIOD_US 10000
+
+// Motor modes (what the firmware is doing with each motor)
+#define DMCC_SIM_MODE_POWER 0
+#define DMCC_SIM_MODE_POS   1
+#define DMCC_SIM_MODE_VEL   2
+
+// Firmware versions the simulated cape can behave like (DMCCsimSetFirmware)
+//   Mk.05 - one register per transfer (no auto-increment), no power limits
+//   Mk.06 - auto-increment up to 16 bytes per transfer, no power limits
+//   Mk.07 - auto-increment up to 32 bytes per transfer, power limits
+#define DMCC_SIM_FIRMWARE 7
+
+// Motor commands waiting out the firmware delay (commandDelayUs)
+#define DMCC_SIM_MAX_PENDING 16
+
+// Fault rules a cape can hold (DMCCsimAddFault)
+#define DMCC_SIM_MAX_FAULTS 8
+
+// DMCCsimFault - delays and failures of the transfers that touch a range of
+//                registers.  Every rule that matches a transfer applies, in
+//                the order they were added.  Chances are per 1000 transfers
+//                and times are simulated microseconds.
+typedef struct DMCCsimFault {
+    unsigned char first;        // registers [first, last]
+    unsigned char last;
+    unsigned char reads;        // rule applies to reads
+    unsigned char writes;       // rule applies to writes
+    unsigned int latencyUs;     // added to every transfer
+    unsigned int jitterUs;      // plus a random time, exponential with
+                                // this mean
+    unsigned int tailPerMille;  // chance of a rare long delay
+    unsigned int tailUs;
+    unsigned int stretchPerMille;   // chance the cape stretches the clock,
+    unsigned int stretchUs;         // for up to stretchUs (a stretch past
+                                    // timeoutUs times the transfer out)
+    unsigned int nakPerMille;   // chance of a NAK
+    unsigned int shortPerMille; // chance a read returns fewer bytes
+    unsigned int busyPerMille;  // chance the cape is busy after the
+    unsigned int busyUs;        // transfer (NAKs everything for busyUs)
+} DMCCsimFault;
+
+// DMCCsimMotor - model of one motor plus its encoder
+typedef struct DMCCsimMotor {
+    // Plant parameters (first order DC motor)
+    double maxVel;          // counts/second at full power and nominal supply
+    double tau;             // mechanical time constant in seconds
+    double deadband;        // fraction of full power needed to start moving
+    double stallCurrent;    // current register value at stall, full power
+
+    // Plant state
+    double pos;             // counts
+    double vel;             // counts/second
+    int pwm;                // power applied by the firmware (-10000..10000)
+    int mode;               // DMCC_SIM_MODE_*
+
+    // Firmware PID state
+    long long integral;
+    int prevError;
+} DMCCsimMotor;
+
+// DMCCsim - one simulated cape
+typedef struct DMCCsim {
+    unsigned char reg[256];     // register file as seen over the bus
+    unsigned char addr;         // register pointer (i2c-dev auto-increment)
+    DMCCsimMotor motor[2];
+    double supplyVolts;         // motor supply voltage
+    double nominalVolts;        // supply at which maxVel is reached
+    unsigned int usPerByte;     // simulated bus time for every byte moved
+    unsigned int latencyUs;     // real time every transfer blocks (0: none)
+    int firmware;               // firmware version (5, 6 or 7)
+    unsigned int maxBurst;      // data bytes the firmware moves per transfer
+    int autoIncrement;          // register pointer moves within a transfer
+    int powerLimits;            // PID power limit registers work
+    unsigned long long timeUs;  // time since DMCCsimInit
+    unsigned int tickUs;        // time carried over to the next PID tick
+
+    // Firmware delay: motor commands (everything but the status snapshot)
+    // take effect on the first PID tick at least this long after the write
+    unsigned int commandDelayUs;
+    unsigned int numPending;
+    unsigned char pendingCmd[DMCC_SIM_MAX_PENDING];
+    unsigned long long pendingDue[DMCC_SIM_MAX_PENDING];
+
+    // Fault injection: chance (per 1000 transfers) that a transfer fails.
+    // A NAK fails at once, a timeout first holds the bus for timeoutUs, and
+    // after a hang every transfer times out until the session reopens the
+    // adapter (DMCCtransport.reopen).  A failed transfer changes nothing.
+    unsigned int nakPerMille;
+    unsigned int timeoutPerMille;
+    unsigned int hangPerMille;
+    unsigned int timeoutUs;
+    unsigned int seed;          // random state of the faults
+    int hung;                   // adapter hung, waiting for a reopen
+    unsigned long long naks;    // faults injected so far
+    unsigned long long timeouts;
+    unsigned long long hangs;
+    unsigned long long reopens; // reopens asked for by the session
+
+    // Fault rules by register range (DMCCsimAddFault)
+    DMCCsimFault fault[DMCC_SIM_MAX_FAULTS];
+    int numFaults;
+    unsigned long long busyUntil;   // cape busy (NAKs) until this time
+    unsigned long long shortReads;  // faults injected by the rules (NAKs
+    unsigned long long stretches;   // and timeouts count above)
+    unsigned long long busyPeriods;
+} DMCCsim;
+
+// DMCCsimInit - Sets up a cape with default motors, a 12V supply, the
+//               Mk.07 ID string, 100kHz bus timing, no firmware delay and
+//               no faults (timeoutUs is 10ms, the shortest I2C_TIMEOUT)
+// Parameters: sim - cape to initialise
+void DMCCsimInit(DMCCsim *sim);
+
+// DMCCsimSetFirmware - Makes the cape behave like the given firmware
+//                      version (ID string and bus behaviour)
+// Parameters: sim - cape to change
+//             version - 5, 6 or 7
+// Returns: -1 - if the version is not simulated
+//           0 - otherwise
+int DMCCsimSetFirmware(DMCCsim *sim, int version);
+
+// DMCCsimStart - Begins a session on a simulated cape
+//                Prints an error if the session cannot be opened
+// Parameters: sim - cape to connect to (must outlive the session)
+// Returns: session to pass to the DMCC.h functions (end with DMCCend)
+//          -1 - if an error occurs
+int DMCCsimStart(DMCCsim *sim);
+
+// DMCCsimAdvance - Runs the cape (firmware and motors) forward in time
+// Parameters: sim - cape to run
+//             microseconds - amount of simulated time
+void DMCCsimAdvance(DMCCsim *sim, unsigned int microseconds);
+
+// DMCCsimWrite - i2c-dev style write to the cape (DMCCtransport callback)
+// Parameters: ctx - cape (DMCCsim *)
+//             buf - register address followed by the data bytes
+//             len - number of bytes in buf
+// Returns: number of bytes written
+//          -1 - if a fault was injected (errno is EREMOTEIO or ETIMEDOUT)
+int DMCCsimWrite(void *ctx, const unsigned char *buf, int len);
+
+// DMCCsimRead - i2c-dev style read from the cape (DMCCtransport callback)
+// Parameters: ctx - cape (DMCCsim *)
+//             buf - where to put the bytes
+//             len - number of bytes to read
+// Returns: number of bytes read
+//          -1 - if a fault was injected (errno is EREMOTEIO or ETIMEDOUT)
+int DMCCsimRead(void *ctx, unsigned char *buf, int len);
+
+// DMCCsimAddFault - Adds a fault rule to a cape
+//                   Prints an error if the cape has no room for it
+// Parameters: sim - cape to change
+//             fault - rule to add (copied)
+// Returns: -1 - if there are DMCC_SIM_MAX_FAULTS rules already
+//           0 - otherwise
+int DMCCsimAddFault(DMCCsim *sim, const DMCCsimFault *fault);
+
+// DMCCsimParseFault - Adds a fault rule written as a line of text:
+//                       <read|write|any> <first>[-<last>] [key=value ...]
+//                     with the keys latency=us, jitter=us, tail=chance:us,
+//                     stretch=chance:us, nak=chance, short=chance and
+//                     busy=chance:us (chances per 1000 transfers), e.g.
+//                       read 0x10-0x1f jitter=200 nak=5
+//                     Blank lines and lines starting with # add nothing
+//                     Prints an error if the line cannot be read
+// Parameters: sim - cape to change
+//             line - rule
+// Returns: -1 - if an error occurs
+//           0 - otherwise
+int DMCCsimParseFault(DMCCsim *sim, const char *line);
+
+// DMCCsimLoadFaults - Adds the fault rules of a file, one line each (see
+//                     DMCCsimParseFault)
+//                     Prints an error if the file cannot be read
+// Parameters: sim - cape to change
+//             path - file of rules
+// Returns: -1 - if an error occurs (rules before the bad line are added)
+//           0 - otherwise
+int DMCCsimLoadFaults(DMCCsim *sim, const char *path);
+
+// DMCCsimReopen - Reopens the adapter of the cape, which ends a hang
+//                 (DMCCtransport callback)
+// Parameters: ctx - cape (DMCCsim *)
+// Returns: 0
+int DMCCsimReopen(void *ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,274 @@
+//
+// Copyright (C) 2013-2016 - Exadler Technologies Inc., Sarah Tan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "DMCC.h"
+#include "DMCCtelemetry.h"
+#include "DMCClog.h"
+
+int DMCCtelemetryOpen(DMCCtelemetry *log, const char *path,
+                        unsigned int capacity)
+{
+    if (capacity == 0) {
+        LOG_ERROR("telemetry log needs room for at least one record");
+        return -1;
+    }
+
+    log->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (log->fd < 0) {
+        LOG_ERROR("cannot create %s", path);
+        return -1;
+    }
+
+    // Allocate the whole file now so writes never extend it
+    log->mapSize = sizeof(DMCCtelemetryHeader) +
+                    ((size_t)capacity * sizeof(DMCCtelemetryRecord));
+    if (posix_fallocate(log->fd, 0, log->mapSize) != 0) {
+        LOG_ERROR("cannot allocate %lu bytes for %s",
+                (unsigned long)log->mapSize, path);
+        close(log->fd);
+        return -1;
+    }
+
+    void *map = mmap(NULL, log->mapSize, PROT_READ | PROT_WRITE, MAP_SHARED,
+                        log->fd, 0);
+    if (map == MAP_FAILED) {
+        LOG_ERROR("cannot map %s", path);
+        close(log->fd);
+        return -1;
+    }
+    log->header = (DMCCtelemetryHeader *)map;
+    log->records = (DMCCtelemetryRecord *)
+                    ((char *)map + sizeof(DMCCtelemetryHeader));
+
+    // Touch every page now so the first pass around the ring does not
+    // take page faults inside the control loop
+    memset(map, 0, log->mapSize);
+
+    memcpy(log->header->magic, DMCC_TELEMETRY_MAGIC, 8);
+    log->header->recordSize = sizeof(DMCCtelemetryRecord);
+    log->header->capacity = capacity;
+    log->header->head = 0;
+    return 0;
+}
+
+void DMCCtelemetryWrite(DMCCtelemetry *log, const DMCCtelemetryRecord *record)
+{
+    uint64_t head = log->header->head;
+
+    log->records[head % log->header->capacity] = *record;
+    // Publish the record after its contents for readers of the mapping
+    __atomic_store_n(&log->header->head, head + 1, __ATOMIC_RELEASE);
+}
+
+void DMCCtelemetryClose(DMCCtelemetry *log)
+{
+    munmap(log->header, log->mapSize);
+    close(log->fd);
+    log->header = NULL;
+    log->records = NULL;
+}
+
+int DMCCtelemetrySample(int fd, DMCCtelemetryRecord *record)
+{
+    unsigned long long start = DMCCclock(fd);
+    DMCCregs regs;
+
+    // Status update command, then 0x10 - 0x2b (encoders, velocities,
+    // currents, targets) and 0x02 - 0x07 (pwm, voltage) in two reads
+    int result = DMCCreadStatus(fd, DMCC_REG_QEI1,
+                    DMCC_REG_TARGET_VEL2 + 2 - DMCC_REG_QEI1, &regs);
+    if (result == DMCC_OK) {
+        result = DMCCreadRegs(fd, DMCC_REG_PWM1,
+                    DMCC_REG_VOLTAGE + 2 - DMCC_REG_PWM1, &regs);
+    }
+    if (result != DMCC_OK) {
+        memset(&regs, 0, sizeof(regs));
+    }
+
+    record->timeUs = start;
+    record->qei[0] = (int32_t)regs.qei1;
+    record->qei[1] = (int32_t)regs.qei2;
+    record->vel[0] = (int16_t)regs.qeiVel1;
+    record->vel[1] = (int16_t)regs.qeiVel2;
+    record->current[0] = (uint16_t)regs.current1;
+    record->current[1] = (uint16_t)regs.current2;
+    record->voltage = (uint16_t)regs.voltage;
+    record->pwm[0] = (int16_t)regs.pwm1;
+    record->pwm[1] = (int16_t)regs.pwm2;
+    record->targetVel[0] = (int16_t)regs.targetVel1;
+    record->targetVel[1] = (int16_t)regs.targetVel2;
+    record->targetPos[0] = (int32_t)regs.targetPos1;
+    record->targetPos[1] = (int32_t)regs.targetPos2;
+    record->sampleUs = (uint32_t)(DMCCclock(fd) - start);
+    record->reserved = 0;
+    return result;
+}
+
+void DMCCadaptiveInit(DMCCadaptive *rate, unsigned int fastUs,
+                        unsigned int slowUs)
+{
+    memset(rate, 0, sizeof(DMCCadaptive));
+    rate->fastUs = fastUs;
+    rate->slowUs = slowUs;
+    rate->velThreshold = DMCC_ADAPTIVE_VEL;
+    rate->currentThreshold = DMCC_ADAPTIVE_CURRENT;
+    rate->posTolerance = DMCC_ADAPTIVE_POS;
+    rate->holdUs = DMCC_ADAPTIVE_HOLD_US;
+}
+
+int DMCCadaptiveDue(DMCCadaptive *rate, int session)
+{
+    DMCCcommandState state;
+
+    if ((DMCCgetCommandState(session, &state) == 0) &&
+            (state.count != rate->commands)) {
+        return 1;
+    }
+    return DMCCclock(session) >= rate->next;
+}
+
+int DMCCadaptiveDueState(DMCCadaptive *rate, const DMCCcommandState *state,
+                            unsigned long long now)
+{
+    return (state->count != rate->commands) || (now >= rate->next);
+}
+
+// motorActive - checks if a motor in a sample has work to do
+static int motorActive(DMCCadaptive *rate, int mode,
+                        const DMCCtelemetryRecord *record, int m)
+{
+    if ((record->vel[m] > rate->velThreshold) ||
+            (record->vel[m] < -rate->velThreshold) ||
+            (record->current[m] > rate->currentThreshold)) {
+        return 1;
+    }
+    if (mode == DMCC_MODE_POS) {
+        int error = record->targetPos[m] - record->qei[m];
+        return (error > rate->posTolerance) || (error < -rate->posTolerance);
+    } else if (mode == DMCC_MODE_VEL) {
+        return record->targetVel[m] != 0;
+    }
+    return record->pwm[m] != 0;
+}
+
+unsigned int DMCCadaptiveUpdate(DMCCadaptive *rate, int session,
+                                const DMCCtelemetryRecord *record)
+{
+    DMCCcommandState state;
+
+    if (DMCCgetCommandState(session, &state) != 0) {
+        memset(&state, 0, sizeof(state));
+    }
+    return DMCCadaptiveUpdateState(rate, &state, record);
+}
+
+unsigned int DMCCadaptiveUpdateState(DMCCadaptive *rate,
+                                        const DMCCcommandState *state,
+                                        const DMCCtelemetryRecord *record)
+{
+    int m;
+
+    // A new command makes the motors active until proven idle
+    int active = (state->count != rate->commands);
+    rate->commands = state->count;
+    for (m = 0; m < 2; m++) {
+        active |= motorActive(rate, state->mode[m], record, m);
+    }
+
+    if (active) {
+        rate->fast = 1;
+        rate->lastActive = record->timeUs;
+    } else if (rate->fast && (record->timeUs - rate->lastActive >=
+                                rate->holdUs)) {
+        rate->fast = 0;
+    }
+    unsigned int period = rate->fast ? rate->fastUs : rate->slowUs;
+    rate->next = record->timeUs + period;
+    return period;
+}
+
+long DMCCtelemetryExportCSV(const char *path, FILE *out)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        LOG_ERROR("cannot open %s", path);
+        return -1;
+    }
+
+    struct stat st;
+    if ((fstat(fd, &st) != 0) ||
+            ((size_t)st.st_size < sizeof(DMCCtelemetryHeader))) {
+        LOG_ERROR("%s is not a telemetry log", path);
+        close(fd);
+        return -1;
+    }
+
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        LOG_ERROR("cannot map %s", path);
+        return -1;
+    }
+
+    DMCCtelemetryHeader *header = (DMCCtelemetryHeader *)map;
+    DMCCtelemetryRecord *records = (DMCCtelemetryRecord *)
+                    ((char *)map + sizeof(DMCCtelemetryHeader));
+    if ((memcmp(header->magic, DMCC_TELEMETRY_MAGIC, 8) != 0) ||
+            (header->recordSize != sizeof(DMCCtelemetryRecord)) ||
+            (header->capacity == 0) ||
+            ((size_t)st.st_size < sizeof(DMCCtelemetryHeader) +
+                ((size_t)header->capacity * sizeof(DMCCtelemetryRecord)))) {
+        LOG_ERROR("%s is not a telemetry log", path);
+        munmap(map, st.st_size);
+        return -1;
+    }
+
+    uint64_t head = __atomic_load_n(&header->head, __ATOMIC_ACQUIRE);
+    uint64_t first = 0;
+    if (head > header->capacity) {
+        first = head - header->capacity;
+    }
+
+    fprintf(out, "time_us,qei1,qei2,vel1,vel2,current1,current2,voltage,"
+                 "pwm1,pwm2,target_vel1,target_vel2,target_pos1,target_pos2,"
+                 "sample_us\n");
+    uint64_t i;
+    for (i = first; i < head; i++) {
+        DMCCtelemetryRecord r = records[i % header->capacity];
+        fprintf(out, "%llu,%d,%d,%d,%d,%u,%u,%u,%d,%d,%d,%d,%d,%d,%u\n",
+                (unsigned long long)r.timeUs, r.qei[0], r.qei[1],
+                r.vel[0], r.vel[1], r.current[0], r.current[1], r.voltage,
+                r.pwm[0], r.pwm[1], r.targetVel[0], r.targetVel[1],
+                r.targetPos[0], r.targetPos[1], r.sampleUs);
+    }
+
+    munmap(map, st.st_size);
+    return (long)(head - first);
+}
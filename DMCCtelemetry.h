@@ -0,0 +1,185 @@
+//
+// Copyright (C) 2013-2016 - Exadler Technologies Inc., Sarah Tan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+// DMCCtelemetry.h - binary telemetry log in a memory mapped ring file
+//
+// The log file is created at its full size when it is opened, then mapped
+// into memory.  Writing a record is a copy into the mapping plus one
+// counter update: no allocation, no system call, no formatting.  When the
+// ring is full the oldest records are overwritten.
+
+#ifndef DMCCTELEMETRY
+#define DMCCTELEMETRY
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "DMCC.h"
+
+#define DMCC_TELEMETRY_MAGIC "DMCCTLM1"
+
+// DMCCtelemetryRecord - one sample of a cape (48 bytes, little endian)
+typedef struct DMCCtelemetryRecord {
+    uint64_t timeUs;        // DMCCclock of the session when sampled
+    int32_t qei[2];         // QEI position of motor 1 and 2
+    int16_t vel[2];         // QEI velocity of motor 1 and 2
+    uint16_t current[2];    // current of motor 1 and 2
+    uint16_t voltage;       // motor supply voltage
+    int16_t pwm[2];         // power last set for motor 1 and 2
+    int16_t targetVel[2];   // velocity target of motor 1 and 2
+    int32_t targetPos[2];   // position target of motor 1 and 2
+    uint32_t sampleUs;      // time the sample took on the bus
+    uint16_t reserved;
+} __attribute__((packed)) DMCCtelemetryRecord;
+
+// DMCCtelemetryHeader - start of the log file
+typedef struct DMCCtelemetryHeader {
+    char magic[8];          // DMCC_TELEMETRY_MAGIC
+    uint32_t recordSize;    // sizeof(DMCCtelemetryRecord)
+    uint32_t capacity;      // number of records in the ring
+    uint64_t head;          // number of records ever written
+} __attribute__((packed)) DMCCtelemetryHeader;
+
+// DMCCtelemetry - an open log
+typedef struct DMCCtelemetry {
+    int fd;
+    DMCCtelemetryHeader *header;
+    DMCCtelemetryRecord *records;
+    size_t mapSize;
+} DMCCtelemetry;
+
+// DMCCtelemetryOpen - Creates (or replaces) a log file with room for the
+//                     given number of records and maps it
+//                     Logs an error if the file cannot be created
+// Parameters: log - log to open
+//             path - name of the log file
+//             capacity - number of records kept (oldest are overwritten)
+// Returns: -1 - if an error occurs
+//           0 - otherwise
+int DMCCtelemetryOpen(DMCCtelemetry *log, const char *path,
+                        unsigned int capacity);
+
+// DMCCtelemetryWrite - Adds a record to the log (never allocates or blocks)
+// Parameters: log - log from DMCCtelemetryOpen
+//             record - sample to add
+void DMCCtelemetryWrite(DMCCtelemetry *log, const DMCCtelemetryRecord *record);
+
+// DMCCtelemetryClose - Unmaps and closes a log
+// Parameters: log - log from DMCCtelemetryOpen
+void DMCCtelemetryClose(DMCCtelemetry *log);
+
+// DMCCtelemetrySample - Reads a record from a cape (one status update
+//                       command, then the registers)
+// Parameters: fd - connection to the board (value returned from DMCCstart)
+//             record - where to put the sample
+// Returns: DMCC_EINVAL - if the session is invalid
+//          DMCC_EIO - if a bus transfer fails (the record is not a sample
+//                     of the cape and should not be kept)
+//          DMCC_OK - otherwise
+int DMCCtelemetrySample(int fd, DMCCtelemetryRecord *record);
+
+// Adaptive sampling: fast while a motor moves or has work to do, a slow
+// heartbeat once every motor has been idle for a while
+#define DMCC_ADAPTIVE_VEL 2             // |QEI velocity| above this is moving
+#define DMCC_ADAPTIVE_CURRENT 200       // current above this is working
+#define DMCC_ADAPTIVE_POS 10            // QEI counts from a position target
+#define DMCC_ADAPTIVE_HOLD_US 500000    // idle this long to slow down
+
+// DMCCadaptive - when to take the next sample of a cape
+typedef struct DMCCadaptive {
+    unsigned int fastUs;            // period while a motor is active
+    unsigned int slowUs;            // period while every motor is idle
+    int velThreshold;               // DMCC_ADAPTIVE_VEL
+    unsigned int currentThreshold;  // DMCC_ADAPTIVE_CURRENT
+    int posTolerance;               // DMCC_ADAPTIVE_POS
+    unsigned int holdUs;            // DMCC_ADAPTIVE_HOLD_US
+    int fast;                       // sampling at fastUs
+    unsigned int commands;          // commands seen (DMCCcommandState)
+    unsigned long long lastActive;  // time of the last active sample
+    unsigned long long next;        // when the next sample is due
+} DMCCadaptive;
+
+// DMCCadaptiveInit - Sets up adaptive sampling with the default thresholds
+//                    (the first sample is due at once)
+// Parameters: rate - state to set up
+//             fastUs - sample period while a motor is active
+//             slowUs - sample period while every motor is idle
+void DMCCadaptiveInit(DMCCadaptive *rate, unsigned int fastUs,
+                        unsigned int slowUs);
+
+// DMCCadaptiveDue - Checks if a sample is due: its time has come, or a
+//                   motor command was sent on the session since the last
+//                   sample (cheap, no bus traffic, call it every fastUs)
+//                   Only commands sent on this session, in this process,
+//                   are seen: commands another process sends to the cape
+//                   show up at the next sample that finds a motor active
+//                   (up to slowUs late).  A sampler in another process
+//                   uses DMCCadaptiveDueState with the commands published
+//                   by the process that sends them (DMCCshmGetCommands).
+// Parameters: rate - state from DMCCadaptiveInit
+//             session - connection to the board (value returned from DMCCstart)
+// Returns: 1 - if a sample is due
+//          0 - otherwise
+int DMCCadaptiveDue(DMCCadaptive *rate, int session);
+
+// DMCCadaptiveDueState - DMCCadaptiveDue with the motor commands and the
+//                        time given by the caller
+// Parameters: rate - state from DMCCadaptiveInit
+//             state - motor commands sent to the cape
+//             now - time on the clock the samples are timed with (timeUs)
+// Returns: 1 - if a sample is due
+//          0 - otherwise
+int DMCCadaptiveDueState(DMCCadaptive *rate, const DMCCcommandState *state,
+                            unsigned long long now);
+
+// DMCCadaptiveUpdate - Picks the rate from a sample just taken and sets
+//                      when the next one is due
+//                      A motor is active if it moves, draws current, has
+//                      power set, a velocity target or a position target
+//                      it has not reached
+// Parameters: rate - state from DMCCadaptiveInit
+//             session - connection to the board (value returned from DMCCstart)
+//             record - the sample (from DMCCtelemetrySample)
+// Returns: microseconds until the next sample is due
+unsigned int DMCCadaptiveUpdate(DMCCadaptive *rate, int session,
+                                const DMCCtelemetryRecord *record);
+
+// DMCCadaptiveUpdateState - DMCCadaptiveUpdate with the motor commands given
+//                           by the caller
+// Parameters: rate - state from DMCCadaptiveInit
+//             state - motor commands sent to the cape
+//             record - the sample
+// Returns: microseconds until the next sample is due
+unsigned int DMCCadaptiveUpdateState(DMCCadaptive *rate,
+                                        const DMCCcommandState *state,
+                                        const DMCCtelemetryRecord *record);
+
+// DMCCtelemetryExportCSV - Writes the records of a log file as CSV, oldest
+//                          first
+//                          Logs an error if the file is not a log
+// Parameters: path - name of the log file
+//             out - where to write the CSV
+// Returns: number of records written
+//          -1 - if an error occurs
+long DMCCtelemetryExportCSV(const char *path, FILE *out);
+
+#endif
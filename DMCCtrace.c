@@ -0,0 +1,385 @@
+//
+// Copyright (C) 2013-2016 - Exadler Technologies Inc., Sarah Tan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+
+#include "DMCC.h"
+#include "DMCCtrace.h"
+#include "DMCClog.h"
+
+#ifdef DMCC_TRACE
+
+// ------------------------
+// Per-thread event buffers
+// ------------------------
+#define TRACE_MAX_SESSIONS 256
+
+typedef struct TraceEvent {
+    unsigned long long start;   // ns
+    unsigned long long end;     // ns
+    const char *api;            // API call (innermost) or NULL
+    const char *outer;          // API call it was made from, or NULL
+    short int session;
+    unsigned char kind;         // DMCC_TRACE_*
+    unsigned char reg;
+    unsigned short int len;
+} TraceEvent;
+
+typedef struct TraceBuffer {
+    struct TraceBuffer *next;   // list of every thread's buffer
+    long tid;
+    unsigned int capacity;
+    int freed;                  // 1 once its thread exited (the next new
+                                // thread takes it, and its events, over)
+    unsigned long long head;    // events ever recorded (ring index)
+    TraceEvent events[];
+} TraceBuffer;
+
+// TracePool - buffers for DMCC_TRACE_THREADS threads, allocated by
+//             DMCCtraceStart so that recording never allocates; a thread
+//             that exits gives its buffer back
+typedef struct TracePool {
+    unsigned int capacity;      // events in each buffer
+    unsigned int used;          // buffers ever handed to threads
+    size_t bufferSize;
+    char buffers[];
+} TracePool;
+
+static TraceBuffer *traceBuffers;       // pushed with compare and swap
+static TracePool *tracePool;            // pool of the latest size
+static volatile int traceOn;
+static unsigned char traceCapeAddr[TRACE_MAX_SESSIONS];
+static unsigned char traceReg[TRACE_MAX_SESSIONS];
+static const char *traceFile;
+static pthread_key_t traceKey;          // runs traceThreadExit
+static pthread_once_t traceKeyOnce = PTHREAD_ONCE_INIT;
+
+static __thread TraceBuffer *myBuffer;
+static __thread const char *myApi;
+static __thread const char *myOuter;
+
+unsigned long long DMCCtraceTime(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((unsigned long long)ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+}
+
+// traceThreadExit - gives the buffer of an exiting thread back to its pool
+//                   (destructor of traceKey)
+static void traceThreadExit(void *buffer)
+{
+    __atomic_store_n(&((TraceBuffer *)buffer)->freed, 1, __ATOMIC_RELEASE);
+}
+
+// traceMakeKey - creates traceKey (once)
+static void traceMakeKey(void)
+{
+    if (pthread_key_create(&traceKey, traceThreadExit) != 0) {
+        LOG_ERROR("cannot create the trace thread key");
+    }
+}
+
+// traceReuse - takes a buffer of the pool that an exited thread gave back
+// Returns: NULL - if every buffer is held by a live thread
+static TraceBuffer *traceReuse(TracePool *pool)
+{
+    unsigned int used = __atomic_load_n(&pool->used, __ATOMIC_ACQUIRE);
+    unsigned int i;
+    int freed;
+
+    used = (used < DMCC_TRACE_THREADS) ? used : DMCC_TRACE_THREADS;
+    for (i = 0; i < used; i++) {
+        TraceBuffer *b = (TraceBuffer *)
+                            (pool->buffers + (i * pool->bufferSize));
+        freed = 1;
+        if (__atomic_compare_exchange_n(&b->freed, &freed, 0, 0,
+                                __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            return b;
+        }
+    }
+    return NULL;
+}
+
+// traceEvent - next free event in this thread's buffer (NULL if tracing is
+//              off); the buffer is only written by its own thread
+static TraceEvent *traceEvent(void)
+{
+    if (!traceOn) {
+        return NULL;
+    }
+
+    TraceBuffer *b = myBuffer;
+    TracePool *pool = __atomic_load_n(&tracePool, __ATOMIC_ACQUIRE);
+    if ((b == NULL) || (b->capacity != pool->capacity)) {
+        // First event on this thread (or after a restart with a new size):
+        // take the next buffer of the pool, or one an exited thread gave
+        // back, or record nothing if live threads hold them all
+        if (b != NULL) {
+            traceThreadExit(b);
+        }
+        myBuffer = NULL;
+        unsigned int i = DMCC_TRACE_THREADS;
+        if (__atomic_load_n(&pool->used, __ATOMIC_RELAXED) <
+                DMCC_TRACE_THREADS) {
+            i = __atomic_fetch_add(&pool->used, 1, __ATOMIC_ACQ_REL);
+        }
+        if (i < DMCC_TRACE_THREADS) {
+            // Never used: it goes on the list of buffers
+            b = (TraceBuffer *)(pool->buffers + (i * pool->bufferSize));
+            b->tid = syscall(SYS_gettid);
+            b->capacity = pool->capacity;
+            b->freed = 0;
+            b->head = 0;
+            b->next = __atomic_load_n(&traceBuffers, __ATOMIC_ACQUIRE);
+            while (!__atomic_compare_exchange_n(&traceBuffers, &b->next, b, 0,
+                                    __ATOMIC_RELEASE, __ATOMIC_ACQUIRE)) {
+                // Another thread added its buffer first, try again
+            }
+        } else {
+            // Already on the list: the events of its old thread are dropped
+            b = traceReuse(pool);
+            if (b == NULL) {
+                return NULL;
+            }
+            __atomic_store_n(&b->head, 0, __ATOMIC_RELEASE);
+            b->tid = syscall(SYS_gettid);
+        }
+        myBuffer = b;
+        pthread_setspecific(traceKey, b);
+    }
+
+    TraceEvent *e = &b->events[b->head % b->capacity];
+    __atomic_store_n(&b->head, b->head + 1, __ATOMIC_RELEASE);
+    return e;
+}
+
+DMCCtraceScope DMCCtraceEnter(const char *api)
+{
+    DMCCtraceScope scope;
+
+    scope.api = api;
+    scope.outer = myApi;
+    scope.start = traceOn ? DMCCtraceTime() : 0;
+    myOuter = (myOuter == NULL) ? api : myOuter;
+    myApi = api;
+    return scope;
+}
+
+void DMCCtraceLeave(DMCCtraceScope *scope)
+{
+    myApi = scope->outer;
+    if (scope->outer == NULL) {
+        myOuter = NULL;
+    }
+    if (scope->start == 0) {
+        return;
+    }
+
+    TraceEvent *e = traceEvent();
+    if (e != NULL) {
+        e->start = scope->start;
+        e->end = DMCCtraceTime();
+        e->api = scope->api;
+        e->outer = scope->outer;
+        e->session = -1;
+        e->kind = DMCC_TRACE_API;
+        e->reg = 0;
+        e->len = 0;
+    }
+}
+
+void DMCCtraceTransaction(int session, int kind, const unsigned char *buf,
+                            int len, unsigned long long start)
+{
+    unsigned char reg = 0;
+
+    // Follow the register pointer of the session, as i2c-dev does
+    if ((session >= 0) && (session < TRACE_MAX_SESSIONS)) {
+        // Threads can share a session, so the pointer is updated
+        // atomically (the bus itself orders their transactions)
+        if (kind == DMCC_TRACE_WRITE) {
+            reg = buf[0];
+            __atomic_store_n(&traceReg[session],
+                                buf[0] + ((len > 1) ? (len - 1) : 0),
+                                __ATOMIC_RELAXED);
+        } else {
+            reg = __atomic_fetch_add(&traceReg[session],
+                                        (len > 0) ? len : 0, __ATOMIC_RELAXED);
+        }
+    }
+
+    TraceEvent *e = traceEvent();
+    if (e != NULL) {
+        e->start = start;
+        e->end = DMCCtraceTime();
+        e->api = myApi;
+        e->outer = myOuter;
+        e->session = session;
+        e->kind = kind;
+        e->reg = reg;
+        e->len = (len > 0) ? len : 0;
+    }
+}
+
+void DMCCtraceCape(int session, unsigned char capeAddr)
+{
+    if ((session >= 0) && (session < TRACE_MAX_SESSIONS)) {
+        __atomic_store_n(&traceCapeAddr[session], capeAddr, __ATOMIC_RELAXED);
+    }
+}
+
+// traceAtExit - writes the trace named by DMCC_TRACE_FILE
+static void traceAtExit(void)
+{
+    DMCCtraceStop();
+    DMCCtraceWrite(traceFile);
+}
+
+#endif
+
+int DMCCtraceStart(unsigned int eventsPerThread)
+{
+#ifdef DMCC_TRACE
+    TraceBuffer *b;
+
+    if (eventsPerThread == 0) {
+        LOG_ERROR("trace needs room for at least one event");
+        return -1;
+    }
+    traceOn = 0;
+    pthread_once(&traceKeyOnce, traceMakeKey);
+    // Buffers of another size go in a new pool; threads holding one of the
+    // old buffers take a new one on their next event, so the old pool is
+    // never freed and its buffers are only emptied
+    if ((tracePool == NULL) || (tracePool->capacity != eventsPerThread)) {
+        size_t bufferSize = sizeof(TraceBuffer) +
+                            ((size_t)eventsPerThread * sizeof(TraceEvent));
+        TracePool *pool = (TracePool *)malloc(sizeof(TracePool) +
+                                (DMCC_TRACE_THREADS * bufferSize));
+        if (pool == NULL) {
+            LOG_ERROR("cannot allocate trace buffers for %u events",
+                        eventsPerThread);
+            return -1;
+        }
+        pool->capacity = eventsPerThread;
+        pool->used = 0;
+        pool->bufferSize = bufferSize;
+        __atomic_store_n(&tracePool, pool, __ATOMIC_RELEASE);
+    }
+    for (b = traceBuffers; b != NULL; b = b->next) {
+        b->head = 0;
+    }
+    __atomic_store_n(&traceOn, 1, __ATOMIC_RELEASE);
+    return 0;
+#else
+    LOG_ERROR("library compiled without -DDMCC_TRACE");
+    return -1;
+#endif
+}
+
+void DMCCtraceStop(void)
+{
+#ifdef DMCC_TRACE
+    __atomic_store_n(&traceOn, 0, __ATOMIC_RELEASE);
+#endif
+}
+
+int DMCCtraceWrite(const char *path)
+{
+#ifdef DMCC_TRACE
+    static const char *kinds[] = {"api", "write", "read"};
+    TraceBuffer *b;
+    int first = 1;
+
+    FILE *f = fopen(path, "w");
+    if (f == NULL) {
+        LOG_ERROR("cannot open %s", path);
+        return -1;
+    }
+
+    fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    for (b = __atomic_load_n(&traceBuffers, __ATOMIC_ACQUIRE); b != NULL;
+            b = b->next) {
+        unsigned long long head = __atomic_load_n(&b->head, __ATOMIC_ACQUIRE);
+        unsigned long long i = (head > b->capacity) ? (head - b->capacity) : 0;
+
+        for (; i < head; i++) {
+            TraceEvent *e = &b->events[i % b->capacity];
+            const char *api = (e->api != NULL) ? e->api : "";
+            const char *outer = (e->outer != NULL) ? e->outer : api;
+
+            fprintf(f, "%s{\"ph\":\"X\",\"pid\":%d,\"tid\":%ld,"
+                        "\"ts\":%llu.%03llu,\"dur\":%llu.%03llu,",
+                    first ? "" : ",\n", (int)getpid(), b->tid,
+                    e->start / 1000, e->start % 1000,
+                    (e->end - e->start) / 1000, (e->end - e->start) % 1000);
+            if (e->kind == DMCC_TRACE_API) {
+                fprintf(f, "\"name\":\"%s\",\"cat\":\"api\","
+                            "\"args\":{\"outer\":\"%s\"}}",
+                        api, (e->outer != NULL) ? e->outer : "");
+            } else {
+                int cape = ((e->session >= 0) &&
+                            (e->session < TRACE_MAX_SESSIONS)) ?
+                                __atomic_load_n(&traceCapeAddr[e->session],
+                                                __ATOMIC_RELAXED) : 0;
+                fprintf(f, "\"name\":\"%s 0x%02x\",\"cat\":\"bus\","
+                            "\"args\":{\"session\":%d,\"cape\":\"0x%02x\","
+                            "\"reg\":\"0x%02x\",\"len\":%u,"
+                            "\"api\":\"%s\",\"caller\":\"%s\"}}",
+                        kinds[e->kind], e->reg, e->session, cape, e->reg,
+                        e->len, api, outer);
+            }
+            first = 0;
+        }
+    }
+    fprintf(f, "\n]}\n");
+    fclose(f);
+    return 0;
+#else
+    LOG_ERROR("library compiled without -DDMCC_TRACE");
+    return -1;
+#endif
+}
+
+void DMCCtraceFromEnv(void)
+{
+#ifdef DMCC_TRACE
+    static int started = 0;
+    char *file = getenv("DMCC_TRACE_FILE");
+
+    if (started || (file == NULL) || (file[0] == '\0')) {
+        return;
+    }
+    started = 1;
+    traceFile = file;
+    if (DMCCtraceStart(65536) == 0) {
+        atexit(traceAtExit);
+    }
+#endif
+}
@@ -0,0 +1,83 @@
+//
+// Copyright (C) 2013-2016 - Exadler Technologies Inc., Sarah Tan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+// DMCCtrace.h - hooks the library uses to record bus transactions
+//
+// Only used inside the library.  The functions to start the tracer and
+// write the trace are in DMCC.h.  Without -DDMCC_TRACE every hook below
+// compiles to nothing.
+
+#ifndef DMCCTRACE
+#define DMCCTRACE
+
+// Event kinds
+#define DMCC_TRACE_API 0        // a DMCC.h function
+#define DMCC_TRACE_WRITE 1      // write() on the bus
+#define DMCC_TRACE_READ 2       // read() on the bus
+
+// DMCCtraceFromEnv - starts tracing when DMCC_TRACE_FILE names a file, and
+//                    writes the trace there when the program exits
+void DMCCtraceFromEnv(void);
+
+#ifdef DMCC_TRACE
+
+// DMCCtraceScope - an API call in progress on this thread
+typedef struct DMCCtraceScope {
+    const char *api;
+    const char *outer;          // API call this one was made from
+    unsigned long long start;
+} DMCCtraceScope;
+
+// DMCCtraceTime - trace time stamp in nanoseconds
+unsigned long long DMCCtraceTime(void);
+
+// DMCCtraceEnter - marks the start of an API call on this thread
+DMCCtraceScope DMCCtraceEnter(const char *api);
+
+// DMCCtraceLeave - records the API call (runs when its scope ends)
+void DMCCtraceLeave(DMCCtraceScope *scope);
+
+// DMCCtraceTransaction - records one write()/read() on a session
+void DMCCtraceTransaction(int session, int kind, const unsigned char *buf,
+                            int len, unsigned long long start);
+
+// DMCCtraceCape - remembers the cape address behind a session
+void DMCCtraceCape(int session, unsigned char capeAddr);
+
+#define TRACE_API(name) \
+    DMCCtraceScope traceScope __attribute__((cleanup(DMCCtraceLeave))) = \
+        DMCCtraceEnter(name)
+#define TRACE_START(t) unsigned long long t = DMCCtraceTime()
+#define TRACE_TRANSACTION(fd, kind, buf, len, t) \
+    DMCCtraceTransaction(fd, kind, buf, len, t)
+#define TRACE_CAPE(fd, addr) DMCCtraceCape(fd, addr)
+
+#else
+
+#define TRACE_API(name)
+#define TRACE_START(t)
+#define TRACE_TRANSACTION(fd, kind, buf, len, t)
+#define TRACE_CAPE(fd, addr)
+
+#endif
+
+#endif
@@ -0,0 +1,230 @@
+//
+// Copyright (C) 2013-2016 - Exadler Technologies Inc., Sarah Tan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "DMCC.h"
+#include "DMCCsim.h"
+#include "DMCCtelemetry.h"
+
+// This program compares sampling a cape at a fixed rate with adaptive
+// sampling (DMCCadaptive) on a simulated cape that runs a script of motor
+// commands with idle time in between.  For each it prints the samples
+// taken, the bus time they used, how long after each command the first
+// sample came and the longest gap between samples while a motor moved
+// (MOVING_VEL in the simulated motor).
+
+#define STEP_US 1000                // how often the sampler checks
+#define MOVING_VEL 100.0            // counts/second that count as moving
+
+// Step - one command of the script
+typedef struct Step {
+    unsigned int timeMs;
+    const char *name;
+    int type;                       // 0 power, 1 position, 2 velocity
+    unsigned int motor;
+    int value;
+} Step;
+
+static const Step script[] = {
+    { 1000, "vel 100", 2, 1, 100 },
+    { 4000, "vel 0", 2, 1, 0 },
+    { 7000, "pos 5000", 1, 2, 5000 },
+    { 12000, "power 5000", 0, 1, 5000 },
+    { 13000, "power 0", 0, 1, 0 },
+};
+#define STEPS (int)(sizeof(script) / sizeof(script[0]))
+#define SCRIPT_MS 18000
+
+// Bench - a simulated cape and what the bus did
+typedef struct Bench {
+    DMCCsim sim;
+    unsigned long long bytes;       // bytes moved, with address bytes
+} Bench;
+
+static int countWrite(void *ctx, const unsigned char *buf, int len)
+{
+    Bench *bench = (Bench *)ctx;
+    bench->bytes += len + 1;
+    return DMCCsimWrite(&bench->sim, buf, len);
+}
+
+static int countRead(void *ctx, unsigned char *buf, int len)
+{
+    Bench *bench = (Bench *)ctx;
+    bench->bytes += len + 1;
+    return DMCCsimRead(&bench->sim, buf, len);
+}
+
+static unsigned long long countNow(void *ctx)
+{
+    return ((Bench *)ctx)->sim.timeUs;
+}
+
+static void countSleep(void *ctx, unsigned int microseconds)
+{
+    DMCCsimAdvance(&((Bench *)ctx)->sim, microseconds);
+}
+
+// sendStep - sends one command of the script
+static void sendStep(int fd, const Step *step)
+{
+    if (step->type == 0) {
+        setMotorPower(fd, step->motor, step->value);
+    } else if (step->type == 1) {
+        setTargetPos(fd, step->motor, step->value);
+    } else {
+        setTargetVel(fd, step->motor, step->value);
+    }
+}
+
+// runScript - runs the script while sampling
+//             fixed - 1 to sample every fastUs, 0 to sample adaptively
+static void runScript(const char *name, int fixed, unsigned int fastUs,
+                        unsigned int slowUs)
+{
+    static Bench bench;
+    DMCCtransport transport;
+    DMCCtelemetryRecord record;
+    DMCCadaptive rate;
+    unsigned long long response[STEPS];
+    unsigned long long samples = 0;
+    unsigned long long lastSample = 0;
+    unsigned long long maxGap = 0;
+    int step = 0;
+    int waiting = -1;               // step waiting for its first sample
+    int moving = 0;                 // a motor moved at the last sample
+    int i;
+
+    memset(&bench, 0, sizeof(bench));
+    DMCCsimInit(&bench.sim);
+    int fd = DMCCsimStart(&bench.sim);
+    if (fd < 0) {
+        exit(1);
+    }
+    transport.write = countWrite;
+    transport.read = countRead;
+    transport.now = countNow;
+    transport.sleep = countSleep;
+    transport.reopen = NULL;
+    transport.flush = NULL;
+    transport.stop = NULL;
+    transport.ctx = &bench;
+    DMCCattachTransport(fd, &transport);
+    setDefaultPIDConstants(fd);
+    DMCCadaptiveInit(&rate, fastUs, slowUs);
+
+    unsigned long long start = DMCCclock(fd);
+    unsigned long long end = start + SCRIPT_MS * 1000ULL;
+    unsigned long long next = start;
+    unsigned long long busStart = bench.bytes;
+    lastSample = start;
+
+    while (DMCCclock(fd) < end) {
+        unsigned long long now = DMCCclock(fd);
+        if ((step < STEPS) && (now - start >= script[step].timeMs * 1000ULL)) {
+            sendStep(fd, &script[step]);
+            response[step] = now;
+            waiting = step;
+            step++;
+        }
+
+        int due = fixed ? (now >= next) : DMCCadaptiveDue(&rate, fd);
+        if (due) {
+            DMCCtelemetrySample(fd, &record);
+            samples++;
+            if (!fixed) {
+                DMCCadaptiveUpdate(&rate, fd, &record);
+            }
+            next = now + fastUs;
+            if (waiting >= 0) {
+                response[waiting] = record.timeUs - response[waiting];
+                waiting = -1;
+            }
+            // Gaps between two samples that both saw a motor moving
+            int nowMoving = (bench.sim.motor[0].vel > MOVING_VEL) ||
+                            (bench.sim.motor[0].vel < -MOVING_VEL) ||
+                            (bench.sim.motor[1].vel > MOVING_VEL) ||
+                            (bench.sim.motor[1].vel < -MOVING_VEL);
+            if (moving && nowMoving && (record.timeUs - lastSample > maxGap)) {
+                maxGap = record.timeUs - lastSample;
+            }
+            moving = nowMoving;
+            lastSample = record.timeUs;
+        }
+        DMCCwaitUntil(fd, now + STEP_US);
+    }
+
+    double busUs = (bench.bytes - busStart) * bench.sim.usPerByte;
+    double elapsed = DMCCclock(fd) - start;
+    printf("%-8s %8llu %9.1f %8.1f%% %10.1f", name, samples,
+            busUs / 1000.0, busUs / elapsed * 100.0, maxGap / 1000.0);
+    for (i = 0; i < STEPS; i++) {
+        printf(" %6.1f", response[i] / 1000.0);
+    }
+    printf("\n");
+    DMCCend(fd);
+}
+
+static void usage(void)
+{
+    printf("usage: ./adaptiveBench [-f fast rate] [-s slow rate]\n");
+    printf("       -f samples per second while a motor is active ");
+    printf("(default: 100)\n");
+    printf("       -s samples per second while idle (default: 2)\n");
+    printf("example: ./adaptiveBench -f 50 -s 1\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    int fast = 100;
+    int slow = 2;
+    int opt, i;
+
+    while ((opt = getopt(argc, argv, "f:s:")) != -1) {
+        switch (opt) {
+        case 'f': fast = atoi(optarg); break;
+        case 's': slow = atoi(optarg); break;
+        default: usage();
+        }
+    }
+    if ((fast < 1) || (fast > 1000) || (slow < 1) || (slow > fast)) {
+        usage();
+    }
+
+    printf("script of %d s, response is ms from command to first sample\n",
+            SCRIPT_MS / 1000);
+    printf("%-8s %8s %9s %9s %10s", "sampling", "samples", "bus ms", "bus",
+            "moving gap");
+    for (i = 0; i < STEPS; i++) {
+        printf(" %6d", i + 1);
+    }
+    printf("\n");
+    runScript("fixed", 1, 1000000 / fast, 1000000 / fast);
+    runScript("adaptive", 0, 1000000 / fast, 1000000 / slow);
+    return 0;
+}
@@ -0,0 +1,380 @@
+//
+// Copyright (C) 2013-2016 - Exadler Technologies Inc., Sarah Tan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <semaphore.h>
+
+#include "DMCC.h"
+#include "DMCCprofile.h"
+#include "DMCCsim.h"
+
+// This program checks that the library never uses the heap once a session
+// has started.  malloc, calloc, realloc and the aligned allocators are
+// replaced by versions that count the calls (from every thread, the log
+// thread included) and pass them on to glibc.  It starts a session on a
+// simulated cape with logging at the debug level and tracing on (this
+// program is built with -DDMCC_TRACE, -DDMCC_STATS and -DDMCC_LOG_MAX=4),
+// then calls every DMCC.h function (with good and with bad arguments), once
+// on a clean bus and once on a bus that NAKs, times out and hangs so the
+// retry and reopen paths run.
+// Last, a thread started before the session makes its first calls (its
+// first trace event).  It fails if any call allocated.
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t num, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+extern void __libc_free(void *ptr);
+
+static int counting;
+static unsigned long allocations;
+
+// countAllocation - counts one allocation while counting is on
+static void countAllocation(void)
+{
+    if (__atomic_load_n(&counting, __ATOMIC_RELAXED)) {
+        __atomic_fetch_add(&allocations, 1, __ATOMIC_RELAXED);
+    }
+}
+
+void *malloc(size_t size)
+{
+    countAllocation();
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t num, size_t size)
+{
+    countAllocation();
+    return __libc_calloc(num, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    countAllocation();
+    return __libc_realloc(ptr, size);
+}
+
+void *memalign(size_t alignment, size_t size)
+{
+    countAllocation();
+    return __libc_memalign(alignment, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+    countAllocation();
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **ptr, size_t alignment, size_t size)
+{
+    countAllocation();
+    *ptr = __libc_memalign(alignment, size);
+    return (*ptr == NULL) ? 12 : 0;     // ENOMEM
+}
+
+void free(void *ptr)
+{
+    __libc_free(ptr);
+}
+
+// ------------------------
+// One call of every function
+// ------------------------
+static unsigned long messages;
+
+// countSink - log sink that only counts (the messages still go through the
+//             log ring and its thread)
+static void countSink(int level, const char *message, void *ctx)
+{
+    messages++;
+}
+
+static void callByte(int fd)
+{
+    putByte(fd, DMCC_REG_TARGET_POS1, 0x10);
+    getByte(fd, DMCC_REG_VOLTAGE);
+    getWord(fd, DMCC_REG_VOLTAGE);
+    getDWord(fd, DMCC_REG_QEI1);
+}
+
+static void callBytes(int fd)
+{
+    static const unsigned char data[4] = {0x10, 0x27, 0, 0};
+    unsigned char id[16];
+
+    putBytes(fd, DMCC_REG_TARGET_POS1, data, 4);
+    getBytes(fd, DMCC_REG_ID, id, 16);
+}
+
+static void callRegs(int fd)
+{
+    DMCCregs regs;
+
+    DMCCreadStatus(fd, DMCC_REG_QEI1, 16, &regs);
+    DMCCreadRegs(fd, DMCC_REG_POS_P1, DMCC_REG_VEL_D2 + 2 - DMCC_REG_POS_P1,
+                    &regs);
+    DMCCwriteRegs(fd, DMCC_REG_POS_P1,
+                    DMCC_REG_VEL_D2 + 2 - DMCC_REG_POS_P1, &regs);
+}
+
+static void callQEI(int fd)
+{
+    getQEI(fd, 1);
+    getQEIVel(fd, 2);
+    getQEIDir(fd, 1);
+    configQEIDir(fd, 1, 0);
+    resetQEI(fd, 2);
+    resetAllQEI(fd);
+}
+
+static void callMotor(int fd)
+{
+    getMotorCurrent(fd, 1);
+    getMotorVoltage(fd);
+    getTargetPos(fd, 1);
+    setTargetPos(fd, 1, 0);
+    setAllTargetPos(fd, 0, 0);
+    getTargetVel(fd, 2);
+    setTargetVel(fd, 2, 0);
+    setAllTargetVel(fd, 0, 0);
+    getMotorDir(fd, 1);
+    configMotorDir(fd, 1, 0);
+    setMotorPower(fd, 1, 0);
+    setAllMotorPower(fd, 0, 0);
+}
+
+static void callPrepared(int fd)
+{
+    DMCCprepared cmd;
+
+    DMCCpreparePower(fd, &cmd, 0, 0);
+    DMCCpatchPrepared(&cmd, 1, 100);
+    DMCCsendPrepared(fd, &cmd);
+    DMCCprepareTargetPos(fd, &cmd, 0, 0);
+    DMCCsendPrepared(fd, &cmd);
+    DMCCprepareTargetVel(fd, &cmd, 0, 0);
+    DMCCsendPrepared(fd, &cmd);
+    DMCCpreparePIDConstants(fd, &cmd, 1, 0, -5248, -75, -500);
+    DMCCsendPrepared(fd, &cmd);
+}
+
+static void callMoves(int fd)
+{
+    moveUntilPos(fd, 1, 2000, 2);
+    moveUntilTime(fd, 1, 3000, 100000);
+    moveUntilVel(fd, 1, 20, 2);
+    moveAllUntilPos(fd, 0, 0, 2);
+    moveAllUntilTime(fd, 3000, 3000, 100000);
+    moveAllUntilVel(fd, 20, 20, 2);
+}
+
+static void callPID(int fd)
+{
+    int P, I, D;
+
+    getPIDConstants(fd, 1, 0, &P, &I, &D);
+    setPIDConstants(fd, 2, 1, -5248, -75, -500);
+    setDefaultPIDConstants(fd);
+    setPIDPowerLimits(fd, 0, 0);
+    autotunePID(fd, 1, 0, 3000, 5000, &P, &I, &D);
+}
+
+static void callProfile(int fd)
+{
+    DMCCprofile profile;
+
+    DMCCprofileRead(fd, &profile);
+    profile.regs.velP2 += 100;
+    profile.regs.config ^= DMCC_PROFILE_QEI_DIR2;
+    DMCCprofileApply(fd, &profile);
+    DMCCprofileDefaults(&profile);
+    DMCCprofileApply(fd, &profile);
+}
+
+static void callSession(int fd)
+{
+    DMCCretryStats retryStats;
+    DMCCcommandState state;
+    DMCCcaps caps;
+    DMCCstats stats;
+
+    DMCCgetRetryStats(fd, &retryStats);
+    DMCCgetError(fd);
+    DMCCgetCommandState(fd, &state);
+    DMCCgetCaps(fd, &caps);
+    DMCCgetStats(fd, &stats);
+    DMCCresetStats(fd);
+    DMCCwaitUntil(fd, DMCCclock(fd) + 100);
+    DMCCwait(10);
+    checkVersion(fd, 0);
+    DMCCemergencyStopAll();
+    DMCClogDropped();
+}
+
+// Arguments every function turns down (each logs an error)
+static void callInvalid(int fd)
+{
+    DMCCprepared cmd;
+    DMCCregs regs;
+    int P, I, D;
+
+    getQEI(fd, 3);
+    setMotorPower(fd, 1, 20000);
+    setTargetVel(fd, 3, 0);
+    getPIDConstants(fd, 3, 0, &P, &I, &D);
+    DMCCreadRegs(fd, 0xf0, 32, &regs);
+    DMCCpreparePower(fd, &cmd, 0, 0);
+    DMCCpatchPrepared(&cmd, 7, 0);
+    getQEI(4096, 1);
+    getBytes(-1, 0, NULL, 0);
+}
+
+typedef struct Check {
+    const char *name;
+    void (*run)(int fd);
+} Check;
+
+static const Check checks[] = {
+    {"putByte getByte getWord getDWord", callByte},
+    {"putBytes getBytes", callBytes},
+    {"DMCCreadStatus DMCCreadRegs DMCCwriteRegs", callRegs},
+    {"QEI functions", callQEI},
+    {"motor functions", callMotor},
+    {"prepared commands", callPrepared},
+    {"move functions", callMoves},
+    {"PID functions", callPID},
+    {"profile functions", callProfile},
+    {"session functions", callSession},
+    {"invalid arguments", callInvalid},
+};
+
+#define NUM_CHECKS (int)(sizeof(checks) / sizeof(checks[0]))
+
+// runChecks - runs every check, prints the ones that allocated
+// Returns: number of checks that allocated
+static int runChecks(int fd, const char *bus)
+{
+    int failed = 0;
+    int i;
+
+    for (i = 0; i < NUM_CHECKS; i++) {
+        unsigned long before = __atomic_load_n(&allocations, __ATOMIC_RELAXED);
+        checks[i].run(fd);
+        DMCClogFlush();
+        unsigned long n = __atomic_load_n(&allocations, __ATOMIC_RELAXED) -
+                            before;
+        printf("%-6s %-44s %lu allocation(s)\n", bus, checks[i].name, n);
+        failed += (n != 0);
+    }
+    return failed;
+}
+
+// ------------------------
+// A thread that calls the library for the first time
+// ------------------------
+static sem_t go;
+static int threadFd;
+
+static void *threadMain(void *arg)
+{
+    sem_wait(&go);
+    callQEI(threadFd);
+    callMotor(threadFd);
+    return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+    static DMCCsim sim;
+    DMCCretry retry = {20000, 100, 3};
+    int failed = 0;
+
+    // Everything a program does before its control loop may allocate
+    DMCCsetLogSink(countSink, NULL);
+    DMCCsetLogLevel(DMCC_LOG_DEBUG);
+    DMCCtraceStart(4096);
+    DMCCsimInit(&sim);
+    int fd = DMCCsimStart(&sim);
+    if (fd < 0) {
+        return 1;
+    }
+    DMCCsetRetry(fd, &retry);
+    pthread_t thread;
+    sem_init(&go, 0, 0);
+    threadFd = fd;
+    if (pthread_create(&thread, NULL, threadMain, NULL) != 0) {
+        printf("Error: cannot start a thread\n");
+        return 1;
+    }
+
+    // The counting allocator has to see this program's own allocations
+    __atomic_store_n(&counting, 1, __ATOMIC_RELAXED);
+    free(malloc(1));
+    if (__atomic_load_n(&allocations, __ATOMIC_RELAXED) != 1) {
+        printf("Error: malloc is not being counted\n");
+        return 1;
+    }
+    allocations = 0;
+    failed += runChecks(fd, "clean");
+
+    sim.nakPerMille = 50;
+    sim.timeoutPerMille = 10;
+    sim.hangPerMille = 2;
+    DMCCsimParseFault(&sim, "any 0x00-0xff busy=5:500 short=5");
+    failed += runChecks(fd, "faulty");
+    printf("faulty bus: %llu NAKs, %llu timeouts, %llu hangs, %llu reopens\n",
+            sim.naks, sim.timeouts, sim.hangs, sim.reopens);
+
+    sim.nakPerMille = 0;
+    sim.timeoutPerMille = 0;
+    sim.hangPerMille = 0;
+    sim.numFaults = 0;
+    unsigned long before = __atomic_load_n(&allocations, __ATOMIC_RELAXED);
+    sem_post(&go);
+    pthread_join(thread, NULL);
+    DMCClogFlush();
+    unsigned long n = __atomic_load_n(&allocations, __ATOMIC_RELAXED) - before;
+    printf("%-6s %-44s %lu allocation(s)\n", "thread", "first calls", n);
+    failed += (n != 0);
+
+    before = __atomic_load_n(&allocations, __ATOMIC_RELAXED);
+    DMCCend(fd);
+    DMCClogFlush();
+    n = __atomic_load_n(&allocations, __ATOMIC_RELAXED) - before;
+    printf("%-6s %-44s %lu allocation(s)\n", "", "DMCCend", n);
+    failed += (n != 0);
+    __atomic_store_n(&counting, 0, __ATOMIC_RELAXED);
+
+    printf("%lu log message(s), %llu dropped\n", messages, DMCClogDropped());
+    if (failed) {
+        printf("FAIL: %d check(s) used the heap after the session started\n",
+                failed);
+        return 1;
+    }
+    printf("OK: no heap allocations after the session started\n");
+    return 0;
+}
@@ -0,0 +1,134 @@
+//
+// Copyright (C) 2013-2016 - Exadler Technologies Inc., Sarah Tan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+
+#include "DMCC.h"
+#include "DMCCsim.h"
+
+#define TIME_LIMIT 30   // Sets the timeout for the check move at 30 seconds
+
+// This program finds PID constants with autotunePID (relay experiment)
+// instead of trying constants by hand with setPID.  Use "sim" as the board
+// number to run it against the simulated cape.  After tuning, the motor is
+// moved to <check target> with the new constants as a check.
+
+int session;
+unsigned int nMotor;
+
+void sig_handler(int sig)
+{
+    // Only async-signal-safe calls here
+    DMCCemergencyStopAll();
+    _exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    // Prints usage statement
+    if ((argc != 6) && (argc != 7)) {
+        printf("usage: ./autotune <board number> <motor> <pos_vel> ");
+        printf("<relay power> <check target> [sample period]\n");
+        printf("       <board number> is [0-3] for placement of cape, ");
+        printf("or sim\n");
+        printf("       <motor> is the motor number\n");
+        printf("       <pos_vel> 0 for position, 1 for velocity\n");
+        printf("       <relay power> is the power used for the relay ");
+        printf("(1 to 10000)\n");
+        printf("       <check target> is the QEI position or velocity to ");
+        printf("move to after tuning\n");
+        printf("       [sample period] in microseconds (default: 5000)\n");
+        printf("example: ./autotune 0 1 0 3000 5000\n");
+        exit(1);
+    }
+
+    // Get the arguments from the command line
+    int useSim = (strcmp(argv[1], "sim") == 0);
+    nMotor = atoi(argv[2]);
+    int indicator = atol(argv[3]);
+    int relayPower = atol(argv[4]);
+    int target = atol(argv[5]);
+    unsigned int period = 5000;
+    if (argc == 7) {
+        period = atoi(argv[6]);
+    }
+
+    // Show the library's errors (on stderr)
+    DMCCsetLogLevel(DMCC_LOG_ERROR);
+
+    // Begin the session (open a connection to the board)
+    DMCCsim sim;
+    if (useSim) {
+        DMCCsimInit(&sim);
+        session = DMCCsimStart(&sim);
+        if (session < 0) {
+            exit(1);
+        }
+    } else {
+        session = DMCCstart(atol(argv[1]));
+    }
+
+    // Catch Ctrl-C to kill the motor
+    signal(SIGINT, sig_handler);
+
+    int P, I, D;
+    if (autotunePID(session, nMotor, indicator, relayPower, period,
+                        &P, &I, &D) != 0) {
+        DMCCend(session);
+        return -1;
+    }
+    printf("PID constants set: P = %d, I = %d, D = %d\n", P, I, D);
+
+    // Check the new constants: the tuned loop must reach the target
+    int result;
+    resetQEI(session, nMotor);
+    if (indicator == 0) {
+        result = moveUntilPos(session, nMotor, target, TIME_LIMIT);
+    } else {
+        result = moveUntilVel(session, nMotor, target, TIME_LIMIT);
+    }
+    setMotorPower(session, nMotor, 0);
+    if (result == DMCC_EIO) {
+        printf("Check failed: the bus failed during the move\n");
+        DMCCend(session);
+        return -1;
+    }
+    if (result == DMCC_ETIMEDOUT) {
+        printf("Check failed: target %d not reached within %d seconds\n",
+                    target, TIME_LIMIT);
+        DMCCend(session);
+        return -1;
+    }
+    if (result != DMCC_OK) {
+        printf("Check failed: the move to %d could not be made\n", target);
+        DMCCend(session);
+        return -1;
+    }
+    printf("Check passed: target %d reached\n", target);
+
+    DMCCend(session);
+    return 0;
+}
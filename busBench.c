@@ -0,0 +1,448 @@
+//
+// Copyright (C) 2013-2016 - Exadler Technologies Inc., Sarah Tan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <fcntl.h>
+
+#include "DMCC.h"
+#include "DMCCprofile.h"
+#include "DMCCsim.h"
+
+// This program runs the functions in DMCC.h against a simulated cape
+// through a counting transport, so it needs no hardware.  For every
+// function it prints the time per call on this host, the bus transactions
+// per call and the system calls per call the same work would cost on
+// i2c-dev (one per write()/read() plus one per wait).
+//
+// With -b <baseline> it fails (exit 1) when a function needs more
+// transactions per call than the baseline allows; "make bench" runs it
+// against busBench.baseline.  After making a function cheaper, update the
+// baseline with -w <baseline>.  -f runs the cape as an older firmware
+// version (the baseline is for Mk.07).
+
+#define MAX_LINE 128
+
+// BenchCape - a simulated cape and what was done to it
+typedef struct BenchCape {
+    DMCCsim sim;
+    unsigned long long transactions;    // write()/read() calls
+    unsigned long long waits;           // sleeps (nanosleep on hardware)
+} BenchCape;
+
+// Cape the current benchmark runs on (see usleep below)
+static BenchCape *current;
+
+// Firmware version of the simulated capes (-f)
+static int firmware = DMCC_SIM_FIRMWARE;
+
+static int countWrite(void *ctx, const unsigned char *buf, int len)
+{
+    BenchCape *cape = (BenchCape *)ctx;
+    cape->transactions++;
+    return DMCCsimWrite(&cape->sim, buf, len);
+}
+
+static int countRead(void *ctx, unsigned char *buf, int len)
+{
+    BenchCape *cape = (BenchCape *)ctx;
+    cape->transactions++;
+    return DMCCsimRead(&cape->sim, buf, len);
+}
+
+static unsigned long long countNow(void *ctx)
+{
+    return ((BenchCape *)ctx)->sim.timeUs;
+}
+
+static void countSleep(void *ctx, unsigned int microseconds)
+{
+    BenchCape *cape = (BenchCape *)ctx;
+    cape->waits++;
+    DMCCsimAdvance(&cape->sim, microseconds);
+}
+
+// usleep - the timed functions (moveUntilTime, DMCCwait...) wait with
+// usleep instead of the session clock; this program provides its own so
+// their waits run the simulated cape instead of the host clock
+int usleep(useconds_t microseconds)
+{
+    if (current != NULL) {
+        current->waits++;
+        DMCCsimAdvance(&current->sim, microseconds);
+    }
+    return 0;
+}
+
+// startCape - opens a session on a fresh simulated cape with the default
+//             PID constants, and clears the counters
+static int startCape(BenchCape *cape)
+{
+    DMCCtransport transport;
+
+    memset(cape, 0, sizeof(BenchCape));
+    DMCCsimInit(&cape->sim);
+    if (DMCCsimSetFirmware(&cape->sim, firmware) != 0) {
+        return -1;
+    }
+
+    int fd = DMCCsimStart(&cape->sim);
+    if (fd < 0) {
+        return -1;
+    }
+    transport.write = countWrite;
+    transport.read = countRead;
+    transport.now = countNow;
+    transport.sleep = countSleep;
+    transport.reopen = NULL;
+    transport.flush = NULL;
+    transport.stop = NULL;
+    transport.ctx = cape;
+    DMCCattachTransport(fd, &transport);
+
+    setDefaultPIDConstants(fd);
+    cape->transactions = 0;
+    cape->waits = 0;
+    return fd;
+}
+
+// ------------------------
+// One call of every function
+// ------------------------
+static void benchPutByte(int fd) { putByte(fd, 0x20, 0x10); }
+static void benchGetByte(int fd) { getByte(fd, 0x06); }
+static void benchGetWord(int fd) { getWord(fd, 0x06); }
+static void benchGetDWord(int fd) { getDWord(fd, 0x10); }
+
+static void benchPutBytes(int fd)
+{
+    static const unsigned char data[4] = {0x10, 0x27, 0, 0};
+    putBytes(fd, 0x20, data, 4);
+}
+
+static void benchGetBytes(int fd)
+{
+    unsigned char data[10];
+    getBytes(fd, 0xe0, data, 10);
+}
+
+static void benchGetQEI(int fd) { getQEI(fd, 1); }
+static void benchGetQEIVel(int fd) { getQEIVel(fd, 1); }
+static void benchGetQEIDir(int fd) { getQEIDir(fd, 1); }
+static void benchConfigQEIDir(int fd) { configQEIDir(fd, 1, 0); }
+static void benchResetQEI(int fd) { resetQEI(fd, 1); }
+static void benchResetAllQEI(int fd) { resetAllQEI(fd); }
+static void benchGetMotorCurrent(int fd) { getMotorCurrent(fd, 1); }
+static void benchGetMotorVoltage(int fd) { getMotorVoltage(fd); }
+static void benchGetTargetPos(int fd) { getTargetPos(fd, 1); }
+static void benchSetTargetPos(int fd) { setTargetPos(fd, 1, 0); }
+static void benchSetAllTargetPos(int fd) { setAllTargetPos(fd, 0, 0); }
+static void benchGetTargetVel(int fd) { getTargetVel(fd, 1); }
+static void benchSetTargetVel(int fd) { setTargetVel(fd, 1, 0); }
+static void benchSetAllTargetVel(int fd) { setAllTargetVel(fd, 0, 0); }
+static void benchGetMotorDir(int fd) { getMotorDir(fd, 1); }
+static void benchSetMotorPower(int fd) { setMotorPower(fd, 1, 0); }
+static void benchSetAllMotorPower(int fd) { setAllMotorPower(fd, 0, 0); }
+static void benchConfigMotorDir(int fd) { configMotorDir(fd, 1, 0); }
+
+// All stop, prepared once per cape
+static void benchSendPrepared(int fd)
+{
+    static DMCCprepared stop;
+    static int preparedFd = -1;
+
+    if (preparedFd != fd) {
+        DMCCpreparePower(fd, &stop, 0, 0);
+        preparedFd = fd;
+    }
+    DMCCsendPrepared(fd, &stop);
+}
+static void benchDMCCwait(int fd) { DMCCwait(1000); }
+static void benchDMCCwaitSec(int fd) { DMCCwaitSec(1); }
+static void benchMoveUntilPos(int fd) { moveUntilPos(fd, 1, 2000, 2); }
+static void benchMoveUntilTime(int fd) { moveUntilTime(fd, 1, 3000, 100000); }
+static void benchMoveUntilVel(int fd) { moveUntilVel(fd, 1, 20, 2); }
+static void benchMoveAllUntilPos(int fd) { moveAllUntilPos(fd, 2000, 2000, 2); }
+
+static void benchMoveAllUntilTime(int fd)
+{
+    moveAllUntilTime(fd, 3000, 3000, 100000);
+}
+
+static void benchMoveAllUntilVel(int fd) { moveAllUntilVel(fd, 20, 20, 2); }
+
+static void benchGetPIDConstants(int fd)
+{
+    int P, I, D;
+    getPIDConstants(fd, 1, 0, &P, &I, &D);
+}
+
+static void benchSetPIDConstants(int fd)
+{
+    setPIDConstants(fd, 1, 0, -5248, -75, -500);
+}
+
+static void benchSetDefaultPIDConstants(int fd) { setDefaultPIDConstants(fd); }
+static void benchSetPIDPowerLimits(int fd) { setPIDPowerLimits(fd, 0, 0); }
+
+// Warm restart: the cape already holds the default profile
+static void benchProfileApply(int fd)
+{
+    DMCCprofile profile;
+    DMCCprofileDefaults(&profile);
+    DMCCprofileApply(fd, &profile);
+}
+
+static void benchAutotunePID(int fd)
+{
+    int P, I, D;
+    autotunePID(fd, 1, 0, 3000, 5000, &P, &I, &D);
+}
+
+static void benchDMCCclock(int fd) { DMCCclock(fd); }
+static void benchDMCCwaitUntil(int fd) { DMCCwaitUntil(fd, DMCCclock(fd) + 100); }
+
+// Benchmark - a function and how many times to call it
+typedef struct Benchmark {
+    const char *name;
+    void (*run)(int fd);
+    int calls;
+} Benchmark;
+
+static const Benchmark benchmarks[] = {
+    {"putByte", benchPutByte, 10000},
+    {"getByte", benchGetByte, 10000},
+    {"getWord", benchGetWord, 10000},
+    {"getDWord", benchGetDWord, 10000},
+    {"putBytes", benchPutBytes, 10000},
+    {"getBytes", benchGetBytes, 10000},
+    {"getQEI", benchGetQEI, 10000},
+    {"getQEIVel", benchGetQEIVel, 10000},
+    {"getQEIDir", benchGetQEIDir, 10000},
+    {"configQEIDir", benchConfigQEIDir, 10000},
+    {"resetQEI", benchResetQEI, 10000},
+    {"resetAllQEI", benchResetAllQEI, 10000},
+    {"getMotorCurrent", benchGetMotorCurrent, 10000},
+    {"getMotorVoltage", benchGetMotorVoltage, 10000},
+    {"getTargetPos", benchGetTargetPos, 10000},
+    {"setTargetPos", benchSetTargetPos, 10000},
+    {"setAllTargetPos", benchSetAllTargetPos, 10000},
+    {"getTargetVel", benchGetTargetVel, 10000},
+    {"setTargetVel", benchSetTargetVel, 10000},
+    {"setAllTargetVel", benchSetAllTargetVel, 10000},
+    {"getMotorDir", benchGetMotorDir, 10000},
+    {"setMotorPower", benchSetMotorPower, 10000},
+    {"setAllMotorPower", benchSetAllMotorPower, 10000},
+    {"configMotorDir", benchConfigMotorDir, 10000},
+    {"DMCCsendPrepared", benchSendPrepared, 10000},
+    {"getPIDConstants", benchGetPIDConstants, 10000},
+    {"setPIDConstants", benchSetPIDConstants, 10000},
+    {"setDefaultPIDConstants", benchSetDefaultPIDConstants, 1000},
+    {"setPIDPowerLimits", benchSetPIDPowerLimits, 10000},
+    {"DMCCprofileApply", benchProfileApply, 1000},
+    {"DMCCclock", benchDMCCclock, 10000},
+    {"DMCCwaitUntil", benchDMCCwaitUntil, 10000},
+    {"DMCCwait", benchDMCCwait, 1000},
+    {"DMCCwaitSec", benchDMCCwaitSec, 10},
+    {"moveUntilPos", benchMoveUntilPos, 1},
+    {"moveUntilTime", benchMoveUntilTime, 10},
+    {"moveUntilVel", benchMoveUntilVel, 1},
+    {"moveAllUntilPos", benchMoveAllUntilPos, 1},
+    {"moveAllUntilTime", benchMoveAllUntilTime, 10},
+    {"moveAllUntilVel", benchMoveAllUntilVel, 1},
+    {"autotunePID", benchAutotunePID, 1},
+};
+
+#define NUM_BENCHMARKS (sizeof(benchmarks) / sizeof(benchmarks[0]))
+
+// Result - what one benchmark measured
+typedef struct Result {
+    double ns;
+    double transactions;
+    double syscalls;
+} Result;
+
+static unsigned long long wallNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((unsigned long long)ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+}
+
+// runBenchmark - calls a function on a fresh cape and measures it
+static int runBenchmark(const Benchmark *b, Result *result)
+{
+    BenchCape cape;
+    int i;
+
+    int fd = startCape(&cape);
+    if (fd < 0) {
+        return -1;
+    }
+    current = &cape;
+
+    // Keep what the functions print out of the table (and out of the time)
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    int devNull = open("/dev/null", O_WRONLY);
+    dup2(devNull, STDOUT_FILENO);
+
+    unsigned long long start = wallNs();
+    for (i = 0; i < b->calls; i++) {
+        b->run(fd);
+    }
+    unsigned long long end = wallNs();
+
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+    close(devNull);
+    current = NULL;
+    result->ns = (double)(end - start) / b->calls;
+    result->transactions = (double)cape.transactions / b->calls;
+    result->syscalls = (double)(cape.transactions + cape.waits) / b->calls;
+    DMCCend(fd);
+    return 0;
+}
+
+// findBaseline - transactions per call allowed for a function
+// Returns: -1 - if the function has no baseline
+static double findBaseline(FILE *f, const char *name)
+{
+    char line[MAX_LINE];
+    char fname[MAX_LINE];
+    double allowed;
+
+    rewind(f);
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if ((line[0] == '#') ||
+                (sscanf(line, "%127s %lf", fname, &allowed) != 2)) {
+            continue;
+        }
+        if (strcmp(fname, name) == 0) {
+            return allowed;
+        }
+    }
+    return -1;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *baselinePath = NULL;
+    const char *writePath = NULL;
+    FILE *baseline = NULL;
+    FILE *out = NULL;
+    Result results[NUM_BENCHMARKS];
+    int regressions = 0;
+    unsigned int i;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "b:w:f:")) != -1) {
+        switch (opt) {
+        case 'b': baselinePath = optarg; break;
+        case 'w': writePath = optarg; break;
+        case 'f': firmware = atoi(optarg); break;
+        default:
+            printf("usage: ./busBench [-b baseline] [-w baseline] ");
+            printf("[-f firmware]\n");
+            printf("       -b fails if a function needs more bus ");
+            printf("transactions than the baseline\n");
+            printf("       -w writes the measured transactions as the ");
+            printf("new baseline\n");
+            printf("       -f firmware version of the simulated cape ");
+            printf("(5, 6 or 7, default: 7)\n");
+            printf("example: ./busBench -b busBench.baseline\n");
+            exit(1);
+        }
+    }
+
+    if (baselinePath != NULL) {
+        baseline = fopen(baselinePath, "r");
+        if (baseline == NULL) {
+            printf("Error: cannot open %s\n", baselinePath);
+            exit(1);
+        }
+    }
+
+    printf("Simulated cape with firmware Mk.%02d\n", firmware);
+    printf("%-24s %12s %14s %10s %10s\n", "function", "ns/call",
+            "transactions", "syscalls", "baseline");
+    for (i = 0; i < NUM_BENCHMARKS; i++) {
+        const Benchmark *b = &benchmarks[i];
+        Result *r = &results[i];
+
+        if (runBenchmark(b, r) != 0) {
+            exit(1);
+        }
+        printf("%-24s %12.0f %14.2f %10.2f", b->name, r->ns,
+                r->transactions, r->syscalls);
+
+        if (baseline == NULL) {
+            printf("\n");
+            continue;
+        }
+        double allowed = findBaseline(baseline, b->name);
+        if (allowed < 0) {
+            printf(" %10s\n", "none");
+        } else if (r->transactions > allowed + 0.005) {
+            printf(" %10.2f  REGRESSION\n", allowed);
+            regressions++;
+        } else {
+            printf(" %10.2f\n", allowed);
+        }
+    }
+
+    // Functions that need the board itself (EEPROM in sysfs, /dev/i2c-1)
+    printf("not run (needs hardware): DMCCstart getVersionNumber "
+            "checkVersion\n");
+
+    if (baseline != NULL) {
+        fclose(baseline);
+    }
+
+    if (writePath != NULL) {
+        out = fopen(writePath, "w");
+        if (out == NULL) {
+            printf("Error: cannot write %s\n", writePath);
+            exit(1);
+        }
+        fprintf(out, "# Bus transactions per call allowed for each DMCC.h "
+                        "function (make bench)\n");
+        fprintf(out, "# Regenerate with ./busBench -w busBench.baseline "
+                        "after making a function cheaper\n");
+        for (i = 0; i < NUM_BENCHMARKS; i++) {
+            fprintf(out, "%s %.2f\n", benchmarks[i].name,
+                    results[i].transactions);
+        }
+        fclose(out);
+    }
+
+    if (regressions > 0) {
+        printf("%d function(s) need more bus transactions than the "
+                "baseline\n", regressions);
+        return 1;
+    }
+    return 0;
+}
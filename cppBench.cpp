@@ -0,0 +1,171 @@
+//
+// Copyright (C) 2013-2016 - Exadler Technologies Inc., Sarah Tan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "DMCC.hpp"
+#include "DMCCsim.h"
+
+// This program compares the cost of a call through DMCC.hpp with the same
+// call through DMCC.h, on a simulated cape.  Each pair is run in turns and
+// the fastest of several rounds is kept.  It prints the CPU time per call
+// (library plus simulated cape) and the simulated bus time per call, which
+// must be the same for both.  It fails if the two APIs do not read the
+// same values or leave the cape in the same state.
+
+#define ROUNDS 5
+
+static int numCalls = 200000;
+
+static unsigned long long nowNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((unsigned long long)ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+}
+
+// Result - one side of a pair
+struct Result {
+    double ns;              // CPU time per call
+    double busUs;           // simulated bus time per call
+    unsigned long long sum; // of the values read (to compare)
+};
+
+// measure - runs fn numCalls times, keeping the fastest round
+template <typename Fn> static void measure(DMCCsim &sim, Fn fn, Result &r,
+                                            int round)
+{
+    unsigned long long sum = 0;
+    unsigned long long busStart = sim.timeUs;
+    unsigned long long start = nowNs();
+    for (int i = 0; i < numCalls; i++) {
+        sum += (unsigned int)fn(i);
+    }
+    double ns = (double)(nowNs() - start) / numCalls;
+    if ((round == 0) || (ns < r.ns)) {
+        r.ns = ns;
+    }
+    r.busUs = (double)(sim.timeUs - busStart) / numCalls;
+    r.sum = sum;
+}
+
+// report - prints a pair; fails if they did different things
+static int report(const char *name, const Result &c, const Result &cpp,
+                    int compareValues)
+{
+    int bad = (c.busUs != cpp.busUs) || (compareValues && (c.sum != cpp.sum));
+    printf("%-16s %8.1f %8.1f %+8.1f %8.1f %8.1f%s\n", name, c.ns, cpp.ns,
+            cpp.ns - c.ns, c.busUs, cpp.busUs, bad ? "  FAILED" : "");
+    return bad ? -1 : 0;
+}
+
+int main(int argc, char *argv[])
+{
+    static DMCCsim simC, simCpp;
+    Result c[5], cpp[5];
+    int opt, result = 0;
+
+    while ((opt = getopt(argc, argv, "n:")) != -1) {
+        switch (opt) {
+        case 'n': numCalls = atoi(optarg); break;
+        default:
+            printf("usage: ./cppBench [-n calls]\n");
+            printf("       -n calls of each function per round ");
+            printf("(default: 200000)\n");
+            return 1;
+        }
+    }
+    if (numCalls < 1) {
+        return 1;
+    }
+
+    // One cape per API, so both see the same cape state
+    DMCCsimInit(&simC);
+    DMCCsimInit(&simCpp);
+    int fd = DMCCsimStart(&simC);
+    dmcc::Session session = dmcc::Session::adopt(DMCCsimStart(&simCpp));
+    if ((fd < 0) || !session.valid()) {
+        return 1;
+    }
+    dmcc::Motor<1> motor1(session);
+    dmcc::Motor<2> motor2(session);
+
+    for (int round = 0; round < ROUNDS; round++) {
+        measure(simC, [&](int) { return getQEI(fd, 1); }, c[0], round);
+        measure(simCpp, [&](int) { return motor1.qei(); }, cpp[0], round);
+
+        measure(simC, [&](int) { return getMotorCurrent(fd, 2); }, c[1],
+                round);
+        measure(simCpp, [&](int) { return motor2.current(); }, cpp[1],
+                round);
+
+        measure(simC, [&](int i) {
+                    return setMotorPower(fd, 1, (i % 20000) - 10000);
+                }, c[2], round);
+        measure(simCpp, [&](int i) {
+                    return motor1.setPower((i % 20000) - 10000);
+                }, cpp[2], round);
+
+        measure(simC, [&](int i) {
+                    return setTargetVel(fd, 2, (i % 2000) - 1000);
+                }, c[3], round);
+        measure(simCpp, [&](int i) {
+                    return motor2.setTargetVel((i % 2000) - 1000);
+                }, cpp[3], round);
+
+        measure(simC, [&](int i) {
+                    return setPIDConstants(fd, 1, 1, i & 0xff, 0, -i & 0xff);
+                }, c[4], round);
+        measure(simCpp, [&](int i) {
+                    return motor1.setPID<1>(i & 0xff, 0, -i & 0xff);
+                }, cpp[4], round);
+    }
+
+    printf("%d calls per round, fastest of %d rounds\n", numCalls, ROUNDS);
+    printf("%-16s %8s %8s %8s %8s %8s\n", "call", "C ns", "C++ ns", "diff",
+            "C bus", "C++ bus");
+    result |= report("getQEI", c[0], cpp[0], 1);
+    result |= report("getMotorCurrent", c[1], cpp[1], 1);
+    result |= report("setMotorPower", c[2], cpp[2], 1);
+    result |= report("setTargetVel", c[3], cpp[3], 1);
+    result |= report("setPIDConstants", c[4], cpp[4], 1);
+
+    // The setters must have left both capes with the same registers
+    for (int i = 0x02; i < 0x50; i++) {
+        if ((i >= 0x10) && (i < 0x20)) {
+            continue;           // encoders and currents keep moving
+        }
+        if (simC.reg[i] != simCpp.reg[i]) {
+            printf("Error: register 0x%02x differs (C 0x%02x, C++ 0x%02x)\n",
+                    i, simC.reg[i], simCpp.reg[i]);
+            result = -1;
+        }
+    }
+
+    DMCCend(fd);
+    return (result != 0) ? 1 : 0;
+}
@@ -0,0 +1,297 @@
+//
+// Copyright (C) 2013-2016 - Exadler Technologies Inc., Sarah Tan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "DMCC.h"
+#include "DMCCsim.h"
+
+// This program measures the CPU time the library spends in a call, without
+// the bus.  The session starts on a simulated cape (which picks the
+// firmware features), then its transport is swapped for a bare register
+// file that only copies bytes, so nearly all the time left is the
+// library's own.  Each function is called numCalls times per round and the
+// fastest of several rounds is kept.
+//
+// make cpubench builds it twice: cpuBenchO0 the way the programs used to be
+// built (library sources compiled into the program, no optimization) and
+// cpuBench linked with libdmcc.a (-O2, link-time optimization).  The first
+// writes its times with -w, the second prints them next to its own with -c.
+
+#define ROUNDS 5
+#define MAX_LINE 128
+
+static int numCalls = 200000;
+
+// ------------------------
+// Bare register file (i2c-dev semantics, no simulated time)
+// ------------------------
+typedef struct BareCape {
+    unsigned char reg[256];
+    unsigned char addr;
+    unsigned long long timeUs;
+} BareCape;
+
+static int bareWrite(void *ctx, const unsigned char *buf, int len)
+{
+    BareCape *cape = (BareCape *)ctx;
+    int i;
+
+    cape->addr = buf[0];
+    for (i = 1; i < len; i++) {
+        cape->reg[(unsigned char)(cape->addr + i - 1)] = buf[i];
+    }
+    return len;
+}
+
+static int bareRead(void *ctx, unsigned char *buf, int len)
+{
+    BareCape *cape = (BareCape *)ctx;
+    int i;
+
+    for (i = 0; i < len; i++) {
+        buf[i] = cape->reg[(unsigned char)(cape->addr + i)];
+    }
+    return len;
+}
+
+static unsigned long long bareNow(void *ctx)
+{
+    return ((BareCape *)ctx)->timeUs++;
+}
+
+static void bareSleep(void *ctx, unsigned int microseconds)
+{
+    ((BareCape *)ctx)->timeUs += microseconds;
+}
+
+// ------------------------
+// One call of every hot function
+// ------------------------
+static DMCCprepared prepared;
+
+static void cpuPutByte(int fd, int i) { putByte(fd, 0x20, i); }
+static void cpuGetByte(int fd, int i) { getByte(fd, 0x06); }
+static void cpuGetWord(int fd, int i) { getWord(fd, 0x06); }
+static void cpuGetDWord(int fd, int i) { getDWord(fd, 0x10); }
+static void cpuGetQEI(int fd, int i) { getQEI(fd, 1); }
+static void cpuGetQEIVel(int fd, int i) { getQEIVel(fd, 1); }
+static void cpuGetMotorCurrent(int fd, int i) { getMotorCurrent(fd, 1); }
+static void cpuSetMotorPower(int fd, int i) { setMotorPower(fd, 1, i & 0xfff); }
+static void cpuSetAllTargetVel(int fd, int i) { setAllTargetVel(fd, i & 0xff, 0); }
+
+static void cpuSetPIDConstants(int fd, int i)
+{
+    setPIDConstants(fd, 1, 0, -5248, -75, -500);
+}
+
+static void cpuGetPIDConstants(int fd, int i)
+{
+    int P, I, D;
+    getPIDConstants(fd, 1, 0, &P, &I, &D);
+}
+
+static void cpuReadStatus(int fd, int i)
+{
+    DMCCregs regs;
+    DMCCreadStatus(fd, DMCC_REG_QEI1, 16, &regs);
+}
+
+static void cpuSendPrepared(int fd, int i)
+{
+    DMCCpatchPrepared(&prepared, 1, i & 0xfff);
+    DMCCsendPrepared(fd, &prepared);
+}
+
+// Benchmark - a function to time
+typedef struct Benchmark {
+    const char *name;
+    void (*run)(int fd, int i);
+} Benchmark;
+
+static const Benchmark benchmarks[] = {
+    {"putByte", cpuPutByte},
+    {"getByte", cpuGetByte},
+    {"getWord", cpuGetWord},
+    {"getDWord", cpuGetDWord},
+    {"getQEI", cpuGetQEI},
+    {"getQEIVel", cpuGetQEIVel},
+    {"getMotorCurrent", cpuGetMotorCurrent},
+    {"setMotorPower", cpuSetMotorPower},
+    {"setAllTargetVel", cpuSetAllTargetVel},
+    {"setPIDConstants", cpuSetPIDConstants},
+    {"getPIDConstants", cpuGetPIDConstants},
+    {"DMCCreadStatus", cpuReadStatus},
+    {"DMCCsendPrepared", cpuSendPrepared},
+};
+
+#define NUM_BENCHMARKS (sizeof(benchmarks) / sizeof(benchmarks[0]))
+
+static unsigned long long cpuNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ((unsigned long long)ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+}
+
+// measure - CPU time of one call (fastest of ROUNDS rounds)
+static double measure(const Benchmark *b, int fd)
+{
+    double best = 0;
+    int round, i;
+
+    for (round = 0; round < ROUNDS; round++) {
+        unsigned long long start = cpuNs();
+        for (i = 0; i < numCalls; i++) {
+            b->run(fd, i);
+        }
+        double ns = (double)(cpuNs() - start) / numCalls;
+        if ((round == 0) || (ns < best)) {
+            best = ns;
+        }
+    }
+    return best;
+}
+
+// findBefore - time of a function in a file written with -w
+// Returns: -1 - if the function is not in the file
+static double findBefore(FILE *f, const char *name)
+{
+    char line[MAX_LINE];
+    char fname[MAX_LINE];
+    double ns;
+
+    rewind(f);
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if ((line[0] != '#') &&
+                (sscanf(line, "%127s %lf", fname, &ns) == 2) &&
+                (strcmp(fname, name) == 0)) {
+            return ns;
+        }
+    }
+    return -1;
+}
+
+int main(int argc, char *argv[])
+{
+    static DMCCsim sim;
+    static BareCape cape;
+    const char *comparePath = NULL;
+    const char *writePath = NULL;
+    FILE *before = NULL;
+    FILE *out = NULL;
+    DMCCtransport transport;
+    unsigned int i;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "c:w:n:")) != -1) {
+        switch (opt) {
+        case 'c': comparePath = optarg; break;
+        case 'w': writePath = optarg; break;
+        case 'n': numCalls = atoi(optarg); break;
+        default:
+            printf("usage: ./cpuBench [-c times] [-w times] [-n calls]\n");
+            printf("       -c prints the times in a file written with -w ");
+            printf("next to these\n");
+            printf("       -w writes the measured times to a file\n");
+            printf("       -n calls per round (default: 200000)\n");
+            printf("example: make cpubench\n");
+            exit(1);
+        }
+    }
+    if (numCalls <= 0) {
+        printf("Error: -n must be at least 1\n");
+        exit(1);
+    }
+    if (comparePath != NULL) {
+        before = fopen(comparePath, "r");
+        if (before == NULL) {
+            printf("Error: cannot open %s\n", comparePath);
+            exit(1);
+        }
+    }
+
+    DMCCsimInit(&sim);
+    int fd = DMCCsimStart(&sim);
+    if (fd < 0) {
+        exit(1);
+    }
+    memcpy(cape.reg, sim.reg, sizeof(cape.reg));
+    transport.write = bareWrite;
+    transport.read = bareRead;
+    transport.now = bareNow;
+    transport.sleep = bareSleep;
+    transport.reopen = NULL;
+    transport.flush = NULL;
+    transport.stop = NULL;
+    transport.ctx = &cape;
+    DMCCattachTransport(fd, &transport);
+    DMCCpreparePower(fd, &prepared, 0, 0);
+
+    if (writePath != NULL) {
+        out = fopen(writePath, "w");
+        if (out == NULL) {
+            printf("Error: cannot write %s\n", writePath);
+            exit(1);
+        }
+        fprintf(out, "# CPU ns per call of %s\n", argv[0]);
+    }
+
+    if (before != NULL) {
+        printf("%-20s %12s %12s %8s\n", "function", "before ns",
+                "after ns", "change");
+    } else {
+        printf("%-20s %12s\n", "function", "ns/call");
+    }
+    for (i = 0; i < NUM_BENCHMARKS; i++) {
+        const Benchmark *b = &benchmarks[i];
+        double ns = measure(b, fd);
+
+        if (out != NULL) {
+            fprintf(out, "%s %.1f\n", b->name, ns);
+        }
+        if (before == NULL) {
+            printf("%-20s %12.1f\n", b->name, ns);
+            continue;
+        }
+        double old = findBefore(before, b->name);
+        if (old <= 0) {
+            printf("%-20s %12s %12.1f\n", b->name, "none", ns);
+        } else {
+            printf("%-20s %12.1f %12.1f %+7.0f%%\n", b->name, old, ns,
+                    100.0 * (ns - old) / old);
+        }
+    }
+
+    if (before != NULL) {
+        fclose(before);
+    }
+    if (out != NULL) {
+        fclose(out);
+    }
+    DMCCend(fd);
+    return 0;
+}
@@ -0,0 +1,612 @@
+//
+// Copyright (C) 2013-2016 - Exadler Technologies Inc., Sarah Tan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "DMCC.h"
+#include "DMCCsim.h"
+#include "DMCCtelemetry.h"
+#include "DMCCclient.h"
+
+// dmccd - the bus daemon.  It is the only program with the capes open and
+// serves any number of clients on a Unix domain socket (protocol in
+// DMCCclient.h).  Run programs with DMCC_SOCKET=<socket> to send them
+// through the daemon.
+//
+// Within one request, writes to consecutive registers of a board are
+// joined into one putBytes (if it fails, every write joined into it is
+// answered DMCCD_ERROR), and status requests for a board share one
+// snapshot until the board is written to.  Subscriptions to the same board
+// that are due together also share one snapshot.  Simulated capes follow
+// the wall clock, so motors move between requests as on a real bus.  -t
+// checks a client through the daemon (run by make bench).
+
+#define MAX_CLIENTS 32
+#define BOARDS 4
+
+// Writes waiting to be joined with the next one
+typedef struct JoinedWrite {
+    int board;                          // -1 if nothing is waiting
+    unsigned char addr;
+    unsigned char data[256];
+    int len;
+    DMCCdResult *results[255];          // replies to patch if it fails
+    int count;
+} JoinedWrite;
+
+typedef struct Client {
+    int conn;                           // -1 if the slot is free
+    unsigned int rate[BOARDS];          // subscriptions (0 is none)
+    unsigned long long next[BOARDS];    // when the next push is due
+} Client;
+
+static Client clients[MAX_CLIENTS];
+static int session[BOARDS];             // -1 if the board is not served
+static DMCCsim sim[BOARDS];
+static int simulated[BOARDS];           // 1 for a simulated cape
+static unsigned long long simStart;     // now() when serving started
+static volatile sig_atomic_t running = 1;
+
+void sig_handler(int sig)
+{
+    running = 0;
+}
+
+static unsigned long long now(void)
+{
+    // Clock of the system, not of any one board
+    return DMCCclock(-1);
+}
+
+// addResult - appends a result to a reply
+// Returns: the result in the reply
+//          NULL - if the reply is full
+static DMCCdResult *addResult(DMCCbatch *reply, unsigned int code,
+                                unsigned int board, unsigned int status,
+                                const void *data, unsigned int len)
+{
+    // A reply that would not fit keeps the result but not its data
+    if (reply->header.length + sizeof(DMCCdResult) + len > DMCCD_MAX_BODY) {
+        status = DMCCD_ERROR;
+        len = 0;
+    }
+    if ((reply->header.count == 255) ||
+            (reply->header.length + sizeof(DMCCdResult) > DMCCD_MAX_BODY)) {
+        return NULL;
+    }
+
+    DMCCdResult *r = (DMCCdResult *)&reply->body[reply->header.length];
+    r->code = code;
+    r->board = board;
+    r->status = status;
+    r->len = len;
+    if (len > 0) {
+        memcpy(r + 1, data, len);
+    }
+    reply->header.length += sizeof(DMCCdResult) + len;
+    reply->header.count++;
+    return r;
+}
+
+// flushWrite - sends the joined writes that are waiting, and answers each
+//              of them DMCCD_ERROR if the bus transfer fails
+// Returns: DMCC_EIO - if the bus transfer fails
+//          DMCC_OK - otherwise
+static int flushWrite(JoinedWrite *w)
+{
+    int result = DMCC_OK;
+    int i;
+
+    if (w->len > 0) {
+        result = putBytes(session[w->board], w->addr, w->data, w->len);
+        if (result != DMCC_OK) {
+            for (i = 0; i < w->count; i++) {
+                w->results[i]->status = DMCCD_ERROR;
+            }
+        }
+    }
+    w->board = -1;
+    w->len = 0;
+    w->count = 0;
+    return result;
+}
+
+// serve - runs a request from a client and builds the reply
+static void serve(Client *c, DMCCbatch *req, DMCCbatch *reply)
+{
+    DMCCtelemetryRecord status[BOARDS];
+    int haveStatus[BOARDS] = {0, 0, 0, 0};      // 1 sampled, -1 failed
+    JoinedWrite w;
+    unsigned int pos = 0;
+    unsigned int i;
+
+    reply->header.magic = DMCCD_MAGIC;
+    reply->header.type = DMCCD_REPLY;
+    reply->header.count = 0;
+    reply->header.length = 0;
+    w.board = -1;
+    w.len = 0;
+    w.count = 0;
+
+    for (i = 0; i < req->header.count; i++) {
+        if (pos + sizeof(DMCCdOp) > req->header.length) {
+            break;
+        }
+        DMCCdOp *op = (DMCCdOp *)&req->body[pos];
+        const unsigned char *data = (const unsigned char *)(op + 1);
+        unsigned int dataLen = 0;
+        if ((op->code == DMCCD_OP_WRITE) || (op->code == DMCCD_OP_SUBSCRIBE)) {
+            dataLen = op->len;
+        }
+        pos += sizeof(DMCCdOp) + dataLen;
+        if (pos > req->header.length) {
+            break;
+        }
+
+        int b = op->board;
+        if ((b >= BOARDS) || (session[b] < 0)) {
+            addResult(reply, op->code, b, DMCCD_ERROR, NULL, 0);
+            continue;
+        }
+
+        switch (op->code) {
+        case DMCCD_OP_WRITE: {
+            // Join with the waiting write if it continues it
+            if ((w.board != b) ||
+                    ((unsigned char)(w.addr + w.len) != op->addr) ||
+                    (w.len + op->len > (int)sizeof(w.data))) {
+                flushWrite(&w);
+                w.board = b;
+                w.addr = op->addr;
+            }
+            memcpy(&w.data[w.len], data, op->len);
+            w.len += op->len;
+            haveStatus[b] = 0;
+            // Answered DMCCD_OK for now, flushWrite changes it if it fails
+            DMCCdResult *r = addResult(reply, op->code, b, DMCCD_OK, NULL, 0);
+            if (r != NULL) {
+                w.results[w.count++] = r;
+            }
+            break;
+        }
+
+        case DMCCD_OP_READ: {
+            unsigned char buf[255];
+            flushWrite(&w);
+            if (getBytes(session[b], op->addr, buf, op->len) != DMCC_OK) {
+                addResult(reply, op->code, b, DMCCD_ERROR, NULL, 0);
+                break;
+            }
+            addResult(reply, op->code, b, DMCCD_OK, buf, op->len);
+            break;
+        }
+
+        case DMCCD_OP_STATUS:
+            flushWrite(&w);
+            if (!haveStatus[b]) {
+                haveStatus[b] = (DMCCtelemetrySample(session[b], &status[b])
+                                    == DMCC_OK) ? 1 : -1;
+            }
+            if (haveStatus[b] < 0) {
+                addResult(reply, op->code, b, DMCCD_ERROR, NULL, 0);
+                break;
+            }
+            addResult(reply, op->code, b, DMCCD_OK, &status[b],
+                        sizeof(DMCCtelemetryRecord));
+            break;
+
+        case DMCCD_OP_SUBSCRIBE: {
+            uint32_t rate;
+            if (op->len != sizeof(rate)) {
+                addResult(reply, op->code, b, DMCCD_ERROR, NULL, 0);
+                break;
+            }
+            memcpy(&rate, data, sizeof(rate));
+            c->rate[b] = (rate > 1000000) ? 1000000 : rate;
+            c->next[b] = now();
+            addResult(reply, op->code, b, DMCCD_OK, NULL, 0);
+            break;
+        }
+
+        default:
+            addResult(reply, op->code, b, DMCCD_ERROR, NULL, 0);
+            break;
+        }
+    }
+    flushWrite(&w);
+}
+
+// pushStatus - sends status to subscribers that are due, one snapshot per
+//              board; returns milliseconds until the next push is due
+static int pushStatus(void)
+{
+    unsigned long long t = now();
+    unsigned long long wait = 1000000;
+    int b, i;
+
+    for (b = 0; b < BOARDS; b++) {
+        DMCCbatch push;
+        int sampled = 0;
+
+        for (i = 0; i < MAX_CLIENTS; i++) {
+            Client *c = &clients[i];
+            if ((c->conn < 0) || (c->rate[b] == 0)) {
+                continue;
+            }
+            if (c->next[b] <= t) {
+                if (!sampled) {
+                    // A failed sample is pushed as an error with no data
+                    DMCCtelemetryRecord status;
+                    int ok = (DMCCtelemetrySample(session[b], &status) ==
+                                DMCC_OK);
+                    push.header.magic = DMCCD_MAGIC;
+                    push.header.type = DMCCD_PUSH;
+                    push.header.count = 0;
+                    push.header.length = 0;
+                    addResult(&push, DMCCD_OP_STATUS, b,
+                                ok ? DMCCD_OK : DMCCD_ERROR, &status,
+                                ok ? sizeof(status) : 0);
+                    sampled = 1;
+                }
+                // Slow clients miss pushes instead of holding up the bus
+                send(c->conn, &push, sizeof(DMCCdHeader) + push.header.length,
+                        MSG_DONTWAIT | MSG_NOSIGNAL);
+
+                c->next[b] += 1000000ULL / c->rate[b];
+                if (c->next[b] <= t) {
+                    c->next[b] = t + (1000000ULL / c->rate[b]);
+                }
+            }
+            if (c->next[b] - t < wait) {
+                wait = c->next[b] - t;
+            }
+        }
+    }
+    return (int)((wait + 999) / 1000);
+}
+
+// syncSims - runs the simulated capes forward to the wall clock, so that
+//            a motor commanded by a client moves while the client sleeps
+static void syncSims(void)
+{
+    unsigned long long elapsed = now() - simStart;
+    int b;
+
+    for (b = 0; b < BOARDS; b++) {
+        if (simulated[b] && (elapsed > sim[b].timeUs)) {
+            DMCCsimAdvance(&sim[b], (unsigned int)(elapsed - sim[b].timeUs));
+        }
+    }
+}
+
+// startBoard - opens a board named on the command line (0-3 or sim0-sim3)
+// Returns: -1 if the name is invalid or the board cannot be opened
+static int startBoard(const char *name)
+{
+    int isSim = (strncmp(name, "sim", 3) == 0);
+    int b = atoi(isSim ? name + 3 : name);
+
+    if ((b < 0) || (b >= BOARDS) || (session[b] >= 0)) {
+        printf("Error: board %s is invalid\n", name);
+        return -1;
+    }
+    if (isSim) {
+        DMCCsimInit(&sim[b]);
+        session[b] = DMCCsimStart(&sim[b]);
+        simulated[b] = 1;
+    } else {
+        session[b] = DMCCstart(b);
+    }
+    return (session[b] < 0) ? -1 : 0;
+}
+
+// serveBus - serves clients on the socket until SIGINT or SIGTERM
+// Returns: 0 - when stopped
+//          1 - if the socket cannot be served
+static int serveBus(const char *path)
+{
+    struct sockaddr_un sa;
+    int i, b;
+
+    if (strlen(path) >= sizeof(sa.sun_path)) {
+        printf("Error: socket path %s is too long\n", path);
+        return 1;
+    }
+    int listener = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+    if (listener < 0) {
+        printf("Error: cannot create socket\n");
+        return 1;
+    }
+    memset(&sa, 0, sizeof(sa));
+    sa.sun_family = AF_UNIX;
+    strcpy(sa.sun_path, path);
+    unlink(path);
+    if ((bind(listener, (struct sockaddr *)&sa, sizeof(sa)) != 0) ||
+            (listen(listener, 8) != 0)) {
+        printf("Error: cannot listen on %s\n", path);
+        close(listener);
+        return 1;
+    }
+
+    signal(SIGINT, sig_handler);
+    signal(SIGTERM, sig_handler);
+    signal(SIGPIPE, SIG_IGN);
+
+    DMCCbatch req, reply;
+    struct pollfd fds[MAX_CLIENTS + 1];
+    int slot[MAX_CLIENTS + 1];
+
+    simStart = now();
+    while (running) {
+        syncSims();
+        int timeout = pushStatus();
+
+        int n = 0;
+        fds[n].fd = listener;
+        fds[n].events = POLLIN;
+        slot[n++] = -1;
+        for (i = 0; i < MAX_CLIENTS; i++) {
+            if (clients[i].conn >= 0) {
+                fds[n].fd = clients[i].conn;
+                fds[n].events = POLLIN;
+                slot[n++] = i;
+            }
+        }
+
+        if (poll(fds, n, timeout) <= 0) {
+            continue;
+        }
+        syncSims();
+
+        for (i = 1; i < n; i++) {
+            if (!(fds[i].revents & (POLLIN | POLLHUP | POLLERR))) {
+                continue;
+            }
+            Client *c = &clients[slot[i]];
+            ssize_t len = recv(c->conn, &req, sizeof(req), 0);
+            if ((len < (ssize_t)sizeof(DMCCdHeader)) ||
+                    (req.header.magic != DMCCD_MAGIC) ||
+                    ((req.header.type != DMCCD_REQUEST) &&
+                        (req.header.type != DMCCD_ONEWAY)) ||
+                    (req.header.length != len - sizeof(DMCCdHeader))) {
+                // Closed, or not speaking the protocol
+                close(c->conn);
+                c->conn = -1;
+                continue;
+            }
+            serve(c, &req, &reply);
+            if (req.header.type != DMCCD_REQUEST) {
+                continue;
+            }
+            // A client that stops reading must not stop the bus for the
+            // others: if its reply cannot be queued, it is disconnected
+            // (a dropped reply would pair its next request with the wrong
+            // answer)
+            size_t size = sizeof(DMCCdHeader) + reply.header.length;
+            if (send(c->conn, &reply, size, MSG_DONTWAIT | MSG_NOSIGNAL) !=
+                    (ssize_t)size) {
+                close(c->conn);
+                c->conn = -1;
+            }
+        }
+
+        if (fds[0].revents & POLLIN) {
+            int conn = accept(listener, NULL, NULL);
+            if (conn >= 0) {
+                for (i = 0; i < MAX_CLIENTS; i++) {
+                    if (clients[i].conn < 0) {
+                        break;
+                    }
+                }
+                if (i == MAX_CLIENTS) {
+                    close(conn);
+                } else {
+                    memset(&clients[i], 0, sizeof(Client));
+                    clients[i].conn = conn;
+                }
+            }
+        }
+    }
+
+    close(listener);
+    unlink(path);
+    for (i = 0; i < MAX_CLIENTS; i++) {
+        if (clients[i].conn >= 0) {
+            close(clients[i].conn);
+        }
+    }
+    for (b = 0; b < BOARDS; b++) {
+        if (session[b] >= 0) {
+            DMCCend(session[b]);
+        }
+    }
+    return 0;
+}
+
+// ------------------------
+// Test mode (-t)
+// ------------------------
+#define TEST_POWER 5000
+#define TEST_TIME_US 300000
+#define TEST_MIN_COUNTS 1000    // about a third of what the sim moves
+#define TEST_PUSH_RATE 100
+#define TEST_PUSH_WAIT_US 100000
+#define TEST_MIN_PUSHES 5       // about half of what is pushed in the wait
+
+// testMove - runs moveUntilTime through the daemon, and checks that the
+//            motor moved during the sleep
+// Returns: 0 if it moved
+static int testMove(int fd)
+{
+    int moved = moveUntilTime(fd, 1, TEST_POWER, TEST_TIME_US);
+    int qei = (int)getQEI(fd, 1);
+    int error = DMCCgetError(fd);
+
+    printf("moveUntilTime(power %d, %d us) through dmccd: result %d, "
+            "QEI %d\n", TEST_POWER, TEST_TIME_US, moved, qei);
+    if ((moved != DMCC_OK) || (error != DMCC_OK)) {
+        printf("Test failed: the bus failed\n");
+        return 1;
+    }
+    if (abs(qei) < TEST_MIN_COUNTS) {
+        printf("Test failed: the motor did not move while the client "
+                "slept\n");
+        return 1;
+    }
+    return 0;
+}
+
+// testPushes - subscribes, lets status pile up, then sends a request: the
+//              status pushed before its reply must still be delivered
+// Returns: 0 if it was
+static int testPushes(const char *path)
+{
+    DMCCtelemetryRecord status;
+    unsigned int board;
+    int kept = 0;
+
+    int conn = DMCCclientConnect(path);
+    if ((conn < 0) || (DMCCclientSubscribe(conn, 0, TEST_PUSH_RATE) != 0)) {
+        printf("Test failed: cannot subscribe\n");
+        return 1;
+    }
+    usleep(TEST_PUSH_WAIT_US);
+    // The reply to the unsubscribe comes after the pushes that piled up
+    int result = DMCCclientSubscribe(conn, 0, 0);
+
+    // Nothing more is pushed, so stop waiting once the kept ones are read
+    struct timeval tv = {0, 200000};
+    setsockopt(conn, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    while (DMCCclientNextStatus(conn, &board, &status) == 0) {
+        kept++;
+    }
+    unsigned long dropped = DMCCclientDropped(conn);
+    close(conn);
+
+    printf("subscription at %d/s: %d status kept across a request, %lu "
+            "dropped\n", TEST_PUSH_RATE, kept, dropped);
+    if ((result != 0) || (kept < TEST_MIN_PUSHES)) {
+        printf("Test failed: status pushed during a request was lost\n");
+        return 1;
+    }
+    return 0;
+}
+
+// runTest - starts a daemon serving a simulated cape and runs the checks
+// Returns: 0 if they pass
+static int runTest(void)
+{
+    char dir[] = "/tmp/dmccd.XXXXXX";
+    char path[64];
+    int tries;
+
+    if (mkdtemp(dir) == NULL) {
+        printf("Error: cannot create a socket directory in /tmp\n");
+        return 1;
+    }
+    snprintf(path, sizeof(path), "%s/sock", dir);
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        printf("Error: cannot start the daemon\n");
+        rmdir(dir);
+        return 1;
+    }
+    if (pid == 0) {
+        exit((startBoard("sim0") == 0) ? serveBus(path) : 1);
+    }
+
+    // Wait for the daemon to listen
+    int fd = -1;
+    for (tries = 0; (fd < 0) && (tries < 100); tries++) {
+        usleep(10000);
+        fd = DMCCclientStart(path, 0);
+    }
+
+    int failed = 1;
+    if (fd < 0) {
+        printf("Error: the daemon did not answer on %s\n", path);
+    } else {
+        failed = testMove(fd);
+        DMCCend(fd);
+        failed += testPushes(path);
+        if (failed == 0) {
+            printf("Test passed\n");
+        }
+    }
+
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+    unlink(path);
+    rmdir(dir);
+    return (failed == 0) ? 0 : 1;
+}
+
+int main(int argc, char *argv[])
+{
+    int i, b;
+
+    for (b = 0; b < BOARDS; b++) {
+        session[b] = -1;
+    }
+    for (i = 0; i < MAX_CLIENTS; i++) {
+        clients[i].conn = -1;
+    }
+
+    // The daemon itself always owns the bus
+    unsetenv(DMCCD_SOCKET_ENV);
+
+    if ((argc == 2) && (strcmp(argv[1], "-t") == 0)) {
+        return runTest();
+    }
+
+    // Prints usage statement
+    if (argc < 3) {
+        printf("usage: ./dmccd <socket> <board number>...\n");
+        printf("       ./dmccd -t\n");
+        printf("       <socket> is the path of the socket to serve\n");
+        printf("       <board number> is [0-3] for placement of cape, ");
+        printf("or sim0-sim3 for a simulated cape (runs in real time)\n");
+        printf("       -t checks a client move and a subscription through ");
+        printf("the daemon on a simulated cape\n");
+        printf("example: ./dmccd /tmp/dmccd.sock 0 1\n");
+        printf("         DMCC_SOCKET=/tmp/dmccd.sock ./getQEI 0\n");
+        exit(1);
+    }
+
+    for (i = 2; i < argc; i++) {
+        if (startBoard(argv[i]) != 0) {
+            exit(1);
+        }
+    }
+    return serveBus(argv[1]);
+}
@@ -0,0 +1,241 @@
+//
+// Copyright (C) 2013-2016 - Exadler Technologies Inc., Sarah Tan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+
+#include "DMCC.h"
+#include "DMCCsim.h"
+
+// This program measures DMCCemergencyStopAll on simulated capes that are
+// all driving their motors: called directly, and from a signal handler
+// (raise(SIGUSR1)).  For comparison it also times the old way to stop, two
+// setMotorPower calls per cape.  It prints the bus transactions and bytes
+// per stop, the simulated bus time (100kHz) and the latency distribution
+// of each way, and fails if a stop leaves a motor with power.
+
+#define MAX_CAPES 16
+
+// Cape - a simulated cape and what went over its bus
+typedef struct Cape {
+    DMCCsim sim;
+    unsigned long long transactions;
+    unsigned long long bytes;
+} Cape;
+
+static Cape capes[MAX_CAPES];
+static int sessions[MAX_CAPES];
+static int numCapes = 4;
+static DMCCprepared drive[MAX_CAPES];
+static volatile unsigned long long handlerEnd;
+
+static int countWrite(void *ctx, const unsigned char *buf, int len)
+{
+    Cape *cape = (Cape *)ctx;
+    cape->transactions++;
+    cape->bytes += len + 1;
+    return DMCCsimWrite(&cape->sim, buf, len);
+}
+
+static int countRead(void *ctx, unsigned char *buf, int len)
+{
+    Cape *cape = (Cape *)ctx;
+    cape->transactions++;
+    cape->bytes += len + 1;
+    return DMCCsimRead(&cape->sim, buf, len);
+}
+
+static unsigned long long nowNs(void)
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (unsigned long long)t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+static void stopHandler(int sig)
+{
+    DMCCemergencyStopAll();
+    handlerEnd = nowNs();
+}
+
+static int compareNs(const void *a, const void *b)
+{
+    unsigned long long x = *(const unsigned long long *)a;
+    unsigned long long y = *(const unsigned long long *)b;
+    return (x > y) - (x < y);
+}
+
+// startDriving - sets power on every cape and clears the counters
+static void startDriving(void)
+{
+    int c;
+
+    for (c = 0; c < numCapes; c++) {
+        DMCCsendPrepared(sessions[c], &drive[c]);
+        DMCCsimAdvance(&capes[c].sim, 2000);
+        capes[c].transactions = 0;
+        capes[c].bytes = 0;
+    }
+}
+
+// stopped - checks that every motor of every cape has no power
+static int stopped(void)
+{
+    int c, m;
+
+    for (c = 0; c < numCapes; c++) {
+        for (m = 0; m < 2; m++) {
+            if ((capes[c].sim.motor[m].mode != DMCC_SIM_MODE_POWER) ||
+                    (capes[c].sim.reg[2 + 2 * m] != 0) ||
+                    (capes[c].sim.reg[3 + 2 * m] != 0)) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+// measure - times one way to stop every cape
+// Returns: -1 - if a stop left a motor with power
+static int measure(const char *name, int way, int iterations)
+{
+    unsigned long long *ns = (unsigned long long *)malloc(
+                                sizeof(unsigned long long) * iterations);
+    unsigned long long transactions = 0, bytes = 0;
+    int failed = 0;
+    int i, c;
+
+    for (i = 0; i < iterations; i++) {
+        startDriving();
+        unsigned long long start = nowNs();
+        if (way == 0) {
+            DMCCemergencyStopAll();
+            ns[i] = nowNs() - start;
+        } else if (way == 1) {
+            raise(SIGUSR1);
+            ns[i] = handlerEnd - start;
+        } else {
+            for (c = 0; c < numCapes; c++) {
+                setMotorPower(sessions[c], 1, 0);
+                setMotorPower(sessions[c], 2, 0);
+            }
+            ns[i] = nowNs() - start;
+        }
+        for (c = 0; c < numCapes; c++) {
+            DMCCsimAdvance(&capes[c].sim, 2000);
+            transactions += capes[c].transactions;
+            bytes += capes[c].bytes;
+        }
+        failed |= !stopped();
+    }
+
+    qsort(ns, iterations, sizeof(unsigned long long), compareNs);
+    double perCape = (double)bytes / iterations / numCapes;
+    printf("%-14s %8.1f %7.1f %9.0f %8.2f %8.2f %8.2f %8.2f%s\n", name,
+            (double)transactions / iterations / numCapes, perCape,
+            perCape * capes[0].sim.usPerByte, ns[0] / 1000.0,
+            ns[iterations / 2] / 1000.0,
+            ns[(int)(iterations * 0.99)] / 1000.0, ns[iterations - 1] / 1000.0,
+            failed ? "  FAILED" : "");
+    free(ns);
+    return failed ? -1 : 0;
+}
+
+static void usage(void)
+{
+    printf("usage: ./estopBench [-c capes] [-n iterations] [-t latency] ");
+    printf("[-f firmware]\n");
+    printf("       -c simulated capes (default: 4)\n");
+    printf("       -n stops measured per way (default: 10000)\n");
+    printf("       -t real microseconds every simulated transfer takes ");
+    printf("(default: 0)\n");
+    printf("       -f firmware version of the simulated capes [5-7] ");
+    printf("(default: %d)\n", DMCC_SIM_FIRMWARE);
+    printf("example: ./estopBench -c 2 -t 100 -n 1000\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    DMCCtransport transport;
+    int iterations = 10000;
+    int latency = 0;
+    int firmware = DMCC_SIM_FIRMWARE;
+    int opt, c, result = 0;
+
+    while ((opt = getopt(argc, argv, "c:n:t:f:")) != -1) {
+        switch (opt) {
+        case 'c': numCapes = atoi(optarg); break;
+        case 'n': iterations = atoi(optarg); break;
+        case 't': latency = atoi(optarg); break;
+        case 'f': firmware = atoi(optarg); break;
+        default: usage();
+        }
+    }
+    if ((numCapes < 1) || (numCapes > MAX_CAPES) || (iterations < 1) ||
+            (latency < 0)) {
+        usage();
+    }
+
+    for (c = 0; c < numCapes; c++) {
+        DMCCsimInit(&capes[c].sim);
+        if (DMCCsimSetFirmware(&capes[c].sim, firmware) != 0) {
+            usage();
+        }
+        capes[c].sim.latencyUs = latency;
+        sessions[c] = DMCCsimStart(&capes[c].sim);
+        if (sessions[c] < 0) {
+            exit(1);
+        }
+        transport.write = countWrite;
+        transport.read = countRead;
+        transport.now = NULL;
+        transport.sleep = NULL;
+        transport.reopen = NULL;
+        transport.flush = NULL;
+        transport.stop = NULL;
+        transport.ctx = &capes[c];
+        DMCCattachTransport(sessions[c], &transport);
+        DMCCpreparePower(sessions[c], &drive[c], 5000, -5000);
+    }
+    signal(SIGUSR1, stopHandler);
+
+    printf("%d cape(s), Mk.%02d firmware, %d us per transfer\n", numCapes,
+            firmware, latency);
+    printf("%-14s %8s %7s %9s %8s %8s %8s %8s\n", "stop", "trans", "bytes",
+            "bus us", "min us", "p50 us", "p99 us", "max us");
+    printf("%-14s %8s %7s %9s\n", "", "/cape", "/cape", "/cape");
+    result |= measure("stopAll", 0, iterations);
+    result |= measure("stopAll signal", 1, iterations);
+    result |= measure("setMotorPower", 2, iterations);
+
+    for (c = 0; c < numCapes; c++) {
+        DMCCend(sessions[c]);
+    }
+    return (result != 0) ? 1 : 0;
+}
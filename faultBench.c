@@ -0,0 +1,200 @@
+//
+// Copyright (C) 2013-2016 - Exadler Technologies Inc., Sarah Tan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "DMCC.h"
+#include "DMCCsim.h"
+
+// This program runs a control loop (setAllTargetVel, then getQEI, once per
+// millisecond) on a simulated cape whose bus NAKs, times out and hangs at
+// random, once without retries and once with them.  For each it prints the
+// commands that failed, the retry counters, and the simulated time the
+// commands took.  It fails if a command that returned DMCC_OK wrote or read
+// the wrong value, or if a transaction retried for longer than its budget
+// (plus one timed out try).
+
+#define CONTROL_PERIOD_US 1000
+
+static int numOps = 10000;
+static unsigned int nakPerMille = 20;
+static unsigned int timeoutPerMille = 5;
+static unsigned int hangPerMille = 1;
+static unsigned int seed = 1;
+
+static int compareUs(const void *a, const void *b)
+{
+    unsigned long long x = *(const unsigned long long *)a;
+    unsigned long long y = *(const unsigned long long *)b;
+    return (x > y) - (x < y);
+}
+
+// regValue - little endian register value of the simulated cape
+static unsigned int regValue(const DMCCsim *sim, unsigned char addr, int size)
+{
+    unsigned int value = 0;
+    int i;
+
+    for (i = size - 1; i >= 0; i--) {
+        value = (value << 8) | sim->reg[addr + i];
+    }
+    return value;
+}
+
+// run - runs the control loop with the given retry settings
+// Returns: -1 - if a command gave wrong data or retried past its budget
+static int run(const char *name, const DMCCretry *retry)
+{
+    static DMCCsim sim;
+    DMCCretryStats stats;
+    unsigned long long *us = (unsigned long long *)malloc(
+                                sizeof(unsigned long long) * numOps);
+    int failed = 0;
+    int wrong = 0;
+    int i;
+
+    DMCCsimInit(&sim);
+    int fd = DMCCsimStart(&sim);
+    if ((fd < 0) || (us == NULL)) {
+        exit(1);
+    }
+    setDefaultPIDConstants(fd);
+    DMCCsetRetry(fd, retry);
+    sim.nakPerMille = nakPerMille;
+    sim.timeoutPerMille = timeoutPerMille;
+    sim.hangPerMille = hangPerMille;
+    sim.seed = seed;
+
+    // The library prints every transaction it gives up on
+    fflush(stdout);
+    int out = dup(STDOUT_FILENO);
+    if (freopen("/dev/null", "w", stdout) == NULL) {
+        exit(1);
+    }
+
+    for (i = 0; i < numOps; i++) {
+        unsigned long long start = sim.timeUs;
+        if ((i % 2) == 0) {
+            int vel = (i % 2000) - 1000;
+            if (setAllTargetVel(fd, vel, -vel) != DMCC_OK) {
+                failed++;
+            } else if ((regValue(&sim, 0x28, 2) != (unsigned short)vel) ||
+                    (regValue(&sim, 0x2a, 2) != (unsigned short)-vel)) {
+                wrong++;
+            }
+        } else {
+            unsigned int qei = getQEI(fd, 1);
+            if (DMCCgetError(fd) != DMCC_OK) {
+                failed++;
+            } else if (qei != regValue(&sim, 0x10, 4)) {
+                wrong++;
+            }
+        }
+        us[i] = sim.timeUs - start;
+        DMCCsimAdvance(&sim, CONTROL_PERIOD_US);
+    }
+
+    fflush(stdout);
+    dup2(out, STDOUT_FILENO);
+    close(out);
+    clearerr(stdout);
+
+    DMCCgetRetryStats(fd, &stats);
+    DMCCend(fd);
+
+    // A transaction retries for its budget, then finishes its last try
+    unsigned long long bound = retry->budgetUs + sim.timeoutUs +
+                                    (64 * sim.usPerByte);
+    int late = (stats.maxRetryUs > bound);
+
+    qsort(us, numOps, sizeof(unsigned long long), compareUs);
+    printf("%-9s %7d %6d %5d %7llu %7llu %7llu %7llu %7llu %8llu %8llu%s\n",
+            name, numOps, failed, wrong, sim.naks, sim.timeouts,
+            stats.retries, stats.reopens, us[numOps / 2],
+            us[(int)(numOps * 0.99)], us[numOps - 1],
+            (wrong || late) ? "  FAILED" : "");
+    free(us);
+    return (wrong || late) ? -1 : 0;
+}
+
+static void usage(void)
+{
+    printf("usage: ./faultBench [-n commands] [-k naks] [-t timeouts] ");
+    printf("[-h hangs]\n");
+    printf("                    [-b budget] [-w backoff] [-r reopen] ");
+    printf("[-s seed]\n");
+    printf("       -n commands in the control loop (default: 10000)\n");
+    printf("       -k NAKs per 1000 transfers (default: 20)\n");
+    printf("       -t timeouts per 1000 transfers (default: 5)\n");
+    printf("       -h hangs per 1000 transfers, each lasts until the ");
+    printf("adapter is reopened (default: 1)\n");
+    printf("       -b retry budget in microseconds (default: %d)\n",
+            DMCC_RETRY_BUDGET_US);
+    printf("       -w wait before each retry in microseconds ");
+    printf("(default: %d)\n", DMCC_RETRY_BACKOFF_US);
+    printf("       -r failures in a row before a reopen, 0 for never ");
+    printf("(default: %d)\n", DMCC_RETRY_REOPEN);
+    printf("       -s seed of the faults (default: 1)\n");
+    printf("example: ./faultBench -k 100 -h 0 -b 5000\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    DMCCretry none = {0, 0, 0};
+    DMCCretry retry = {DMCC_RETRY_BUDGET_US, DMCC_RETRY_BACKOFF_US,
+                        DMCC_RETRY_REOPEN};
+    int opt, result = 0;
+
+    while ((opt = getopt(argc, argv, "n:k:t:h:b:w:r:s:")) != -1) {
+        switch (opt) {
+        case 'n': numOps = atoi(optarg); break;
+        case 'k': nakPerMille = atoi(optarg); break;
+        case 't': timeoutPerMille = atoi(optarg); break;
+        case 'h': hangPerMille = atoi(optarg); break;
+        case 'b': retry.budgetUs = atoi(optarg); break;
+        case 'w': retry.backoffUs = atoi(optarg); break;
+        case 'r': retry.reopenAfter = atoi(optarg); break;
+        case 's': seed = atoi(optarg); break;
+        default: usage();
+        }
+    }
+    if ((numOps < 1) ||
+            (nakPerMille + timeoutPerMille + hangPerMille > 1000)) {
+        usage();
+    }
+
+    printf("%u NAKs, %u timeouts, %u hangs per 1000 transfers; ",
+            nakPerMille, timeoutPerMille, hangPerMille);
+    printf("budget %u us, backoff %u us, reopen after %u\n", retry.budgetUs,
+            retry.backoffUs, retry.reopenAfter);
+    printf("%-9s %7s %6s %5s %7s %7s %7s %7s %7s %8s %8s\n", "retry",
+            "cmds", "failed", "wrong", "naks", "timeout", "retries",
+            "reopens", "p50 us", "p99 us", "max us");
+    result |= run("none", &none);
+    result |= run("budget", &retry);
+    return (result != 0) ? 1 : 0;
+}
@@ -38,6 +38,8 @@ int main(int argc, char *argv[])
 
     int boardNum = atol(argv[1]);
 
+    // Show the library's errors (on stderr)
+    DMCCsetLogLevel(DMCC_LOG_ERROR);
     int session = DMCCstart(boardNum);
     unsigned int curr1, curr2, voltage;
 
@@ -0,0 +1,390 @@
+//
+// Copyright (C) 2013-2016 - Exadler Technologies Inc., Sarah Tan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+
+#include "DMCC.h"
+#include "DMCCsim.h"
+
+// This program measures the time from issuing a motion command to the first
+// change the command makes in what the QEI reports.  Every sample starts
+// with the motor at rest, waits a random fraction of a firmware tick, issues
+// the command and polls until the QEI position (or velocity) moves.
+//
+// Commands: vel   - setTargetVel
+//           power - setMotorPower
+//           pos   - setAllTargetPos (both motors)
+// Polling:  busy  - reads back to back
+//           <n>   - one read every n microseconds
+//
+// Use "sim" as the board number for the simulated cape; -d sets how long
+// its firmware takes to act on a command.
+
+#define MAX_COMMANDS 3
+#define MAX_STRATEGIES 8
+#define SAMPLE_TIMEOUT_US 1000000   // a sample that sees no motion is missed
+#define REST_TIMEOUT_US 5000000     // longest wait for the motor to stop
+#define REST_CHECK_US 200000        // QEI unchanged this long = at rest
+#define TICK_US 1000                // firmware control loop period
+
+#define CMD_VEL 0
+#define CMD_POWER 1
+#define CMD_POS 2
+
+static const char *commandNames[MAX_COMMANDS] = {"vel", "power", "pos"};
+
+int session;
+unsigned int nMotor = 1;
+
+void sig_handler(int sig)
+{
+    // Only async-signal-safe calls here
+    DMCCemergencyStopAll();
+    _exit(1);
+}
+
+// Settings - what to measure
+typedef struct Settings {
+    int command[MAX_COMMANDS];          // CMD_* to measure
+    int numCommands;
+    unsigned int period[MAX_STRATEGIES];    // 0 is busy polling
+    int numStrategies;
+    int samples;
+    int watchVel;                       // watch velocity instead of position
+    int vel;                            // target for vel (QEI units)
+    int power;                          // power for power
+    int move;                           // QEI counts to move for pos
+} Settings;
+
+// observe - the QEI value the samples watch
+static int observe(const Settings *s)
+{
+    if (s->watchVel) {
+        return getQEIVel(session, nMotor);
+    }
+    return (int)getQEI(session, nMotor);
+}
+
+// waitForRest - stops the motors and waits until the QEI stops changing
+// Returns: -1 - if the motor is still moving after REST_TIMEOUT_US
+static int waitForRest(void)
+{
+    setAllMotorPower(session, 0, 0);
+
+    unsigned long long start = DMCCclock(session);
+    unsigned long long still = start;
+    unsigned int last = getQEI(session, nMotor);
+
+    while (DMCCclock(session) - start < REST_TIMEOUT_US) {
+        DMCCwaitUntil(session, DMCCclock(session) + REST_CHECK_US / 4);
+        unsigned int qei = getQEI(session, nMotor);
+        if (qei != last) {
+            last = qei;
+            still = DMCCclock(session);
+        } else if (DMCCclock(session) - still >= REST_CHECK_US) {
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// issue - sends the command being measured (pos1/pos2 are the position
+//         targets for CMD_POS, read before the clock starts)
+static void issue(const Settings *s, int command, int pos1, int pos2)
+{
+    switch (command) {
+    case CMD_VEL:
+        setTargetVel(session, nMotor, s->vel);
+        break;
+    case CMD_POWER:
+        setMotorPower(session, nMotor, s->power);
+        break;
+    case CMD_POS:
+        setAllTargetPos(session, pos1, pos2);
+        break;
+    }
+}
+
+// sample - one measurement
+// Returns: microseconds from the command to the first change
+//          -1 - if nothing changed within SAMPLE_TIMEOUT_US
+static long sample(const Settings *s, int command, unsigned int period)
+{
+    int before = observe(s);
+
+    // Position targets are read now (the motors are at rest), so the time
+    // measured is the command's alone, as for the other commands
+    int pos1 = 0;
+    int pos2 = 0;
+    if (command == CMD_POS) {
+        pos1 = (int)getQEI(session, 1) + s->move;
+        pos2 = (int)getQEI(session, 2) + s->move;
+    }
+
+    // Start at a random point of the firmware tick
+    DMCCwaitUntil(session, DMCCclock(session) + (rand() % TICK_US));
+
+    unsigned long long start = DMCCclock(session);
+    issue(s, command, pos1, pos2);
+
+    unsigned long long next = start;
+    while (1) {
+        if (period > 0) {
+            next += period;
+            DMCCwaitUntil(session, next);
+        }
+        int now = observe(s);
+        unsigned long long t = DMCCclock(session);
+        if (now != before) {
+            return (long)(t - start);
+        }
+        if (t - start > SAMPLE_TIMEOUT_US) {
+            return -1;
+        }
+    }
+}
+
+static int compareLong(const void *a, const void *b)
+{
+    long x = *(const long *)a;
+    long y = *(const long *)b;
+    return (x > y) - (x < y);
+}
+
+// percentile - value below which the given fraction of sorted samples lie
+static long percentile(const long *sorted, int n, double p)
+{
+    int i = (int)(p * (n - 1) + 0.5);
+    return sorted[i];
+}
+
+// parseCommands - reads the comma separated list of commands (-c)
+// Returns: number of commands, -1 if a command is not known
+static int parseCommands(char *arg, Settings *s)
+{
+    char *item;
+    int i;
+
+    s->numCommands = 0;
+    for (item = strtok(arg, ","); item != NULL; item = strtok(NULL, ",")) {
+        for (i = 0; i < MAX_COMMANDS; i++) {
+            if (strcmp(item, commandNames[i]) == 0) {
+                break;
+            }
+        }
+        if ((i == MAX_COMMANDS) || (s->numCommands == MAX_COMMANDS)) {
+            return -1;
+        }
+        s->command[s->numCommands++] = i;
+    }
+    return s->numCommands;
+}
+
+// parseStrategies - reads the comma separated list of polling (-p)
+// Returns: number of strategies, -1 if one is not known
+static int parseStrategies(char *arg, Settings *s)
+{
+    char *item;
+
+    s->numStrategies = 0;
+    for (item = strtok(arg, ","); item != NULL; item = strtok(NULL, ",")) {
+        if (s->numStrategies == MAX_STRATEGIES) {
+            return -1;
+        }
+        if (strcmp(item, "busy") == 0) {
+            s->period[s->numStrategies++] = 0;
+        } else if (atoi(item) > 0) {
+            s->period[s->numStrategies++] = atoi(item);
+        } else {
+            return -1;
+        }
+    }
+    return s->numStrategies;
+}
+
+static void usage(void)
+{
+    printf("usage: ./motionLatency <board number> [-c commands] ");
+    printf("[-p polling] [-n samples]\n");
+    printf("                       [-m motor] [-w pos|vel] ");
+    printf("[-d firmware delay] [-r raw file]\n");
+    printf("       <board number> is [0-3] for placement of cape, ");
+    printf("or sim\n");
+    printf("       -c commands to measure: vel,power,pos (default: all)\n");
+    printf("       -p polling: busy and/or read periods in microseconds ");
+    printf("(default: busy,1000,5000)\n");
+    printf("       -n samples per command and polling (default: 1000)\n");
+    printf("       -m motor number (default: 1)\n");
+    printf("       -w watch QEI position or velocity (default: pos)\n");
+    printf("       -d microseconds the simulated firmware takes to act ");
+    printf("on a command (default: 0)\n");
+    printf("       -r writes every sample (command,polling,us) to a file\n");
+    printf("example: ./motionLatency sim -c vel,power -p busy,2000 -d 500\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    Settings s;
+    DMCCsim sim;
+    char commands[] = "vel,power,pos";
+    char strategies[] = "busy,1000,5000";
+    const char *rawPath = NULL;
+    unsigned int delay = 0;
+    FILE *raw = NULL;
+    int opt, c, p, i;
+
+    if (argc < 2) {
+        usage();
+    }
+
+    memset(&s, 0, sizeof(s));
+    s.samples = 1000;
+    s.vel = 20;
+    s.power = 3000;
+    s.move = 1000;
+    parseCommands(commands, &s);
+    parseStrategies(strategies, &s);
+
+    optind = 2;
+    while ((opt = getopt(argc, argv, "c:p:n:m:w:d:r:")) != -1) {
+        switch (opt) {
+        case 'c':
+            if (parseCommands(optarg, &s) <= 0) {
+                usage();
+            }
+            break;
+        case 'p':
+            if (parseStrategies(optarg, &s) <= 0) {
+                usage();
+            }
+            break;
+        case 'n': s.samples = atoi(optarg); break;
+        case 'm': nMotor = atoi(optarg); break;
+        case 'w': s.watchVel = (strcmp(optarg, "vel") == 0); break;
+        case 'd': delay = atoi(optarg); break;
+        case 'r': rawPath = optarg; break;
+        default: usage();
+        }
+    }
+    if ((s.samples <= 0) || ((nMotor != 1) && (nMotor != 2))) {
+        usage();
+    }
+
+    // Begin the session (open a connection to the board)
+    if (strcmp(argv[1], "sim") == 0) {
+        DMCCsimInit(&sim);
+        sim.commandDelayUs = delay;
+        session = DMCCsimStart(&sim);
+    } else {
+        session = DMCCstart(atoi(argv[1]));
+    }
+    if (session < 0) {
+        exit(1);
+    }
+    setDefaultPIDConstants(session);
+    signal(SIGINT, sig_handler);
+
+    if (rawPath != NULL) {
+        raw = fopen(rawPath, "w");
+        if (raw == NULL) {
+            printf("Error: cannot write %s\n", rawPath);
+            DMCCend(session);
+            exit(1);
+        }
+        fprintf(raw, "command,polling,us\n");
+    }
+
+    long *latency = (long *)malloc(s.samples * sizeof(long));
+    if (latency == NULL) {
+        printf("Error: out of memory\n");
+        DMCCend(session);
+        exit(1);
+    }
+    srand(1);
+
+    printf("Latency in microseconds from the command to the first QEI %s "
+            "change\n", s.watchVel ? "velocity" : "position");
+    printf("%-6s %-8s %8s %8s %8s %8s %8s %8s %8s\n", "cmd", "polling",
+            "min", "p50", "p90", "p99", "max", "mean", "missed");
+
+    for (c = 0; c < s.numCommands; c++) {
+        for (p = 0; p < s.numStrategies; p++) {
+            int n = 0;
+            int missed = 0;
+            double sum = 0;
+            char polling[16];
+
+            if (s.period[p] == 0) {
+                strcpy(polling, "busy");
+            } else {
+                snprintf(polling, sizeof(polling), "%uus", s.period[p]);
+            }
+
+            for (i = 0; i < s.samples; i++) {
+                if (waitForRest() != 0) {
+                    printf("Error: motor does not come to rest\n");
+                    setAllMotorPower(session, 0, 0);
+                    DMCCend(session);
+                    exit(1);
+                }
+                long us = sample(&s, s.command[c], s.period[p]);
+                if (us < 0) {
+                    missed++;
+                    continue;
+                }
+                latency[n++] = us;
+                sum += us;
+                if (raw != NULL) {
+                    fprintf(raw, "%s,%s,%ld\n", commandNames[s.command[c]],
+                            polling, us);
+                }
+            }
+
+            if (n == 0) {
+                printf("%-6s %-8s %8s %8s %8s %8s %8s %8s %8d\n",
+                        commandNames[s.command[c]], polling, "-", "-", "-",
+                        "-", "-", "-", missed);
+                continue;
+            }
+            qsort(latency, n, sizeof(long), compareLong);
+            printf("%-6s %-8s %8ld %8ld %8ld %8ld %8ld %8.0f %8d\n",
+                    commandNames[s.command[c]], polling, latency[0],
+                    percentile(latency, n, 0.5), percentile(latency, n, 0.9),
+                    percentile(latency, n, 0.99), latency[n - 1], sum / n,
+                    missed);
+            fflush(stdout);
+        }
+    }
+
+    setAllMotorPower(session, 0, 0);
+    if (raw != NULL) {
+        fclose(raw);
+    }
+    free(latency);
+    DMCCend(session);
+    return 0;
+}
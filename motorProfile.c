@@ -0,0 +1,238 @@
+//
+// Copyright (C) 2013-2016 - Exadler Technologies Inc., Sarah Tan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "DMCC.h"
+#include "DMCCprofile.h"
+#include "DMCCsim.h"
+
+// This program saves the motor configuration of a cape to a profile file,
+// applies a profile to a cape, or prints a profile.  With the board "sim"
+// it applies the profile to a simulated cape and compares the bus traffic
+// with setting the cape up call by call: once on a fresh cape (cold start)
+// and once more on the same cape (warm restart).
+
+static void usage(void)
+{
+    printf("usage: ./motorProfile save <board number> [file]\n");
+    printf("       ./motorProfile apply <board number> [file]\n");
+    printf("       ./motorProfile show <file>\n");
+    printf("       <board number> is [0-3] for placement of cape, or sim\n");
+    printf("       [file] defaults to %s/i2c-1-<board number>.profile\n",
+            DMCC_PROFILE_DIR);
+    printf("examples: ./motorProfile save 0\n");
+    printf("          ./motorProfile apply sim tuned.profile\n");
+}
+
+// ------------------------
+// Simulated cape with a transfer count
+// ------------------------
+typedef struct CountedSim {
+    DMCCsim sim;
+    unsigned long transfers;
+} CountedSim;
+
+static int countWrite(void *ctx, const unsigned char *buf, int len)
+{
+    CountedSim *c = (CountedSim *)ctx;
+    c->transfers++;
+    return DMCCsimWrite(&c->sim, buf, len);
+}
+
+static int countRead(void *ctx, unsigned char *buf, int len)
+{
+    CountedSim *c = (CountedSim *)ctx;
+    c->transfers++;
+    return DMCCsimRead(&c->sim, buf, len);
+}
+
+static unsigned long long countNow(void *ctx)
+{
+    return ((CountedSim *)ctx)->sim.timeUs;
+}
+
+static void countSleep(void *ctx, unsigned int microseconds)
+{
+    DMCCsimAdvance(&((CountedSim *)ctx)->sim, microseconds);
+}
+
+// startCounted - opens a session on a fresh simulated cape
+static int startCounted(CountedSim *c)
+{
+    DMCCtransport transport;
+
+    memset(c, 0, sizeof(CountedSim));
+    DMCCsimInit(&c->sim);
+    int fd = DMCCsimStart(&c->sim);
+    if (fd < 0) {
+        return -1;
+    }
+    transport.write = countWrite;
+    transport.read = countRead;
+    transport.now = countNow;
+    transport.sleep = countSleep;
+    transport.reopen = NULL;
+    transport.flush = NULL;
+    transport.stop = NULL;
+    transport.ctx = c;
+    DMCCattachTransport(fd, &transport);
+    return fd;
+}
+
+// setUpByCalls - the set up a program did before profiles
+static void setUpByCalls(int fd, const DMCCprofile *p)
+{
+    int config = p->regs.config;
+
+    setDefaultPIDConstants(fd);
+    setPIDConstants(fd, 1, 0, p->regs.posP1, p->regs.posI1, p->regs.posD1);
+    setPIDConstants(fd, 1, 1, p->regs.velP1, p->regs.velI1, p->regs.velD1);
+    setPIDConstants(fd, 2, 0, p->regs.posP2, p->regs.posI2, p->regs.posD2);
+    setPIDConstants(fd, 2, 1, p->regs.velP2, p->regs.velI2, p->regs.velD2);
+    setPIDPowerLimits(fd, p->regs.pidLimit1, p->regs.pidLimit2);
+    configMotorDir(fd, 1, (config & DMCC_PROFILE_MOTOR_DIR1) != 0);
+    configMotorDir(fd, 2, (config & DMCC_PROFILE_MOTOR_DIR2) != 0);
+    configQEIDir(fd, 1, (config & DMCC_PROFILE_QEI_DIR1) != 0);
+    configQEIDir(fd, 2, (config & DMCC_PROFILE_QEI_DIR2) != 0);
+}
+
+// compareOnSim - prints the bus traffic of both ways of setting up a cape
+static int compareOnSim(const DMCCprofile *profile)
+{
+    static CountedSim calls, cold;
+    DMCCprofile check;
+
+    int fd = startCounted(&calls);
+    if (fd < 0) {
+        return 1;
+    }
+    unsigned long long start = calls.sim.timeUs;
+    setUpByCalls(fd, profile);
+    printf("%-24s %10lu transfers %8llu us\n", "set up call by call",
+            calls.transfers, calls.sim.timeUs - start);
+    DMCCend(fd);
+
+    fd = startCounted(&cold);
+    if (fd < 0) {
+        return 1;
+    }
+    start = cold.sim.timeUs;
+    int runs = DMCCprofileApply(fd, profile);
+    printf("%-24s %10lu transfers %8llu us  (%d runs written)\n",
+            "profile, cold start", cold.transfers, cold.sim.timeUs - start,
+            runs);
+
+    unsigned long before = cold.transfers;
+    start = cold.sim.timeUs;
+    runs = DMCCprofileApply(fd, profile);
+    printf("%-24s %10lu transfers %8llu us  (%d runs written)\n",
+            "profile, warm restart", cold.transfers - before,
+            cold.sim.timeUs - start, runs);
+
+    // The cape must now hold the profile
+    if ((DMCCprofileRead(fd, &check) != DMCC_OK) ||
+            (memcmp(&check.regs, &profile->regs, sizeof(DMCCregs)) != 0)) {
+        printf("Error: the cape does not hold the profile\n");
+        DMCCend(fd);
+        return 1;
+    }
+    DMCCend(fd);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    char path[256];
+    char text[2048];
+    DMCCprofile profile;
+
+    // Show the library's errors (on stderr)
+    DMCCsetLogLevel(DMCC_LOG_ERROR);
+
+    if ((argc == 3) && (strcmp(argv[1], "show") == 0)) {
+        if ((DMCCprofileLoad(argv[2], &profile) != 0) ||
+                (DMCCprofileFormat(&profile, text, sizeof(text)) < 0)) {
+            exit(1);
+        }
+        fputs(text, stdout);
+        return 0;
+    }
+    if (((argc != 3) && (argc != 4)) ||
+            ((strcmp(argv[1], "save") != 0) &&
+                (strcmp(argv[1], "apply") != 0))) {
+        usage();
+        exit(1);
+    }
+    int save = (strcmp(argv[1], "save") == 0);
+    int sim = (strcmp(argv[2], "sim") == 0);
+    int boardNum = sim ? 0 : atol(argv[2]);
+    if (argc == 4) {
+        snprintf(path, sizeof(path), "%s", argv[3]);
+    } else {
+        DMCCprofilePath(path, sizeof(path), 1, boardNum);
+    }
+
+    if (sim) {
+        if (save) {
+            static DMCCsim cape;
+            DMCCsimInit(&cape);
+            int session = DMCCsimStart(&cape);
+            if ((session < 0) || (DMCCprofileRead(session, &profile) != 0)) {
+                exit(1);
+            }
+            DMCCend(session);
+            return (DMCCprofileSave(path, &profile) != 0) ? 1 : 0;
+        }
+        if (DMCCprofileLoad(path, &profile) != 0) {
+            exit(1);
+        }
+        return compareOnSim(&profile);
+    }
+
+    int session = DMCCstartBus(1, boardNum);
+    if (session < 0) {
+        exit(1);
+    }
+    int result;
+    if (save) {
+        result = DMCCprofileRead(session, &profile);
+        if (result == DMCC_OK) {
+            result = DMCCprofileSave(path, &profile);
+        }
+        if (result == 0) {
+            printf("Saved %s\n", path);
+        }
+    } else {
+        result = DMCCprofileLoad(path, &profile);
+        if (result == 0) {
+            result = DMCCprofileApply(session, &profile);
+        }
+        if (result >= 0) {
+            printf("Applied %s (%d register runs written)\n", path, result);
+        }
+    }
+    DMCCend(session);
+    return (result < 0) ? 1 : 0;
+}
@@ -0,0 +1,213 @@
+//
+// Copyright (C) 2013-2016 - Exadler Technologies Inc., Sarah Tan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "DMCC.h"
+#include "DMCCsim.h"
+#include "DMCCprobe.h"
+#include "DMCCmulti.h"
+
+// This program measures how the throughput of DMCCmulti grows with the
+// number of buses.  Every round reads the status of all capes and sends a
+// velocity command to both motors of each.  Simulated capes are used, with
+// every transfer taking -l microseconds of real time; for 1 to -b buses it
+// prints cape updates (status + commands) per second, the speedup over one
+// bus and how busy the workers of the buses were.  -e runs the same rounds once on the capes
+// DMCCenumerate finds on the real buses instead.
+
+#define MAX_BUSES DMCC_MULTI_MAX_BUSES
+
+static DMCCsim sims[MAX_BUSES][DMCC_MAX_CAPES];
+
+// simOpener - opens the simulated cape of a bus (DMCCsetBusOpener)
+static int simOpener(int bus, unsigned char capeAddr)
+{
+    if ((bus < 0) || (bus >= MAX_BUSES)) {
+        return -1;
+    }
+    return DMCCsimStart(&sims[bus][capeAddr]);
+}
+
+// nowUs - monotonic time in microseconds
+static unsigned long long nowUs(void)
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (unsigned long long)t.tv_sec * 1000000ULL + t.tv_nsec / 1000;
+}
+
+// runRounds - runs the rounds on the capes
+// Parameters: failed - set to the number of status reads and commands that
+//                      failed
+// Returns: wall time in microseconds (-1 if the capes cannot be opened)
+static long long runRounds(const DMCCcapeInfo *capes, int count, int rounds,
+                            DMCCmulti *multi, int *failed)
+{
+    DMCCcapeStatus status[DMCC_MULTI_MAX_CAPES];
+    DMCCmotorCommand commands[2 * DMCC_MULTI_MAX_CAPES];
+    int r, i;
+
+    *failed = 0;
+    if (DMCCmultiOpen(multi, capes, count) != 0) {
+        return -1;
+    }
+    for (i = 0; i < count; i++) {
+        commands[2 * i].cape = i;
+        commands[2 * i].type = DMCC_CMD_VEL;
+        commands[2 * i].motor = 1;
+        commands[2 * i + 1] = commands[2 * i];
+        commands[2 * i + 1].motor = 2;
+    }
+
+    DMCCmultiResetStats(multi);
+    unsigned long long start = nowUs();
+    for (r = 0; r < rounds; r++) {
+        DMCCmultiReadStatus(multi, status);
+        for (i = 0; i < count; i++) {
+            *failed += (status[i].error != DMCC_OK);
+        }
+        for (i = 0; i < 2 * count; i++) {
+            commands[i].value = (r % 2) ? 10 : -10;
+        }
+        *failed += DMCCmultiSend(multi, commands, 2 * count);
+    }
+    return nowUs() - start;
+}
+
+// printBuses - prints how busy the worker of each bus was
+static void printBuses(DMCCmulti *multi)
+{
+    DMCCbusStats stats;
+    int i;
+
+    for (i = 0; DMCCmultiGetBusStats(multi, i, &stats) == 0; i++) {
+        printf("    bus %2d: %d cape(s), %llu jobs, busy %llu us of %llu us "
+                "(%.1f%%)\n", stats.bus, stats.capes, stats.jobs,
+                stats.busyUs, stats.elapsedUs, stats.utilization * 100.0);
+    }
+}
+
+static void usage(void)
+{
+    printf("usage: ./multiBus [-b buses] [-c capes per bus] ");
+    printf("[-l latency] [-n rounds] [-e]\n");
+    printf("       -b largest number of simulated buses (default: 4)\n");
+    printf("       -c simulated capes on each bus [1-4] (default: 2)\n");
+    printf("       -l real microseconds every simulated transfer takes ");
+    printf("(default: 200)\n");
+    printf("       -n rounds (status of all capes + one command per motor) ");
+    printf("(default: 100)\n");
+    printf("       -e use the capes found on the real buses\n");
+    printf("example: ./multiBus -b 8 -l 500\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    DMCCcapeInfo capes[DMCC_MULTI_MAX_CAPES];
+    DMCCmulti multi;
+    int maxBuses = 4;
+    int perBus = 2;
+    int latency = 200;
+    int rounds = 100;
+    int real = 0;
+    double base = 0.0;
+    int opt, b, a, n, failed;
+
+    while ((opt = getopt(argc, argv, "b:c:l:n:e")) != -1) {
+        switch (opt) {
+        case 'b': maxBuses = atoi(optarg); break;
+        case 'c': perBus = atoi(optarg); break;
+        case 'l': latency = atoi(optarg); break;
+        case 'n': rounds = atoi(optarg); break;
+        case 'e': real = 1; break;
+        default: usage();
+        }
+    }
+    if ((maxBuses < 1) || (maxBuses > MAX_BUSES) || (perBus < 1) ||
+            (perBus > DMCC_MAX_CAPES) || (latency < 0) || (rounds < 1)) {
+        usage();
+    }
+
+    if (real) {
+        n = DMCCenumerate(capes, DMCC_MULTI_MAX_CAPES, 1);
+        if (n <= 0) {
+            printf("Error: no capes found\n");
+            exit(1);
+        }
+        long long us = runRounds(capes, n, rounds, &multi, &failed);
+        if (us < 0) {
+            printf("Error: cannot open the capes\n");
+            exit(1);
+        }
+        printf("%d cape(s): %d rounds in %lld us, %.1f rounds/s, "
+                "%d failed\n", n, rounds, us, rounds * 1000000.0 / us,
+                failed);
+        printBuses(&multi);
+        DMCCmultiClose(&multi);
+        return 0;
+    }
+
+    DMCCsetBusOpener(simOpener);
+    printf("%d cape(s) per bus, %d us per transfer, %d rounds\n", perBus,
+            latency, rounds);
+    printf("buses  capes   rounds/s   capes/s  speedup  efficiency\n");
+    for (b = 1; b <= maxBuses; b++) {
+        n = 0;
+        for (a = 0; a < b * perBus; a++) {
+            capes[n].bus = a / perBus;
+            capes[n].capeAddr = a % perBus;
+            DMCCsimInit(&sims[capes[n].bus][capes[n].capeAddr]);
+            sims[capes[n].bus][capes[n].capeAddr].latencyUs = latency;
+            n++;
+        }
+
+        long long us = runRounds(capes, n, rounds, &multi, &failed);
+        if (us < 0) {
+            printf("Error: cannot open the capes\n");
+            exit(1);
+        }
+        if (failed > 0) {
+            printf("Error: %d status reads or commands failed on %d bus(es)\n",
+                    failed, b);
+            exit(1);
+        }
+        double rate = rounds * 1000000.0 / us;
+        if (b == 1) {
+            base = rate * n;
+        }
+        printf("%5d  %5d  %9.1f  %8.1f  %6.2fx  %9.1f%%\n", b, n, rate,
+                rate * n, rate * n / base, rate * n / base / b * 100.0);
+        if (b == maxBuses) {
+            printBuses(&multi);
+        }
+        DMCCmultiClose(&multi);
+    }
+    return 0;
+}
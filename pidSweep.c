@@ -0,0 +1,364 @@
+//
+// Copyright (C) 2013-2016 - Exadler Technologies Inc., Sarah Tan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "DMCC.h"
+#include "DMCCsim.h"
+
+// This program searches for PID constants on the simulated cape instead of
+// trying them one at a time on the robot with setPID.  Every combination in
+// the given ranges gets a step response on its own simulated cape, the
+// responses are scored, and the best constants are printed.  Workers run on
+// all CPU cores and share nothing but the job counter, so the sweep scales
+// with the number of cores.
+//
+// Cost functions (e = target - response, summed every 1 ms):
+//      iae  - integral of |e|
+//      itae - integral of t * |e| (punishes slow settling)
+//      ise  - integral of e * e (punishes large errors)
+// The overshoot weight adds <weight> per percent of overshoot.
+
+#define COST_IAE  0
+#define COST_ITAE 1
+#define COST_ISE  2
+
+typedef struct SweepRange {
+    int min;
+    int max;
+    int step;
+    int count;
+} SweepRange;
+
+typedef struct SweepResult {
+    short int P;
+    short int I;
+    short int D;
+    float cost;
+    float overshoot;    // percent of target
+    int settleMs;       // -1 if it never settled
+} SweepResult;
+
+// Sweep settings (set once in main, read only in the workers)
+static int posOrVel;
+static int target;
+static int durationMs = 2000;
+static int costType = COST_IAE;
+static double overshootWeight = 0.0;
+static double maxVel = 20000.0;
+static double tau = 0.05;
+static SweepRange rangeP, rangeI, rangeD;
+static long totalJobs;
+static long nextJob;
+static SweepResult *results;
+
+// parseRange - reads <min> <max> <step> from the command line
+// Returns: -1 - if the range is not valid for a 16 bit signed constant
+//           0 - otherwise
+static int parseRange(char *argv[], SweepRange *r)
+{
+    r->min = atoi(argv[0]);
+    r->max = atoi(argv[1]);
+    r->step = atoi(argv[2]);
+    if ((r->min < -32768) || (r->max > 32767) || (r->min > r->max) ||
+            (r->step <= 0)) {
+        printf("Error: range %d..%d step %d is invalid\n",
+                r->min, r->max, r->step);
+        return -1;
+    }
+    r->count = ((r->max - r->min) / r->step) + 1;
+    return 0;
+}
+
+// stepResponse - runs one set of constants on the cape and scores it
+static void stepResponse(DMCCsim *sim, int session, long job, SweepResult *r)
+{
+    long n = job;
+    int P = rangeP.min + (int)(n % rangeP.count) * rangeP.step;
+    n /= rangeP.count;
+    int I = rangeI.min + (int)(n % rangeI.count) * rangeI.step;
+    n /= rangeI.count;
+    int D = rangeD.min + (int)n * rangeD.step;
+
+    // Fresh cape, simulated time only moves with DMCCsimAdvance
+    DMCCsimInit(sim);
+    sim->usPerByte = 0;
+    sim->motor[0].maxVel = maxVel;
+    sim->motor[1].maxVel = maxVel;
+    sim->motor[0].tau = tau;
+    sim->motor[1].tau = tau;
+
+    setPIDConstants(session, 1, posOrVel, P, I, D);
+    if (posOrVel == 0) {
+        setTargetPos(session, 1, target);
+    } else {
+        setTargetVel(session, 1, target);
+    }
+
+    double cost = 0.0;
+    double peak = 0.0;
+    double band = fabs(target) * 0.02;
+    int settleMs = 0;
+    int t;
+
+    if (band < 1.0) {
+        band = 1.0;
+    }
+    for (t = 1; t <= durationMs; t++) {
+        DMCCsimAdvance(sim, 1000);
+
+        int value;
+        if (posOrVel == 0) {
+            value = (int)getQEI(session, 1);
+        } else {
+            value = getQEIVel(session, 1);
+        }
+        double e = (double)target - value;
+        double dt = 0.001;
+
+        if (costType == COST_ITAE) {
+            cost += (t * dt) * fabs(e) * dt;
+        } else if (costType == COST_ISE) {
+            cost += e * e * dt;
+        } else {
+            cost += fabs(e) * dt;
+        }
+
+        // Overshoot is measured past the target in the direction of travel
+        double past = (target >= 0) ? -e : e;
+        if (past > peak) {
+            peak = past;
+        }
+        if (fabs(e) > band) {
+            settleMs = t;
+        }
+    }
+
+    double overshoot = (target != 0) ? (100.0 * peak / fabs(target)) : 0.0;
+
+    r->P = (short int)P;
+    r->I = (short int)I;
+    r->D = (short int)D;
+    r->cost = (float)(cost + overshootWeight * overshoot);
+    r->overshoot = (float)overshoot;
+    r->settleMs = (settleMs >= durationMs) ? -1 : settleMs;
+}
+
+// sweepWorker - takes jobs until there are none left
+static void *sweepWorker(void *arg)
+{
+    DMCCsim sim;
+    int session;
+
+    DMCCsimInit(&sim);
+    session = DMCCsimStart(&sim);
+    if (session < 0) {
+        return NULL;
+    }
+
+    while (1) {
+        long job = __sync_fetch_and_add(&nextJob, 1);
+        if (job >= totalJobs) {
+            break;
+        }
+        stepResponse(&sim, session, job, &results[job]);
+    }
+
+    DMCCend(session);
+    return NULL;
+}
+
+// compareResults - qsort order, lowest cost first
+static int compareResults(const void *a, const void *b)
+{
+    float ca = ((const SweepResult *)a)->cost;
+    float cb = ((const SweepResult *)b)->cost;
+
+    // Unstable responses can produce NaN, keep those at the end
+    if (isnan(ca)) {
+        return isnan(cb) ? 0 : 1;
+    }
+    if (isnan(cb)) {
+        return -1;
+    }
+    return (ca > cb) - (ca < cb);
+}
+
+// printResult - one row of the result table
+static void printResult(FILE *f, long rank, SweepResult *r)
+{
+    fprintf(f, "%6ld %6d %6d %6d %14.3f %8.1f %6d\n", rank,
+            r->P, r->I, r->D, r->cost, r->overshoot, r->settleMs);
+}
+
+static void usage(void)
+{
+    printf("usage: ./pidSweep <pos_vel> <target> <Pmin> <Pmax> <Pstep> ");
+    printf("<Imin> <Imax> <Istep> <Dmin> <Dmax> <Dstep> [options]\n");
+    printf("       <pos_vel> 0 for position, 1 for velocity\n");
+    printf("       <target> is the target QEI position or velocity\n");
+    printf("       <min> <max> <step> are the constant ranges ");
+    printf("(-32768 to 32767)\n");
+    printf("options: -j <threads>   worker threads (default: all cores)\n");
+    printf("         -c <cost>      iae, itae or ise (default: iae)\n");
+    printf("         -w <weight>    cost added per %% overshoot ");
+    printf("(default: 0)\n");
+    printf("         -t <ms>        length of each step response ");
+    printf("(default: 2000)\n");
+    printf("         -v <vel>       motor speed at full power in ");
+    printf("counts/s (default: 20000)\n");
+    printf("         -m <tau>       motor time constant in s ");
+    printf("(default: 0.05)\n");
+    printf("         -n <rows>      rows to print (default: 10)\n");
+    printf("         -o <file>      write the full ranked table to file\n");
+    printf("example: ./pidSweep 0 5000 -12000 -2000 500 -200 0 25 ");
+    printf("-1000 0 100 -c itae -w 50\n");
+}
+
+int main(int argc, char *argv[])
+{
+    int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int rows = 10;
+    char *outFile = NULL;
+    int i;
+
+    if (argc < 12) {
+        usage();
+        exit(1);
+    }
+
+    posOrVel = atoi(argv[1]);
+    target = atoi(argv[2]);
+    if ((posOrVel != 0) && (posOrVel != 1)) {
+        printf("Error: position or velocity not correctly specified\n");
+        exit(1);
+    }
+    if ((parseRange(&argv[3], &rangeP) != 0) ||
+            (parseRange(&argv[6], &rangeI) != 0) ||
+            (parseRange(&argv[9], &rangeD) != 0)) {
+        exit(1);
+    }
+
+    for (i = 12; i < argc; i++) {
+        if (i + 1 >= argc) {
+            usage();
+            exit(1);
+        }
+        if (strcmp(argv[i], "-j") == 0) {
+            threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-c") == 0) {
+            i++;
+            if (strcmp(argv[i], "iae") == 0) {
+                costType = COST_IAE;
+            } else if (strcmp(argv[i], "itae") == 0) {
+                costType = COST_ITAE;
+            } else if (strcmp(argv[i], "ise") == 0) {
+                costType = COST_ISE;
+            } else {
+                printf("Error: unknown cost function %s\n", argv[i]);
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "-w") == 0) {
+            overshootWeight = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-t") == 0) {
+            durationMs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-v") == 0) {
+            maxVel = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-m") == 0) {
+            tau = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-n") == 0) {
+            rows = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-o") == 0) {
+            outFile = argv[++i];
+        } else {
+            usage();
+            exit(1);
+        }
+    }
+    if (threads < 1) {
+        threads = 1;
+    }
+    if (durationMs < 1) {
+        printf("Error: step response must be at least 1 ms\n");
+        exit(1);
+    }
+
+    totalJobs = (long)rangeP.count * rangeI.count * rangeD.count;
+    results = (SweepResult *)malloc(sizeof(SweepResult) * totalJobs);
+    pthread_t *workers = (pthread_t *)malloc(sizeof(pthread_t) * threads);
+    if ((results == NULL) || (workers == NULL)) {
+        printf("Error: memory allocation failure\n");
+        exit(1);
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (i = 0; i < threads; i++) {
+        if (pthread_create(&workers[i], NULL, sweepWorker, NULL) != 0) {
+            printf("Error: cannot start worker %d\n", i);
+            exit(1);
+        }
+    }
+    for (i = 0; i < threads; i++) {
+        pthread_join(workers[i], NULL);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double seconds = (end.tv_sec - start.tv_sec) +
+                        (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    qsort(results, totalJobs, sizeof(SweepResult), compareResults);
+
+    printf("%ld step responses on %d threads in %.2f s (%.0f/s)\n",
+            totalJobs, threads, seconds, totalJobs / seconds);
+    printf("%6s %6s %6s %6s %14s %8s %6s\n",
+            "rank", "P", "I", "D", "cost", "over%", "settle");
+    long r;
+    for (r = 0; (r < totalJobs) && (r < rows); r++) {
+        printResult(stdout, r + 1, &results[r]);
+    }
+
+    if (outFile != NULL) {
+        FILE *f = fopen(outFile, "w");
+        if (f == NULL) {
+            printf("Error: cannot open %s\n", outFile);
+            exit(1);
+        }
+        fprintf(f, "# pos_vel=%d target=%d cost=%d weight=%g ms=%d\n",
+                posOrVel, target, costType, overshootWeight, durationMs);
+        for (r = 0; r < totalJobs; r++) {
+            printResult(f, r + 1, &results[r]);
+        }
+        fclose(f);
+    }
+
+    free(workers);
+    free(results);
+    return 0;
+}
@@ -0,0 +1,312 @@
+//
+// Copyright (C) 2013-2016 - Exadler Technologies Inc., Sarah Tan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "DMCC.h"
+#include "DMCCprobe.h"
+#include "DMCCsim.h"
+
+// This program lists the DMCC capes on a bus with their board and software
+// versions.  Use -f to probe the bus again instead of using the cache, and
+// -a to list the capes on all buses.  -t checks DMCCenumerate against
+// simulated capes in a fake /dev and /sys tree (run by make bench).
+
+#define MAX_FOUND 64
+
+// ------------------------
+// Test mode (-t)
+// ------------------------
+#define TEST_BUSES 6            // buses 0-5, i2c-0, i2c-2 and i2c-5 exist
+
+// TestCape - what the fake tree has at one bus and address
+typedef struct TestCape {
+    int bus;
+    int capeAddr;
+    int firmware;               // simulated firmware, 0 if no cape answers
+    int busy;                   // 1 if the address cannot be opened (EBUSY)
+    int boardVersion;           // version in the EEPROM, -1 for no EEPROM
+    const char *id;             // ID at 0xe0, NULL for the firmware's own
+} TestCape;
+
+static const TestCape Test_Capes[] = {
+    {0, 1, 7, 0, 15, NULL},
+    {2, 0, 6, 0, -1, NULL},
+    {2, 1, 7, 1, 15, NULL},     // owned by a kernel driver, skipped
+    {2, 3, 5, 0, 12, NULL},
+    {5, 2, 7, 0, 15, "DMCC Mk.7b"}, // variant firmware, no known version
+};
+#define TEST_CAPES (int)(sizeof(Test_Capes) / sizeof(Test_Capes[0]))
+
+static DMCCsim Test_Sim[TEST_BUSES][DMCC_MAX_CAPES];
+static int Test_Opens;
+
+// testOpener - opens the simulated cape at a bus and address
+//              (DMCCbusOpener)
+static int testOpener(int bus, unsigned char capeAddr)
+{
+    int i;
+
+    Test_Opens++;
+    for (i = 0; i < TEST_CAPES; i++) {
+        const TestCape *c = &Test_Capes[i];
+        if ((c->bus != bus) || (c->capeAddr != capeAddr)) {
+            continue;
+        }
+        if (c->busy) {
+            return -1;
+        }
+        DMCCsim *sim = &Test_Sim[bus][capeAddr];
+        DMCCsimInit(sim);
+        DMCCsimSetFirmware(sim, c->firmware);
+        if (c->id != NULL) {
+            memset(&sim->reg[0xe0], 0, DMCC_ID_LEN);
+            memcpy(&sim->reg[0xe0], c->id, strlen(c->id));
+        }
+        return DMCCsimStart(sim);
+    }
+    // Nothing answers there: a session whose ID reads as zeros
+    static DMCCsim empty;
+    DMCCsimInit(&empty);
+    memset(&empty.reg[0xe0], 0, DMCC_ID_LEN);
+    return DMCCsimStart(&empty);
+}
+
+// testFile - creates a file of the fake tree (and the directories to it)
+// Returns: -1 - if it cannot be created
+static int testFile(const char *root, const char *name,
+                    const unsigned char *data, int len)
+{
+    char path[256];
+    char *slash;
+
+    snprintf(path, sizeof(path), "%s/%s", root, name);
+    for (slash = strchr(path + strlen(root) + 1, '/'); slash != NULL;
+            slash = strchr(slash + 1, '/')) {
+        *slash = '\0';
+        mkdir(path, 0755);
+        *slash = '/';
+    }
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return -1;
+    }
+    int ok = (write(fd, data, len) == len);
+    close(fd);
+    return ok ? 0 : -1;
+}
+
+// testRemove - removes the fake tree
+static void testRemove(const char *root)
+{
+    char cmd[300];
+
+    snprintf(cmd, sizeof(cmd), "rm -rf '%s'", root);
+    if (system(cmd) != 0) {
+        printf("Warning: cannot remove %s\n", root);
+    }
+}
+
+// testCompare - checks the capes enumerated against the fake tree
+// Returns: number of differences
+static int testCompare(const char *pass, const DMCCcapeInfo *info, int found)
+{
+    char id[DMCC_ID_LEN + 1];
+    int errors = 0;
+    int n = 0;
+    int i;
+
+    for (i = 0; i < TEST_CAPES; i++) {
+        const TestCape *c = &Test_Capes[i];
+        if (c->busy || (c->firmware == 0)) {
+            continue;
+        }
+        if (c->id != NULL) {
+            snprintf(id, sizeof(id), "%s", c->id);
+        } else {
+            snprintf(id, sizeof(id), "DMCC Mk.%02d", c->firmware);
+        }
+        int software = DMCCidVersion(id);
+        if ((n >= found) || (info[n].bus != c->bus) ||
+                (info[n].capeAddr != c->capeAddr) ||
+                (strcmp(info[n].id, id) != 0) ||
+                (info[n].softwareVersion != software) ||
+                (info[n].boardVersion != c->boardVersion)) {
+            printf("%s: expected bus %d board %d (%s, software %d, "
+                    "board %d)\n", pass, c->bus, c->capeAddr, id, software,
+                    c->boardVersion);
+            errors++;
+        }
+        n++;
+    }
+    for (i = 0; i < found; i++) {
+        printf("%s: bus %d board %d: %s, board version %d, "
+                "software version %d\n", pass, info[i].bus, info[i].capeAddr,
+                info[i].id, info[i].boardVersion, info[i].softwareVersion);
+    }
+    if (found != n) {
+        printf("%s: %d cape(s) found, expected %d\n", pass, found, n);
+        errors++;
+    }
+    return errors;
+}
+
+// runTest - enumerates the capes of a fake tree, then again from the cache
+// Returns: 0 if both lists are right
+static int runTest(void)
+{
+    DMCCcapeInfo info[MAX_FOUND];
+    char root[] = "/tmp/probeCapes.XXXXXX";
+    char name[128];
+    unsigned char eeprom[64];
+    int errors = 0;
+    int i;
+
+    if (mkdtemp(root) == NULL) {
+        printf("Error: cannot create a fake tree in /tmp\n");
+        return 1;
+    }
+
+    // /dev/i2c-0, i2c-2 and i2c-5, and names that are not buses
+    const char *devices[] = {"i2c-0", "i2c-2", "i2c-5", "i2c-x", "i2c-1a"};
+    for (i = 0; i < 5; i++) {
+        snprintf(name, sizeof(name), "dev/%s", devices[i]);
+        errors += (testFile(root, name, NULL, 0) != 0);
+    }
+    for (i = 0; i < TEST_CAPES; i++) {
+        const TestCape *c = &Test_Capes[i];
+        if (c->boardVersion < 0) {
+            continue;
+        }
+        memset(eeprom, 0xff, sizeof(eeprom));
+        eeprom[40] = '0' + (c->boardVersion / 10);
+        eeprom[41] = '0' + (c->boardVersion % 10);
+        snprintf(name, sizeof(name), "sys/bus/i2c/devices/%d-%04x/eeprom",
+                    c->bus, 0x54 + c->capeAddr);
+        errors += (testFile(root, name, eeprom, sizeof(eeprom)) != 0);
+    }
+    if (errors > 0) {
+        printf("Error: cannot create the fake tree in %s\n", root);
+        testRemove(root);
+        return 1;
+    }
+
+    snprintf(name, sizeof(name), "%s/probe.cache", root);
+    setenv(DMCC_ROOT_ENV, root, 1);
+    setenv(DMCC_PROBE_CACHE_ENV, name, 1);
+    DMCCsetBusOpener(testOpener);
+
+    int found = DMCCenumerate(info, MAX_FOUND, 0);
+    errors += testCompare("probe", info, found);
+
+    // Same list from the cache, without opening any cape
+    Test_Opens = 0;
+    found = DMCCenumerate(info, MAX_FOUND, 1);
+    errors += testCompare("cache", info, found);
+    if (Test_Opens != 0) {
+        printf("cache: %d cape(s) opened, expected none\n", Test_Opens);
+        errors++;
+    }
+
+    DMCCsetBusOpener(NULL);
+    testRemove(root);
+    if (errors > 0) {
+        printf("FAILED: %d difference(s)\n", errors);
+        return 1;
+    }
+    printf("OK: DMCCenumerate found the capes of the fake tree\n");
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    DMCCcapeInfo info[MAX_FOUND];
+    struct timespec t0, t1;
+    int bus = 1;
+    int useCache = 1;
+    int all = 0;
+    int found;
+    int i;
+
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-f") == 0) {
+            useCache = 0;
+        } else if (strcmp(argv[i], "-a") == 0) {
+            all = 1;
+        } else if (strcmp(argv[i], "-t") == 0) {
+            return runTest();
+        } else if ((argv[i][0] >= '0') && (argv[i][0] <= '9')) {
+            bus = atoi(argv[i]);
+        } else {
+            printf("usage: ./probeCapes [bus number] [-f] [-a] [-t]\n");
+            printf("       [bus number] is the i2c bus (default: 1)\n");
+            printf("       -f probes the bus even if the capes are cached\n");
+            printf("       -a lists the capes on all buses\n");
+            printf("       -t checks the probing on simulated capes\n");
+            printf("example: ./probeCapes 1\n");
+            exit(1);
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    if (all) {
+        found = DMCCenumerate(info, MAX_FOUND, useCache);
+    } else {
+        found = DMCCprobeCapes(bus, info, useCache);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    if (found < 0) {
+        exit(1);
+    }
+
+    if (all) {
+        for (i = 0; i < found; i++) {
+            printf("Bus %d board %d: %s, board version %d, "
+                    "software version %d\n", info[i].bus, info[i].capeAddr,
+                    info[i].id, info[i].boardVersion, info[i].softwareVersion);
+        }
+        printf("%d cape(s) found on all buses in %.3f ms\n", found,
+                (t1.tv_sec - t0.tv_sec) * 1000.0 +
+                    (t1.tv_nsec - t0.tv_nsec) / 1000000.0);
+        return 0;
+    }
+
+    for (i = 0; i < DMCC_MAX_CAPES; i++) {
+        if (info[i].present) {
+            printf("Board %d: %s, board version %d, software version %d\n",
+                    i, info[i].id, info[i].boardVersion,
+                    info[i].softwareVersion);
+        } else {
+            printf("Board %d: none\n", i);
+        }
+    }
+    printf("%d cape(s) found on bus %d in %.3f ms\n", found, bus,
+            (t1.tv_sec - t0.tv_sec) * 1000.0 +
+                (t1.tv_nsec - t0.tv_nsec) / 1000000.0);
+    return 0;
+}
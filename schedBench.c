@@ -0,0 +1,253 @@
+//
+// Copyright (C) 2013-2016 - Exadler Technologies Inc., Sarah Tan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "DMCC.h"
+#include "DMCCsim.h"
+#include "DMCCsched.h"
+
+// This program measures how long motor commands wait for the bus while
+// other threads read telemetry from the same cape.  A control thread sends
+// a velocity setpoint every -p microseconds, a status thread polls getQEI
+// and -l logger threads poll getQEI and getMotorCurrent back to back.
+// Every transfer of the simulated cape takes -t microseconds of real time.
+//
+// It runs three times: the control thread alone, everything with all
+// threads in one class (first come first served, like a plain lock) and
+// everything with priority classes.  The wait of each role is printed.
+
+#define MAX_LOGGERS 8
+#define MAX_SAMPLES 200000
+
+#define ROLE_CONTROL 0
+#define ROLE_STATUS 1
+#define ROLE_LOGGER 2
+#define ROLES 3
+
+static const char *roleNames[ROLES] = {"setpoint", "status", "bulk"};
+static const int roleClass[ROLES] = {DMCC_CLASS_SETPOINT, DMCC_CLASS_STATUS,
+                                        DMCC_CLASS_BULK};
+
+// Worker - one thread of the benchmark
+typedef struct Worker {
+    pthread_t thread;
+    int role;
+    int cls;                    // class it asks for
+    unsigned long long *waitNs; // wait of every operation
+    int samples;
+} Worker;
+
+static DMCCsched sched;
+static int session;
+static unsigned int period = 2000;
+static volatile int running;
+
+// nowNs - monotonic time in nanoseconds
+static unsigned long long nowNs(void)
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (unsigned long long)t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+// workerMain - runs the operations of one role until stopped
+static void *workerMain(void *arg)
+{
+    Worker *w = (Worker *)arg;
+    struct timespec t;
+    int sign = 1;
+
+    while (running) {
+        unsigned long long start = nowNs();
+        DMCCschedAcquire(&sched, w->cls);
+        unsigned long long wait = nowNs() - start;
+        if (w->role == ROLE_CONTROL) {
+            setTargetVel(session, 1, 20 * sign);
+            sign = -sign;
+        } else if (w->role == ROLE_STATUS) {
+            getQEI(session, 1);
+        } else {
+            getQEI(session, 2);
+            getMotorCurrent(session, 1);
+        }
+        DMCCschedRelease(&sched);
+        if (w->samples < MAX_SAMPLES) {
+            w->waitNs[w->samples++] = wait;
+        }
+
+        if (w->role == ROLE_CONTROL) {
+            t.tv_sec = 0;
+            t.tv_nsec = period * 1000L;
+            nanosleep(&t, NULL);
+        }
+    }
+    return NULL;
+}
+
+static int compareNs(const void *a, const void *b)
+{
+    unsigned long long x = *(const unsigned long long *)a;
+    unsigned long long y = *(const unsigned long long *)b;
+    return (x > y) - (x < y);
+}
+
+// printRole - prints the waits of all workers of a role
+static void printRole(const char *mode, int role, Worker *workers, int count)
+{
+    unsigned long long *all = (unsigned long long *)malloc(
+                                sizeof(unsigned long long) * MAX_SAMPLES * count);
+    int n = 0;
+    int i;
+
+    for (i = 0; i < count; i++) {
+        if (workers[i].role == role) {
+            memcpy(&all[n], workers[i].waitNs,
+                    sizeof(unsigned long long) * workers[i].samples);
+            n += workers[i].samples;
+        }
+    }
+    if (n > 0) {
+        qsort(all, n, sizeof(unsigned long long), compareNs);
+        printf("%-9s %-9s %8d %9.1f %9.1f %9.1f\n", mode, roleNames[role], n,
+                all[n / 2] / 1000.0, all[(int)(n * 0.99)] / 1000.0,
+                all[n - 1] / 1000.0);
+    }
+    free(all);
+}
+
+// runMode - runs the threads for a while and prints their waits
+static void runMode(const char *mode, int loggers, int priority,
+                    unsigned int seconds)
+{
+    Worker workers[MAX_LOGGERS + 2];
+    int count = 0;
+    int i;
+
+    workers[count++].role = ROLE_CONTROL;
+    if (loggers > 0) {
+        workers[count++].role = ROLE_STATUS;
+        for (i = 0; i < loggers; i++) {
+            workers[count++].role = ROLE_LOGGER;
+        }
+    }
+
+    running = 1;
+    for (i = 0; i < count; i++) {
+        workers[i].cls = priority ? roleClass[workers[i].role] :
+                                    DMCC_CLASS_BULK;
+        workers[i].samples = 0;
+        workers[i].waitNs = (unsigned long long *)malloc(
+                                sizeof(unsigned long long) * MAX_SAMPLES);
+        if ((workers[i].waitNs == NULL) || (pthread_create(&workers[i].thread,
+                    NULL, workerMain, &workers[i]) != 0)) {
+            printf("Error: cannot start a thread\n");
+            exit(1);
+        }
+    }
+    sleep(seconds);
+    running = 0;
+    for (i = 0; i < count; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+
+    for (i = 0; i < ROLES; i++) {
+        printRole(mode, i, workers, count);
+    }
+    for (i = 0; i < count; i++) {
+        free(workers[i].waitNs);
+    }
+}
+
+static void usage(void)
+{
+    printf("usage: ./schedBench [-l loggers] [-p period] [-t latency] ");
+    printf("[-d seconds]\n");
+    printf("       -l logger threads polling telemetry (default: 2)\n");
+    printf("       -p microseconds between setpoints (default: 2000)\n");
+    printf("       -t real microseconds every simulated transfer takes ");
+    printf("(default: 100)\n");
+    printf("       -d seconds each run takes (default: 2)\n");
+    printf("example: ./schedBench -l 4 -t 200\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    DMCCsim sim;
+    DMCCschedStats stats;
+    int loggers = 2;
+    int latency = 100;
+    int seconds = 2;
+    int opt, c;
+
+    while ((opt = getopt(argc, argv, "l:p:t:d:")) != -1) {
+        switch (opt) {
+        case 'l': loggers = atoi(optarg); break;
+        case 'p': period = atoi(optarg); break;
+        case 't': latency = atoi(optarg); break;
+        case 'd': seconds = atoi(optarg); break;
+        default: usage();
+        }
+    }
+    if ((loggers < 0) || (loggers > MAX_LOGGERS) || (period < 1) ||
+            (period >= 1000000) || (latency < 0) || (seconds < 1)) {
+        usage();
+    }
+
+    DMCCsimInit(&sim);
+    sim.latencyUs = latency;
+    session = DMCCsimStart(&sim);
+    if (session < 0) {
+        exit(1);
+    }
+    DMCCschedInit(&sched);
+
+    printf("wait for the bus in microseconds (%d us per transfer)\n",
+            latency);
+    printf("%-9s %-9s %8s %9s %9s %9s\n", "mode", "class", "count", "p50",
+            "p99", "max");
+    runMode("alone", 0, 1, seconds);
+    runMode("fifo", loggers, 0, seconds);
+    DMCCschedResetStats(&sched);
+    runMode("priority", loggers, 1, seconds);
+
+    printf("\nscheduler (priority run):\n");
+    for (c = DMCC_CLASS_SETPOINT; c < DMCC_CLASSES; c++) {
+        DMCCschedGetStats(&sched, c, &stats);
+        printf("    %-9s %8llu grants, %6llu aged, mean wait %.1f us, "
+                "max %.1f us\n", roleNames[c - 1], stats.grants, stats.aged,
+                stats.grants ? stats.totalWaitNs / 1000.0 / stats.grants : 0,
+                stats.maxWaitNs / 1000.0);
+    }
+
+    DMCCschedDestroy(&sched);
+    DMCCend(session);
+    return 0;
+}
@@ -44,11 +44,13 @@ int main(int argc, char *argv[])
     int pwm = atol(argv[3]);
    
     // Function setup (start session then end session)
+    // Show the library's errors (on stderr)
+    DMCCsetLogLevel(DMCC_LOG_ERROR);
     int session = DMCCstart(boardNum);    
  
-    setMotorPower(session, nMotor, pwm);
+    int result = setMotorPower(session, nMotor, pwm);
 
     DMCCend(session);
-    return 0;
+    return (result == DMCC_OK) ? 0 : 1;
 }
 
@@ -49,10 +49,9 @@ int session;
 
 void sig_handler(int sig)
 {
-    setMotorPower(session, 1, 0);
-    setMotorPower(session, 2, 0);
-    DMCCend(session);
-    exit(1);
+    // Only async-signal-safe calls here
+    DMCCemergencyStopAll();
+    _exit(1);
 }
 
 int main(int argc, char *argv[])
@@ -84,6 +83,9 @@ int main(int argc, char *argv[])
     // Catch Ctrl-C to kill all motors
     signal(SIGINT, sig_handler);
 
+    // Show the library's errors (on stderr)
+    DMCCsetLogLevel(DMCC_LOG_ERROR);
+
     // Begin the session (open a connection to the board)
     session = DMCCstart(boardNum); 
 
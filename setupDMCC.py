@@ -1,12 +1,18 @@
 #
 # SetupDMCC.py - setup the DMCC library
 #
+# Links the module with libdmcc.a (run make libdmcc.a first), built with
+# the same optimization and link-time optimization as the C programs
+#
 
 from distutils.core import setup, Extension
 
 setup(
     ext_modules = [
-        Extension("DMCC", sources=["DMCC-py.c","DMCC.c"]),
+        Extension("DMCC", sources=["DMCC-py.c"],
+                  extra_objects=["libdmcc.a"],
+                  libraries=["m", "pthread"],
+                  extra_compile_args=["-O2", "-flto"],
+                  extra_link_args=["-O2", "-flto"]),
         ],
     )
-
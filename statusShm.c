@@ -0,0 +1,179 @@
+//
+// Copyright (C) 2013-2016 - Exadler Technologies Inc., Sarah Tan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+
+#include "DMCC.h"
+#include "DMCCsim.h"
+#include "DMCCshm.h"
+
+// This program is the status publisher: it owns the capes, samples them at
+// a fixed rate and publishes every snapshot in shared memory (DMCCshm.h).
+// Run it once, then any number of "./statusShm read" (or programs using
+// DMCCshmSubscribe) can watch the capes without touching the bus.
+
+volatile sig_atomic_t running = 1;
+
+void sig_handler(int sig)
+{
+    running = 0;
+}
+
+static void usage(void)
+{
+    printf("usage: ./statusShm publish <name> <rate> <board number>...\n");
+    printf("       ./statusShm read <name> <board number>\n");
+    printf("       <name> is the shared memory name, for example /dmcc\n");
+    printf("       <rate> is snapshots per second for every cape\n");
+    printf("       <board number> is [0-3] for placement of cape ");
+    printf("(publish: sim0-sim3 for a simulated cape)\n");
+    printf("examples: ./statusShm publish /dmcc 200 0 1\n");
+    printf("          ./statusShm read /dmcc 1\n");
+}
+
+static int readStatus(char *name, unsigned int board)
+{
+    DMCCshm shm;
+    DMCCtelemetryRecord s;
+
+    if (DMCCshmSubscribe(&shm, name) != 0) {
+        return 1;
+    }
+
+    signal(SIGINT, sig_handler);
+    while (running) {
+        int result = DMCCshmRead(&shm, board, &s);
+        if (result == -1) {
+            printf("No status published for board %u\n", board);
+        } else if (result == -2) {
+            printf("Publisher stalled updating board %u\n", board);
+        } else {
+            printf("QEI Motor 1 = %d [v = %d], Motor 2 = %d [v = %d], ",
+                    s.qei[0], s.vel[0], s.qei[1], s.vel[1]);
+            printf("Current 1 = %u, Current 2 = %u, Voltage = %u\n",
+                    s.current[0], s.current[1], s.voltage);
+        }
+
+        // Wait 0.2 seconds before next reading
+        usleep(200000);
+    }
+
+    DMCCshmClose(&shm);
+    return 0;
+}
+
+static int publishStatus(char *name, int rate, int nBoards, char *boards[])
+{
+    DMCCsim sim[DMCC_SHM_CAPES];
+    int session[DMCC_SHM_CAPES];
+    unsigned int boardNum[DMCC_SHM_CAPES];
+    DMCCshm shm;
+    int i;
+
+    if ((nBoards < 1) || (nBoards > DMCC_SHM_CAPES)) {
+        printf("Error: between 1 and %d boards can be published\n",
+                DMCC_SHM_CAPES);
+        return 1;
+    }
+
+    for (i = 0; i < nBoards; i++) {
+        if (strncmp(boards[i], "sim", 3) == 0) {
+            boardNum[i] = atoi(boards[i] + 3);
+            DMCCsimInit(&sim[i]);
+            session[i] = DMCCsimStart(&sim[i]);
+            if (session[i] < 0) {
+                return 1;
+            }
+        } else {
+            boardNum[i] = atoi(boards[i]);
+            session[i] = DMCCstart(boardNum[i]);
+        }
+        if (boardNum[i] >= DMCC_SHM_CAPES) {
+            printf("Error: board number %u is invalid\n", boardNum[i]);
+            return 1;
+        }
+    }
+
+    if (DMCCshmPublish(&shm, name) != 0) {
+        return 1;
+    }
+
+    signal(SIGINT, sig_handler);
+    signal(SIGTERM, sig_handler);
+
+    unsigned long long period = 1000000ULL / rate;
+    unsigned long long deadline = DMCCclock(session[0]);
+    DMCCtelemetryRecord status;
+    DMCCcommandState commands;
+
+    while (running) {
+        // A failed sample is not published, readers keep the last one
+        // (its timeUs shows how old it is)
+        for (i = 0; i < nBoards; i++) {
+            if (DMCCtelemetrySample(session[i], &status) == DMCC_OK) {
+                DMCCshmWrite(&shm, boardNum[i], &status);
+            }
+            if (DMCCgetCommandState(session[i], &commands) == 0) {
+                DMCCshmSetCommands(&shm, boardNum[i], &commands);
+            }
+        }
+
+        deadline += period;
+        if (DMCCclock(session[0]) > deadline) {
+            // Sampling took longer than the period, do not try to catch up
+            deadline = DMCCclock(session[0]);
+        }
+        DMCCwaitUntil(session[0], deadline);
+    }
+
+    DMCCshmClose(&shm);
+    DMCCshmRemove(name);
+    for (i = 0; i < nBoards; i++) {
+        DMCCend(session[i]);
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    // Show the library's errors (on stderr)
+    DMCCsetLogLevel(DMCC_LOG_ERROR);
+
+    if ((argc == 4) && (strcmp(argv[1], "read") == 0)) {
+        return readStatus(argv[2], atoi(argv[3]));
+    }
+    if ((argc >= 5) && (strcmp(argv[1], "publish") == 0)) {
+        int rate = atoi(argv[3]);
+        if ((rate < 1) || (rate > 1000000)) {
+            printf("Error: rate must be between 1 and 1000000\n");
+            exit(1);
+        }
+        return publishStatus(argv[2], rate, argc - 4, &argv[4]);
+    }
+
+    usage();
+    exit(1);
+}
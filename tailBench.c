@@ -0,0 +1,289 @@
+//
+// Copyright (C) 2013-2016 - Exadler Technologies Inc., Sarah Tan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "DMCC.h"
+#include "DMCCsim.h"
+
+// This program measures the tail latency of getQEI, moveUntilPos and a
+// control loop tick (getQEI of both motors, then setAllTargetVel) on a
+// simulated cape, once for each fault profile: a set of DMCCsimFault rules
+// that slow down or fail the transfers of some registers.  Latencies are
+// simulated microseconds, retries included, so runs are repeatable.  It
+// fails if a getQEI that returned DMCC_OK read the wrong value.
+//
+// A profile file holds one rule per line (see DMCCsimParseFault), e.g.
+//     # slow encoder reads that are sometimes cut short
+//     read 0x10-0x1f latency=300 jitter=300 short=10
+
+#define CONTROL_PERIOD_US 5000
+#define MOVE_TARGET 2000
+#define MOVE_LIMIT_SEC 10
+#define MAX_RULES 4
+
+// Profile - named set of fault rules
+typedef struct Profile {
+    const char *name;
+    const char *rules[MAX_RULES];
+} Profile;
+
+static const Profile Profiles[] = {
+    {"clean", {NULL}},
+    {"jitter", {"any 0x00-0xff latency=50 jitter=100 tail=5:5000", NULL}},
+    {"nak", {"any 0x00-0xff nak=20", "read 0x10-0x1f short=10", NULL}},
+    {"stretch", {"any 0x00-0xff stretch=50:2000",
+                 "read 0x10-0x1f stretch=2:20000", NULL}},
+    {"busy", {"write 0xff busy=20:3000", NULL}},
+    {"qei", {"read 0x10-0x1f latency=300 jitter=300 nak=10", NULL}},
+};
+
+static int numSamples = 10000;
+static int numMoves = 200;
+static unsigned int seed = 1;
+
+static int compareUs(const void *a, const void *b)
+{
+    unsigned long long x = *(const unsigned long long *)a;
+    unsigned long long y = *(const unsigned long long *)b;
+    return (x > y) - (x < y);
+}
+
+// regValue - little endian register value of the simulated cape
+static unsigned int regValue(const DMCCsim *sim, unsigned char addr, int size)
+{
+    unsigned int value = 0;
+    int i;
+
+    for (i = size - 1; i >= 0; i--) {
+        value = (value << 8) | sim->reg[addr + i];
+    }
+    return value;
+}
+
+// percentile - latency below which the given fraction of samples fall
+static unsigned long long percentile(const unsigned long long *us, int n,
+                                        double fraction)
+{
+    int i = (int)(n * fraction);
+    return us[(i < n) ? i : (n - 1)];
+}
+
+// report - prints one row of the table
+static void report(const char *profile, const char *op, unsigned long long *us,
+                    int n, int failed, const char *extra)
+{
+    qsort(us, n, sizeof(unsigned long long), compareUs);
+    printf("%-9s %-8s %6d %6d %8llu %8llu %8llu %8llu%s\n", profile, op, n,
+            failed, percentile(us, n, 0.5), percentile(us, n, 0.99),
+            percentile(us, n, 0.999), us[n - 1], extra);
+}
+
+// start - opens a session on a cape with the fault rules of a profile
+// Returns: session, or -1 if a rule is bad
+static int start(DMCCsim *sim, const Profile *profile, const char *path)
+{
+    int i;
+
+    DMCCsimInit(sim);
+    sim->seed = seed;
+    for (i = 0; (i < MAX_RULES) && (profile->rules[i] != NULL); i++) {
+        if (DMCCsimParseFault(sim, profile->rules[i]) != 0) {
+            return -1;
+        }
+    }
+    if ((path != NULL) && (DMCCsimLoadFaults(sim, path) != 0)) {
+        return -1;
+    }
+    int fd = DMCCsimStart(sim);
+    if (fd >= 0) {
+        setDefaultPIDConstants(fd);
+    }
+    return fd;
+}
+
+// run - measures the three operations under one profile
+// Returns: -1 - if a getQEI read the wrong value or the profile is bad
+static int run(const Profile *profile, const char *path)
+{
+    static DMCCsim sim;
+    int max = (numSamples > numMoves) ? numSamples : numMoves;
+    unsigned long long *us = (unsigned long long *)malloc(
+                                sizeof(unsigned long long) * max);
+    int failed[3] = {0, 0, 0};
+    int misses = 0;
+    int wrong = 0;
+    int fd, i;
+
+    if (us == NULL) {
+        exit(1);
+    }
+
+    // The library prints every transaction it gives up on, and the moves
+    // print their progress
+    fflush(stdout);
+    int out = dup(STDOUT_FILENO);
+    if (freopen("/dev/null", "w", stdout) == NULL) {
+        exit(1);
+    }
+    // Only the first line of the table names the profile
+    const char *name = profile->name;
+
+    // getQEI, once per control period
+    fd = start(&sim, profile, path);
+    for (i = 0; (fd >= 0) && (i < numSamples); i++) {
+        unsigned long long begin = sim.timeUs;
+        unsigned int qei = getQEI(fd, 1);
+        if (DMCCgetError(fd) != DMCC_OK) {
+            failed[0]++;
+        } else if (qei != regValue(&sim, 0x10, 4)) {
+            wrong++;
+        }
+        us[i] = sim.timeUs - begin;
+        DMCCsimAdvance(&sim, CONTROL_PERIOD_US);
+    }
+    if (fd >= 0) {
+        DMCCend(fd);
+        fflush(stdout);
+        dup2(out, STDOUT_FILENO);
+        report(name, "getQEI", us, numSamples, failed[0], "");
+        fflush(stdout);
+        freopen("/dev/null", "w", stdout);
+        name = "";
+    }
+
+    // moveUntilPos, back and forth
+    fd = (fd >= 0) ? start(&sim, profile, path) : -1;
+    for (i = 0; (fd >= 0) && (i < numMoves); i++) {
+        unsigned long long begin = sim.timeUs;
+        if (moveUntilPos(fd, 1, ((i % 2) == 0) ? MOVE_TARGET : 0,
+                            MOVE_LIMIT_SEC) != 0) {
+            failed[1]++;
+        }
+        us[i] = sim.timeUs - begin;
+    }
+    if (fd >= 0) {
+        DMCCend(fd);
+        fflush(stdout);
+        dup2(out, STDOUT_FILENO);
+        report(name, "move", us, numMoves, failed[1], "");
+        fflush(stdout);
+        freopen("/dev/null", "w", stdout);
+    }
+
+    // Control loop ticks; a tick that takes longer than the period misses
+    // its deadline and the next one starts late
+    fd = (fd >= 0) ? start(&sim, profile, path) : -1;
+    for (i = 0; (fd >= 0) && (i < numSamples); i++) {
+        unsigned long long begin = sim.timeUs;
+        int vel = (i % 2000) - 1000;
+        getQEI(fd, 1);
+        getQEI(fd, 2);
+        if ((DMCCgetError(fd) != DMCC_OK) |
+                (setAllTargetVel(fd, vel, -vel) != DMCC_OK)) {
+            failed[2]++;
+        }
+        us[i] = sim.timeUs - begin;
+        if (us[i] > CONTROL_PERIOD_US) {
+            misses++;
+        } else {
+            DMCCsimAdvance(&sim, CONTROL_PERIOD_US - us[i]);
+        }
+    }
+
+    fflush(stdout);
+    dup2(out, STDOUT_FILENO);
+    close(out);
+    clearerr(stdout);
+
+    if (fd < 0) {
+        printf("Error: cannot run profile %s\n", profile->name);
+        free(us);
+        return -1;
+    }
+    DMCCend(fd);
+
+    char extra[64];
+    snprintf(extra, sizeof(extra), "  %d late%s", misses,
+                wrong ? "  FAILED" : "");
+    report(name, "tick", us, numSamples, failed[2], extra);
+    free(us);
+    return wrong ? -1 : 0;
+}
+
+static void usage(void)
+{
+    printf("usage: ./tailBench [-n samples] [-m moves] [-s seed] ");
+    printf("[-p profile]\n");
+    printf("       -n getQEI calls and control loop ticks (default: 10000)\n");
+    printf("       -m moves of %d counts (default: 200)\n", MOVE_TARGET);
+    printf("       -s seed of the faults (default: 1)\n");
+    printf("       -p file of fault rules to run instead of the built-in ");
+    printf("profiles\n");
+    printf("example: ./tailBench -p slowqei.txt\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *path = NULL;
+    int opt, i, result = 0;
+
+    while ((opt = getopt(argc, argv, "n:m:s:p:")) != -1) {
+        switch (opt) {
+        case 'n': numSamples = atoi(optarg); break;
+        case 'm': numMoves = atoi(optarg); break;
+        case 's': seed = atoi(optarg); break;
+        case 'p': path = optarg; break;
+        default: usage();
+        }
+    }
+    if ((numSamples < 1) || (numMoves < 1)) {
+        usage();
+    }
+
+    // Check the file while errors can still be seen
+    static DMCCsim check;
+    DMCCsimInit(&check);
+    if ((path != NULL) && (DMCCsimLoadFaults(&check, path) != 0)) {
+        return 1;
+    }
+
+    printf("%-9s %-8s %6s %6s %8s %8s %8s %8s\n", "profile", "op", "n",
+            "failed", "p50 us", "p99 us", "p999 us", "max us");
+    if (path != NULL) {
+        // Compare the file against a clean bus
+        Profile file = {path, {NULL}};
+        result |= run(&Profiles[0], NULL);
+        result |= run(&file, path);
+    } else {
+        for (i = 0; i < (int)(sizeof(Profiles) / sizeof(Profile)); i++) {
+            result |= run(&Profiles[i], NULL);
+        }
+    }
+    return (result != 0) ? 1 : 0;
+}
@@ -0,0 +1,161 @@
+//
+// Copyright (C) 2013-2016 - Exadler Technologies Inc., Sarah Tan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+
+#include "DMCC.h"
+#include "DMCCsim.h"
+#include "DMCCtelemetry.h"
+
+// This program records binary telemetry from a cape into a ring file
+// (DMCCtelemetry.h) at a fixed rate, and exports a ring file as CSV.
+// Recording stops after <seconds>, or on Ctrl-C.  With the rate "auto" it
+// samples at AUTO_FAST_RATE while a motor is active and AUTO_SLOW_RATE
+// while every motor is idle (DMCCadaptive).  Only the motors decide the
+// rate: commands other programs send are seen at the next sample that
+// finds a motor active, so going fast can take up to 1/AUTO_SLOW_RATE s.
+
+#define AUTO_FAST_RATE 1000
+#define AUTO_SLOW_RATE 10
+
+volatile sig_atomic_t running = 1;
+
+void sig_handler(int sig)
+{
+    running = 0;
+}
+
+static void usage(void)
+{
+    printf("usage: ./telemetry record <board number> <file> <rate> ");
+    printf("<seconds> [records]\n");
+    printf("       ./telemetry csv <file>\n");
+    printf("       <board number> is [0-3] for placement of cape, or sim\n");
+    printf("       <rate> is samples per second, or auto (%d/s while a ",
+            AUTO_FAST_RATE);
+    printf("motor is active, %d/s when idle)\n", AUTO_SLOW_RATE);
+    printf("       (auto sees commands from other programs only at the ");
+    printf("next sample, up to 1/%d s late)\n", AUTO_SLOW_RATE);
+    printf("       <seconds> is how long to record (0 until Ctrl-C)\n");
+    printf("       [records] is the size of the ring (default: 10 ");
+    printf("seconds)\n");
+    printf("examples: ./telemetry record 0 run.tlm 1000 60\n");
+    printf("          ./telemetry csv run.tlm > run.csv\n");
+}
+
+int main(int argc, char *argv[])
+{
+    // Show the library's errors (on stderr)
+    DMCCsetLogLevel(DMCC_LOG_ERROR);
+
+    if ((argc == 3) && (strcmp(argv[1], "csv") == 0)) {
+        return (DMCCtelemetryExportCSV(argv[2], stdout) < 0) ? 1 : 0;
+    }
+
+    if (((argc != 6) && (argc != 7)) || (strcmp(argv[1], "record") != 0)) {
+        usage();
+        exit(1);
+    }
+
+    int adaptive = (strcmp(argv[4], "auto") == 0);
+    int rate = adaptive ? AUTO_FAST_RATE : atoi(argv[4]);
+    unsigned int seconds = atoi(argv[5]);
+    if ((rate < 1) || (rate > 1000000)) {
+        printf("Error: rate must be between 1 and 1000000\n");
+        exit(1);
+    }
+    unsigned int capacity = rate * 10;
+    if (argc == 7) {
+        capacity = atoi(argv[6]);
+    }
+
+    DMCCsim sim;
+    int session;
+    if (strcmp(argv[2], "sim") == 0) {
+        DMCCsimInit(&sim);
+        session = DMCCsimStart(&sim);
+        if (session < 0) {
+            exit(1);
+        }
+    } else {
+        session = DMCCstart(atol(argv[2]));
+    }
+
+    DMCCtelemetry log;
+    if (DMCCtelemetryOpen(&log, argv[3], capacity) != 0) {
+        DMCCend(session);
+        exit(1);
+    }
+
+    signal(SIGINT, sig_handler);
+
+    unsigned long long period = 1000000ULL / rate;
+    unsigned long long start = DMCCclock(session);
+    unsigned long long deadline = start;
+    unsigned long long end = start + (seconds * 1000000ULL);
+    unsigned long long count = 0;
+    unsigned long long late = 0;
+    unsigned long long failed = 0;
+    DMCCtelemetryRecord record;
+    DMCCadaptive sampling;
+    DMCCadaptiveInit(&sampling, period, 1000000 / AUTO_SLOW_RATE);
+
+    while (running && ((seconds == 0) || (deadline < end))) {
+        if (adaptive && !DMCCadaptiveDue(&sampling, session)) {
+            // Checked every fast period, so a new command is seen at once
+            deadline += period;
+            DMCCwaitUntil(session, deadline);
+            continue;
+        }
+        // A sample the bus failed is not kept (adaptive sampling tries
+        // again after the next fast period)
+        if (DMCCtelemetrySample(session, &record) != DMCC_OK) {
+            failed++;
+        } else {
+            DMCCtelemetryWrite(&log, &record);
+            count++;
+            if (adaptive) {
+                DMCCadaptiveUpdate(&sampling, session, &record);
+            }
+        }
+
+        deadline += period;
+        if (DMCCclock(session) > deadline) {
+            // Sample took longer than the period, do not try to catch up
+            late++;
+            deadline = DMCCclock(session);
+        }
+        DMCCwaitUntil(session, deadline);
+    }
+
+    double elapsed = (DMCCclock(session) - start) / 1000000.0;
+    printf("%llu records in %.2f s (%.0f/s), %llu late, %llu failed\n",
+            count, elapsed, count / elapsed, late, failed);
+
+    DMCCtelemetryClose(&log);
+    DMCCend(session);
+    return 0;
+}